@@ -0,0 +1,474 @@
+/// Throughput and latency benchmark of core ejdb2 operations.
+///
+/// Generates a reproducible synthetic collection (fixed PRNG seed)
+/// and runs a set of workloads over it. Results are written as JSON
+/// so runs of different builds can be diffed:
+///
+///   ejdb_bench [-n records] [-q queries] [-s seed] [-d dbfile] [-o results.json]
+///
+#include <ejdb2.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+
+#define BENCH_COLL "bench"
+#define BENCH_GROUPS 100
+#define BENCH_IN_VALUES 10
+#define BENCH_BATCH_SIZE 1000
+
+/** Benchmark run state */
+typedef struct BENCH {
+  EJDB db;
+  JBL  workloads;      /**< Results of workloads */
+  int64_t *ids;        /**< Ids of generated documents */
+  uint64_t *lat;       /**< Operation latencies of current workload in nanoseconds */
+  int64_t lat_num;
+  int64_t lat_asz;
+  uint64_t start;      /**< Start time of current workload */
+  uint64_t rnd;        /**< PRNG state */
+  int64_t records;     /**< Number of generated documents */
+  int64_t queries;     /**< Number of executed queries per query workload */
+  int64_t rows;        /**< Number of documents returned by current workload */
+} BENCH;
+
+static uint64_t _bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t _bench_rand(BENCH *b) {
+  // xorshift64*
+  b->rnd ^= b->rnd >> 12;
+  b->rnd ^= b->rnd << 25;
+  b->rnd ^= b->rnd >> 27;
+  return b->rnd * 2685821657736338717ULL;
+}
+
+static int _bench_lat_cmp(const void *a, const void *b) {
+  uint64_t v1 = *(const uint64_t *) a, v2 = *(const uint64_t *) b;
+  return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+static void _bench_begin(BENCH *b) {
+  b->lat_num = 0;
+  b->rows = 0;
+  b->start = _bench_now();
+}
+
+static iwrc _bench_op(BENCH *b, uint64_t t0) {
+  if (b->lat_num >= b->lat_asz) {
+    int64_t nsz = b->lat_asz ? b->lat_asz * 2 : 1024;
+    uint64_t *nlat = realloc(b->lat, nsz * sizeof(b->lat[0]));
+    if (!nlat) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    b->lat = nlat;
+    b->lat_asz = nsz;
+  }
+  b->lat[b->lat_num++] = _bench_now() - t0;
+  return 0;
+}
+
+static double _bench_percentile_us(BENCH *b, int pct) {
+  if (!b->lat_num) {
+    return 0;
+  }
+  int64_t rank = (b->lat_num * pct + 99) / 100; // Nearest rank
+  if (rank < 1) {
+    rank = 1;
+  }
+  return b->lat[rank - 1] / 1000.0;
+}
+
+static iwrc _bench_end(BENCH *b, const char *name) {
+  JBL jbl;
+  uint64_t elapsed = _bench_now() - b->start;
+  double seconds = elapsed / 1e9;
+  qsort(b->lat, b->lat_num, sizeof(b->lat[0]), _bench_lat_cmp);
+
+  iwrc rc = jbl_create_empty_object(&jbl);
+  RCRET(rc);
+  rc = jbl_set_int64(jbl, "ops", b->lat_num);
+  RCGO(rc, finish);
+  rc = jbl_set_int64(jbl, "rows", b->rows);
+  RCGO(rc, finish);
+  rc = jbl_set_f64(jbl, "seconds", seconds);
+  RCGO(rc, finish);
+  rc = jbl_set_f64(jbl, "ops_per_sec", seconds > 0 ? b->lat_num / seconds : 0);
+  RCGO(rc, finish);
+  rc = jbl_set_f64(jbl, "p50_us", _bench_percentile_us(b, 50));
+  RCGO(rc, finish);
+  rc = jbl_set_f64(jbl, "p90_us", _bench_percentile_us(b, 90));
+  RCGO(rc, finish);
+  rc = jbl_set_f64(jbl, "p99_us", _bench_percentile_us(b, 99));
+  RCGO(rc, finish);
+  rc = jbl_set_f64(jbl, "max_us", _bench_percentile_us(b, 100));
+  RCGO(rc, finish);
+  rc = jbl_set_nested(b->workloads, name, jbl);
+
+  fprintf(stderr, "%-24s ops: %-8" PRId64 " rows: %-10" PRId64 " ops/s: %-12.1f p50: %.1fus p99: %.1fus\n",
+          name, b->lat_num, b->rows, seconds > 0 ? b->lat_num / seconds : 0,
+          _bench_percentile_us(b, 50), _bench_percentile_us(b, 99));
+
+finish:
+  jbl_destroy(&jbl);
+  return rc;
+}
+
+static iwrc _bench_put_new(BENCH *b) {
+  iwrc rc = 0;
+  char name[32];
+  _bench_begin(b);
+  for (int64_t i = 0; i < b->records; ++i) {
+    JBL jbl;
+    snprintf(name, sizeof(name), "name%016" PRIx64, _bench_rand(b));
+    rc = jbl_create_empty_object(&jbl);
+    RCRET(rc);
+    rc = jbl_set_int64(jbl, "seq", i);
+    RCGO(rc, finish);
+    rc = jbl_set_string(jbl, "name", name);
+    RCGO(rc, finish);
+    rc = jbl_set_int64(jbl, "group", (int64_t) (_bench_rand(b) % BENCH_GROUPS));
+    RCGO(rc, finish);
+    rc = jbl_set_f64(jbl, "score", (_bench_rand(b) % 1000000) / 100.0);
+    RCGO(rc, finish);
+    rc = jbl_set_bool(jbl, "active", _bench_rand(b) & 1);
+    RCGO(rc, finish);
+    uint64_t t0 = _bench_now();
+    rc = ejdb_put_new(b->db, BENCH_COLL, jbl, &b->ids[i]);
+    if (!rc) {
+      rc = _bench_op(b, t0);
+    }
+finish:
+    jbl_destroy(&jbl);
+    RCRET(rc);
+  }
+  return _bench_end(b, "put_new");
+}
+
+/**
+ * Stores the same kind of documents as `_bench_put_new()` into separate collection
+ * by batches of `BENCH_BATCH_SIZE` documents. Every batch is a single operation.
+ */
+static iwrc _bench_put_new_batch(BENCH *b) {
+  iwrc rc = 0;
+  char name[32];
+  int64_t num = 0;
+  JBL *docs = calloc(BENCH_BATCH_SIZE, sizeof(docs[0]));
+  if (!docs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  _bench_begin(b);
+  for (int64_t i = 0; i < b->records; i += num) {
+    num = b->records - i < BENCH_BATCH_SIZE ? b->records - i : BENCH_BATCH_SIZE;
+    for (int64_t j = 0; j < num; ++j) {
+      JBL jbl;
+      snprintf(name, sizeof(name), "name%016" PRIx64, _bench_rand(b));
+      rc = jbl_create_empty_object(&jbl);
+      RCGO(rc, finish);
+      docs[j] = jbl;
+      rc = jbl_set_int64(jbl, "seq", i + j);
+      RCGO(rc, finish);
+      rc = jbl_set_string(jbl, "name", name);
+      RCGO(rc, finish);
+      rc = jbl_set_int64(jbl, "group", (int64_t) (_bench_rand(b) % BENCH_GROUPS));
+      RCGO(rc, finish);
+      rc = jbl_set_f64(jbl, "score", (_bench_rand(b) % 1000000) / 100.0);
+      RCGO(rc, finish);
+      rc = jbl_set_bool(jbl, "active", _bench_rand(b) & 1);
+      RCGO(rc, finish);
+    }
+    uint64_t t0 = _bench_now();
+    rc = ejdb_put_new_batch(b->db, BENCH_COLL "_batch", docs, num, 0);
+    RCGO(rc, finish);
+    rc = _bench_op(b, t0);
+    RCGO(rc, finish);
+    for (int64_t j = 0; j < num; ++j) {
+      jbl_destroy(&docs[j]);
+    }
+    b->rows += num;
+  }
+  rc = _bench_end(b, "put_new_batch");
+
+finish:
+  for (int64_t j = 0; j < BENCH_BATCH_SIZE; ++j) {
+    jbl_destroy(&docs[j]);
+  }
+  free(docs);
+  return rc;
+}
+
+static iwrc _bench_get(BENCH *b) {
+  _bench_begin(b);
+  for (int64_t i = 0; i < b->records; ++i) {
+    JBL jbl;
+    int64_t id = b->ids[_bench_rand(b) % b->records];
+    uint64_t t0 = _bench_now();
+    iwrc rc = ejdb_get(b->db, BENCH_COLL, id, &jbl);
+    RCRET(rc);
+    rc = _bench_op(b, t0);
+    jbl_destroy(&jbl);
+    RCRET(rc);
+    ++b->rows;
+  }
+  return _bench_end(b, "get");
+}
+
+static iwrc _bench_patch(BENCH *b) {
+  char patch[64];
+  _bench_begin(b);
+  for (int64_t i = 0; i < b->records; ++i) {
+    int64_t id = b->ids[_bench_rand(b) % b->records];
+    snprintf(patch, sizeof(patch), "{\"score\":%.2f}", (_bench_rand(b) % 1000000) / 100.0);
+    uint64_t t0 = _bench_now();
+    iwrc rc = ejdb_patch(b->db, BENCH_COLL, patch, id);
+    RCRET(rc);
+    rc = _bench_op(b, t0);
+    RCRET(rc);
+  }
+  return _bench_end(b, "patch");
+}
+
+static iwrc _bench_count_visitor(EJDB_EXEC *ux, EJDB_DOC doc, int64_t *step) {
+  BENCH *b = ux->opaque;
+  ++b->rows;
+  return 0;
+}
+
+/**
+ * Executes `query` `num` times.
+ * If query has `:group` placeholder it is set to random group value for each run.
+ */
+static iwrc _bench_query(BENCH *b, const char *name, const char *query, int64_t num) {
+  JQL q;
+  iwrc rc = jql_create(&q, BENCH_COLL, query);
+  RCRET(rc);
+  bool has_group = strstr(query, ":group") != 0;
+  EJDB_EXEC ux = {
+    .db = b->db,
+    .q = q,
+    .visitor = _bench_count_visitor,
+    .opaque = b
+  };
+  _bench_begin(b);
+  for (int64_t i = 0; i < num; ++i) {
+    if (has_group) {
+      rc = jql_set_i64(q, "group", 0, (int64_t) (_bench_rand(b) % BENCH_GROUPS));
+      RCGO(rc, finish);
+    }
+    uint64_t t0 = _bench_now();
+    rc = ejdb_exec(&ux);
+    RCGO(rc, finish);
+    rc = _bench_op(b, t0);
+    RCGO(rc, finish);
+  }
+  rc = _bench_end(b, name);
+
+finish:
+  jql_destroy(&q);
+  return rc;
+}
+
+/**
+ * Executes `num` `in` queries over `/group` values,
+ * served by duplicates index scanner when `/group` index exists.
+ */
+static iwrc _bench_query_in(BENCH *b, const char *name, int64_t num) {
+  iwrc rc = 0;
+  char query[32 + BENCH_IN_VALUES * 8];
+  _bench_begin(b);
+  for (int64_t i = 0; i < num; ++i) {
+    JQL q;
+    int len = snprintf(query, sizeof(query), "/[group in [");
+    for (int j = 0; j < BENCH_IN_VALUES; ++j) {
+      len += snprintf(query + len, sizeof(query) - len, j ? ",%d" : "%d", (int) (_bench_rand(b) % BENCH_GROUPS));
+    }
+    snprintf(query + len, sizeof(query) - len, "]]");
+    uint64_t t0 = _bench_now();
+    rc = jql_create(&q, BENCH_COLL, query);
+    RCRET(rc);
+    EJDB_EXEC ux = {
+      .db = b->db,
+      .q = q,
+      .visitor = _bench_count_visitor,
+      .opaque = b
+    };
+    rc = ejdb_exec(&ux);
+    jql_destroy(&q);
+    RCRET(rc);
+    rc = _bench_op(b, t0);
+    RCRET(rc);
+  }
+  return _bench_end(b, name);
+}
+
+static iwrc _bench_ensure_index(BENCH *b, const char *name, const char *path, ejdb_idx_mode_t mode) {
+  _bench_begin(b);
+  uint64_t t0 = _bench_now();
+  iwrc rc = ejdb_ensure_index(b->db, BENCH_COLL, path, mode);
+  RCRET(rc);
+  rc = _bench_op(b, t0);
+  RCRET(rc);
+  b->rows = b->records;
+  return _bench_end(b, name);
+}
+
+static iwrc _bench_run(BENCH *b) {
+  int64_t sort_num = b->queries / 20 > 0 ? b->queries / 20 : 1;
+  iwrc rc = _bench_put_new(b);
+  RCRET(rc);
+  rc = _bench_put_new_batch(b);
+  RCRET(rc);
+  rc = _bench_get(b);
+  RCRET(rc);
+  rc = _bench_patch(b);
+  RCRET(rc);
+  rc = _bench_query(b, "query_full_scan", "/[group = :group]", b->queries);
+  RCRET(rc);
+  rc = _bench_query(b, "order_by_no_index", "/* | asc /name", sort_num);
+  RCRET(rc);
+  rc = _bench_query(b, "order_by_limit_no_index", "/* | asc /name limit 100", b->queries);
+  RCRET(rc);
+  rc = _bench_ensure_index(b, "ensure_index_i64", "/group", EJDB_IDX_I64);
+  RCRET(rc);
+  rc = _bench_query(b, "query_index_scan", "/[group = :group]", b->queries);
+  RCRET(rc);
+  rc = _bench_query_in(b, "query_in_dup_scan", b->queries);
+  RCRET(rc);
+  rc = _bench_ensure_index(b, "ensure_index_str", "/name", EJDB_IDX_STR);
+  RCRET(rc);
+  rc = _bench_query(b, "order_by_index", "/* | asc /name", sort_num);
+  RCRET(rc);
+  rc = _bench_query(b, "order_by_limit_index", "/* | asc /name limit 100", b->queries);
+  RCRET(rc);
+  return 0;
+}
+
+static void _bench_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n records] [-q queries] [-s seed] [-d dbfile] [-o results.json]\n"
+          "  -n records  Number of generated documents (default: 100000)\n"
+          "  -q queries  Number of executed queries per query workload (default: 200)\n"
+          "  -s seed     PRNG seed of generated data (default: 1)\n"
+          "  -d dbfile   Database file (default: ejdb_bench.db)\n"
+          "  -o file     Output JSON file (default: stdout)\n", prog);
+}
+
+int main(int argc, char const *argv[]) {
+  BENCH b = {
+    .records = 100000,
+    .queries = 200,
+    .rnd = 1
+  };
+  const char *path = "ejdb_bench.db";
+  const char *out = 0;
+  FILE *fout = stdout;
+  JBL res = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (i + 1 >= argc || arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0') {
+      _bench_usage(argv[0]);
+      return 1;
+    }
+    const char *val = argv[++i];
+    switch (arg[1]) {
+      case 'n':
+        b.records = strtoll(val, 0, 10);
+        break;
+      case 'q':
+        b.queries = strtoll(val, 0, 10);
+        break;
+      case 's':
+        b.rnd = strtoull(val, 0, 10);
+        break;
+      case 'd':
+        path = val;
+        break;
+      case 'o':
+        out = val;
+        break;
+      default:
+        _bench_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (b.records < 1 || b.queries < 1) {
+    _bench_usage(argv[0]);
+    return 1;
+  }
+  uint64_t seed = b.rnd;
+  if (!b.rnd) {
+    b.rnd = 1; // xorshift state must not be zero
+  }
+
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = path,
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+
+  iwrc rc = ejdb_init();
+  RCGO(rc, finish);
+  b.ids = malloc(b.records * sizeof(b.ids[0]));
+  if (!b.ids) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  rc = ejdb_open(&opts, &b.db);
+  RCGO(rc, finish);
+
+  rc = jbl_create_empty_object(&res);
+  RCGO(rc, finish);
+  rc = jbl_create_empty_object(&b.workloads);
+  RCGO(rc, finish);
+  rc = _bench_run(&b);
+  RCGO(rc, finish);
+
+  rc = jbl_set_string(res, "version", ejdb_version_full());
+  RCGO(rc, finish);
+  rc = jbl_set_int64(res, "records", b.records);
+  RCGO(rc, finish);
+  rc = jbl_set_int64(res, "queries", b.queries);
+  RCGO(rc, finish);
+  rc = jbl_set_int64(res, "seed", (int64_t) seed);
+  RCGO(rc, finish);
+  rc = jbl_set_nested(res, "workloads", b.workloads);
+  RCGO(rc, finish);
+
+  if (out) {
+    fout = fopen(out, "w");
+    if (!fout) {
+      rc = iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+      goto finish;
+    }
+  }
+  rc = jbl_as_json(res, jbl_fstream_json_printer, fout, JBL_PRINT_PRETTY);
+  fputc('\n', fout);
+
+finish:
+  if (fout && fout != stdout) {
+    fclose(fout);
+  }
+  if (b.db) {
+    iwrc rc2 = ejdb_close(&b.db);
+    if (!rc) {
+      rc = rc2;
+    }
+  }
+  jbl_destroy(&b.workloads);
+  jbl_destroy(&res);
+  free(b.ids);
+  free(b.lat);
+  if (rc) {
+    iwlog_ecode_error3(rc);
+    return 1;
+  }
+  return 0;
+}
@@ -42,17 +42,631 @@ static int64_t _jb_meta_nrecs_get(EJDB db, uint32_t dbid) {
   return (int64_t) ret;
 }
 
+static void _jb_idx_ptrs_release(JBIDX idx) {
+  if (idx->cptrs) {
+    for (int i = 0; i < idx->cnum; ++i) {
+      free(idx->cptrs[i]);
+    }
+    free(idx->cptrs);
+  } else if (idx->ptr) {
+    free(idx->ptr);
+  }
+  idx->cptrs = 0;
+  idx->cnum = 0;
+  idx->ptr = 0;
+}
+
+/**
+ * Parses index `path` according to `idx->mode`.
+ * Path of `EJDB_IDX_COMPOSITE` index is a comma separated list of JSON pointers.
+ */
+static iwrc _jb_idx_ptrs_alloc(JBIDX idx, const char *path) {
+  if (!(idx->mode & EJDB_IDX_COMPOSITE)) {
+    return jbl_ptr_alloc(path, &idx->ptr);
+  }
+  iwrc rc = 0;
+  int cnum = 1;
+  for (const char *p = path; *p; ++p) {
+    if (*p == ',') ++cnum;
+  }
+  if (cnum < 2 || cnum > JB_IDX_COMPOSITE_MAX_FIELDS) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  idx->cptrs = calloc(cnum, sizeof(idx->cptrs[0]));
+  if (!idx->cptrs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  char *buf = strdup(path);
+  if (!buf) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  char *sp, *field = strtok_r(buf, ",", &sp);
+  for ( ; field; field = strtok_r(0, ",", &sp)) {
+    while (*field == ' ') ++field;
+    if (idx->cnum == cnum) {
+      break;
+    }
+    rc = jbl_ptr_alloc(field, &idx->cptrs[idx->cnum]);
+    RCGO(rc, finish);
+    idx->cnum++;
+  }
+  if (idx->cnum != cnum) { // Empty fields
+    rc = IW_ERROR_INVALID_ARGS;
+    goto finish;
+  }
+  idx->ptr = idx->cptrs[0];
+
+finish:
+  free(buf);
+  if (rc) {
+    _jb_idx_ptrs_release(idx);
+  }
+  return rc;
+}
+
+/** Returns true if indexes have the same type and fields */
+static bool _jb_idx_same(JBIDX idx1, JBIDX idx2) {
+  if ((idx1->mode & ~EJDB_IDX_UNIQUE) != (idx2->mode & ~EJDB_IDX_UNIQUE) || idx1->cnum != idx2->cnum) {
+    return false;
+  }
+  if (!idx1->cnum) {
+    return !jbl_ptr_cmp(idx1->ptr, idx2->ptr);
+  }
+  for (int i = 0; i < idx1->cnum; ++i) {
+    if (jbl_ptr_cmp(idx1->cptrs[i], idx2->cptrs[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Returns true if indexes have the same partial index filter or both are not partial */
+static bool _jb_idx_same_filter(JBIDX idx1, JBIDX idx2) {
+  if (!idx1->fqs || !idx2->fqs) {
+    return idx1->fqs == idx2->fqs;
+  }
+  return !strcmp(idx1->fqs, idx2->fqs);
+}
+
+/**
+ * Compiles `filter` query of partial index.
+ * Query must consist only of filter expressions without placeholders.
+ */
+static iwrc _jb_idx_filter_init(JBIDX idx, const char *filter) {
+  iwrc rc = jql_create(&idx->fq, idx->jbc->name, filter);
+  RCRET(rc);
+  JQP_AUX *aux = idx->fq->aux;
+  if (aux->first_anchor
+      || aux->projection
+      || aux->apply
+      || aux->apply_placeholder
+      || aux->orderby_num
+      || aux->skip
+      || aux->limit
+      || aux->num_placeholders
+      || aux->qmode) {
+    return EJDB_ERROR_INVALID_INDEX_FILTER;
+  }
+  idx->fqs = strdup(filter);
+  if (!idx->fqs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  return jbi_idx_filter_prepare(idx);
+}
+
 static void _jb_idx_release(JBIDX idx) {
   if (idx->idb) {
     iwkv_db_cache_release(idx->idb);
   }
-  if (idx->ptr) {
-    free(idx->ptr);
+  if (idx->fq) {
+    jql_destroy(&idx->fq);
   }
+  free(idx->fqs);
+  _jb_idx_ptrs_release(idx);
+  jbi_stat_release(&idx->stat);
   free(idx);
 }
 
-static void _jb_coll_release(JBCOLL jbc) {
+static iwrc _jb_idx_stat_load(JBIDX idx) {
+  IWKV_val key, val;
+  char keybuf[sizeof(KEY_PREFIX_IDXSTAT) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: s.<coldbid>.<idxdbid>
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXSTAT "%u" "." "%u", idx->jbc->dbid, idx->dbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  iwrc rc = iwkv_get(idx->jbc->db->metadb, &key, &val);
+  if (rc == IWKV_ERROR_NOTFOUND) { // Index was never analyzed
+    return 0;
+  }
+  RCRET(rc);
+  rc = jbi_stat_from_buf(idx, val.data, val.size, &idx->stat);
+  iwkv_val_dispose(&val);
+  return rc;
+}
+
+static iwrc _jb_idx_stat_save(JBIDX idx, struct _JBIDXSTAT *stat) {
+  IWKV_val key, val;
+  binn *bn = 0;
+  char keybuf[sizeof(KEY_PREFIX_IDXSTAT) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: s.<coldbid>.<idxdbid>
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXSTAT "%u" "." "%u", idx->jbc->dbid, idx->dbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  iwrc rc = jbi_stat_to_binn(idx, stat, &bn);
+  RCRET(rc);
+  val.data = binn_ptr(bn);
+  val.size = binn_size(bn);
+  rc = iwkv_put(idx->jbc->db->metadb, &key, &val, 0);
+  binn_free(bn);
+  return rc;
+}
+
+static iwrc _jb_idx_stat_remove(EJDB db, uint32_t coldbid, uint32_t idxdbid) {
+  IWKV_val key;
+  char keybuf[sizeof(KEY_PREFIX_IDXSTAT) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: s.<coldbid>.<idxdbid>
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXSTAT "%u" "." "%u", coldbid, idxdbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  iwrc rc = iwkv_del(db->metadb, &key, 0);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    rc = 0;
+  }
+  return rc;
+}
+
+static iwrc _jb_dcache_init(JBCOLL jbc) {
+  uint32_t max_size = jbc->db->opts.document_cache_sz;
+  if (!max_size) {
+    return 0;
+  }
+  struct _JBDCACHE *dc = calloc(1, sizeof(*dc));
+  if (!dc) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  dc->map = kh_init(JBDCM);
+  if (!dc->map) {
+    free(dc);
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  int rci = pthread_mutex_init(&dc->mtx, 0);
+  if (rci) {
+    kh_destroy(JBDCM, dc->map);
+    free(dc);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  dc->max_size = max_size;
+  jbc->dcache = dc;
+  return 0;
+}
+
+void jb_dcache_release(struct _JBDCE *e) {
+  if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(e);
+  }
+}
+
+// Binn free function of documents sharing cache entry data
+static void _jb_dcache_freefn(void *ptr) {
+  jb_dcache_release((void *) ((uint8_t *) ptr - offsetof(struct _JBDCE, data)));
+}
+
+// Removes entry from cache, called under `dc->mtx` lock
+static void _jb_dcache_remove(struct _JBDCACHE *dc, struct _JBDCE *e) {
+  khiter_t k = kh_get(JBDCM, dc->map, e->id);
+  if (k != kh_end(dc->map)) {
+    kh_del(JBDCM, dc->map, k);
+  }
+  struct _JBDCE *last = dc->ring[--dc->num];
+  dc->ring[e->slot] = last;
+  last->slot = e->slot;
+  if (dc->hand >= dc->num) {
+    dc->hand = 0;
+  }
+  dc->size -= sizeof(*e) + e->size;
+  jb_dcache_release(e);
+}
+
+static void _jb_dcache_destroy(JBCOLL jbc) {
+  struct _JBDCACHE *dc = jbc->dcache;
+  if (!dc) {
+    return;
+  }
+  for (size_t i = 0; i < dc->num; ++i) {
+    jb_dcache_release(dc->ring[i]);
+  }
+  free(dc->ring);
+  kh_destroy(JBDCM, dc->map);
+  pthread_mutex_destroy(&dc->mtx);
+  free(dc);
+  jbc->dcache = 0;
+}
+
+/**
+ * Returns cached document entry referenced by caller or zero on cache miss.
+ * Entry must be released by `jb_dcache_release()`.
+ */
+struct _JBDCE *jb_dcache_acquire(JBCOLL jbc, int64_t id) {
+  struct _JBDCE *e = 0;
+  struct _JBDCACHE *dc = jbc->dcache;
+  if (!dc) {
+    return 0;
+  }
+  pthread_mutex_lock(&dc->mtx);
+  khiter_t k = kh_get(JBDCM, dc->map, id);
+  if (k != kh_end(dc->map)) {
+    e = kh_value(dc->map, k);
+    e->ref = true;
+    __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+    ++dc->hits;
+  } else {
+    ++dc->misses;
+  }
+  pthread_mutex_unlock(&dc->mtx);
+  return e;
+}
+
+/**
+ * Caches copy of document `data` just read from collection.
+ * Entries not referenced since the last pass of CLOCK hand are evicted to fit cache size budget.
+ * Caching is best effort, document is not cached if there is no memory for it.
+ */
+void jb_dcache_put(JBCOLL jbc, int64_t id, const void *data, size_t size) {
+  int ret;
+  struct _JBDCACHE *dc = jbc->dcache;
+  size_t esz = sizeof(struct _JBDCE) + size;
+  if (!dc || esz > dc->max_size / 4) { // Large documents do not push out hot ones
+    return;
+  }
+  struct _JBDCE *e = malloc(esz);
+  if (!e) {
+    return;
+  }
+  e->id = id;
+  e->refs = 1;
+  e->ref = false;
+  e->size = size;
+  memcpy(e->data, data, size);
+
+  pthread_mutex_lock(&dc->mtx);
+  if (dc->num >= dc->asz) {
+    size_t nsz = dc->asz ? dc->asz * 2 : 64;
+    struct _JBDCE **nring = realloc(dc->ring, nsz * sizeof(dc->ring[0]));
+    if (!nring) {
+      free(e);
+      goto finish;
+    }
+    dc->ring = nring;
+    dc->asz = nsz;
+  }
+  khiter_t k = kh_put(JBDCM, dc->map, id, &ret);
+  if (ret <= 0) { // Already cached by concurrent reader or no memory
+    free(e);
+    goto finish;
+  }
+  while (dc->num && dc->size + esz > dc->max_size) {
+    struct _JBDCE *c = dc->ring[dc->hand];
+    if (c->ref) {
+      c->ref = false;
+      dc->hand = (dc->hand + 1) % dc->num;
+    } else {
+      _jb_dcache_remove(dc, c);
+    }
+  }
+  kh_value(dc->map, k) = e;
+  e->slot = dc->num;
+  dc->ring[dc->num++] = e;
+  dc->size += esz;
+
+finish:
+  pthread_mutex_unlock(&dc->mtx);
+}
+
+/**
+ * Removes cached document modified by collection writer.
+ * Called by writer holding document versions lock in snapshot reads mode,
+ * otherwise collection write lock excludes readers.
+ */
+static void _jb_dcache_invalidate(JBCOLL jbc, int64_t id) {
+  struct _JBDCACHE *dc = jbc->dcache;
+  if (!dc) {
+    return;
+  }
+  pthread_mutex_lock(&dc->mtx);
+  khiter_t k = kh_get(JBDCM, dc->map, id);
+  if (k != kh_end(dc->map)) {
+    _jb_dcache_remove(dc, kh_value(dc->map, k));
+  }
+  pthread_mutex_unlock(&dc->mtx);
+}
+
+static iwrc _jb_dcache_add_meta(JBCOLL jbc, binn *meta) {
+  iwrc rc = 0;
+  struct _JBDCACHE *dc = jbc->dcache;
+  if (!dc) {
+    return 0;
+  }
+  binn *cmeta = binn_object();
+  if (!cmeta) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  pthread_mutex_lock(&dc->mtx);
+  if (!binn_object_set_int64(cmeta, "max_size", dc->max_size)
+      || !binn_object_set_int64(cmeta, "size", dc->size)
+      || !binn_object_set_int64(cmeta, "num", dc->num)
+      || !binn_object_set_int64(cmeta, "hits", dc->hits)
+      || !binn_object_set_int64(cmeta, "misses", dc->misses)) {
+    rc = JBL_ERROR_CREATION;
+  }
+  pthread_mutex_unlock(&dc->mtx);
+  if (!rc && !binn_object_set_object(meta, "cache", cmeta)) {
+    rc = JBL_ERROR_CREATION;
+  }
+  binn_free(cmeta);
+  return rc;
+}
+
+static void _jb_zdicts_release(JBCOLL jbc) {
+  for (struct _JBZDICT *d = jbc->zdicts, *nd; d; d = nd) {
+    nd = d->next;
+    lzb_dict_destroy(d->lzd);
+    free(d);
+  }
+  jbc->zdicts = 0;
+  jbc->zdict = 0;
+}
+
+static struct _JBZDICT *_jb_zdict_get(JBCOLL jbc, uint32_t id) {
+  for (struct _JBZDICT *d = jbc->zdicts; d; d = d->next) {
+    if (d->id == id) {
+      return d;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Adds compression dictionary to collection.
+ * Dictionaries are read by snapshot readers, so they are added under `jbc->slock`
+ * if collection is available to readers.
+ */
+static iwrc _jb_zdict_add(JBCOLL jbc, uint32_t id, const void *data, size_t size, struct _JBZDICT **dp) {
+  struct _JBZDICT *d = malloc(sizeof(*d));
+  if (!d) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  d->id = id;
+  d->lzd = lzb_dict_create(data, size);
+  if (!d->lzd) {
+    free(d);
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  d->next = jbc->zdicts;
+  jbc->zdicts = d;
+  if (dp) {
+    *dp = d;
+  }
+  return 0;
+}
+
+/**
+ * Loads documents compression settings and dictionaries of collection.
+ * Stored as `{mode, dict, dicts: [{id, data}]}` object under `z.<coldbid>` key.
+ */
+static iwrc _jb_coll_load_zmeta_lr(JBCOLL jbc) {
+  IWKV_val key, val;
+  char keybuf[sizeof(KEY_PREFIX_COLLZ) + JBNUMBUF_SIZE]; // Full key format: z.<coldbid>
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_COLLZ "%u", jbc->dbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  iwrc rc = iwkv_get(jbc->db->metadb, &key, &val);
+  if (rc == IWKV_ERROR_NOTFOUND) { // Documents are not compressed
+    return 0;
+  }
+  RCRET(rc);
+
+  binn bv, *list = 0;
+  uint32_t mode = 0, did = 0;
+  if (!binn_load(val.data, &bv)
+      || !binn_object_get_uint32(&bv, "mode", &mode)
+      || !binn_object_get_uint32(&bv, "dict", &did)
+      || !binn_object_get_list(&bv, "dicts", (void **) &list)) {
+    rc = EJDB_ERROR_INVALID_COLLECTION_META;
+    goto finish;
+  }
+  int cnt = binn_count(list);
+  for (int i = 1; i <= cnt; ++i) {
+    void *dobj, *data;
+    uint32_t id;
+    int size;
+    if (!binn_list_get_object(list, i, &dobj)
+        || !binn_object_get_uint32(dobj, "id", &id)
+        || !binn_object_get_blob(dobj, "data", &data, &size)) {
+      rc = EJDB_ERROR_INVALID_COLLECTION_META;
+      goto finish;
+    }
+    rc = _jb_zdict_add(jbc, id, data, size, 0);
+    RCGO(rc, finish);
+  }
+  jbc->zmode = mode;
+  jbc->zdict = did ? _jb_zdict_get(jbc, did) : 0;
+  if (did && !jbc->zdict) {
+    rc = EJDB_ERROR_INVALID_COLLECTION_META;
+  }
+
+finish:
+  iwkv_val_dispose(&val);
+  return rc;
+}
+
+/**
+ * Saves documents compression settings of collection.
+ * @param all Keep all dictionaries, otherwise only dictionary used for new documents is kept.
+ */
+static iwrc _jb_coll_save_zmeta(JBCOLL jbc, bool all) {
+  iwrc rc = 0;
+  IWKV_val key, val;
+  binn *dobj = 0;
+  char keybuf[sizeof(KEY_PREFIX_COLLZ) + JBNUMBUF_SIZE]; // Full key format: z.<coldbid>
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_COLLZ "%u", jbc->dbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  binn *bn = binn_object();
+  binn *list = binn_list();
+  if (!bn || !list) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  for (struct _JBZDICT *d = jbc->zdicts; d; d = d->next) {
+    if (!all && d != jbc->zdict) {
+      continue;
+    }
+    size_t size;
+    const void *data = lzb_dict_data(d->lzd, &size);
+    dobj = binn_object();
+    if (!dobj) {
+      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      goto finish;
+    }
+    if (!binn_object_set_uint32(dobj, "id", d->id)
+        || !binn_object_set_blob(dobj, "data", (void *) data, (int) size)
+        || !binn_list_add_object(list, dobj)) {
+      rc = JBL_ERROR_CREATION;
+      goto finish;
+    }
+    binn_free(dobj);
+    dobj = 0;
+  }
+  if (!binn_object_set_uint32(bn, "mode", jbc->zmode)
+      || !binn_object_set_uint32(bn, "dict", jbc->zdict ? jbc->zdict->id : 0)
+      || !binn_object_set_list(bn, "dicts", list)) {
+    rc = JBL_ERROR_CREATION;
+    goto finish;
+  }
+  val.data = binn_ptr(bn);
+  val.size = binn_size(bn);
+  rc = iwkv_put(jbc->db->metadb, &key, &val, 0);
+
+finish:
+  if (dobj) binn_free(dobj);
+  if (list) binn_free(list);
+  if (bn) binn_free(bn);
+  return rc;
+}
+
+static iwrc _jb_coll_remove_zmeta(EJDB db, uint32_t coldbid) {
+  IWKV_val key;
+  char keybuf[sizeof(KEY_PREFIX_COLLZ) + JBNUMBUF_SIZE]; // Full key format: z.<coldbid>
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_COLLZ "%u", coldbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  iwrc rc = iwkv_del(db->metadb, &key, 0);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    rc = 0;
+  }
+  return rc;
+}
+
+/**
+ * Compresses document data `val` to be stored according to collection compression mode.
+ * If document is compressed `val` points to compressed data allocated in `*bufp`, caller frees it.
+ */
+static iwrc _jb_doc_pack(JBCOLL jbc, IWKV_val *val, void **bufp) {
+  *bufp = 0;
+  if (jbc->zmode == EJDB_COMPRESS_NONE || val->size > UINT32_MAX) {
+    return 0;
+  }
+  uint32_t did = jbc->zdict ? jbc->zdict->id : 0;
+  uint32_t size = (uint32_t) val->size;
+  size_t bufsz = JB_ZDOC_HDR_SZ + LZB_COMPRESS_BOUND(val->size);
+  uint8_t *buf = malloc(bufsz);
+  if (!buf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  size_t csz = lzb_compress(val->data, val->size, jbc->zdict ? jbc->zdict->lzd : 0,
+                            buf + JB_ZDOC_HDR_SZ, bufsz - JB_ZDOC_HDR_SZ);
+  if (!csz || JB_ZDOC_HDR_SZ + csz >= val->size) { // Not worth it
+    free(buf);
+    return 0;
+  }
+  buf[0] = JB_ZDOC_MAGIC;
+  did = IW_HTOIL(did);
+  size = IW_HTOIL(size);
+  memcpy(buf + 1, &did, sizeof(did));
+  memcpy(buf + 1 + sizeof(did), &size, sizeof(size));
+  val->data = buf;
+  val->size = JB_ZDOC_HDR_SZ + csz;
+  *bufp = buf;
+  return 0;
+}
+
+/**
+ * Decompresses stored document `data` into `buf`.
+ * If document doesn't fit into `bufsz` bytes `buf` is not changed, size of document is returned in `vszp` anyway.
+ */
+iwrc jb_doc_unpack(JBCOLL jbc, const void *data, size_t size, void *buf, size_t bufsz, size_t *vszp) {
+  uint32_t did, vsz;
+  const uint8_t *rp = data;
+  struct _JBZDICT *d = 0;
+  memcpy(&did, rp + 1, sizeof(did));
+  memcpy(&vsz, rp + 1 + sizeof(did), sizeof(vsz));
+  did = IW_ITOHL(did);
+  vsz = IW_ITOHL(vsz);
+  *vszp = vsz;
+  if (vsz > bufsz) {
+    return 0;
+  }
+  if (did) {
+    d = _jb_zdict_get(jbc, did);
+    if (!d) {
+      iwlog_error("Dictionary %u of compressed document is not found, collection: %s", did, jbc->name);
+      return EJDB_ERROR_INVALID_COMPRESSED_DOCUMENT;
+    }
+  }
+  if (!lzb_decompress(rp + JB_ZDOC_HDR_SZ, size - JB_ZDOC_HDR_SZ, d ? d->lzd : 0, buf, vsz)) {
+    iwlog_ecode_error3(EJDB_ERROR_INVALID_COMPRESSED_DOCUMENT);
+    return EJDB_ERROR_INVALID_COMPRESSED_DOCUMENT;
+  }
+  return 0;
+}
+
+/**
+ * Replaces compressed document data of `val` allocated by IWKV with decompressed one.
+ * `val` is not changed on error.
+ */
+iwrc jb_doc_unpack_val(JBCOLL jbc, IWKV_val *val) {
+  size_t vsz;
+  if (!JB_ZDOC_PACKED(val->data, val->size)) {
+    return 0;
+  }
+  iwrc rc = jb_doc_unpack(jbc, val->data, val->size, 0, 0, &vsz);
+  RCRET(rc);
+  void *buf = malloc(vsz);
+  if (!buf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  rc = jb_doc_unpack(jbc, val->data, val->size, buf, vsz, &vsz);
+  if (rc) {
+    free(buf);
+    return rc;
+  }
+  iwkv_val_dispose(val);
+  val->data = buf;
+  val->size = vsz;
+  return 0;
+}
+
+static void _jb_coll_release_data(JBCOLL jbc) {
   if (jbc->cdb) {
     iwkv_db_cache_release(jbc->cdb);
   }
@@ -65,13 +679,198 @@ static void _jb_coll_release(JBCOLL jbc) {
     _jb_idx_release(idx);
   }
   jbc->idx = 0;
+  if (jbc->dvers) {
+    for (khiter_t k = kh_begin(jbc->dvers); k != kh_end(jbc->dvers); ++k) {
+      if (!kh_exist(jbc->dvers, k)) continue;
+      for (struct _JBDVER *v = kh_value(jbc->dvers, k), *nv; v; v = nv) {
+        nv = v->next;
+        free(v);
+      }
+    }
+    kh_destroy(JBDVERS, jbc->dvers);
+    jbc->dvers = 0;
+  }
+  _jb_dcache_destroy(jbc);
+  _jb_zdicts_release(jbc);
+}
+
+static void _jb_coll_release(JBCOLL jbc) {
+  _jb_coll_release_data(jbc);
   pthread_rwlock_destroy(&jbc->rwl);
+  pthread_rwlock_destroy(&jbc->slock);
+  pthread_rwlock_destroy(&jbc->vlock);
   free(jbc);
 }
 
+static int _jb_creg_cmp(const void *o1, const void *o2) {
+  const struct _JBCREGE *e1 = o1, *e2 = o2;
+  return strcmp(e1->name, e2->name);
+}
+
+// Sequence of reader slots assigned to threads
+static uint32_t _jb_creg_slot_seq;
+
+/** Returns number of readers entered registry read section at epochs of given `parity`. */
+static uint32_t _jb_creg_readers(EJDB db, int parity) {
+  uint32_t ret = 0;
+  for (int i = 0; i < JB_CREG_SLOTS; ++i) {
+    ret += __atomic_load_n(&db->creg_slots[i].readers[parity], __ATOMIC_SEQ_CST);
+  }
+  return ret;
+}
+
+/**
+ * Releases retired registries and removed collections no reader can use.
+ * Caller must hold `db->creg_mtx`.
+ *
+ * Epoch is advanced from `e` to `e + 1` only when readers entered at `e - 1` are gone,
+ * so readers inside of read section are entered at the last two epochs. Objects are retired
+ * after they are unpublished, hence objects retired at epoch `r` are not reachable
+ * once epoch is `r + 2`. Removed collections having acquired handles are kept.
+ */
+static void _jb_creg_reclaim_lk(EJDB db) {
+  for (int i = 0; i < 2; ++i) {
+    uint64_t e = __atomic_load_n(&db->creg_epoch, __ATOMIC_SEQ_CST);
+    if (_jb_creg_readers(db, (e + 1) & 1)) {
+      break;
+    }
+    __atomic_store_n(&db->creg_epoch, e + 1, __ATOMIC_SEQ_CST);
+  }
+  uint64_t e = __atomic_load_n(&db->creg_epoch, __ATOMIC_SEQ_CST);
+  for (struct _JBCREG **regp = &db->cregs; *regp; ) {
+    struct _JBCREG *reg = *regp;
+    if (reg->epoch + 2 <= e) {
+      *regp = reg->next;
+      free(reg);
+    } else {
+      regp = &reg->next;
+    }
+  }
+  for (JBCOLL *jbcp = &db->rcolls; *jbcp; ) {
+    JBCOLL jbc = *jbcp;
+    if (jbc->repoch + 2 > e || __atomic_load_n(&jbc->nhandles, __ATOMIC_SEQ_CST)) {
+      jbcp = &jbc->rnext;
+    } else {
+      *jbcp = jbc->rnext;
+      _jb_coll_release(jbc);
+    }
+  }
+}
+
+static void _jb_creg_reclaim(EJDB db) {
+  pthread_mutex_lock(&db->creg_mtx);
+  _jb_creg_reclaim_lk(db);
+  pthread_mutex_unlock(&db->creg_mtx);
+}
+
+/**
+ * Retires unpublished registry `reg` and/or removed collection `jbc` (both optional)
+ * and releases retired objects not used by readers.
+ */
+static void _jb_creg_retire(EJDB db, struct _JBCREG *reg, JBCOLL jbc) {
+  pthread_mutex_lock(&db->creg_mtx);
+  uint64_t e = __atomic_load_n(&db->creg_epoch, __ATOMIC_SEQ_CST);
+  if (reg) {
+    reg->epoch = e;
+    reg->next = db->cregs;
+    db->cregs = reg;
+  }
+  if (jbc) {
+    jbc->repoch = e;
+    jbc->rnext = db->rcolls;
+    db->rcolls = jbc;
+  }
+  _jb_creg_reclaim_lk(db);
+  pthread_mutex_unlock(&db->creg_mtx);
+}
+
+/**
+ * Enters registry read section.
+ * Reader is counted in the slot of calling thread at the current epoch.
+ * @return Readers counter to be passed to `_jb_creg_leave()`.
+ */
+static uint32_t *_jb_creg_enter(EJDB db) {
+  static _Thread_local uint32_t tslot;
+  if (!tslot) {
+    tslot = __atomic_fetch_add(&_jb_creg_slot_seq, 1, __ATOMIC_RELAXED) % JB_CREG_SLOTS + 1;
+  }
+  struct _JBCREGSLOT *slot = &db->creg_slots[tslot - 1];
+  while (1) {
+    uint64_t e = __atomic_load_n(&db->creg_epoch, __ATOMIC_SEQ_CST);
+    uint32_t *rp = &slot->readers[e & 1];
+    __atomic_add_fetch(rp, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&db->creg_epoch, __ATOMIC_SEQ_CST) == e) {
+      return rp;
+    }
+    // Epoch was advanced by reclamation which has not seen this reader, retry at the new epoch
+    __atomic_sub_fetch(rp, 1, __ATOMIC_RELEASE);
+  }
+}
+
+IW_INLINE void _jb_creg_leave(EJDB db, uint32_t *rp) {
+  __atomic_sub_fetch(rp, 1, __ATOMIC_RELEASE);
+  if ((__atomic_load_n(&db->cregs, __ATOMIC_RELAXED) || __atomic_load_n(&db->rcolls, __ATOMIC_RELAXED))
+      && !pthread_mutex_trylock(&db->creg_mtx)) {
+    _jb_creg_reclaim_lk(db); // Readers leaving the section release objects retired before they entered
+    pthread_mutex_unlock(&db->creg_mtx);
+  }
+}
+
+/**
+ * Publishes registry of current collections set and retires the previous one.
+ * Called under database write lock. If there is no memory registry is cleared,
+ * so collections are found by lookup under database lock.
+ */
+static void _jb_creg_publish(EJDB db) {
+  size_t num = 0, nsz = 0;
+  for (khiter_t k = kh_begin(db->mcolls); k != kh_end(db->mcolls); ++k) {
+    if (!kh_exist(db->mcolls, k)) continue;
+    ++num;
+    nsz += strlen(kh_key(db->mcolls, k)) + 1;
+  }
+  struct _JBCREG *reg = malloc(sizeof(*reg) + num * sizeof(reg->colls[0]) + nsz);
+  if (reg) {
+    char *wp = (char *) (reg->colls + num);
+    reg->next = 0;
+    reg->num = 0;
+    for (khiter_t k = kh_begin(db->mcolls); k != kh_end(db->mcolls); ++k) {
+      if (!kh_exist(db->mcolls, k)) continue;
+      const char *name = kh_key(db->mcolls, k);
+      size_t len = strlen(name) + 1;
+      memcpy(wp, name, len);
+      reg->colls[reg->num++] = (struct _JBCREGE) {
+        .name = wp,
+        .jbc = kh_value(db->mcolls, k)
+      };
+      wp += len;
+    }
+    qsort(reg->colls, reg->num, sizeof(reg->colls[0]), _jb_creg_cmp);
+  } else {
+    iwlog_ecode_error3(iwrc_set_errno(IW_ERROR_ALLOC, errno));
+  }
+  struct _JBCREG *oreg = __atomic_exchange_n(&db->creg, reg, __ATOMIC_SEQ_CST);
+  if (oreg) {
+    _jb_creg_retire(db, oreg, 0);
+  }
+}
+
+/**
+ * Finds collection in registry.
+ * Must be called inside of registry read section.
+ */
+static JBCOLL _jb_creg_find(EJDB db, const char *coll) {
+  struct _JBCREG *reg = __atomic_load_n(&db->creg, __ATOMIC_SEQ_CST);
+  if (!reg) {
+    return 0;
+  }
+  struct _JBCREGE key = { .name = coll };
+  struct _JBCREGE *e = bsearch(&key, reg->colls, reg->num, sizeof(reg->colls[0]), _jb_creg_cmp);
+  return e ? e->jbc : 0;
+}
+
 static iwrc _jb_coll_load_index_lr(JBCOLL jbc, IWKV_val *mval) {
   binn *bn;
-  char *ptr;
+  char *ptr, *filter;
   struct _JBL imeta;
   JBIDX idx = calloc(1, sizeof(*idx));
   if (!idx) return iwrc_set_errno(IW_ERROR_ALLOC, errno);
@@ -87,13 +886,28 @@ static iwrc _jb_coll_load_index_lr(JBCOLL jbc, IWKV_val *mval) {
     rc = EJDB_ERROR_INVALID_COLLECTION_INDEX_META;
     goto finish;
   }
-  rc = jbl_ptr_alloc(ptr, &idx->ptr);
+  idx->jbc = jbc;
+  rc = _jb_idx_ptrs_alloc(idx, ptr);
   RCGO(rc, finish);
+  if (idx->cnum && !binn_object_get_uint32(bn, "ckv", &idx->ckv)) {
+    idx->ckv = 1; // Composite index created before keys format was versioned
+  }
+  uint32_t coerced;
+  if (binn_object_get_uint32(bn, "coerced", &coerced)) {
+    idx->coerced = coerced;
+  } else {
+    idx->coerced = true; // Index created before coerced keys were tracked
+  }
+  if (binn_object_get_str(bn, "filter", &filter)) {
+    rc = _jb_idx_filter_init(idx, filter);
+    RCGO(rc, finish);
+  }
 
   rc = iwkv_db(jbc->db->iwkv, idx->dbid, idx->idbf, &idx->idb);
   RCGO(rc, finish);
-  idx->jbc = jbc;
   idx->rnum = _jb_meta_nrecs_get(jbc->db, idx->dbid);
+  rc = _jb_idx_stat_load(idx);
+  RCGO(rc, finish);
   idx->next = jbc->idx;
   jbc->idx = idx;
 
@@ -171,6 +985,9 @@ static iwrc _jb_coll_load_meta_lr(JBCOLL jbc) {
   rc = _jb_coll_load_indexes_lr(jbc);
   RCRET(rc);
 
+  rc = _jb_coll_load_zmeta_lr(jbc);
+  RCRET(rc);
+
   rc = iwkv_cursor_open(jbc->cdb, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
   RCRET(rc);
   rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT);
@@ -197,6 +1014,14 @@ static iwrc _jb_coll_init(JBCOLL jbc, IWKV_val *meta) {
   pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
   pthread_rwlock_init(&jbc->rwl, &attr);
+  pthread_rwlock_init(&jbc->slock, &attr);
+  pthread_rwlock_init(&jbc->vlock, 0);
+  jbc->dvers = kh_init(JBDVERS);
+  if (!jbc->dvers) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  rc = _jb_dcache_init(jbc);
+  RCRET(rc);
   if (meta) {
     rc = jbl_from_buf_keep(&jbc->meta, meta->data, meta->size, false);
     RCRET(rc);
@@ -229,14 +1054,15 @@ static iwrc _jb_idx_add_meta_lr(JBIDX idx, binn *list) {
     iwxstr_destroy(xstr);
     return rc;
   }
-  rc = jbl_ptr_serialize(idx->ptr, xstr);
+  rc = jbi_idx_ptr_serialize(idx, xstr);
   RCGO(rc, finish);
 
   if (!binn_object_set_str(meta, "ptr", iwxstr_ptr(xstr)) ||
       !binn_object_set_uint32(meta, "mode", idx->mode) ||
       !binn_object_set_uint32(meta, "idbf", idx->idbf) ||
       !binn_object_set_uint32(meta, "dbid", idx->dbid) ||
-      !binn_object_set_int64(meta, "rnum", idx->rnum)) {
+      !binn_object_set_int64(meta, "rnum", idx->rnum) ||
+      (idx->fqs && !binn_object_set_str(meta, "filter", idx->fqs))) {
     rc = JBL_ERROR_CREATION;
   }
 
@@ -260,10 +1086,13 @@ static iwrc _jb_coll_add_meta_lr(JBCOLL jbc, binn *list) {
   }
   if (!binn_object_set_str(meta, "name", jbc->name)
       || !binn_object_set_uint32(meta, "dbid", jbc->dbid)
-      || !binn_object_set_int64(meta, "rnum", jbc->rnum)) {
+      || !binn_object_set_int64(meta, "rnum", jbc->rnum)
+      || !binn_object_set_uint32(meta, "compression", jbc->zmode)) {
     rc = JBL_ERROR_CREATION;
     goto finish;
   }
+  rc = _jb_dcache_add_meta(jbc, meta);
+  RCGO(rc, finish);
   ilist = binn_list();
   if (!ilist) {
     rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
@@ -334,6 +1163,105 @@ finish:
   return rc;
 }
 
+static void _jb_qcache_entry_destroy(struct _JBQCE *e) {
+  if (e->q) {
+    jql_destroy(&e->q);
+  }
+  free(e->key);
+  free(e);
+}
+
+// Remove entry from chain of idle entries with the same key
+static void _jb_qcache_unlink_key(struct _JBQCACHE *qc, struct _JBQCE *e) {
+  khiter_t k = kh_get(JBQCM, qc->map, e->key);
+  assert(k != kh_end(qc->map));
+  struct _JBQCE *h = kh_value(qc->map, k);
+  if (h == e) {
+    if (e->knext) {
+      kh_key(qc->map, k) = e->knext->key;
+      kh_value(qc->map, k) = e->knext;
+    } else {
+      kh_del(JBQCM, qc->map, k);
+    }
+  } else {
+    for (; h->knext != e; h = h->knext);
+    h->knext = e->knext;
+  }
+  e->knext = 0;
+}
+
+static void _jb_qcache_unlink_lru(struct _JBQCACHE *qc, struct _JBQCE *e) {
+  if (e->prev) {
+    e->prev->next = e->next;
+  } else {
+    qc->head = e->next;
+  }
+  if (e->next) {
+    e->next->prev = e->prev;
+  } else {
+    qc->tail = e->prev;
+  }
+  e->prev = e->next = 0;
+  --qc->num;
+}
+
+// Releases cache reference held by the caller and unlocks cache, the last reference frees the cache.
+static void _jb_qcache_unref_unlock(struct _JBQCACHE *qc) {
+  bool last = (--qc->refs == 0);
+  pthread_mutex_unlock(&qc->mtx);
+  if (last) {
+    pthread_mutex_destroy(&qc->mtx);
+    free(qc);
+  }
+}
+
+static iwrc _jb_qcache_init(EJDB db) {
+  if (db->opts.no_query_cache) {
+    return 0;
+  }
+  if (!db->opts.query_cache_sz) {
+    db->opts.query_cache_sz = 256;
+  }
+  struct _JBQCACHE *qc = calloc(1, sizeof(*qc));
+  if (!qc) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  qc->map = kh_init(JBQCM);
+  if (!qc->map) {
+    free(qc);
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  int rci = pthread_mutex_init(&qc->mtx, 0);
+  if (rci) {
+    kh_destroy(JBQCM, qc->map);
+    free(qc);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  qc->max = db->opts.query_cache_sz;
+  qc->refs = 1;
+  db->qcache = qc;
+  return 0;
+}
+
+/** Destroys idle entries and releases database reference to the cache. */
+static void _jb_qcache_destroy(EJDB db) {
+  struct _JBQCACHE *qc = db->qcache;
+  if (!qc) {
+    return;
+  }
+  db->qcache = 0;
+  pthread_mutex_lock(&qc->mtx);
+  for (struct _JBQCE *e = qc->head, *n; e; e = n) {
+    n = e->next;
+    _jb_qcache_entry_destroy(e);
+  }
+  qc->head = qc->tail = 0;
+  qc->num = 0;
+  kh_destroy(JBQCM, qc->map);
+  qc->map = 0;
+  _jb_qcache_unref_unlock(qc);
+}
+
 static iwrc _jb_db_release(EJDB *dbp) {
   iwrc rc = 0;
   EJDB db = *dbp;
@@ -352,10 +1280,24 @@ static iwrc _jb_db_release(EJDB *dbp) {
     kh_destroy(JBCOLLM, db->mcolls);
     db->mcolls = 0;
   }
+  for (JBCOLL jbc = db->rcolls, njbc; jbc; jbc = njbc) {
+    njbc = jbc->rnext;
+    _jb_coll_release(jbc);
+  }
+  db->rcolls = 0;
+  for (struct _JBCREG *reg = db->cregs, *nreg; reg; reg = nreg) {
+    nreg = reg->next;
+    free(reg);
+  }
+  db->cregs = 0;
+  free(db->creg);
+  db->creg = 0;
+  _jb_qcache_destroy(db);
   if (db->iwkv) {
     IWRC(iwkv_close(&db->iwkv), rc);
   }
   pthread_rwlock_destroy(&db->rwl);
+  pthread_mutex_destroy(&db->creg_mtx);
 
   EJDB_HTTP *http = &db->opts.http;
   if (http->bind) free((void *) http->bind);
@@ -364,6 +1306,20 @@ static iwrc _jb_db_release(EJDB *dbp) {
   return rc;
 }
 
+/**
+ * Locks collection according to acquire mode: writers and readers use `rwl` lock,
+ * snapshot readers lock only indexes chain of collection.
+ */
+static int _jb_coll_lock(JBCOLL jbc, jb_coll_acquire_t acm) {
+  if (acm & JB_COLL_ACQUIRE_WRITE) {
+    return pthread_rwlock_wrlock(&jbc->rwl);
+  } else if (acm & JB_COLL_ACQUIRE_SNAPSHOT) {
+    return pthread_rwlock_rdlock(&jbc->slock);
+  } else {
+    return pthread_rwlock_rdlock(&jbc->rwl);
+  }
+}
+
 static iwrc _jb_coll_acquire_keeplock2(EJDB db, const char *coll, jb_coll_acquire_t acm, JBCOLL *jbcp) {
   if (strlen(coll) > EJDB_COLLECTION_NAME_MAX_LEN) {
     return EJDB_ERROR_INVALID_COLLECTION_NAME;
@@ -372,13 +1328,12 @@ static iwrc _jb_coll_acquire_keeplock2(EJDB db, const char *coll, jb_coll_acquir
   iwrc rc = 0;
   *jbcp = 0;
   JBCOLL jbc = 0;
-  bool wl = acm & JB_COLL_ACQUIRE_WRITE;
   API_RLOCK(db, rci);
   khiter_t k = kh_get(JBCOLLM, db->mcolls, coll);
   if (k != kh_end(db->mcolls)) {
     jbc = kh_value(db->mcolls, k);
     assert(jbc);
-    rci = wl ? pthread_rwlock_wrlock(&jbc->rwl) : pthread_rwlock_rdlock(&jbc->rwl);
+    rci = _jb_coll_lock(jbc, acm);
     if (rci) {
       rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
       goto finish;
@@ -394,7 +1349,7 @@ static iwrc _jb_coll_acquire_keeplock2(EJDB db, const char *coll, jb_coll_acquir
     if (k != kh_end(db->mcolls)) {
       jbc = kh_value(db->mcolls, k);
       assert(jbc);
-      rci = pthread_rwlock_rdlock(&jbc->rwl);
+      rci = _jb_coll_lock(jbc, acm);
       if (rci) {
         rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
         goto finish;
@@ -427,54 +1382,438 @@ static iwrc _jb_coll_acquire_keeplock2(EJDB db, const char *coll, jb_coll_acquir
       rc = jbl_as_buf(meta, &val.data, &val.size);
       RCGO(rc, create_finish);
 
-      key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_COLLMETA "%u", dbid);
-      if (key.size >= sizeof(keybuf)) {
-        rc = IW_ERROR_OVERFLOW;
-        goto create_finish;
-      }
-      key.data = keybuf;
-      rc = iwkv_put(db->metadb, &key, &val, IWKV_SYNC);
-      RCGO(rc, create_finish);
+      key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_COLLMETA "%u", dbid);
+      if (key.size >= sizeof(keybuf)) {
+        rc = IW_ERROR_OVERFLOW;
+        goto create_finish;
+      }
+      key.data = keybuf;
+      rc = iwkv_put(db->metadb, &key, &val, IWKV_SYNC);
+      RCGO(rc, create_finish);
+
+      jbc->db = db;
+      jbc->meta = meta;
+      rc = _jb_coll_init(jbc, 0);
+      if (rc) {
+        iwkv_del(db->metadb, &key, IWKV_SYNC);
+        goto create_finish;
+      }
+
+create_finish:
+      if (rc) {
+        if (meta) jbl_destroy(&meta);
+        if (cdb) iwkv_db_destroy(&cdb);
+        if (jbc) {
+          jbc->meta = 0; // meta was cleared
+          _jb_coll_release(jbc);
+        }
+      } else {
+        _jb_creg_publish(db);
+        rci = _jb_coll_lock(jbc, acm);
+        if (rci) {
+          rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+          goto finish;
+        }
+        *jbcp = jbc;
+      }
+    }
+  }
+
+finish:
+  if (rc) {
+    pthread_rwlock_unlock(&db->rwl);
+  }
+  return rc;
+}
+
+IW_INLINE iwrc _jb_coll_acquire_keeplock(EJDB db, const char *coll, bool wl, JBCOLL *jbcp) {
+  return _jb_coll_acquire_keeplock2(db, coll, wl ? JB_COLL_ACQUIRE_WRITE : 0, jbcp);
+}
+
+static iwrc _jb_coll_unlock(JBCOLL jbc, jb_coll_acquire_t acm) {
+  int rci = pthread_rwlock_unlock((acm & JB_COLL_ACQUIRE_SNAPSHOT) ? &jbc->slock : &jbc->rwl);
+  return rci ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci) : 0;
+}
+
+/**
+ * Acquires collection for reading without database lock.
+ * Collection is found in collections registry, on registry miss it is acquired
+ * (and created if needed) under database lock which is released then.
+ * Acquired collection must be unlocked by `_jb_coll_unlock()`.
+ */
+static iwrc _jb_coll_acquire_rd(EJDB db, const char *coll, jb_coll_acquire_t acm, JBCOLL *jbcp) {
+  int rci;
+  iwrc rc = 0;
+  *jbcp = 0;
+  ENSURE_OPEN(db);
+  // Collection found in registry is not released until reader leaves registry read section,
+  // once it is locked it is not removed until unlocked
+  uint32_t *crp = _jb_creg_enter(db);
+  JBCOLL jbc = _jb_creg_find(db, coll);
+  if (jbc) {
+    rci = _jb_coll_lock(jbc, acm);
+    if (rci) {
+      _jb_creg_leave(db, crp);
+      return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    }
+    // Collection may be removed or renamed after registry was read
+    if (!jbc->removed && !strcmp(jbc->name, coll)) {
+      _jb_creg_leave(db, crp);
+      *jbcp = jbc;
+      return 0;
+    }
+    rc = _jb_coll_unlock(jbc, acm);
+  }
+  _jb_creg_leave(db, crp);
+  RCRET(rc);
+  rc = _jb_coll_acquire_keeplock2(db, coll, acm, &jbc);
+  RCRET(rc);
+  API_UNLOCK(db, rci, rc);
+  if (rc) {
+    _jb_coll_unlock(jbc, acm);
+    return rc;
+  }
+  *jbcp = jbc;
+  return 0;
+}
+
+/**
+ * Locks collection of handle.
+ * Writers keep database lock, it is released by `API_COLL_UNLOCK`.
+ */
+static iwrc _jb_coll_handle_lock(JBCOLL jbc, jb_coll_acquire_t acm) {
+  int rci;
+  EJDB db = jbc->db;
+  if (acm & JB_COLL_ACQUIRE_WRITE) {
+    API_RLOCK(db, rci);
+  } else {
+    ENSURE_OPEN(db);
+  }
+  rci = _jb_coll_lock(jbc, acm);
+  if (rci) {
+    if (acm & JB_COLL_ACQUIRE_WRITE) {
+      pthread_rwlock_unlock(&db->rwl);
+    }
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  if (jbc->removed) {
+    _jb_coll_unlock(jbc, acm);
+    if (acm & JB_COLL_ACQUIRE_WRITE) {
+      pthread_rwlock_unlock(&db->rwl);
+    }
+    return EJDB_ERROR_COLLECTION_NOT_FOUND;
+  }
+  return 0;
+}
+
+/** Maintains record of `EJDB_IDX_COMPOSITE` index on document modification */
+static iwrc _jb_idx_composite_record_add(JBIDX idx, int64_t id, JBL jbl, JBL jblprev) {
+  uint8_t step;
+  char vnbuf[IW_VNUMBUFSZ];
+  IWKV_val key = { 0 }, keyprev = { 0 };
+  iwrc rc = 0;
+  int64_t delta = 0;
+  bool compound = idx->idbf & IWDB_COMPOUND_KEYS;
+  IWXSTR *xstr = iwxstr_new(), *xstrprev = iwxstr_new();
+
+  if (!xstr || !xstrprev) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  if (jblprev) {
+    rc = jbi_composite_fill_ikey(idx, jblprev, xstrprev, &keyprev);
+    RCGO(rc, finish);
+  }
+  if (jbl) {
+    rc = jbi_composite_fill_ikey(idx, jbl, xstr, &key);
+    RCGO(rc, finish);
+  }
+  if (key.size == keyprev.size && (!key.size || !memcmp(key.data, keyprev.data, key.size))) {
+    goto finish; // Indexed fields are not changed
+  }
+  if (keyprev.size) {
+    keyprev.compound = id;
+    rc = iwkv_del(idx->idb, &keyprev, 0);
+    if (!rc) {
+      --delta;
+    } else if (rc == IWKV_ERROR_NOTFOUND) {
+      rc = 0;
+    }
+    RCGO(rc, finish);
+  }
+  if (key.size) {
+    if (compound) {
+      key.compound = id;
+      rc = iwkv_put(idx->idb, &key, &EMPTY_VAL, IWKV_NO_OVERWRITE);
+      if (!rc) {
+        ++delta;
+      } else if (rc == IWKV_ERROR_KEY_EXISTS) {
+        rc = 0;
+      }
+    } else {
+      IW_SETVNUMBUF64(step, vnbuf, id);
+      IWKV_val idval = {
+        .data = vnbuf,
+        .size = step
+      };
+      rc = iwkv_put(idx->idb, &key, &idval, IWKV_NO_OVERWRITE);
+      if (!rc) {
+        ++delta;
+      } else if (rc == IWKV_ERROR_KEY_EXISTS) {
+        rc = EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED;
+      }
+    }
+  }
+
+finish:
+  iwxstr_destroy(xstr);
+  iwxstr_destroy(xstrprev);
+  if (delta && !_jb_meta_nrecs_update(idx->jbc->db, idx->dbid, delta)) {
+    idx->rnum += delta;
+  }
+  return rc;
+}
+
+/**
+ * Excludes documents not matched by filter of partial index.
+ * Such documents have no index records.
+ */
+static iwrc _jb_idx_filter_apply(JBIDX idx, JBL *jblp, JBL *jblprevp) {
+  bool matched;
+  iwrc rc = 0;
+  if (*jblp) {
+    rc = jql_matched(idx->fq, *jblp, &matched);
+    RCRET(rc);
+    if (!matched) {
+      *jblp = 0;
+    }
+  }
+  if (*jblprevp) {
+    rc = jql_matched(idx->fq, *jblprevp, &matched);
+    RCRET(rc);
+    if (!matched) {
+      *jblprevp = 0;
+    }
+  }
+  return rc;
+}
+
+/** Sorted set of index keys of field value */
+struct _JBIKS {
+  IWXSTR *buf;              /**< Keys data */
+  IWKV_val *keys;           /**< Sorted unique keys pointing into `buf` */
+  size_t num;               /**< Number of keys */
+};
+
+static void _jb_iks_release(struct _JBIKS *ks) {
+  iwxstr_destroy(ks->buf);
+  free(ks->keys);
+}
+
+static int _jb_iks_cmp(const void *o1, const void *o2) {
+  const IWKV_val *k1 = o1, *k2 = o2;
+  int rv = memcmp(k1->data, k2->data, MIN(k1->size, k2->size));
+  if (!rv) {
+    rv = k1->size > k2->size ? 1 : k1->size < k2->size ? -1 : 0;
+  }
+  return rv;
+}
+
+static iwrc _jb_iks_key_add(const char *data, size_t size, void *op) {
+  struct _JBIKS *ks = op;
+  iwrc rc = iwxstr_cat(ks->buf, &size, sizeof(size));
+  RCRET(rc);
+  rc = iwxstr_cat(ks->buf, data, size);
+  RCRET(rc);
+  ks->num++;
+  return 0;
+}
+
+static iwrc _jb_iks_add(JBIDX idx, JBL jbv, struct _JBIKS *ks) {
+  IWKV_val key;
+  char numbuf[JBNUMBUF_SIZE];
+  if (idx->mode & EJDB_IDX_FTS) { // Every word of text is a separate key
+    return jbi_fts_jbl_visit(jbv, _jb_iks_key_add, ks);
+  }
+  jbi_jbl_fill_ikey(idx, jbv, &key, numbuf);
+  if (!key.size) {
+    return 0;
+  }
+  return _jb_iks_key_add(key.data, key.size, ks);
+}
+
+/**
+ * Fills set of index keys of field value `jbv`.
+ * Elements of array are read directly from binn, every element is a separate key.
+ */
+static iwrc _jb_iks_fill(JBIDX idx, JBL jbv, struct _JBIKS *ks) {
+  iwrc rc = 0;
+  if (!jbv) {
+    return 0;
+  }
+  ks->buf = iwxstr_new();
+  if (!ks->buf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  if (jbl_type(jbv) == JBV_ARRAY) {
+    JBL_iterator it;
+    struct _JBL holder;
+    rc = jbl_iterator_init(jbv, &it);
+    RCRET(rc);
+    while (jbl_iterator_next(&it, &holder, 0, 0)) {
+      rc = _jb_iks_add(idx, &holder, ks);
+      RCRET(rc);
+    }
+  } else {
+    rc = _jb_iks_add(idx, jbv, ks);
+    RCRET(rc);
+  }
+  if (!ks->num) {
+    return 0;
+  }
+  ks->keys = malloc(ks->num * sizeof(ks->keys[0]));
+  if (!ks->keys) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  char *rp = iwxstr_ptr(ks->buf);
+  for (size_t i = 0; i < ks->num; ++i) {
+    memcpy(&ks->keys[i].size, rp, sizeof(ks->keys[i].size));
+    ks->keys[i].data = rp + sizeof(ks->keys[i].size);
+    rp += sizeof(ks->keys[i].size) + ks->keys[i].size;
+  }
+  qsort(ks->keys, ks->num, sizeof(ks->keys[0]), _jb_iks_cmp);
+  size_t num = 1;
+  for (size_t i = 1; i < ks->num; ++i) { // Remove keys of duplicated elements
+    if (_jb_iks_cmp(&ks->keys[num - 1], &ks->keys[i])) {
+      ks->keys[num++] = ks->keys[i];
+    }
+  }
+  ks->num = num;
+  return 0;
+}
+
+/**
+ * Updates records of non unique index if array is stored in indexed field before or after modification.
+ * Only records of added and removed array elements are touched.
+ * Also used by `EJDB_IDX_FTS` index to update records of added and removed words of text.
+ */
+static iwrc _jb_idx_array_record_add(JBIDX idx, int64_t id, JBL jbv, JBL jbvprev) {
+  int64_t delta = 0; // delta of added/removed index records
+  struct _JBIKS ks = { 0 }, ksprev = { 0 };
 
-      jbc->db = db;
-      jbc->meta = meta;
-      rc = _jb_coll_init(jbc, 0);
-      if (rc) {
-        iwkv_del(db->metadb, &key, IWKV_SYNC);
-        goto create_finish;
-      }
+  iwrc rc = _jb_iks_fill(idx, jbv, &ks);
+  RCGO(rc, finish);
+  rc = _jb_iks_fill(idx, jbvprev, &ksprev);
+  RCGO(rc, finish);
 
-create_finish:
-      if (rc) {
-        if (meta) jbl_destroy(&meta);
-        if (cdb) iwkv_db_destroy(&cdb);
-        if (jbc) {
-          jbc->meta = 0; // meta was cleared
-          _jb_coll_release(jbc);
-        }
-      } else {
-        rci = wl ? pthread_rwlock_wrlock(&jbc->rwl) : pthread_rwlock_rdlock(&jbc->rwl);
-        if (rci) {
-          rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
-          goto finish;
-        }
-        *jbcp = jbc;
+  for (size_t i = 0, j = 0; i < ks.num || j < ksprev.num; ) {
+    IWKV_val key;
+    int cv = (i == ks.num) ? 1 : (j == ksprev.num) ? -1 : _jb_iks_cmp(&ks.keys[i], &ksprev.keys[j]);
+    if (!cv) { // Element is not changed
+      ++i, ++j;
+      continue;
+    }
+    if (cv < 0) { // Added element
+      key = ks.keys[i++];
+      key.compound = id;
+      rc = iwkv_put(idx->idb, &key, &EMPTY_VAL, IWKV_NO_OVERWRITE);
+      if (!rc) {
+        ++delta;
+      } else if (rc == IWKV_ERROR_KEY_EXISTS) {
+        rc = 0;
+      }
+    } else { // Removed element
+      key = ksprev.keys[j++];
+      key.compound = id;
+      rc = iwkv_del(idx->idb, &key, 0);
+      if (!rc) {
+        --delta;
+      } else if (rc == IWKV_ERROR_NOTFOUND) {
+        rc = 0;
       }
     }
+    RCBREAK(rc);
   }
 
 finish:
-  if (rc) {
-    pthread_rwlock_unlock(&db->rwl);
+  _jb_iks_release(&ks);
+  _jb_iks_release(&ksprev);
+  if (delta && !_jb_meta_nrecs_update(idx->jbc->db, idx->dbid, delta)) {
+    idx->rnum += delta;
   }
   return rc;
 }
 
-IW_INLINE iwrc _jb_coll_acquire_keeplock(EJDB db, const char *coll, bool wl, JBCOLL *jbcp) {
-  return _jb_coll_acquire_keeplock2(db, coll, wl ? JB_COLL_ACQUIRE_WRITE : 0, jbcp);
+/** Saves index meta into metadb */
+static iwrc _jb_idx_meta_save(JBIDX idx, const char *path) {
+  IWKV_val key, val;
+  JBCOLL jbc = idx->jbc;
+  char keybuf[sizeof(KEY_PREFIX_IDXMETA) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: i.<coldbid>.<idxdbid>
+  iwrc rc = 0;
+  binn *imeta = binn_object();
+  if (!imeta) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  if (!binn_object_set_str(imeta, "ptr", path) ||
+      !binn_object_set_uint32(imeta, "mode", idx->mode) ||
+      !binn_object_set_uint32(imeta, "idbf", idx->idbf) ||
+      !binn_object_set_uint32(imeta, "dbid", idx->dbid) ||
+      (idx->cnum && !binn_object_set_uint32(imeta, "ckv", idx->ckv)) ||
+      !binn_object_set_uint32(imeta, "coerced", idx->coerced) ||
+      (idx->fqs && !binn_object_set_str(imeta, "filter", idx->fqs))) {
+    rc = JBL_ERROR_CREATION;
+    goto finish;
+  }
+
+  key.data = keybuf;
+  // Full key format: i.<coldbid>.<idxdbid>
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXMETA "%u" "." "%u", jbc->dbid, idx->dbid);
+  if (key.size >= sizeof(keybuf)) {
+    rc = IW_ERROR_OVERFLOW;
+    goto finish;
+  }
+  val.data = binn_ptr(imeta);
+  val.size = binn_size(imeta);
+  rc = iwkv_put(jbc->db->metadb, &key, &val, 0);
+
+finish:
+  binn_free(imeta);
+  return rc;
 }
 
-static iwrc _jb_idx_record_add(JBIDX idx, int64_t id, JBL jbl, JBL jblprev) {
+/**
+ * Saves meta of published index once maintenance marked it as having coerced keys.
+ * Meta of index being built is saved when it is published.
+ */
+static iwrc _jb_idx_coerced_save(JBIDX idx) {
+  JBIDX eidx = idx->jbc->idx;
+  for ( ; eidx && eidx != idx; eidx = eidx->next);
+  if (!eidx) {
+    return 0;
+  }
+  IWXSTR *xstr = iwxstr_new();
+  if (!xstr) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  iwrc rc = jbi_idx_ptr_serialize(idx, xstr);
+  if (!rc) {
+    rc = _jb_idx_meta_save(idx, iwxstr_ptr(xstr));
+  }
+  iwxstr_destroy(xstr);
+  return rc;
+}
+
+static iwrc _jb_idx_record_put(JBIDX idx, int64_t id, JBL jbl, JBL jblprev) {
+  if (idx->fq) {
+    iwrc rc = _jb_idx_filter_apply(idx, &jbl, &jblprev);
+    RCRET(rc);
+    if (!jbl && !jblprev) {
+      return 0;
+    }
+  }
+  if (idx->cnum) {
+    return _jb_idx_composite_record_add(idx, id, jbl, jblprev);
+  }
   IWKV_val key;
   uint8_t step;
   char vnbuf[IW_VNUMBUFSZ];
@@ -485,7 +1824,6 @@ static iwrc _jb_idx_record_add(JBIDX idx, int64_t id, JBL jbl, JBL jblprev) {
   jbl_type_t jbv_type, jbvprev_type;
 
   iwrc rc = 0;
-  IWPOOL *pool = 0;
   int64_t delta = 0; // delta of added/removed index records
   bool compound = idx->idbf & IWDB_COMPOUND_KEYS;
 
@@ -505,168 +1843,283 @@ static iwrc _jb_idx_record_add(JBIDX idx, int64_t id, JBL jbl, JBL jblprev) {
     jbv_found = false;
   }
 
-  if (compound
-      && jbv_type == jbvprev_type
-      && jbvprev_type == JBV_ARRAY) { // compare next/prev obj arrays
-    pool = iwpool_create(1024);
-    if (!pool) {
-      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-      goto finish;
-    }
-    JBL_NODE jbvprev_node, jbv_node;
-    rc = jbl_to_node(&jbv, &jbv_node, pool);
-    RCGO(rc, finish);
-    jbv.node = jbv_node;
-
-    rc = jbl_to_node(&jbvprev, &jbvprev_node, pool);
-    RCGO(rc, finish);
-    jbvprev.node = jbvprev_node;
-
-    if (_jbl_compare_nodes(jbv_node, jbvprev_node, &rc) == 0) {
-      goto finish; // Arrays are equal or error
-    }
+  if (compound && (jbv_type == JBV_ARRAY || jbvprev_type == JBV_ARRAY)) {
+    return _jb_idx_array_record_add(idx, id, jbv_found ? &jbv : 0, jbvprev_found ? &jbvprev : 0);
   } else if (_jbl_is_eq_atomic_values(&jbv, &jbvprev)) {
     return 0;
-  }
-
-  if (jbvprev_found) { // Remove old index elements
-    if (jbvprev_type == JBV_ARRAY) { // TODO: array modification delta?
-      JBL_NODE n;
-      if (!pool) {
-        pool = iwpool_create(1024);
-        if (!pool) {
-          rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-        }
+  } else if (idx->mode & EJDB_IDX_FTS) {
+    return _jb_idx_array_record_add(idx, id, jbv_found ? &jbv : 0, jbvprev_found ? &jbvprev : 0);
+  }
+
+  if (jbvprev_found) { // Remove old index record
+    jbi_jbl_fill_ikey(idx, &jbvprev, &key, numbuf);
+    if (key.size) {
+      key.compound = id;
+      rc = iwkv_del(idx->idb, &key, 0);
+      if (!rc) {
+        --delta;
+      } else if (rc == IWKV_ERROR_NOTFOUND) {
+        rc = 0;
       }
-      rc = jbl_to_node(&jbvprev, &n, pool);
       RCGO(rc, finish);
-      for (n = n->child; n; n = n->next) {
-        jbi_node_fill_ikey(idx, n, &key, numbuf);
-        if (key.size) {
-          key.compound = id;
-          rc = iwkv_del(idx->idb, &key, 0);
-          if (!rc) {
-            --delta;
-          } else if (rc == IWKV_ERROR_NOTFOUND) {
-            rc = 0;
-          }
-          RCGO(rc, finish);
-        }
-      }
-    } else {
-      jbi_jbl_fill_ikey(idx, &jbvprev, &key, numbuf);
-      if (key.size) {
-        key.compound = id;
-        rc = iwkv_del(idx->idb, &key, 0);
-        if (!rc) {
-          --delta;
-        } else if (rc == IWKV_ERROR_NOTFOUND) {
-          rc = 0;
-        }
-        RCGO(rc, finish);
-      }
     }
   }
 
   if (jbv_found) { // Add index record
-    if (jbv_type == JBV_ARRAY) { // TODO: array modification delta?
-      JBL_NODE n;
-      if (!pool) {
-        pool = iwpool_create(1024);
-        if (!pool) {
-          rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-        }
-      }
-      rc = jbl_to_node(&jbv, &n, pool);
-      RCGO(rc, finish);
-      for (n = n->child; n; n = n->next) {
-        jbi_node_fill_ikey(idx, n, &key, numbuf);
-        if (key.size) {
-          key.compound = id;
-          rc = iwkv_put(idx->idb, &key, &EMPTY_VAL, IWKV_NO_OVERWRITE);
-          if (!rc) {
-            ++delta;
-          } else if (rc == IWKV_ERROR_KEY_EXISTS) {
-            rc = 0;
-          } else {
-            goto finish;
-          }
+    jbi_jbl_fill_ikey(idx, &jbv, &key, numbuf);
+    if (key.size) {
+      if (compound) {
+        key.compound = id;
+        rc = iwkv_put(idx->idb, &key, &EMPTY_VAL, IWKV_NO_OVERWRITE);
+        if (!rc) {
+          ++delta;
+        } else if (rc == IWKV_ERROR_KEY_EXISTS) {
+          rc = 0;
         }
-      }
-    } else {
-      jbi_jbl_fill_ikey(idx, &jbv, &key, numbuf);
-      if (key.size) {
-        if (compound) {
-          key.compound = id;
-          rc = iwkv_put(idx->idb, &key, &EMPTY_VAL, IWKV_NO_OVERWRITE);
-          if (!rc) {
-            ++delta;
-          } else if (rc == IWKV_ERROR_KEY_EXISTS) {
-            rc = 0;
-          }
-        } else {
-          IW_SETVNUMBUF64(step, vnbuf, id);
-          IWKV_val idval = {
-            .data = vnbuf,
-            .size = step
-          };
-          rc = iwkv_put(idx->idb, &key, &idval, IWKV_NO_OVERWRITE);
-          if (!rc) {
-            ++delta;
-          } else if (rc == IWKV_ERROR_KEY_EXISTS) {
-            rc = EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED;
-            goto finish;
-          }
+      } else {
+        IW_SETVNUMBUF64(step, vnbuf, id);
+        IWKV_val idval = {
+          .data = vnbuf,
+          .size = step
+        };
+        rc = iwkv_put(idx->idb, &key, &idval, IWKV_NO_OVERWRITE);
+        if (!rc) {
+          ++delta;
+        } else if (rc == IWKV_ERROR_KEY_EXISTS) {
+          rc = EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED;
         }
       }
     }
   }
 
 finish:
-  if (pool) {
-    iwpool_destroy(pool);
-  }
   if (delta && !_jb_meta_nrecs_update(idx->jbc->db, idx->dbid, delta)) {
     idx->rnum += delta;
   }
   return rc;
 }
 
+static iwrc _jb_idx_record_add(JBIDX idx, int64_t id, JBL jbl, JBL jblprev) {
+  bool coerced = idx->coerced;
+  iwrc rc = _jb_idx_record_put(idx, id, jbl, jblprev);
+  if (!rc && !coerced && idx->coerced) {
+    rc = _jb_idx_coerced_save(idx);
+  }
+  return rc;
+}
+
 IW_INLINE iwrc _jb_idx_record_remove(JBIDX idx, int64_t id, JBL jbl) {
   return _jb_idx_record_add(idx, id, 0, jbl);
 }
 
+/**
+ * Applies document modification to indexes being built online
+ * if document is already visited by index build.
+ * Errors are kept in `idx->build_rc` and abort the build, not the modification.
+ */
+static void _jb_idx_build_record_add(JBCOLL jbc, int64_t id, JBL jbl, JBL jblprev) {
+  for (JBIDX idx = jbc->bidx; idx; idx = idx->next) {
+    if (idx->build_fenced && id <= idx->build_fence && !idx->build_rc) {
+      idx->build_rc = _jb_idx_record_add(idx, id, jbl, jblprev);
+    }
+  }
+}
+
+/**
+ * Fills empty index with records of all collection documents.
+ * Index records are extracted in parallel, sorted and put into index in ascending order of keys.
+ */
 static iwrc _jb_idx_fill(JBIDX idx) {
-  IWKV_cursor cur;
-  IWKV_val key, val;
-  struct _JBL jbs;
-  int64_t llv;
-  JBL jbl = &jbs;
+  int64_t rnum = 0;
+  iwrc rc = jbi_idx_load(idx, jbi_idx_load_threads(idx), &rnum);
+  if (rnum && !_jb_meta_nrecs_update(idx->jbc->db, idx->dbid, rnum)) {
+    idx->rnum += rnum;
+  }
+  return rc;
+}
 
-  iwrc rc = iwkv_cursor_open(idx->jbc->cdb, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
-  while (!rc) {
-    rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT);
-    if (rc == IWKV_ERROR_NOTFOUND) {
-      rc = 0;
-      break;
+/**
+ * Removes document versions not visible to any open snapshot.
+ * Called under `jbc->vlock` write lock.
+ */
+static void _jb_snapshot_gc(JBCOLL jbc) {
+  uint64_t ver = jbc->ver;
+  for (struct _JBSNAP *snap = jbc->snaps; snap; snap = snap->next) {
+    if (snap->ver < ver) {
+      ver = snap->ver;
     }
-    rc = iwkv_cursor_get(cur, &key, &val);
-    RCBREAK(rc);
-    if (!binn_load(val.data, &jbs.bn)) {
-      rc = JBL_ERROR_CREATION;
-      break;
+  }
+  if (ver <= jbc->gcver) {
+    return;
+  }
+  jbc->gcver = ver;
+  for (khiter_t k = kh_begin(jbc->dvers); k != kh_end(jbc->dvers); ++k) {
+    if (!kh_exist(jbc->dvers, k)) continue;
+    struct _JBDVER **vp = &kh_value(jbc->dvers, k);
+    while (*vp && (*vp)->ver > ver) {
+      vp = &(*vp)->next;
+    }
+    for (struct _JBDVER *v = *vp, *nv; v; v = nv) {
+      nv = v->next;
+      free(v);
+    }
+    *vp = 0;
+    if (!kh_value(jbc->dvers, k)) {
+      kh_del(JBDVERS, jbc->dvers, k);
     }
-    memcpy(&llv, key.data, sizeof(llv));
-    rc = _jb_idx_record_add(idx, llv, jbl, 0);
-    iwkv_kv_dispose(&key, &val);
   }
-  IWRC(iwkv_cursor_close(&cur), rc);
+}
+
+/**
+ * Keeps document state before the first modification made by current writer.
+ * Zero `size` means the document did not exist.
+ * Called under `jbc->vlock` write lock.
+ */
+static iwrc _jb_snapshot_record(JBCOLL jbc, int64_t id, const void *data, size_t size) {
+  int ret;
+  uint64_t ver = jbc->ver + 1;
+  khiter_t k = kh_put(JBDVERS, jbc->dvers, id, &ret);
+  if (ret < 0) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  } else if (ret == 0 && kh_value(jbc->dvers, k)->ver == ver) {
+    return 0; // Document is already modified by this writer
+  } else if (ret > 0) {
+    kh_value(jbc->dvers, k) = 0;
+  }
+  struct _JBDVER *v = malloc(sizeof(*v) + size);
+  if (!v) {
+    if (!kh_value(jbc->dvers, k)) {
+      kh_del(JBDVERS, jbc->dvers, k);
+    }
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  v->ver = ver;
+  v->size = size;
+  if (size) {
+    memcpy(v->data, data, size);
+  }
+  v->next = kh_value(jbc->dvers, k);
+  kh_value(jbc->dvers, k) = v;
+  jbc->vpending = true;
+  return 0;
+}
+
+/**
+ * Write lock of document versions held by writer during document modification
+ * if database is opened with `EJDB_OPTS.snapshot_reads`.
+ */
+IW_INLINE iwrc _jb_snapshot_wlock(JBCOLL jbc) {
+  if (!jbc->db->opts.snapshot_reads) {
+    return 0;
+  }
+  int rci = pthread_rwlock_wrlock(&jbc->vlock);
+  return rci ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci) : 0;
+}
+
+IW_INLINE iwrc _jb_snapshot_unlock(JBCOLL jbc) {
+  if (!jbc->db->opts.snapshot_reads) {
+    return 0;
+  }
+  int rci = pthread_rwlock_unlock(&jbc->vlock);
+  return rci ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci) : 0;
+}
+
+void jb_snapshot_commit(JBCOLL jbc) {
+  pthread_rwlock_wrlock(&jbc->vlock);
+  ++jbc->ver;
+  jbc->vpending = false;
+  _jb_snapshot_gc(jbc);
+  pthread_rwlock_unlock(&jbc->vlock);
+}
+
+static iwrc _jb_snapshot_open(JBCOLL jbc, struct _JBSNAP *snap) {
+  snap->ids = kh_init(JBIDS);
+  if (!snap->ids) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  int rci = pthread_rwlock_wrlock(&jbc->vlock);
+  if (rci) {
+    kh_destroy(JBIDS, snap->ids);
+    snap->ids = 0;
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  snap->ver = jbc->ver;
+  snap->next = jbc->snaps;
+  jbc->snaps = snap;
+  pthread_rwlock_unlock(&jbc->vlock);
+  return 0;
+}
+
+/**
+ * Reads document from documents cache or from collection database.
+ * Cache entry is returned in `ep` on cache hit, otherwise document data is returned in `val`.
+ */
+static iwrc _jb_doc_get(JBCOLL jbc, IWKV_val *key, IWKV_val *val, struct _JBDCE **ep) {
+  int64_t id = *(int64_t *) key->data;
+  *ep = jb_dcache_acquire(jbc, id);
+  if (*ep) {
+    return 0;
+  }
+  iwrc rc = iwkv_get(jbc->cdb, key, val);
+  RCRET(rc);
+  rc = jb_doc_unpack_val(jbc, val);
+  if (!rc) {
+    jb_dcache_put(jbc, id, val->data, val->size);
+  }
+  return rc;
+}
+
+/**
+ * Reads the last committed version of document.
+ */
+static iwrc _jb_snapshot_get(JBCOLL jbc, IWKV_val *key, IWKV_val *val, struct _JBDCE **ep) {
+  iwrc rc = 0;
+  int rci = pthread_rwlock_rdlock(&jbc->vlock);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  struct _JBDVER *v = jbi_snapshot_version(jbc, *(int64_t *) key->data, jbc->ver);
+  if (v) {
+    if (v->size) {
+      val->data = malloc(v->size);
+      if (val->data) {
+        memcpy(val->data, v->data, v->size);
+        val->size = v->size;
+      } else {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      }
+    } else {
+      rc = IWKV_ERROR_NOTFOUND;
+    }
+  } else {
+    // Cached documents are replaced by writers under versions lock
+    rc = _jb_doc_get(jbc, key, val, ep);
+  }
+  pthread_rwlock_unlock(&jbc->vlock);
   return rc;
 }
 
+static void _jb_snapshot_close(JBCOLL jbc, struct _JBSNAP *snap) {
+  if (!snap->ids) {
+    return;
+  }
+  pthread_rwlock_wrlock(&jbc->vlock);
+  for (struct _JBSNAP **sp = &jbc->snaps; *sp; sp = &(*sp)->next) {
+    if (*sp == snap) {
+      *sp = snap->next;
+      break;
+    }
+  }
+  _jb_snapshot_gc(jbc);
+  pthread_rwlock_unlock(&jbc->vlock);
+  kh_destroy(JBIDS, snap->ids);
+  snap->ids = 0;
+}
+
 // Used to avoid deadlocks within a `iwkv_put` context
 static iwrc _jb_put_handler_after(iwrc rc, struct _JBPHCTX *ctx) {
   IWKV_val *oldval = &ctx->oldval;
+  _jb_dcache_invalidate(ctx->jbc, ctx->id);
   if (rc) {
     if (oldval->size) {
       iwkv_val_dispose(oldval);
@@ -675,15 +2128,22 @@ static iwrc _jb_put_handler_after(iwrc rc, struct _JBPHCTX *ctx) {
   }
   JBL prev;
   struct _JBL jblprev;
+  JBIDX fail_idx = 0;
   JBCOLL jbc = ctx->jbc;
+  if (jbc->db->opts.snapshot_reads) {
+    rc = _jb_snapshot_record(jbc, ctx->id, oldval->data, oldval->size);
+    if (rc) {
+      fail_idx = jbc->idx; // No index records are added
+      goto finish;
+    }
+  }
   if (oldval->size) {
     rc = jbl_from_buf_keep_onstack(&jblprev, oldval->data, oldval->size);
-    RCRET(rc);
+    RCGO(rc, finish);
     prev = &jblprev;
   } else {
     prev = 0;
   }
-  JBIDX fail_idx = 0;
   for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
     rc = _jb_idx_record_add(idx, ctx->id, ctx->jbl, prev);
     if (rc) {
@@ -691,6 +2151,7 @@ static iwrc _jb_put_handler_after(iwrc rc, struct _JBPHCTX *ctx) {
       goto finish;
     }
   }
+  _jb_idx_build_record_add(jbc, ctx->id, ctx->jbl, prev);
   if (!prev) {
     _jb_meta_nrecs_update(jbc->db, jbc->dbid, 1);
     jbc->rnum += 1;
@@ -711,14 +2172,29 @@ finish:
   return rc;
 }
 
+/**
+ * Takes previous document value before it is replaced.
+ * Value is decompressed and checked here, so put is aborted if previous document
+ * cannot be read and its index records cannot be updated.
+ */
 static iwrc _jb_put_handler(const IWKV_val *key, const IWKV_val *val, IWKV_val *oldval, void *op) {
   struct _JBPHCTX *ctx = op;
   if (oldval && oldval->size) {
+    struct _JBL jblprev;
     memcpy(&ctx->oldval, oldval, sizeof(*oldval));
+    iwrc rc = jb_doc_unpack_val(ctx->jbc, &ctx->oldval);
+    RCRET(rc);
+    return jbl_from_buf_keep_onstack(&jblprev, ctx->oldval.data, ctx->oldval.size);
   }
   return 0;
 }
 
+static iwrc _jb_noop_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  return 0;
+}
+
+static iwrc _jb_exec_list_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step);
+
 static iwrc _jb_exec_scan_init(JBEXEC *ctx) {
   ctx->istep = 1;
   ctx->jblbufsz = ctx->jbc->db->opts.document_buffer_sz;
@@ -730,16 +2206,36 @@ static iwrc _jb_exec_scan_init(JBEXEC *ctx) {
   iwrc rc = jbi_selection(ctx);
   RCRET(rc);
   if (ctx->midx.idx) {
-    if (ctx->midx.idx->idbf & IWDB_COMPOUND_KEYS) {
+    if (ctx->midx.idx->cnum) {
+      ctx->scanner = jbi_composite_scanner;
+    } else if (ctx->midx.idx->mode & EJDB_IDX_FTS) {
+      ctx->scanner = jbi_fts_scanner;
+    } else if (ctx->midx.idx->idbf & IWDB_COMPOUND_KEYS) {
       ctx->scanner = jbi_dup_scanner;
     } else {
       ctx->scanner = jbi_uniq_scanner;
     }
+    if ((jql_has_aggregate_count(ctx->ux->q) || ctx->ux->visitor == _jb_noop_visitor)
+        && jbi_index_covered(ctx)) {
+      ctx->index_only = true;
+      if (ctx->ux->log) {
+        iwxstr_cat2(ctx->ux->log, "[INDEX] ONLY\n");
+      }
+    }
+  } else if (ctx->iunion.num) {
+    ctx->scanner = jbi_union_scanner;
   } else {
     ctx->scanner = jbi_full_scanner;
     if (ctx->ux->log) {
       iwxstr_cat2(ctx->ux->log, "[INDEX] NO");
     }
+    ctx->parallel = jbi_parallel_threads(ctx);
+    if (ctx->parallel) {
+      ctx->scanner = jbi_parallel_scanner;
+      if (ctx->ux->log) {
+        iwxstr_printf(ctx->ux->log, " [PARALLEL] %u", ctx->parallel);
+      }
+    }
   }
   return 0;
 }
@@ -748,25 +2244,84 @@ static void _jb_exec_scan_release(JBEXEC *ctx) {
   if (ctx->jblbuf) {
     free(ctx->jblbuf);
   }
+  free(ctx->zbuf);
+  jbi_isect_release(ctx);
+  if (ctx->iunion.midx) {
+    free(ctx->iunion.midx);
+  }
 }
 
-static iwrc _jb_noop_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
-  return 0;
+/**
+ * Allocates id of new document.
+ * Ids may be allocated without collection lock, id is not reused if document is not stored.
+ */
+IW_INLINE int64_t _jb_id_next(JBCOLL jbc) {
+  return __atomic_add_fetch(&jbc->id_seq, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Advances ids sequence up to document `id` stored by user.
+ * Called before document is stored, so new documents are not given this id afterwards.
+ */
+IW_INLINE void _jb_id_seq_update(JBCOLL jbc, int64_t id) {
+  int64_t seq = __atomic_load_n(&jbc->id_seq, __ATOMIC_RELAXED);
+  while (seq < id && !__atomic_compare_exchange_n(&jbc->id_seq, &seq, id, true,
+                                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Stores document `jbl` serialized into `val`.
+ * If `oidp` is set document is new and never replaces stored one: its id allocated without collection lock
+ * may be taken meanwhile by document stored with explicit id, then the next id is allocated.
+ */
+IW_INLINE iwrc _jb_put_val_impl(JBCOLL jbc, JBL jbl, IWKV_val *val, int64_t id, int64_t *oidp) {
+  IWKV_val key = {
+    .data = &id,
+    .size = sizeof(id)
+  };
+  struct _JBPHCTX pctx = {
+    .id = id,
+    .jbc = jbc,
+    .jbl = jbl
+  };
+  void *zbuf;
+  iwrc rc = _jb_doc_pack(jbc, val, &zbuf);
+  RCRET(rc);
+  rc = _jb_snapshot_wlock(jbc);
+  RCGO(rc, finish);
+  if (oidp) {
+    while ((rc = iwkv_puth(jbc->cdb, &key, val, IWKV_NO_OVERWRITE, _jb_put_handler, &pctx))
+           == IWKV_ERROR_KEY_EXISTS) {
+      id = _jb_id_next(jbc);
+      pctx.id = id;
+    }
+    if (!rc) {
+      *oidp = id;
+    }
+  } else {
+    rc = iwkv_puth(jbc->cdb, &key, val, 0, _jb_put_handler, &pctx);
+  }
+  rc = _jb_put_handler_after(rc, &pctx);
+  IWRC(_jb_snapshot_unlock(jbc), rc);
+
+finish:
+  free(zbuf);
+  return rc;
+}
+
+IW_INLINE iwrc _jb_put_impl(JBCOLL jbc, JBL jbl, int64_t id) {
+  IWKV_val val;
+  iwrc rc = jbl_as_buf(jbl, &val.data, &val.size);
+  RCRET(rc);
+  return _jb_put_val_impl(jbc, jbl, &val, id, 0);
 }
 
-IW_INLINE iwrc _jb_put_impl(JBCOLL jbc, JBL jbl, int64_t id) {
-  IWKV_val val, key = {
-    .data = &id,
-    .size = sizeof(id)
-  };
-  struct _JBPHCTX pctx = {
-    .id = id,
-    .jbc = jbc,
-    .jbl = jbl
-  };
+/** Stores new document `jbl` and sets its id into `oidp` */
+IW_INLINE iwrc _jb_put_new_impl(JBCOLL jbc, JBL jbl, int64_t *oidp) {
+  IWKV_val val;
   iwrc rc = jbl_as_buf(jbl, &val.data, &val.size);
   RCRET(rc);
-  return _jb_put_handler_after(iwkv_puth(jbc->cdb, &key, &val, 0, _jb_put_handler, &pctx), &pctx);
+  return _jb_put_val_impl(jbc, jbl, &val, _jb_id_next(jbc), oidp);
 }
 
 iwrc jb_put(JBCOLL jbc, JBL jbl, int64_t id) {
@@ -780,9 +2335,19 @@ iwrc jb_cursor_set(JBCOLL jbc, IWKV_cursor cur, int64_t id, JBL jbl) {
     .jbc = jbc,
     .jbl = jbl
   };
+  void *zbuf;
   iwrc rc = jbl_as_buf(jbl, &val.data, &val.size);
   RCRET(rc);
-  return _jb_put_handler_after(iwkv_cursor_seth(cur, &val, 0, _jb_put_handler, &pctx), &pctx);
+  rc = _jb_doc_pack(jbc, &val, &zbuf);
+  RCRET(rc);
+  rc = _jb_snapshot_wlock(jbc);
+  RCGO(rc, finish);
+  rc = _jb_put_handler_after(iwkv_cursor_seth(cur, &val, 0, _jb_put_handler, &pctx), &pctx);
+  IWRC(_jb_snapshot_unlock(jbc), rc);
+
+finish:
+  free(zbuf);
+  return rc;
 }
 
 //----------------------- Public API
@@ -793,6 +2358,7 @@ iwrc ejdb_exec(EJDB_EXEC *ux) {
   }
   int rci;
   iwrc rc = 0;
+  struct JQP_PROJECTION *projection = ux->q->aux->projection;
   if (!ux->visitor) {
     ux->visitor = _jb_noop_visitor;
     ux->q->aux->projection = 0; // Actually we don't need projection if exists
@@ -804,45 +2370,195 @@ iwrc ejdb_exec(EJDB_EXEC *ux) {
   JBEXEC ctx = {
     .ux = ux
   };
+  struct _JBSNAP snap = { 0 };
+  // Queries without modifications are not blocked by collection writers in snapshot read mode
+  bool snapshot = ux->db->opts.snapshot_reads && !jql_has_apply(ux->q);
   if (ux->limit < 1) {
     rc = jql_get_limit(ux->q, &ux->limit);
-    RCRET(rc);
+    RCGO(rc, finish_query);
     if (ux->limit < 1) {
       ux->limit = INT64_MAX;
     }
   }
   if (ux->skip < 1) {
     rc = jql_get_skip(ux->q, &ux->skip);
-    RCRET(rc);
+    RCGO(rc, finish_query);
   }
   rc = _jb_coll_acquire_keeplock2(ux->db, ux->q->coll,
-                                  jql_has_apply(ux->q) ? JB_COLL_ACQUIRE_WRITE : JB_COLL_ACQUIRE_EXISTING,
+                                  jql_has_apply(ux->q) ? JB_COLL_ACQUIRE_WRITE
+                                  : snapshot ? JB_COLL_ACQUIRE_EXISTING | JB_COLL_ACQUIRE_SNAPSHOT
+                                  : JB_COLL_ACQUIRE_EXISTING,
                                   &ctx.jbc);
   if (rc == IW_ERROR_NOT_EXISTS) {
-    return 0;
-  } else RCRET(rc);
+    rc = 0;
+    goto finish_query;
+  } else RCGO(rc, finish_query);
 
+  if (snapshot) {
+    rc = _jb_snapshot_open(ctx.jbc, &snap);
+    RCGO(rc, finish);
+    ctx.snap = &snap;
+  }
   rc = _jb_exec_scan_init(&ctx);
   RCGO(rc, finish);
+  if (ctx.snap && ux->q->aux->orderby_num) {
+    // Documents modified after snapshot are passed at the end of scan, index order is not kept
+    ctx.sorting = true;
+  }
   if (ctx.sorting) {
+    if (ux->limit <= JB_SORT_TOPK_MAX_ROWS && ux->skip <= JB_SORT_TOPK_MAX_ROWS - ux->limit
+        // Visitors of application may move over sorted result set by any `step`
+        && (ux->visitor == _jb_noop_visitor || ux->visitor == _jb_exec_list_visitor)) {
+      // Only first `skip + limit` documents of sorted result set are visited by internal visitors
+      ctx.ssc.topk_max = (uint32_t) (ux->skip + ux->limit);
+    }
     if (ux->log) {
-      iwxstr_cat2(ux->log, " [COLLECTOR] SORTER\n");
+      if (ctx.ssc.topk_max) {
+        iwxstr_printf(ux->log, " [COLLECTOR] SORTER [TOPK] %u\n", ctx.ssc.topk_max);
+      } else {
+        iwxstr_cat2(ux->log, " [COLLECTOR] SORTER\n");
+      }
     }
-    rc = ctx.scanner(&ctx, jbi_sorter_consumer);
+    snap.consumer = jbi_sorter_consumer;
   } else {
     if (ux->log) {
       iwxstr_cat2(ux->log, " [COLLECTOR] PLAIN\n");
     }
-    rc = ctx.scanner(&ctx, jbi_consumer);
+    snap.consumer = jbi_consumer;
   }
+  rc = ctx.scanner(&ctx, ctx.snap ? jbi_snapshot_consumer : snap.consumer);
 
 finish:
   _jb_exec_scan_release(&ctx);
-  API_COLL_UNLOCK(ctx.jbc, rci, rc);
+  if (snapshot) {
+    _jb_snapshot_close(ctx.jbc, &snap);
+    API_COLL_SNAPSHOT_UNLOCK(ctx.jbc, rci, rc);
+  } else {
+    API_COLL_UNLOCK(ctx.jbc, rci, rc);
+  }
   jql_reset(ux->q, true, false);
+
+finish_query:
+  // Keep query object intact for the next executions
+  ux->q->aux->projection = projection;
   return rc;
 }
 
+iwrc ejdb_query_acquire(EJDB db, const char *coll, const char *query, jql_create_mode_t mode, JQL *qptr) {
+  if (!db || !query || !qptr) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  *qptr = 0;
+  iwrc rc = 0;
+  JQL q = 0;
+  struct _JBQCE *e = 0;
+  struct _JBQCACHE *qc = db->qcache;
+
+  if (!qc) {
+    return jql_create2(qptr, coll, query, mode);
+  }
+  // Full key format: <collection name length>:<collection name><query>
+  size_t clen = coll ? strlen(coll) : 0;
+  size_t ksz = JBNUMBUF_SIZE + clen + strlen(query) + 2;
+  char *key = malloc(ksz);
+  if (!key) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  snprintf(key, ksz, "%zu:%s%s", clen, coll ? coll : "", query);
+
+  pthread_mutex_lock(&qc->mtx);
+  khiter_t k = kh_get(JBQCM, qc->map, key);
+  if (k != kh_end(qc->map)) {
+    e = kh_value(qc->map, k);
+    _jb_qcache_unlink_key(qc, e);
+    _jb_qcache_unlink_lru(qc, e);
+    ++qc->refs;
+  }
+  pthread_mutex_unlock(&qc->mtx);
+
+  if (e) {
+    free(key);
+    *qptr = e->q;
+    return 0;
+  }
+  rc = jql_create2(&q, coll, query, mode);
+  if (rc) {
+    free(key);
+    *qptr = q; // Kept in JQL_KEEP_QUERY_ON_PARSE_ERROR mode
+    return rc;
+  }
+  e = calloc(1, sizeof(*e));
+  if (!e) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    free(key);
+    jql_destroy(&q);
+    return rc;
+  }
+  e->q = q;
+  e->key = key;
+  e->qc = qc;
+  q->opaque = e;
+  pthread_mutex_lock(&qc->mtx);
+  ++qc->refs;
+  pthread_mutex_unlock(&qc->mtx);
+  *qptr = q;
+  return 0;
+}
+
+void ejdb_query_release(EJDB db, JQL *qptr) {
+  if (!qptr || !*qptr) {
+    return;
+  }
+  int ret;
+  JQL q = *qptr;
+  struct _JBQCE *e = q->opaque, *evicted = 0;
+  *qptr = 0;
+  if (!e) {
+    jql_destroy(&q);
+    return;
+  }
+  // Database is not accessed here: query may be released after database is closed
+  struct _JBQCACHE *qc = e->qc;
+  jql_reset(q, true, true);
+
+  pthread_mutex_lock(&qc->mtx);
+  if (!qc->map) { // Database is closed
+    _jb_qcache_unref_unlock(qc);
+    _jb_qcache_entry_destroy(e);
+    return;
+  }
+  khiter_t k = kh_put(JBQCM, qc->map, e->key, &ret);
+  if (ret < 0) {
+    _jb_qcache_unref_unlock(qc);
+    _jb_qcache_entry_destroy(e);
+    return;
+  } else if (ret == 0) { // Other idle entries with the same key
+    e->knext = kh_value(qc->map, k);
+    kh_key(qc->map, k) = e->key; // Map key is owned by the head of chain
+  }
+  kh_value(qc->map, k) = e;
+  e->prev = 0;
+  e->next = qc->head;
+  if (qc->head) {
+    qc->head->prev = e;
+  } else {
+    qc->tail = e;
+  }
+  qc->head = e;
+  ++qc->num;
+  if (qc->num > qc->max) {
+    evicted = qc->tail;
+    _jb_qcache_unlink_key(qc, evicted);
+    _jb_qcache_unlink_lru(qc, evicted);
+  }
+  --qc->refs; // Database reference is still held
+  pthread_mutex_unlock(&qc->mtx);
+
+  if (evicted) {
+    _jb_qcache_entry_destroy(evicted);
+  }
+}
+
 struct JB_LIST_VISITOR_CTX {
   EJDB_DOC head;
   EJDB_DOC tail;
@@ -900,261 +2616,745 @@ static iwrc _jb_list(EJDB db, JQL q, EJDB_DOC *first, int64_t limit, IWXSTR *log
   return rc;
 }
 
-static iwrc _jb_count(EJDB db, JQL q, int64_t *count, int64_t limit, IWXSTR *log) {
-  if (!db || !q || !count) {
-    return IW_ERROR_INVALID_ARGS;
+static iwrc _jb_count(EJDB db, JQL q, int64_t *count, int64_t limit, IWXSTR *log) {
+  if (!db || !q || !count) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  struct _EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .limit = limit,
+    .log = log
+  };
+  iwrc rc = ejdb_exec(&ux);
+  *count = ux.cnt;
+  return rc;
+}
+
+iwrc ejdb_count(EJDB db, JQL q, int64_t *count, int64_t limit) {
+  return _jb_count(db, q, count, limit, 0);
+}
+
+iwrc ejdb_list(EJDB db, JQL q, EJDB_DOC *first, int64_t limit, IWPOOL *pool) {
+  return _jb_list(db, q, first, limit, 0, pool);
+}
+
+iwrc ejdb_list3(EJDB db, const char *coll, const char *query, int64_t limit, IWXSTR *log, EJDB_LIST *listp) {
+  if (!listp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  iwrc rc = 0;
+  *listp = 0;
+  IWPOOL *pool = iwpool_create(1024);
+  if (!pool) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  EJDB_LIST list = iwpool_alloc(sizeof(*list), pool);
+  if (!list) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  list->q = 0;
+  list->first = 0;
+  list->db = db;
+  list->pool = pool;
+  rc = ejdb_query_acquire(db, coll, query, 0, &list->q);
+  RCGO(rc, finish);
+  rc = _jb_list(db, list->q, &list->first, limit, log, list->pool);
+
+finish:
+  if (rc) {
+    if (list) {
+      ejdb_query_release(db, &list->q);
+    }
+    iwpool_destroy(pool);
+  } else {
+    *listp = list;
+  }
+  return rc;
+}
+
+iwrc ejdb_list4(EJDB db, JQL q, int64_t limit, IWXSTR *log, EJDB_LIST *listp) {
+  if (!listp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  iwrc rc = 0;
+  *listp = 0;
+  IWPOOL *pool = iwpool_create(1024);
+  if (!pool) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  EJDB_LIST list = iwpool_alloc(sizeof(*list), pool);
+  if (!list) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  list->q = 0;
+  list->first = 0;
+  list->db = db;
+  list->pool = pool;
+  rc = _jb_list(db, q, &list->first, limit, log, list->pool);
+
+finish:
+  if (rc) {
+    iwpool_destroy(pool);
+  } else {
+    *listp = list;
+  }
+  return rc;
+}
+
+iwrc ejdb_list2(EJDB db, const char *coll, const char *query, int64_t limit, EJDB_LIST *listp) {
+  return ejdb_list3(db, coll, query, limit, 0, listp);
+}
+
+void ejdb_list_destroy(EJDB_LIST *listp) {
+  if (listp) {
+    EJDB_LIST list = *listp;
+    if (list) {
+      if (list->q) {
+        ejdb_query_release(list->db, &list->q);
+      }
+      if (list->pool) {
+        iwpool_destroy(list->pool);
+      }
+    }
+    *listp = 0;
+  }
+}
+
+/** Removes index `idx` linked to collection indexes chain. Caller must hold the collection write lock. */
+static iwrc _jb_idx_remove_lw(JBCOLL jbc, JBIDX idx) {
+  IWKV_val key;
+  EJDB db = jbc->db;
+  char keybuf[sizeof(KEY_PREFIX_IDXMETA) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: i.<coldbid>.<idxdbid>
+
+  key.data = keybuf;
+  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXMETA "%u" "." "%u", jbc->dbid, idx->dbid);
+  if (key.size >= sizeof(keybuf)) {
+    return IW_ERROR_OVERFLOW;
+  }
+  iwrc rc = iwkv_del(db->metadb, &key, 0);
+  RCRET(rc);
+  rc = _jb_idx_stat_remove(db, jbc->dbid, idx->dbid);
+  RCRET(rc);
+  _jb_meta_nrecs_removedb(db, idx->dbid);
+  int rci = pthread_rwlock_wrlock(&jbc->slock); // Wait for snapshot readers of index
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  for (JBIDX *pp = &jbc->idx; *pp; pp = &(*pp)->next) {
+    if (*pp == idx) {
+      *pp = idx->next;
+      break;
+    }
+  }
+  if (idx->idb) {
+    iwkv_db_destroy(&idx->idb);
+  }
+  _jb_idx_release(idx);
+  pthread_rwlock_unlock(&jbc->slock);
+  return 0;
+}
+
+iwrc ejdb_remove_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode) {
+  if (!db || !coll || !path) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  JBCOLL jbc;
+  struct _JBIDX pidx = { .mode = mode }; // Index path holder
+
+  iwrc rc = _jb_coll_acquire_keeplock2(db, coll, JB_COLL_ACQUIRE_WRITE | JB_COLL_ACQUIRE_EXISTING, &jbc);
+  RCRET(rc);
+
+  rc = _jb_idx_ptrs_alloc(&pidx, path);
+  RCGO(rc, finish);
+
+  for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
+    if (_jb_idx_same(idx, &pidx)) {
+      rc = _jb_idx_remove_lw(jbc, idx);
+      break;
+    }
+  }
+
+finish:
+  _jb_idx_ptrs_release(&pidx);
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
+
+IW_INLINE iwrc _jb_idx_mode_check(ejdb_idx_mode_t mode) {
+  if (mode & EJDB_IDX_FTS) {
+    return (mode != EJDB_IDX_FTS) ? EJDB_ERROR_INVALID_INDEX_MODE : 0;
+  }
+  if (mode & EJDB_IDX_COMPOSITE) {
+    return (mode & JB_IDX_TYPE_MASK) ? EJDB_ERROR_INVALID_INDEX_MODE : 0;
+  }
+  switch (mode & JB_IDX_TYPE_MASK) {
+    case EJDB_IDX_STR:
+    case EJDB_IDX_I64:
+    case EJDB_IDX_F64:
+    case EJDB_IDX_F64B:
+      return 0;
+    default:
+      return EJDB_ERROR_INVALID_INDEX_MODE;
+  }
+}
+
+/**
+ * Creates a new empty index `path` of collection
+ * not linked to collection indexes chain.
+ * Sets `*idxp` to zero if index exists already.
+ */
+static iwrc _jb_idx_create(JBCOLL jbc, const char *path, ejdb_idx_mode_t mode, const char *filter, JBIDX *idxp) {
+  *idxp = 0;
+  JBIDX idx = calloc(1, sizeof(*idx));
+  if (!idx) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  idx->mode = mode;
+  idx->jbc = jbc;
+  iwrc rc = _jb_idx_ptrs_alloc(idx, path);
+  if (idx->cnum) {
+    idx->ckv = JB_IDX_CK_VERSION;
+  }
+  if (!rc && filter) {
+    rc = _jb_idx_filter_init(idx, filter);
+  }
+  if (rc) {
+    _jb_idx_release(idx);
+    return rc;
+  }
+  for (JBIDX eidx = jbc->idx; eidx; eidx = eidx->next) {
+    if (_jb_idx_same(eidx, idx)) {
+      if (eidx->mode != mode) {
+        rc = EJDB_ERROR_MISMATCHED_INDEX_UNIQUENESS_MODE;
+      } else if (!_jb_idx_same_filter(eidx, idx)) {
+        rc = EJDB_ERROR_MISMATCHED_INDEX_FILTER;
+      }
+      _jb_idx_release(idx);
+      return rc;
+    }
+  }
+  for (JBIDX eidx = jbc->bidx; eidx; eidx = eidx->next) {
+    if (_jb_idx_same(eidx, idx)) {
+      _jb_idx_release(idx);
+      return EJDB_ERROR_INDEX_BUILD_IN_PROGRESS;
+    }
+  }
+  idx->idbf = 0;
+  if (mode & EJDB_IDX_I64) {
+    idx->idbf |= IWDB_VNUM64_KEYS;
+  } else if (mode & EJDB_IDX_F64) {
+    idx->idbf |= IWDB_REALNUM_KEYS;
+  }
+  if (!(mode & EJDB_IDX_UNIQUE)) {
+    idx->idbf |= IWDB_COMPOUND_KEYS;
+  }
+  rc = iwkv_new_db(jbc->db->iwkv, idx->idbf, &idx->dbid, &idx->idb);
+  if (rc) {
+    _jb_idx_release(idx);
+    return rc;
+  }
+  *idxp = idx;
+  return 0;
+}
+
+/** Destroys index created by `_jb_idx_create()` but not published in collection */
+static void _jb_idx_discard(JBIDX idx) {
+  if (idx->idb) {
+    _jb_meta_nrecs_removedb(idx->jbc->db, idx->dbid);
+    iwkv_db_destroy(&idx->idb);
+    idx->idb = 0;
+  }
+  _jb_idx_release(idx);
+}
+
+/** Saves index meta into metadb and links index to the collection indexes chain */
+static iwrc _jb_idx_publish(JBIDX idx, const char *path) {
+  JBCOLL jbc = idx->jbc;
+  iwrc rc = _jb_idx_meta_save(idx, path);
+  RCRET(rc);
+  int rci = pthread_rwlock_wrlock(&jbc->slock);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  idx->next = jbc->idx;
+  jbc->idx = idx;
+  pthread_rwlock_unlock(&jbc->slock);
+  return 0;
+}
+
+/** Refills composite index having keys of previous format. Called on database open. */
+static iwrc _jb_idx_ck_rebuild(JBIDX idx) {
+  JBCOLL jbc = idx->jbc;
+  EJDB db = jbc->db;
+  IWXSTR *xstr = iwxstr_new();
+  if (!xstr) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
-  struct _EJDB_EXEC ux = {
-    .db = db,
-    .q = q,
-    .limit = limit,
-    .log = log
-  };
-  iwrc rc = ejdb_exec(&ux);
-  *count = ux.cnt;
-  return rc;
-}
+  iwrc rc = jbi_idx_ptr_serialize(idx, xstr);
+  RCGO(rc, finish);
+  rc = _jb_idx_stat_remove(db, jbc->dbid, idx->dbid);
+  RCGO(rc, finish);
+  jbi_stat_release(&idx->stat);
+  rc = iwkv_db_destroy(&idx->idb);
+  RCGO(rc, finish);
+  _jb_meta_nrecs_removedb(db, idx->dbid);
+  idx->rnum = 0;
+  rc = iwkv_db(db->iwkv, idx->dbid, idx->idbf, &idx->idb);
+  RCGO(rc, finish);
+  rc = _jb_idx_fill(idx);
+  RCGO(rc, finish);
+  idx->ckv = JB_IDX_CK_VERSION;
+  rc = _jb_idx_meta_save(idx, iwxstr_ptr(xstr));
 
-iwrc ejdb_count(EJDB db, JQL q, int64_t *count, int64_t limit) {
-  return _jb_count(db, q, count, limit, 0);
+finish:
+  iwxstr_destroy(xstr);
+  return rc;
 }
 
-iwrc ejdb_list(EJDB db, JQL q, EJDB_DOC *first, int64_t limit, IWPOOL *pool) {
-  return _jb_list(db, q, first, limit, 0, pool);
+/**
+ * Rebuilds composite indexes of all collections stored with previous keys format.
+ * Indexes are left as is in read-only mode and are not used by queries.
+ */
+static iwrc _jb_idx_ck_rebuild_all(EJDB db) {
+  iwrc rc = 0;
+  if (db->oflags & IWKV_RDONLY) {
+    return 0;
+  }
+  for (khiter_t k = kh_begin(db->mcolls); k != kh_end(db->mcolls); ++k) {
+    if (!kh_exist(db->mcolls, k)) continue;
+    JBCOLL jbc = kh_val(db->mcolls, k);
+    for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
+      if (idx->cnum && idx->ckv != JB_IDX_CK_VERSION) {
+        iwlog_info("Rebuilding composite index of collection %s", jbc->name);
+        rc = _jb_idx_ck_rebuild(idx);
+        RCRET(rc);
+      }
+    }
+  }
+  return rc;
 }
 
-iwrc ejdb_list3(EJDB db, const char *coll, const char *query, int64_t limit, IWXSTR *log, EJDB_LIST *listp) {
-  if (!listp) {
+iwrc ejdb_ensure_index2(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode,
+                        const char *filter) {
+  if (!db || !coll || !path) {
     return IW_ERROR_INVALID_ARGS;
   }
-  iwrc rc = 0;
-  *listp = 0;
-  IWPOOL *pool = iwpool_create(1024);
-  if (!pool) {
-    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
-  }
-  EJDB_LIST list = iwpool_alloc(sizeof(*list), pool);
-  if (!list) {
-    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  int rci;
+  JBCOLL jbc;
+  JBIDX idx = 0;
+  iwrc rc = _jb_idx_mode_check(mode);
+  RCRET(rc);
+
+  rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
+  RCRET(rc);
+  rc = _jb_idx_create(jbc, path, mode, filter, &idx);
+  if (rc || !idx) {
     goto finish;
   }
-  list->first = 0;
-  list->db = db;
-  list->pool = pool;
-  rc = jql_create(&list->q, coll, query);
+  rc = _jb_idx_fill(idx);
   RCGO(rc, finish);
-  rc = _jb_list(db, list->q, &list->first, limit, log, list->pool);
+  rc = _jb_idx_publish(idx, path);
 
 finish:
-  if (rc) {
-    iwpool_destroy(pool);
-  } else {
-    *listp = list;
+  if (rc && idx) {
+    _jb_idx_discard(idx);
   }
+  API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
 
-iwrc ejdb_list4(EJDB db, JQL q, int64_t limit, IWXSTR *log, EJDB_LIST *listp) {
-  if (!listp) {
+iwrc ejdb_ensure_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode) {
+  return ejdb_ensure_index2(db, coll, path, mode, 0);
+}
+
+iwrc ejdb_migrate_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode,
+                        ejdb_idx_mode_t new_mode) {
+  if (!db || !coll || !path) {
     return IW_ERROR_INVALID_ARGS;
   }
-  iwrc rc = 0;
-  *listp = 0;
-  IWPOOL *pool = iwpool_create(1024);
-  if (!pool) {
-    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  int rci;
+  JBCOLL jbc;
+  JBIDX idx = 0, oidx = 0;
+  struct _JBIDX pidx = { .mode = mode }; // Index path holder
+
+  iwrc rc = _jb_idx_mode_check(mode);
+  RCRET(rc);
+  rc = _jb_idx_mode_check(new_mode);
+  RCRET(rc);
+  if (((mode | new_mode) & (EJDB_IDX_COMPOSITE | EJDB_IDX_FTS))
+      || (mode & JB_IDX_TYPE_MASK) == (new_mode & JB_IDX_TYPE_MASK)) {
+    return EJDB_ERROR_INVALID_INDEX_MODE;
   }
-  EJDB_LIST list = iwpool_alloc(sizeof(*list), pool);
-  if (!list) {
-    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-    goto finish;
+  rc = _jb_coll_acquire_keeplock2(db, coll, JB_COLL_ACQUIRE_WRITE | JB_COLL_ACQUIRE_EXISTING, &jbc);
+  RCRET(rc);
+
+  rc = _jb_idx_ptrs_alloc(&pidx, path);
+  RCGO(rc, finish);
+  for (JBIDX eidx = jbc->idx; eidx; eidx = eidx->next) {
+    if (_jb_idx_same(eidx, &pidx)) {
+      oidx = eidx;
+      break;
+    }
+  }
+  // Partial index keeps its filter
+  rc = _jb_idx_create(jbc, path, new_mode, oidx ? oidx->fqs : 0, &idx);
+  RCGO(rc, finish);
+  if (idx) {
+    rc = _jb_idx_fill(idx);
+    RCGO(rc, finish);
+    rc = _jb_idx_publish(idx, path);
+    RCGO(rc, finish);
+    idx = 0;
+  }
+  if (oidx) {
+    rc = _jb_idx_remove_lw(jbc, oidx);
   }
-  list->q = 0;
-  list->first = 0;
-  list->db = db;
-  list->pool = pool;
-  rc = _jb_list(db, q, &list->first, limit, log, list->pool);
 
 finish:
-  if (rc) {
-    iwpool_destroy(pool);
-  } else {
-    *listp = list;
+  if (rc && idx) {
+    _jb_idx_discard(idx);
   }
+  _jb_idx_ptrs_release(&pidx);
+  API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
 
-iwrc ejdb_list2(EJDB db, const char *coll, const char *query, int64_t limit, EJDB_LIST *listp) {
-  return ejdb_list3(db, coll, query, limit, 0, listp);
-}
+/**
+ * Indexes up to `limit` documents of online index build beyond `idx->build_fence`
+ * in ascending order of ids. Caller must hold the collection lock.
+ * Documents with ids up to `idx->build_fence` are already indexed and maintained by collection writers.
+ */
+static iwrc _jb_idx_build_step(JBIDX idx, int limit, bool *done) {
+  IWKV_cursor cur;
+  IWKV_val key, val;
+  struct _JBL jbs;
+  int64_t id = INT64_MIN; // Document ids may be negative
 
-void ejdb_list_destroy(EJDB_LIST *listp) {
-  if (listp) {
-    EJDB_LIST list = *listp;
-    if (list) {
-      if (list->q) {
-        jql_destroy(&list->q);
-      }
-      if (list->pool) {
-        iwpool_destroy(list->pool);
-      }
+  if (idx->build_fenced) {
+    if (idx->build_fence == INT64_MAX) {
+      *done = true;
+      return 0;
     }
-    *listp = 0;
+    id = idx->build_fence + 1;
+  }
+  key.data = &id;
+  key.size = sizeof(id);
+  iwrc rc = iwkv_cursor_open(idx->jbc->cdb, &cur, IWKV_CURSOR_GE, &key);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    *done = true;
+    return 0;
+  }
+  RCRET(rc);
+  // Iteration towards greater ids is done by IWKV_CURSOR_PREV
+  for (int i = 0; i < limit; ++i) {
+    rc = iwkv_cursor_get(cur, &key, &val);
+    RCBREAK(rc);
+    memcpy(&id, key.data, sizeof(id));
+    rc = jb_doc_unpack_val(idx->jbc, &val);
+    if (rc) {
+      iwkv_kv_dispose(&key, &val);
+      break;
+    }
+    if (!binn_load(val.data, &jbs.bn)) {
+      rc = JBL_ERROR_CREATION;
+    } else {
+      rc = _jb_idx_record_add(idx, id, &jbs, 0);
+    }
+    iwkv_kv_dispose(&key, &val);
+    RCBREAK(rc);
+    idx->build_fence = id;
+    idx->build_fenced = true;
+    rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV);
+    if (rc == IWKV_ERROR_NOTFOUND) {
+      rc = 0;
+      *done = true;
+      break;
+    }
+    RCBREAK(rc);
   }
+  IWRC(iwkv_cursor_close(&cur), rc);
+  return rc;
 }
 
-iwrc ejdb_remove_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode) {
+/** Indexes next chunk of documents of online index build under collection read lock */
+static iwrc _jb_idx_build_chunk(EJDB db, JBIDX idx, bool *done) {
+  int rci;
+  JBCOLL jbc;
+  API_RLOCK(db, rci);
+  iwrc rc = idx->build_rc;
+  jbc = idx->jbc;
+  if (!jbc) { // Collection removed
+    API_UNLOCK(db, rci, rc);
+    return rc ? rc : EJDB_ERROR_COLLECTION_NOT_FOUND;
+  }
+  rci = pthread_rwlock_rdlock(&jbc->rwl);
+  if (rci) {
+    rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    API_UNLOCK(db, rci, rc);
+    return rc;
+  }
+  if (!rc) {
+    rc = _jb_idx_build_step(idx, JB_IDX_BUILD_CHUNK_SIZE, done);
+  }
+  if (!rc) {
+    rc = idx->build_rc;
+  }
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
+
+iwrc ejdb_ensure_index_online(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode) {
   if (!db || !coll || !path) {
     return IW_ERROR_INVALID_ARGS;
   }
   int rci;
   JBCOLL jbc;
-  IWKV_val key;
-  JBL_PTR ptr = 0;
-  char keybuf[sizeof(KEY_PREFIX_IDXMETA) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: i.<coldbid>.<idxdbid>
+  JBIDX idx = 0;
+  bool done = false;
+  iwrc rc = _jb_idx_mode_check(mode);
+  RCRET(rc);
 
-  iwrc rc = _jb_coll_acquire_keeplock2(db, coll, JB_COLL_ACQUIRE_WRITE | JB_COLL_ACQUIRE_EXISTING, &jbc);
+  rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
   RCRET(rc);
+  rc = _jb_idx_create(jbc, path, mode, 0, &idx);
+  if (!rc && idx) {
+    idx->next = jbc->bidx;
+    jbc->bidx = idx;
+  }
+  API_COLL_UNLOCK(jbc, rci, rc);
+  if (rc || !idx) {
+    return rc;
+  }
 
-  rc = jbl_ptr_alloc(path, &ptr);
-  RCGO(rc, finish);
+  while (!rc && !done) {
+    rc = _jb_idx_build_chunk(db, idx, &done);
+  }
 
-  for (JBIDX idx = jbc->idx, prev = 0; idx; idx = idx->next) {
-    if ((idx->mode & ~EJDB_IDX_UNIQUE) == (mode & ~EJDB_IDX_UNIQUE) && !jbl_ptr_cmp(idx->ptr, ptr)) {
-      key.data = keybuf;
-      key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXMETA "%u" "." "%u", jbc->dbid, idx->dbid);
-      if (key.size >= sizeof(keybuf)) {
-        rc = IW_ERROR_OVERFLOW;
-        goto finish;
-      }
-      rc = iwkv_del(db->metadb, &key, 0);
-      RCGO(rc, finish);
-      _jb_meta_nrecs_removedb(db, idx->dbid);
+  // Publish index or cleanup
+  API_RLOCK(db, rci);
+  jbc = idx->jbc;
+  if (!jbc) { // Collection removed
+    _jb_idx_release(idx);
+    API_UNLOCK(db, rci, rc);
+    return rc ? rc : EJDB_ERROR_COLLECTION_NOT_FOUND;
+  }
+  rci = pthread_rwlock_wrlock(&jbc->rwl);
+  if (rci) {
+    IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci), rc);
+    API_UNLOCK(db, rci, rc);
+    return rc;
+  }
+  for (JBIDX i = jbc->bidx, prev = 0; i; prev = i, i = i->next) {
+    if (i == idx) {
       if (prev) {
         prev->next = idx->next;
       } else {
-        jbc->idx = idx->next;
+        jbc->bidx = idx->next;
       }
-      if (idx->idb) {
-        iwkv_db_destroy(&idx->idb);
-      }
-      _jb_idx_release(idx);
       break;
     }
-    prev = idx;
   }
-
-finish:
-  free(ptr);
+  idx->next = 0;
+  if (!rc) {
+    rc = idx->build_rc;
+  }
+  if (!rc) { // Catch up documents added since the last chunk
+    done = false;
+    rc = _jb_idx_build_step(idx, INT_MAX, &done);
+  }
+  if (!rc) {
+    rc = _jb_idx_publish(idx, path);
+  }
+  if (rc) {
+    _jb_idx_discard(idx);
+  }
   API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
 
-iwrc ejdb_ensure_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode) {
-  if (!db || !coll || !path) {
-    return IW_ERROR_INVALID_ARGS;
-  }
-  int rci;
-  JBCOLL jbc;
-  IWKV_val key, val;
-  char keybuf[sizeof(KEY_PREFIX_IDXMETA) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: i.<coldbid>.<idxdbid>
-
-  JBIDX idx = 0;
-  JBL_PTR ptr = 0;
-  binn *imeta = 0;
+/**
+ * Builds documents compression dictionary of collection from documents
+ * spread over the range of collection ids. Zero `dp` is returned if collection is empty.
+ */
+static iwrc _jb_zdict_train_lw(JBCOLL jbc, struct _JBZDICT **dp) {
+  iwrc rc;
+  IWKV_cursor cur = 0;
+  size_t dsz = 0, vsz;
+  int64_t id, pid = 0, id_seq = jbc->id_seq;
+  struct _JBZDICT *zd = jbc->zdicts;
+  IWKV_val key = {.data = &id, .size = sizeof(id)};
+  *dp = 0;
 
-  switch (mode & (EJDB_IDX_STR | EJDB_IDX_I64 | EJDB_IDX_F64)) {
-    case EJDB_IDX_STR:
-    case EJDB_IDX_I64:
-    case EJDB_IDX_F64:
+  uint8_t *dbuf = malloc(JB_ZDICT_SIZE);
+  uint8_t *vbuf = malloc(JB_ZDICT_SIZE);
+  if (!dbuf || !vbuf) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  rc = iwkv_cursor_open(jbc->cdb, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  RCGO(rc, finish);
+  for (int i = 0; i < JB_ZDICT_SAMPLES && dsz < JB_ZDICT_SIZE; ++i) {
+    id = 1 + (id_seq * i) / JB_ZDICT_SAMPLES;
+    rc = iwkv_cursor_to_key(cur, IWKV_CURSOR_GE, &key);
+    if (rc == IWKV_ERROR_NOTFOUND) {
+      rc = 0;
       break;
-    default:
-      return EJDB_ERROR_INVALID_INDEX_MODE;
+    }
+    RCGO(rc, finish);
+    rc = iwkv_cursor_copy_key(cur, &id, sizeof(id), &vsz, 0);
+    RCGO(rc, finish);
+    if (id == pid) { // Sparse ids
+      continue;
+    }
+    pid = id;
+    rc = iwkv_cursor_copy_val(cur, vbuf, JB_ZDICT_SIZE, &vsz);
+    RCGO(rc, finish);
+    if (vsz > JB_ZDICT_SIZE) { // Only documents which fit into dictionary are sampled
+      continue;
+    }
+    if (JB_ZDOC_PACKED(vbuf, vsz)) {
+      size_t sz;
+      uint8_t *pbuf = malloc(vsz);
+      if (!pbuf) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        goto finish;
+      }
+      memcpy(pbuf, vbuf, vsz);
+      rc = jb_doc_unpack(jbc, pbuf, vsz, vbuf, JB_ZDICT_SIZE, &sz);
+      free(pbuf);
+      RCGO(rc, finish);
+      if (sz > JB_ZDICT_SIZE) {
+        continue;
+      }
+      vsz = sz;
+    }
+    // Recent samples are the nearest to compressed data, so every document takes a fair share
+    vsz = MIN(vsz, MIN(JB_ZDICT_SIZE - dsz, JB_ZDICT_SIZE / 8));
+    memcpy(dbuf + dsz, vbuf, vsz);
+    dsz += vsz;
+  }
+  if (dsz) {
+    pthread_rwlock_wrlock(&jbc->slock);
+    rc = _jb_zdict_add(jbc, zd ? zd->id + 1 : 1, dbuf, dsz, dp);
+    pthread_rwlock_unlock(&jbc->slock);
   }
 
-  iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
-  RCRET(rc);
-  rc = jbl_ptr_alloc(path, &ptr);
-  RCGO(rc, finish);
+finish:
+  if (cur) {
+    iwkv_cursor_close(&cur);
+  }
+  free(dbuf);
+  free(vbuf);
+  return rc;
+}
 
-  for (idx = jbc->idx; idx; idx = idx->next) {
-    if ((idx->mode & ~EJDB_IDX_UNIQUE) == (mode & ~EJDB_IDX_UNIQUE) && !jbl_ptr_cmp(idx->ptr, ptr)) {
-      if (idx->mode != mode) {
-        rc = EJDB_ERROR_MISMATCHED_INDEX_UNIQUENESS_MODE;
-        idx = 0;
+/**
+ * Stores all documents of collection in form of current collection compression mode.
+ */
+static iwrc _jb_coll_recompress_lw(JBCOLL jbc) {
+  IWKV_cursor cur;
+  uint32_t did = jbc->zdict ? jbc->zdict->id : 0;
+  iwrc rc = iwkv_cursor_open(jbc->cdb, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  RCRET(rc);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    IWKV_val val;
+    void *buf, *data;
+    bool packed = false;
+    rc = iwkv_cursor_val(cur, &val);
+    RCBREAK(rc);
+    if (JB_ZDOC_PACKED(val.data, val.size)) {
+      uint32_t vdid;
+      memcpy(&vdid, (uint8_t *) val.data + 1, sizeof(vdid));
+      if (jbc->zmode != EJDB_COMPRESS_NONE && IW_ITOHL(vdid) == did) {
+        iwkv_val_dispose(&val);
+        continue;
+      }
+      rc = jb_doc_unpack_val(jbc, &val);
+      if (rc) {
+        iwkv_val_dispose(&val);
+        break;
+      }
+      packed = true;
+    } else if (jbc->zmode == EJDB_COMPRESS_NONE) {
+      iwkv_val_dispose(&val);
+      continue;
+    }
+    data = val.data;
+    rc = _jb_doc_pack(jbc, &val, &buf);
+    if (!rc && (buf || packed)) { // Previous dictionary may be released
+      // Document data is not changed, so document cache and versions of snapshot readers are kept
+      rc = _jb_snapshot_wlock(jbc);
+      if (!rc) {
+        rc = iwkv_cursor_set(cur, &val, 0);
+        IWRC(_jb_snapshot_unlock(jbc), rc);
       }
-      goto finish;
     }
+    free(buf);
+    free(data);
+    RCBREAK(rc);
   }
-
-  idx = calloc(1, sizeof(*idx));
-  if (!idx) {
-    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-    goto finish;
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    rc = 0;
   }
-  idx->mode = mode;
-  idx->jbc = jbc;
-  idx->ptr = ptr;
-  ptr = 0;
-  idx->idbf = 0;
-  if (mode & EJDB_IDX_I64) {
-    idx->idbf |= IWDB_VNUM64_KEYS;
-  } else if (mode & EJDB_IDX_F64) {
-    idx->idbf |= IWDB_REALNUM_KEYS;
+  iwkv_cursor_close(&cur);
+  return rc;
+}
+
+iwrc ejdb_compress_collection(EJDB db, const char *coll, ejdb_compress_t mode) {
+  if (!db || !coll || mode > EJDB_COMPRESS_LZ_DICT) {
+    return IW_ERROR_INVALID_ARGS;
   }
-  if (!(mode & EJDB_IDX_UNIQUE)) {
-    idx->idbf |= IWDB_COMPOUND_KEYS;
+  int rci;
+  JBCOLL jbc;
+  struct _JBZDICT *zdict = 0;
+  iwrc rc = _jb_coll_acquire_keeplock2(db, coll, JB_COLL_ACQUIRE_WRITE | JB_COLL_ACQUIRE_EXISTING, &jbc);
+  RCRET(rc);
+  if (mode == EJDB_COMPRESS_LZ_DICT) {
+    rc = _jb_zdict_train_lw(jbc, &zdict);
+    RCGO(rc, finish);
   }
-  rc = iwkv_new_db(db->iwkv, idx->idbf, &idx->dbid, &idx->idb);
+  jbc->zmode = mode;
+  jbc->zdict = zdict;
+  // Documents compressed with previous dictionaries may be stored until all documents are processed
+  rc = _jb_coll_save_zmeta(jbc, true);
   RCGO(rc, finish);
-
-  rc = _jb_idx_fill(idx);
+  rc = _jb_coll_recompress_lw(jbc);
   RCGO(rc, finish);
+  rc = _jb_coll_save_zmeta(jbc, false);
 
-  // save index meta into metadb
-  imeta = binn_object();
-  if (!imeta) {
-    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-    goto finish;
-  }
-
-  if (!binn_object_set_str(imeta, "ptr", path) ||
-      !binn_object_set_uint32(imeta, "mode", idx->mode) ||
-      !binn_object_set_uint32(imeta, "idbf", idx->idbf) ||
-      !binn_object_set_uint32(imeta, "dbid", idx->dbid)) {
-    rc = JBL_ERROR_CREATION;
-    goto finish;
-  }
+finish:
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
 
-  key.data = keybuf;
-  // Full key format: i.<coldbid>.<idxdbid>
-  key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXMETA "%u" "." "%u", jbc->dbid, idx->dbid);
-  if (key.size >= sizeof(keybuf)) {
-    rc = IW_ERROR_OVERFLOW;
-    goto finish;
+iwrc ejdb_analyze(EJDB db, const char *coll) {
+  if (!db || !coll) {
+    return IW_ERROR_INVALID_ARGS;
   }
-  val.data = binn_ptr(imeta);
-  val.size = binn_size(imeta);
-  rc = iwkv_put(db->metadb, &key, &val, 0);
-  RCGO(rc, finish);
-
-  idx->next = jbc->idx;
-  jbc->idx = idx;
+  int rci;
+  JBCOLL jbc;
+  iwrc rc = _jb_coll_acquire_keeplock2(db, coll, JB_COLL_ACQUIRE_WRITE | JB_COLL_ACQUIRE_EXISTING, &jbc);
+  RCRET(rc);
 
-finish:
-  if (rc) {
-    if (idx) {
-      if (idx->idb) {
-        iwkv_db_destroy(&idx->idb);
-        idx->idb = 0;
-      }
-      _jb_idx_release(idx);
+  for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
+    struct _JBIDXSTAT *stat;
+    rc = jbi_stat_collect(idx, &stat);
+    RCBREAK(rc);
+    rc = _jb_idx_stat_save(idx, stat);
+    if (rc) {
+      jbi_stat_release(&stat);
+      break;
     }
+    pthread_rwlock_wrlock(&jbc->slock);
+    jbi_stat_release(&idx->stat);
+    idx->stat = stat;
+    pthread_rwlock_unlock(&jbc->slock);
   }
-  if (ptr) free(ptr);
-  if (imeta) {
-    binn_free(imeta);
-  }
+
   API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
@@ -1186,12 +3386,12 @@ static iwrc _jb_patch(EJDB db, const char *coll, const char *patchjson, int64_t
       rc = EJDB_ERROR_PATCH_JSON_NOT_OBJECT;
       goto finish;
     }
+    _jb_id_seq_update(jbc, id);
     rc = _jb_put_impl(jbc, ujbl, id);
-    if (!rc && jbc->id_seq < id) {
-      jbc->id_seq = id;
-    }
     goto finish;
   } else RCGO(rc, finish);
+  rc = jb_doc_unpack_val(jbc, &val);
+  RCGO(rc, finish);
 
   rc = jbl_from_buf_keep_onstack(&sjbl, val.data, val.size);
   RCGO(rc, finish);
@@ -1263,10 +3463,21 @@ iwrc ejdb_put(EJDB db, const char *coll, JBL jbl, int64_t id) {
   JBCOLL jbc;
   iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
   RCRET(rc);
+  _jb_id_seq_update(jbc, id);
   rc = _jb_put_impl(jbc, jbl, id);
-  if (!rc && jbc->id_seq < id) {
-    jbc->id_seq = id;
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
+
+iwrc ejdb_coll_put(EJDB_COLL jbc, JBL jbl, int64_t id) {
+  if (!jbc || !jbl) {
+    return IW_ERROR_INVALID_ARGS;
   }
+  int rci;
+  iwrc rc = _jb_coll_handle_lock(jbc, JB_COLL_ACQUIRE_WRITE);
+  RCRET(rc);
+  _jb_id_seq_update(jbc, id);
+  rc = _jb_put_impl(jbc, jbl, id);
   API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
@@ -1277,120 +3488,286 @@ iwrc ejdb_put_new(EJDB db, const char *coll, JBL jbl, int64_t *id) {
   }
   int rci;
   JBCOLL jbc;
+  IWKV_val val;
   if (id) *id = 0;
-  iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
+  // Document is serialized before collection is locked
+  iwrc rc = jbl_as_buf(jbl, &val.data, &val.size);
   RCRET(rc);
-  int64_t oid = jbc->id_seq + 1;
+  rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
+  RCRET(rc);
+  int64_t oid = _jb_id_next(jbc);
+  rc = _jb_put_val_impl(jbc, jbl, &val, oid, &oid);
+  if (!rc && id) {
+    *id = oid;
+  }
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
 
-  IWKV_val val, key = {
-    .data = &oid,
-    .size = sizeof(oid)
-  };
-  struct _JBPHCTX pctx = {
-    .id = oid,
-    .jbc = jbc,
-    .jbl = jbl
-  };
+iwrc ejdb_coll_put_new(EJDB_COLL jbc, JBL jbl, int64_t *id) {
+  if (!jbc || !jbl) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  IWKV_val val;
+  if (id) *id = 0;
+  iwrc rc = jbl_as_buf(jbl, &val.data, &val.size);
+  RCRET(rc);
+  // Only storage and indexes modification is serialized by collection lock
+  int64_t oid = _jb_id_next(jbc);
+  rc = _jb_coll_handle_lock(jbc, JB_COLL_ACQUIRE_WRITE);
+  RCRET(rc);
+  rc = _jb_put_val_impl(jbc, jbl, &val, oid, &oid);
+  if (!rc && id) {
+    *id = oid;
+  }
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
 
-  rc = jbl_as_buf(jbl, &val.data, &val.size);
-  RCGO(rc, finish);
+static int _jb_batch_rec_cmp(const void *o1, const void *o2) {
+  const struct _JBBATCHREC *r1 = o1, *r2 = o2;
+  if (r1->id != r2->id) {
+    return r1->id < r2->id ? -1 : 1;
+  }
+  return r1->pos < r2->pos ? -1 : r1->pos > r2->pos ? 1 : 0;
+}
 
-  rc = _jb_put_handler_after(iwkv_puth(jbc->cdb, &key, &val, 0, _jb_put_handler, &pctx), &pctx);
-  RCGO(rc, finish);
+iwrc ejdb_put_batch(EJDB db, const char *coll, const JBL *docs, const int64_t *ids, size_t num) {
+  if (!docs || !ids) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  if (!num) {
+    return 0;
+  }
+  for (size_t i = 0; i < num; ++i) {
+    if (!docs[i]) {
+      return IW_ERROR_INVALID_ARGS;
+    }
+  }
+  int rci;
+  JBCOLL jbc;
+  struct _JBBATCHREC *recs = malloc(num * sizeof(recs[0]));
+  if (!recs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    recs[i].id = ids[i];
+    recs[i].jbl = docs[i];
+    recs[i].pos = i;
+  }
+  // Store documents in key order, documents with the same id are ordered by position in batch
+  qsort(recs, num, sizeof(recs[0]), _jb_batch_rec_cmp);
 
-  jbc->id_seq = oid;
-  if (id) {
-    *id = oid;
+  iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
+  RCGO(rc, finish);
+  for (size_t i = 0; i < num; ++i) {
+    if (i + 1 < num && recs[i + 1].id == recs[i].id) {
+      continue; // The last document of the same id wins as with sequential puts
+    }
+    _jb_id_seq_update(jbc, recs[i].id);
+    rc = _jb_put_impl(jbc, recs[i].jbl, recs[i].id);
+    RCBREAK(rc);
   }
+  API_COLL_UNLOCK(jbc, rci, rc);
 
 finish:
-  API_COLL_UNLOCK(jbc, rci, rc);
+  free(recs);
   return rc;
 }
 
-iwrc ejdb_get(EJDB db, const char *coll, int64_t id, JBL *jblp) {
-  if (!id || !jblp) {
+iwrc ejdb_put_new_batch(EJDB db, const char *coll, const JBL *docs, size_t num, int64_t *oids) {
+  if (!docs) {
     return IW_ERROR_INVALID_ARGS;
   }
-  *jblp = 0;
+  for (size_t i = 0; i < num; ++i) {
+    if (!docs[i]) {
+      return IW_ERROR_INVALID_ARGS;
+    }
+  }
+  if (oids) {
+    memset(oids, 0, num * sizeof(oids[0]));
+  }
+  if (!num) {
+    return 0;
+  }
   int rci;
   JBCOLL jbc;
+  iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
+  RCRET(rc);
+  for (size_t i = 0; i < num; ++i) {
+    int64_t oid;
+    rc = _jb_put_new_impl(jbc, docs[i], &oid);
+    RCBREAK(rc);
+    if (oids) {
+      oids[i] = oid;
+    }
+  }
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
+
+static iwrc _jb_get_lr(JBCOLL jbc, int64_t id, JBL *jblp) {
   JBL jbl = 0;
+  struct _JBDCE *e = 0;
   IWKV_val val = {0};
   IWKV_val key = {.data = &id, .size = sizeof(id)};
-  iwrc rc = _jb_coll_acquire_keeplock(db, coll, false, &jbc);
-  RCRET(rc);
-  rc = iwkv_get(jbc->cdb, &key, &val);
-  RCGO(rc, finish);
-  rc = jbl_from_buf_keep(&jbl, val.data, val.size, false);
+  iwrc rc;
+  if (jbc->db->opts.snapshot_reads) {
+    rc = _jb_snapshot_get(jbc, &key, &val, &e);
+  } else {
+    rc = _jb_doc_get(jbc, &key, &val, &e);
+  }
   RCGO(rc, finish);
+  if (e) {
+    // Document shares immutable data of cache entry until destroyed
+    rc = jbl_from_buf_keep(&jbl, e->data, e->size, true);
+    RCGO(rc, finish);
+    jbl->bn.freefn = _jb_dcache_freefn;
+    e = 0;
+  } else {
+    rc = jbl_from_buf_keep(&jbl, val.data, val.size, false);
+    RCGO(rc, finish);
+  }
   *jblp = jbl;
 
 finish:
   if (rc) {
     if (jbl) {
       jbl_destroy(&jbl);
+    } else if (e) {
+      jb_dcache_release(e);
     } else {
       iwkv_val_dispose(&val);
     }
   }
-  API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
 
-iwrc ejdb_del(EJDB db, const char *coll, int64_t id) {
-  int rci;
+iwrc ejdb_get(EJDB db, const char *coll, int64_t id, JBL *jblp) {
+  if (!id || !jblp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  *jblp = 0;
   JBCOLL jbc;
+  // Point reads are not blocked by collection writers in snapshot read mode
+  jb_coll_acquire_t acm = db->opts.snapshot_reads ? JB_COLL_ACQUIRE_SNAPSHOT : 0;
+  iwrc rc = _jb_coll_acquire_rd(db, coll, acm, &jbc);
+  RCRET(rc);
+  rc = _jb_get_lr(jbc, id, jblp);
+  IWRC(_jb_coll_unlock(jbc, acm), rc);
+  return rc;
+}
+
+iwrc ejdb_coll_get(EJDB_COLL jbc, int64_t id, JBL *jblp) {
+  if (!jbc || !id || !jblp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  *jblp = 0;
+  jb_coll_acquire_t acm = jbc->db->opts.snapshot_reads ? JB_COLL_ACQUIRE_SNAPSHOT : 0;
+  iwrc rc = _jb_coll_handle_lock(jbc, acm);
+  RCRET(rc);
+  rc = _jb_get_lr(jbc, id, jblp);
+  IWRC(_jb_coll_unlock(jbc, acm), rc);
+  return rc;
+}
+
+static iwrc _jb_del_lw(JBCOLL jbc, int64_t id) {
   struct _JBL jbl;
   IWKV_val val = {0};
   IWKV_val key = {.data = &id, .size = sizeof(id)};
-  iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
-  RCRET(rc);
 
-  rc = iwkv_get(jbc->cdb, &key, &val);
+  iwrc rc = iwkv_get(jbc->cdb, &key, &val);
+  RCGO(rc, finish);
+  rc = jb_doc_unpack_val(jbc, &val);
   RCGO(rc, finish);
 
   rc = jbl_from_buf_keep_onstack(&jbl, val.data, val.size);
   RCGO(rc, finish);
 
-  for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
-    IWRC(_jb_idx_record_remove(idx, id, &jbl), rc);
-  }
-  rc = iwkv_del(jbc->cdb, &key, 0);
-  RCGO(rc, finish);
-  _jb_meta_nrecs_update(jbc->db, jbc->dbid, -1);
-  jbc->rnum -= 1;
+  rc = jb_del(jbc, &jbl, id);
 
 finish:
   if (val.data) {
     iwkv_val_dispose(&val);
   }
+  return rc;
+}
+
+iwrc ejdb_del(EJDB db, const char *coll, int64_t id) {
+  int rci;
+  JBCOLL jbc;
+  iwrc rc = _jb_coll_acquire_keeplock(db, coll, true, &jbc);
+  RCRET(rc);
+  rc = _jb_del_lw(jbc, id);
+  API_COLL_UNLOCK(jbc, rci, rc);
+  return rc;
+}
+
+iwrc ejdb_coll_del(EJDB_COLL jbc, int64_t id) {
+  if (!jbc) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  iwrc rc = _jb_coll_handle_lock(jbc, JB_COLL_ACQUIRE_WRITE);
+  RCRET(rc);
+  rc = _jb_del_lw(jbc, id);
   API_COLL_UNLOCK(jbc, rci, rc);
   return rc;
 }
 
+/**
+ * Keeps document `jbl` being removed for snapshot readers.
+ */
+static iwrc _jb_snapshot_record_del(JBCOLL jbc, int64_t id, JBL jbl) {
+  void *data;
+  size_t size;
+  if (!jbc->db->opts.snapshot_reads) {
+    return 0;
+  }
+  iwrc rc = jbl_as_buf(jbl, &data, &size);
+  RCRET(rc);
+  return _jb_snapshot_record(jbc, id, data, size);
+}
+
 iwrc jb_del(JBCOLL jbc, JBL jbl, int64_t id) {
-  iwrc rc = 0;
   IWKV_val key = {.data = &id, .size = sizeof(id)};
+  iwrc rc = _jb_snapshot_wlock(jbc);
+  RCRET(rc);
+  _jb_dcache_invalidate(jbc, id);
+  rc = _jb_snapshot_record_del(jbc, id, jbl);
+  RCGO(rc, finish);
   for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
     IWRC(_jb_idx_record_remove(idx, id, jbl), rc);
   }
+  _jb_idx_build_record_add(jbc, id, 0, jbl);
   rc = iwkv_del(jbc->cdb, &key, 0);
-  RCRET(rc);
+  RCGO(rc, finish);
   _jb_meta_nrecs_update(jbc->db, jbc->dbid, -1);
   jbc->rnum -= 1;
+
+finish:
+  IWRC(_jb_snapshot_unlock(jbc), rc);
   return rc;
 }
 
 iwrc jb_cursor_del(JBCOLL jbc, IWKV_cursor cur, int64_t id, JBL jbl) {
-  iwrc rc = 0;
+  iwrc rc = _jb_snapshot_wlock(jbc);
+  RCRET(rc);
+  _jb_dcache_invalidate(jbc, id);
+  rc = _jb_snapshot_record_del(jbc, id, jbl);
+  RCGO(rc, finish);
   for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
     IWRC(_jb_idx_record_remove(idx, id, jbl), rc);
   }
+  _jb_idx_build_record_add(jbc, id, 0, jbl);
   rc = iwkv_cursor_del(cur, 0);
-  RCRET(rc);
+  RCGO(rc, finish);
   _jb_meta_nrecs_update(jbc->db, jbc->dbid, -1);
   jbc->rnum -= 1;
+
+finish:
+  IWRC(_jb_snapshot_unlock(jbc), rc);
   return rc;
 }
 
@@ -1403,6 +3780,36 @@ iwrc ejdb_ensure_collection(EJDB db, const char *coll) {
   return rc;
 }
 
+iwrc ejdb_coll_handle(EJDB db, const char *coll, EJDB_COLL *collp) {
+  if (!collp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  JBCOLL jbc;
+  *collp = 0;
+  iwrc rc = _jb_coll_acquire_rd(db, coll, 0, &jbc);
+  RCRET(rc);
+  // Handle is counted while collection is locked, so it is not released if removed later
+  __atomic_add_fetch(&jbc->nhandles, 1, __ATOMIC_SEQ_CST);
+  rc = _jb_coll_unlock(jbc, 0);
+  if (rc) {
+    __atomic_sub_fetch(&jbc->nhandles, 1, __ATOMIC_SEQ_CST);
+    return rc;
+  }
+  *collp = jbc;
+  return 0;
+}
+
+void ejdb_coll_handle_release(EJDB_COLL *collp) {
+  JBCOLL jbc = collp ? *collp : 0;
+  if (!jbc) {
+    return;
+  }
+  *collp = 0;
+  if (!__atomic_sub_fetch(&jbc->nhandles, 1, __ATOMIC_SEQ_CST) && __atomic_load_n(&jbc->removed, __ATOMIC_SEQ_CST)) {
+    _jb_creg_reclaim(jbc->db);
+  }
+}
+
 iwrc ejdb_remove_collection(EJDB db, const char *coll) {
   int rci;
   iwrc rc = 0;
@@ -1410,7 +3817,7 @@ iwrc ejdb_remove_collection(EJDB db, const char *coll) {
     return IW_ERROR_READONLY;
   }
   API_WLOCK(db, rci);
-  JBCOLL jbc;
+  JBCOLL jbc = 0;
   IWKV_val key;
   char keybuf[sizeof(KEY_PREFIX_IDXMETA) + 1 + 2 * JBNUMBUF_SIZE]; // Full key format: i.<coldbid>.<idxdbid>
   khiter_t k = kh_get(JBCOLLM, db->mcolls, coll);
@@ -1418,18 +3825,25 @@ iwrc ejdb_remove_collection(EJDB db, const char *coll) {
   if (k != kh_end(db->mcolls)) {
 
     jbc = kh_value(db->mcolls, k);
+    // Wait for readers acquired collection without database lock
+    pthread_rwlock_wrlock(&jbc->rwl);
+    pthread_rwlock_wrlock(&jbc->slock);
     key.data = keybuf;
     key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_COLLMETA "%u", jbc->dbid);
     rc = iwkv_del(jbc->db->metadb, &key, IWKV_SYNC);
     RCGO(rc, finish);
 
     _jb_meta_nrecs_removedb(db, jbc->dbid);
+    rc = _jb_coll_remove_zmeta(db, jbc->dbid);
+    RCGO(rc, finish);
 
     for (JBIDX idx = jbc->idx; idx; idx = idx->next) {
       key.data = keybuf;
       key.size = snprintf(keybuf, sizeof(keybuf), KEY_PREFIX_IDXMETA "%u" "." "%u", jbc->dbid, idx->dbid);
       rc = iwkv_del(jbc->db->metadb, &key, 0);
       RCGO(rc, finish);
+      rc = _jb_idx_stat_remove(db, jbc->dbid, idx->dbid);
+      RCGO(rc, finish);
       _jb_meta_nrecs_removedb(db, idx->dbid);
     }
     for (JBIDX idx = jbc->idx, nidx; idx; idx = nidx) {
@@ -1439,12 +3853,34 @@ iwrc ejdb_remove_collection(EJDB db, const char *coll) {
       _jb_idx_release(idx);
     }
     jbc->idx = 0;
+    // Indexes being built online are released by their builders
+    for (JBIDX idx = jbc->bidx, nidx; idx; idx = nidx) {
+      _jb_meta_nrecs_removedb(db, idx->dbid);
+      IWRC(iwkv_db_destroy(&idx->idb), rc);
+      idx->idb = 0;
+      idx->jbc = 0;
+      idx->build_rc = EJDB_ERROR_COLLECTION_NOT_FOUND;
+      nidx = idx->next;
+      idx->next = 0;
+    }
+    jbc->bidx = 0;
     IWRC(iwkv_db_destroy(&jbc->cdb), rc);
     kh_del(JBCOLLM, db->mcolls, k);
-    _jb_coll_release(jbc);
+    _jb_creg_publish(db);
+    jbc->removed = true;
+    _jb_coll_release_data(jbc);
   }
 
 finish:
+  if (jbc) {
+    pthread_rwlock_unlock(&jbc->slock);
+    pthread_rwlock_unlock(&jbc->rwl);
+    if (jbc->removed) {
+      // Collection may be referenced by handles and readers of previous registry,
+      // so it is released once they are gone
+      _jb_creg_retire(db, 0, jbc);
+    }
+  }
   API_UNLOCK(db, rci, rc);
   return rc;
 }
@@ -1515,9 +3951,15 @@ iwrc ejdb_rename_collection(EJDB db, const char *coll, const char *new_coll) {
     goto finish;
   }
 
+  // Name is checked by readers acquired collection without database lock
+  pthread_rwlock_wrlock(&jbc->rwl);
+  pthread_rwlock_wrlock(&jbc->slock);
   jbc->name = new_name;
   jbl_destroy(&jbc->meta);
   jbc->meta = nmeta;
+  pthread_rwlock_unlock(&jbc->slock);
+  pthread_rwlock_unlock(&jbc->rwl);
+  _jb_creg_publish(db);
 
 finish:
   if (jbv) {
@@ -1639,11 +4081,20 @@ iwrc ejdb_open(const EJDB_OPTS *_opts, EJDB *ejdbp) {
     free(db);
     return rc;
   }
+  rci = pthread_mutex_init(&db->creg_mtx, 0);
+  if (rci) {
+    rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    pthread_rwlock_destroy(&db->rwl);
+    free(db);
+    return rc;
+  }
   db->mcolls = kh_init(JBCOLLM);
   if (!db->mcolls) {
     rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
     goto finish;
   }
+  rc = _jb_qcache_init(db);
+  RCGO(rc, finish);
 
   IWKV_OPTS kvopts;
   memcpy(&kvopts, &db->opts.kv, sizeof(db->opts.kv));
@@ -1657,6 +4108,9 @@ iwrc ejdb_open(const EJDB_OPTS *_opts, EJDB *ejdbp) {
   db->oflags = kvopts.oflags;
   rc = _jb_db_meta_load(db);
   RCGO(rc, finish);
+  rc = _jb_idx_ck_rebuild_all(db);
+  RCGO(rc, finish);
+  _jb_creg_publish(db);
 
   if (db->opts.http.enabled) {
     // Maximum WS/HTTP API body size. Default: 64Mb, Min: 512K
@@ -1745,6 +4199,14 @@ static const char *_ejdb_ecodefn(locale_t locale, uint32_t ecode) {
       return "Target collection exists (EJDB_ERROR_TARGET_COLLECTION_EXISTS)";
     case EJDB_ERROR_PATCH_JSON_NOT_OBJECT:
       return "Patch JSON must be an object (map) (EJDB_ERROR_PATCH_JSON_NOT_OBJECT)";
+    case EJDB_ERROR_INDEX_BUILD_IN_PROGRESS:
+      return "Index is being built by ejdb_ensure_index_online() (EJDB_ERROR_INDEX_BUILD_IN_PROGRESS)";
+    case EJDB_ERROR_INVALID_INDEX_FILTER:
+      return "Invalid partial index filter query (EJDB_ERROR_INVALID_INDEX_FILTER)";
+    case EJDB_ERROR_MISMATCHED_INDEX_FILTER:
+      return "Index exists but mismatched partial index filter (EJDB_ERROR_MISMATCHED_INDEX_FILTER)";
+    case EJDB_ERROR_INVALID_COMPRESSED_DOCUMENT:
+      return "Stored document can not be decompressed (EJDB_ERROR_INVALID_COMPRESSED_DOCUMENT)";
   }
   return 0;
 }
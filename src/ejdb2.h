@@ -57,6 +57,10 @@ typedef enum {
   EJDB_ERROR_COLLECTION_NOT_FOUND,                /**< Collection not found */
   EJDB_ERROR_TARGET_COLLECTION_EXISTS,            /**< Target collection exists */
   EJDB_ERROR_PATCH_JSON_NOT_OBJECT,               /**< Patch JSON must be an object (map) */
+  EJDB_ERROR_INDEX_BUILD_IN_PROGRESS,             /**< Index is being built by `ejdb_ensure_index_online()` */
+  EJDB_ERROR_INVALID_INDEX_FILTER,                /**< Invalid partial index filter query */
+  EJDB_ERROR_MISMATCHED_INDEX_FILTER,             /**< Index exists but mismatched partial index filter */
+  EJDB_ERROR_INVALID_COMPRESSED_DOCUMENT,         /**< Stored document can not be decompressed */
   _EJDB_ERROR_END
 } ejdb_ecode_t;
 
@@ -80,12 +84,56 @@ typedef uint8_t ejdb_idx_mode_t;
  */
 #define EJDB_IDX_F64        ((ejdb_idx_mode_t) 0x10U)
 
+/** Index values have floating point type stored as 8 bytes binary keys.
+ *  Unlike `EJDB_IDX_F64` numbers are indexed without loss of precision
+ *  and index keys are compared without parsing.
+ *  Existing `EJDB_IDX_F64` index can be converted by `ejdb_migrate_index()`.
+ *  Type conversion will be performed on atempt to save value with other type */
+#define EJDB_IDX_F64B       ((ejdb_idx_mode_t) 0x02U)
+
+/** Composite index over several fields.
+ *  Index path is a comma separated list of rfc6901 JSON pointers, eg: `/tenant,/created`.
+ *  Document is indexed only if all fields are present and have string, number or boolean values.
+ *  Must not be combined with `EJDB_IDX_STR`, `EJDB_IDX_I64`, `EJDB_IDX_F64`, `EJDB_IDX_F64B`.
+ */
+#define EJDB_IDX_COMPOSITE  ((ejdb_idx_mode_t) 0x20U)
+
+/** Full-text index of string values.
+ *  Text is split into words, every word is case folded and stored as a separate index key,
+ *  so index can be used by `ft` query operator, eg: `/[title ft "quick brown*"]`.
+ *  Strings stored in arrays are indexed as well.
+ *  Must not be combined with other index modes.
+ */
+#define EJDB_IDX_FTS        ((ejdb_idx_mode_t) 0x40U)
+
+/** Documents compression mode of collection */
+typedef uint8_t ejdb_compress_t;
+
+/** Documents are stored uncompressed. */
+#define EJDB_COMPRESS_NONE      ((ejdb_compress_t) 0x00U)
+
+/** Every document is compressed on its own.
+ *  Suitable for large documents having repeated data inside. */
+#define EJDB_COMPRESS_LZ        ((ejdb_compress_t) 0x01U)
+
+/** Documents are compressed using dictionary built from sample of collection documents.
+ *  Object keys and values repeated across documents are encoded as references to dictionary,
+ *  so even small documents of the same structure are compressed well. */
+#define EJDB_COMPRESS_LZ_DICT   ((ejdb_compress_t) 0x02U)
+
 /**
  * @brief Database handler.
  */
 struct _EJDB;
 typedef struct _EJDB *EJDB;
 
+/**
+ * @brief Collection handle.
+ * @see ejdb_coll_handle()
+ */
+struct _JBCOLL;
+typedef struct _JBCOLL *EJDB_COLL;
+
 /**
  * @brief EJDB HTTP/Websocket Server options.
  */
@@ -112,6 +160,13 @@ typedef struct _EJDB_OPTS {
                                      Default 16Mb, min: 1Mb */
   uint32_t document_buffer_sz;  /**< Initial size of buffer in bytes used to process/store document during query execution.
                                      Default 64Kb, min: 16Kb */
+  uint32_t query_cache_sz;      /**< Max number of parsed queries kept by `ejdb_query_acquire()` cache. Default: 256 */
+  bool no_query_cache;          /**< Do not cache parsed queries. Default: false */
+  bool snapshot_reads;          /**< Read only queries and `ejdb_get()` see consistent point in time view of collection
+                                     and do not wait for collection writers. Versions of documents replaced by writers
+                                     are kept in memory while they are visible to running queries. Default: false */
+  uint32_t document_cache_sz;   /**< Max size in bytes of per collection cache of recently read documents
+                                     used by `ejdb_get()` and index lookups of queries. Default: 0 (disabled) */
 } EJDB_OPTS;
 
 /**
@@ -176,6 +231,13 @@ typedef struct _EJDB_EXEC {
   int64_t cnt;                /**< Number of result documents processed by `visitor` */
   IWXSTR *log;                /**< Optional query execution log buffer. If set major query execution/index selection steps will be logged into */
   IWPOOL *pool;               /**< Optional pool which can be used in query apply  */
+  uint32_t parallel;          /**< Optional number of threads used to scan collection when query
+                                   is not served by index. Zero or one means sequential scan.
+                                   Not used for queries with sorting, apply or delete.
+                                   `visitor` is always called by thread executing query,
+                                   negative visitor `step` values are not supported in parallel mode. */
+  bool parallel_unordered;    /**< If set documents found by parallel scan are passed to `visitor`
+                                   as soon as they are available, otherwise in the same order as sequential scan. */
 } EJDB_EXEC;
 
 /**
@@ -254,6 +316,48 @@ IW_EXPORT WUR iwrc ejdb_exec(EJDB_EXEC *ux);
  */
 IW_EXPORT WUR iwrc ejdb_list(EJDB db, JQL q, EJDB_DOC *first, int64_t limit, IWPOOL *pool);
 
+/**
+ * @brief Get query object for the given query text.
+ *
+ * Parsed queries are kept in the database wide LRU cache keyed by collection name and query text,
+ * so repeated queries skip parsing. Returned query object is owned by caller until it is returned
+ * back by `ejdb_query_release()`, hence the same query text can be executed concurrently.
+ * Query placeholders are always unset in acquired query object.
+ *
+ * @code {.c}
+ *  JQL q;
+ *  iwrc rc = ejdb_query_acquire(db, "parrots", "/[age > :age]", 0, &q);
+ *  RCRET(rc);
+ *  rc = jql_set_i64(q, "age", 0, 3);
+ *  ...
+ *  rc = ejdb_exec(&ux);
+ *  ejdb_query_release(db, &q);
+ * @endcode
+ *
+ * @param db          Database handle. Not zero.
+ * @param coll        Collection name. If zero, collection name must be encoded in query.
+ * @param query       Query text. Not zero.
+ * @param mode        Query creation mode. @see jql_create2()
+ * @param [out] qptr  Query object holder. Not zero.
+ *                    On parse error it is set only in `JQL_KEEP_QUERY_ON_PARSE_ERROR` mode.
+ *
+ * @return `0` on success.
+ *          Any non zero error codes.
+ */
+IW_EXPORT WUR iwrc ejdb_query_acquire(EJDB db, const char *coll, const char *query,
+                                      jql_create_mode_t mode, JQL *qptr);
+
+/**
+ * @brief Return query object acquired by `ejdb_query_acquire()` back to the cache.
+ *
+ * Query object is reset and must not be used after this call.
+ * Query may be released after database is closed, in this case it is just destroyed.
+ *
+ * @param db    Database handle the query was acquired from.
+ * @param qptr  Query object holder. `*qptr` is set to zero.
+ */
+IW_EXPORT void ejdb_query_release(EJDB db, JQL *qptr);
+
 IW_EXPORT WUR iwrc ejdb_count(EJDB db, JQL q, int64_t *count, int64_t limit);
 
 /**
@@ -375,6 +479,50 @@ IW_EXPORT WUR iwrc ejdb_put(EJDB db, const char *coll, JBL jbl, int64_t id);
  */
 IW_EXPORT WUR iwrc ejdb_put_new(EJDB db, const char *coll, JBL jbl, int64_t *oid);
 
+/**
+ * @brief Save a batch of documents under specified identifiers.
+ *
+ * Collection and database locks are acquired once for the whole batch
+ * and documents are stored in ascending order of their identifiers.
+ * If identifier occurs in batch several times the last document is stored,
+ * as with sequential `ejdb_put()` calls.
+ * Database WAL checkpoint cannot happen in the middle of a batch.
+ *
+ * Batch is not atomic: processing stops on the first failed document,
+ * documents stored before it are kept.
+ *
+ * @param db        Database handle. Not zero.
+ * @param coll      Collection name. Not zero.
+ * @param docs      Array of JSON documents. Not zero.
+ * @param ids       Array of document identifiers, one per document. Not zero.
+ * @param num       Number of documents in batch.
+ *
+ * @return `0` on success.
+ *          Any non zero error codes.
+ */
+IW_EXPORT WUR iwrc ejdb_put_batch(EJDB db, const char *coll, const JBL *docs, const int64_t *ids, size_t num);
+
+/**
+ * @brief Save a batch of new documents into `coll` under new generated identifiers.
+ *
+ * Collection and database locks are acquired once for the whole batch.
+ * Database WAL checkpoint cannot happen in the middle of a batch.
+ *
+ * Batch is not atomic: processing stops on the first failed document,
+ * documents stored before it are kept and their identifiers are set in `oids`,
+ * identifiers of remaining documents are set to zero.
+ *
+ * @param db          Database handle. Not zero.
+ * @param coll        Collection name. Not zero.
+ * @param docs        Array of JSON documents. Not zero.
+ * @param num         Number of documents in batch.
+ * @param [out] oids  Optional array of `num` placeholders for new document ids.
+ *
+ * @return `0` on success.
+ *          Any non zero error codes.
+ */
+IW_EXPORT WUR iwrc ejdb_put_new_batch(EJDB db, const char *coll, const JBL *docs, size_t num, int64_t *oids);
+
 /**
  * @brief Retrieve document identified by given `id` from collection `coll`.
  *
@@ -439,6 +587,56 @@ IW_EXPORT iwrc ejdb_rename_collection(EJDB db, const char *coll, const char *new
  */
 IW_EXPORT iwrc ejdb_ensure_collection(EJDB db, const char *coll);
 
+/**
+ * @brief Get handle of collection `coll` used to access collection documents
+ *        without lookup of collection by name.
+ *        Collection is created if it has not existed before.
+ *
+ * Handle is valid until it is released by `ejdb_coll_handle_release()` or database is closed.
+ * Renamed collection is accessible by its handle. Once collection is removed
+ * operations on handle return `EJDB_ERROR_COLLECTION_NOT_FOUND`, memory of removed
+ * collection is kept until all its handles are released.
+ *
+ * @param db          Database handle. Not zero.
+ * @param coll        Collection name. Not zero.
+ * @param [out] collp Placeholder for collection handle.
+ *
+ * @return `0` on success.
+ *          Any non zero error codes.
+ */
+IW_EXPORT WUR iwrc ejdb_coll_handle(EJDB db, const char *coll, EJDB_COLL *collp);
+
+/**
+ * @brief Releases collection handle acquired by `ejdb_coll_handle()`.
+ *        Handle is set to zero.
+ */
+IW_EXPORT void ejdb_coll_handle_release(EJDB_COLL *collp);
+
+/**
+ * @brief Retrieve document identified by given `id` from collection `coll`.
+ * @see ejdb_get()
+ */
+IW_EXPORT WUR iwrc ejdb_coll_get(EJDB_COLL coll, int64_t id, JBL *jblp);
+
+/**
+ * @brief Save document under specified `id` into collection `coll`.
+ * @see ejdb_put()
+ */
+IW_EXPORT WUR iwrc ejdb_coll_put(EJDB_COLL coll, JBL jbl, int64_t id);
+
+/**
+ * @brief Save a new document into collection `coll` under new generated identifier.
+ *        Identifier is allocated before collection is locked.
+ * @see ejdb_put_new()
+ */
+IW_EXPORT WUR iwrc ejdb_coll_put_new(EJDB_COLL coll, JBL jbl, int64_t *oid);
+
+/**
+ * @brief Remove document identified by given `id` from collection `coll`.
+ * @see ejdb_del()
+ */
+IW_EXPORT iwrc ejdb_coll_del(EJDB_COLL coll, int64_t id);
+
 /**
  * @brief Create index with specified parameters if it has not existed before.
  *
@@ -462,22 +660,93 @@ IW_EXPORT iwrc ejdb_ensure_collection(EJDB db, const char *coll);
  * iwrc rc = ejdb_ensure_index(db, "mycoll", "/address/street", EJDB_IDX_UNIQUE | EJDB_IDX_STR);
  * @endcode
  *
+ * Create composite index serving queries like `/[tenant = :t] and /[created > :c] | desc /created`:
+ *
+ * @code {.c}
+ * iwrc rc = ejdb_ensure_index(db, "mycoll", "/tenant,/created", EJDB_IDX_COMPOSITE);
+ * @endcode
+ *
  * @param db    Database handle. Not zero.
  * @param coll  Collection name. Not zero.
- * @param path  rfc6901 JSON pointer to indexed field.
+ * @param path  rfc6901 JSON pointer to indexed field
+ *              or comma separated list of pointers for `EJDB_IDX_COMPOSITE` index.
  * @param mode  Index mode.
  *
  * @return `0` on success.
  *         `EJDB_ERROR_INVALID_INDEX_MODE` Invalid `mode` specified
  *         `EJDB_ERROR_MISMATCHED_INDEX_UNIQUENESS_MODE` trying to create non unique index over existing unique or vice versa.
+ *         `EJDB_ERROR_INDEX_BUILD_IN_PROGRESS` index is being built by `ejdb_ensure_index_online()`.
+ *         `EJDB_ERROR_MISMATCHED_INDEX_FILTER` partial index created by `ejdb_ensure_index2()` exists over `path`.
  *          Any non zero error codes.
  *
  */
 IW_EXPORT iwrc ejdb_ensure_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode);
 
+/**
+ * @brief Create partial index with specified parameters if it has not existed before.
+ *
+ * Partial index is like `ejdb_ensure_index()` index but contains only records
+ * of documents matched by `filter` query. Query may use partial index
+ * only if its filter implies index `filter`, it is checked by expressions over the same fields:
+ * equality or `in` expressions with values matched by index `filter`
+ * or range expressions within `filter` ranges.
+ * Index `filter` may consist only of `and` joined filters without negations and regular expressions,
+ * otherwise index is never used by queries.
+ *
+ * Create index over `status` of not deleted documents:
+ *
+ * @code {.c}
+ * iwrc rc = ejdb_ensure_index2(db, "mycoll", "/status", EJDB_IDX_STR, "/[deleted = false]");
+ * @endcode
+ *
+ * It serves queries like `/[deleted = false] and /[status = "open"]`.
+ *
+ * @param db      Database handle. Not zero.
+ * @param coll    Collection name. Not zero.
+ * @param path    Index path, see `ejdb_ensure_index()`.
+ * @param mode    Index mode.
+ * @param filter  Filter part of JQL query without collection, projection and options.
+ *                If zero `ejdb_ensure_index()` is called.
+ *
+ * @return `0` on success.
+ *         `EJDB_ERROR_INVALID_INDEX_FILTER` `filter` is not a plain filter query.
+ *         `EJDB_ERROR_MISMATCHED_INDEX_FILTER` index over `path` exists with other `filter`.
+ *          Any error codes of `ejdb_ensure_index()`.
+ */
+IW_EXPORT iwrc ejdb_ensure_index2(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode,
+                                  const char *filter);
+
+/**
+ * @brief Create index like `ejdb_ensure_index()` without blocking collection writers.
+ *
+ * Collection documents are indexed by chunks in ascending order of ids,
+ * every chunk is indexed under collection read lock, so other threads
+ * are free to read and modify collection between chunks. Modifications of documents already
+ * visited by the build are applied to the index being built. Index is not used by
+ * queries until build is complete.
+ *
+ * Function returns when build is complete, run it in a separate thread to build index
+ * in background. Database must not be closed while build is in progress.
+ * Build is aborted if the collection is removed or unique index constraint is violated.
+ *
+ * @param db    Database handle. Not zero.
+ * @param coll  Collection name. Not zero.
+ * @param path  rfc6901 JSON pointer to indexed field.
+ * @param mode  Index mode.
+ *
+ * @return `0` on success.
+ *         `EJDB_ERROR_INDEX_BUILD_IN_PROGRESS` the same index is being built by another thread.
+ *         `EJDB_ERROR_COLLECTION_NOT_FOUND` collection was removed during index build.
+ *         `EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED` collection documents violate unique index constraint.
+ *          Any error codes of `ejdb_ensure_index()`.
+ */
+IW_EXPORT iwrc ejdb_ensure_index_online(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode);
+
 /**
  * @brief Remove index if it has existed before.
  *
+ * Partial index created by `ejdb_ensure_index2()` is removed regardless of its filter.
+ *
  * @param db    Database handle. Not zero.
  * @param coll  Collection name. Not zero.
  * @param path  rfc6901 JSON pointer to indexed field.
@@ -489,6 +758,78 @@ IW_EXPORT iwrc ejdb_ensure_index(EJDB db, const char *coll, const char *path, ej
  */
 IW_EXPORT iwrc ejdb_remove_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode);
 
+/**
+ * @brief Rebuilds existing index with another type of index keys.
+ *
+ * New index of `new_mode` is created and filled, then index of `mode` over the same `path` is removed.
+ * Filter of partial index is kept. It is the way to convert `EJDB_IDX_F64` index into `EJDB_IDX_F64B`:
+ *
+ * @code {.c}
+ * iwrc rc = ejdb_migrate_index(db, "mycoll", "/price", EJDB_IDX_F64, EJDB_IDX_F64B);
+ * @endcode
+ *
+ * Call is idempotent: if index of `mode` doesn't exist only index of `new_mode` is ensured.
+ * Composite indexes cannot be migrated.
+ *
+ * @param db        Database handle. Not zero.
+ * @param coll      Collection name. Not zero.
+ * @param path      rfc6901 JSON pointer to indexed field.
+ * @param mode      Index mode of existing index.
+ * @param new_mode  Index mode of new index. Must have another type of values than `mode`.
+ *
+ * @return `0` on success.
+ *         `EJDB_ERROR_INVALID_INDEX_MODE` Invalid `mode` or `new_mode` specified.
+ *          Will return `0` if collection is not found.
+ *          Any error codes of `ejdb_ensure_index()`.
+ */
+IW_EXPORT iwrc ejdb_migrate_index(EJDB db, const char *coll, const char *path, ejdb_idx_mode_t mode,
+                                  ejdb_idx_mode_t new_mode);
+
+/**
+ * @brief Collect statistics of all indexes of specified collection.
+ *
+ * For every index it stores the number of distinct values, an equi-depth histogram of
+ * index keys and the most common values with their frequencies. Query planner uses them
+ * to estimate the number of records matched by index expressions and to choose
+ * between indexes, intersection of indexes and full collection scan.
+ *
+ * Statistics are persisted in database meta and scaled to the actual number of index records
+ * on every query, so it is enough to analyze collection again after its data distribution
+ * has changed significantly. Statistics of `EJDB_IDX_COMPOSITE` index are collected over whole
+ * composite keys and estimate records matched by its bound fields.
+ * Without statistics index is not used for `in` arrays larger than 500 values
+ * or large relative to the number of index records.
+ *
+ * @param db    Database handle. Not zero.
+ * @param coll  Collection name. Not zero.
+ *
+ * @return `0` on success.
+ *         `IW_ERROR_NOT_EXISTS` if collection is not found.
+ *          Any non zero error codes.
+ */
+IW_EXPORT iwrc ejdb_analyze(EJDB db, const char *coll);
+
+/**
+ * @brief Sets documents compression mode of collection and recompresses all stored documents.
+ *
+ * Compression is transparent: documents are decompressed on read by queries, `ejdb_get()` and
+ * other API calls. Documents which are not reduced in size by compression are stored as is.
+ * For `EJDB_COMPRESS_LZ_DICT` mode new dictionary is built from a sample of documents stored in collection,
+ * so call it again to rebuild dictionary when the structure of documents is changed significantly.
+ * If collection is empty documents are compressed without dictionary until the next call.
+ *
+ * Collection is write locked until all documents are processed.
+ *
+ * @param db    Database handle. Not zero.
+ * @param coll  Collection name. Not zero.
+ * @param mode  Compression mode: `EJDB_COMPRESS_NONE`, `EJDB_COMPRESS_LZ` or `EJDB_COMPRESS_LZ_DICT`.
+ *
+ * @return `0` on success.
+ *         `IW_ERROR_NOT_EXISTS` if collection is not found.
+ *          Any non zero error codes.
+ */
+IW_EXPORT iwrc ejdb_compress_collection(EJDB db, const char *coll, ejdb_compress_t mode);
+
 /**
  * @brief Returns JSON document describind database structure.
  * @note Returned `jblp` must be disposed by `jbl_destroy()`
@@ -505,6 +846,7 @@ IW_EXPORT iwrc ejdb_remove_index(EJDB db, const char *coll, const char *path, ej
  *      "name": "c1",     // Collection name
  *      "dbid": 3,        // Collection database ID
  *      "rnum": 2,        // Number of documents in collection
+ *      "compression": 0, // Documents compression mode. See ejdb_compress_t
  *      "indexes": [      // List of collections indexes
  *       {
  *        "ptr": "/n",    // rfc6901 JSON pointer to indexed field
@@ -44,6 +44,7 @@
 #include <assert.h>
 #include <setjmp.h>
 #include "khash.h"
+#include "lzb.h"
 #include "ejdb2cfg.h"
 
 static_assert(JBNUMBUF_SIZE >= IWFTOA_BUFSIZE, "JBNUMBUF_SIZE >= IWFTOA_BUFSIZE");
@@ -52,6 +53,8 @@ static_assert(JBNUMBUF_SIZE >= IWFTOA_BUFSIZE, "JBNUMBUF_SIZE >= IWFTOA_BUFSIZE"
 #define NUMRECSDB_ID 2  // DB for number of records per index/collection
 #define KEY_PREFIX_COLLMETA   "c." // Full key format: c.<coldbid>
 #define KEY_PREFIX_IDXMETA    "i." // Full key format: i.<coldbid>.<idxdbid>
+#define KEY_PREFIX_IDXSTAT    "s." // Full key format: s.<coldbid>.<idxdbid>
+#define KEY_PREFIX_COLLZ      "z." // Full key format: z.<coldbid>
 
 #define ENSURE_OPEN(db_)                  \
   if (!(db_) || !((db_)->open)) {         \
@@ -79,14 +82,86 @@ static_assert(JBNUMBUF_SIZE >= IWFTOA_BUFSIZE, "JBNUMBUF_SIZE >= IWFTOA_BUFSIZE"
 
 #define API_COLL_UNLOCK(jbc_, rci_, rc_)                                     \
   do {                                                                    \
+    if ((jbc_)->vpending) jb_snapshot_commit(jbc_);                       \
     rci_ = pthread_rwlock_unlock(&(jbc_)->rwl);                            \
     if (rci_) IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_), rc_);  \
     API_UNLOCK((jbc_)->db, rci_, rc_);                                   \
   } while(0)
 
+#define API_COLL_SNAPSHOT_UNLOCK(jbc_, rci_, rc_)                            \
+  do {                                                                    \
+    rci_ = pthread_rwlock_unlock(&(jbc_)->slock);                          \
+    if (rci_) IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_), rc_);  \
+    API_UNLOCK((jbc_)->db, rci_, rc_);                                   \
+  } while(0)
+
 struct _JBIDX;
 typedef struct _JBIDX *JBIDX;
 
+// Max number of fields of composite index
+#define JB_IDX_COMPOSITE_MAX_FIELDS 8
+
+// Version of composite index keys format, stored in index meta as `ckv`.
+// Composite indexes of previous versions are rebuilt on database open.
+#define JB_IDX_CK_VERSION 2
+
+// Index mode bits of indexed values type
+#define JB_IDX_TYPE_MASK (EJDB_IDX_STR | EJDB_IDX_I64 | EJDB_IDX_F64 | EJDB_IDX_F64B)
+
+KHASH_SET_INIT_INT64(JBIDS)
+
+/** Version of document replaced by collection write */
+struct _JBDVER {
+  uint64_t ver;             /**< Version of collection write replaced this document version */
+  struct _JBDVER *next;     /**< Document version replaced by previous write */
+  size_t size;              /**< Size of document data, zero if document did not exist */
+  uint8_t data[];           /**< Document data */
+};
+
+KHASH_MAP_INIT_INT64(JBDVERS, struct _JBDVER *)
+
+/** Document cache entry, data is immutable and shared by documents returned from cache */
+struct _JBDCE {
+  int64_t id;               /**< Document id */
+  uint32_t refs;            /**< Number of references: cache itself and documents using entry data */
+  bool ref;                 /**< CLOCK reference bit, set on every cache hit */
+  size_t slot;              /**< Position in CLOCK ring */
+  size_t size;              /**< Size of document data */
+  uint8_t data[];           /**< Document data */
+};
+
+KHASH_MAP_INIT_INT64(JBDCM, struct _JBDCE *)
+
+/** Size bounded CLOCK cache of recently read documents of collection */
+struct _JBDCACHE {
+  khash_t(JBDCM) *map;      /**< Document id to cache entry */
+  struct _JBDCE **ring;     /**< CLOCK ring of entries */
+  size_t num;               /**< Number of entries */
+  size_t asz;               /**< Allocated size of ring */
+  size_t hand;              /**< CLOCK hand, position of the next eviction candidate */
+  size_t size;              /**< Size of cached data in bytes */
+  size_t max_size;          /**< Cache size budget in bytes (EJDB_OPTS.document_cache_sz) */
+  uint64_t hits;            /**< Number of cache hits */
+  uint64_t misses;          /**< Number of cache misses */
+  pthread_mutex_t mtx;
+};
+
+// Stored documents are binn containers, compressed document starts with this byte
+#define JB_ZDOC_MAGIC 0x01U
+// Compressed document header: magic, dictionary id (u32 le), size of document (u32 le)
+#define JB_ZDOC_HDR_SZ 9
+
+/** Stored document data is compressed by collection documents compression */
+#define JB_ZDOC_PACKED(data_, size_) \
+  ((size_) > JB_ZDOC_HDR_SZ && *(const uint8_t *) (data_) == JB_ZDOC_MAGIC)
+
+/** Dictionary of collection documents compression */
+struct _JBZDICT {
+  uint32_t id;              /**< Dictionary id referenced by compressed documents */
+  LZB_DICT *lzd;
+  struct _JBZDICT *next;    /**< Previous dictionary, kept while collection is open */
+};
+
 /** Database collection */
 typedef struct _JBCOLL {
   uint32_t dbid;            /**< IWKV collection database ID */
@@ -95,24 +170,121 @@ typedef struct _JBCOLL {
   EJDB db;                  /**< Main database reference */
   JBL meta;                 /**< Collection meta object */
   JBIDX idx;                /**< First index in chain */
+  JBIDX bidx;               /**< Indexes being built by `ejdb_ensure_index_online()` */
   int64_t rnum;             /**< Number of records stored in collection */
   pthread_rwlock_t rwl;
   int64_t id_seq;
+  pthread_rwlock_t slock;   /**< Indexes chain lock used by snapshot readers instead of `rwl` */
+  pthread_rwlock_t vlock;   /**< Documents versions lock, held by writers during document modification */
+  khash_t(JBDVERS) *dvers;  /**< Replaced versions of documents still visible to snapshots (EJDB_OPTS.snapshot_reads) */
+  struct _JBSNAP *snaps;    /**< Active snapshots */
+  uint64_t ver;             /**< Version of the last completed collection write */
+  uint64_t gcver;           /**< Versions of documents up to this version are released */
+  bool vpending;            /**< Collection write in progress replaced documents versions */
+  bool removed;             /**< Collection is removed, kept until no reader or handle can use it */
+  struct _JBCOLL *rnext;    /**< Next removed collection */
+  uint64_t repoch;          /**< Registry epoch collection was removed at */
+  uint32_t nhandles;        /**< Number of acquired collection handles */
+  struct _JBDCACHE *dcache; /**< Cache of recently read documents (EJDB_OPTS.document_cache_sz), optional */
+  ejdb_compress_t zmode;    /**< Compression mode of stored documents */
+  struct _JBZDICT *zdict;   /**< Dictionary used to compress stored documents (optional) */
+  struct _JBZDICT *zdicts;  /**< Dictionaries of compressed documents, the newest first */
 } *JBCOLL;
 
+/** Collection entry of collections registry */
+struct _JBCREGE {
+  const char *name;
+  JBCOLL jbc;
+};
+
+/**
+ * @brief Immutable registry of collections sorted by name.
+ * Published on every change of collections set and used to find collection
+ * without database lock. Replaced registries are retired and released
+ * by epoch based reclamation once readers which could see them are gone.
+ */
+struct _JBCREG {
+  struct _JBCREG *next;     /**< Next retired registry */
+  uint64_t epoch;           /**< Registry epoch it was retired at */
+  size_t num;               /**< Number of collections */
+  struct _JBCREGE colls[];  /**< Collections sorted by name, names are stored after entries */
+};
+
+// Number of reader slots of collections registry read section
+#define JB_CREG_SLOTS 64
+
+/**
+ * @brief Reader slot of collections registry read section.
+ * Readers of different threads are spread over slots to avoid contention on a shared counter.
+ * Slot is padded so counters of adjacent slots never share a cache line.
+ */
+struct _JBCREGSLOT {
+  uint32_t readers[2];      /**< Number of readers entered at even and odd registry epochs */
+  char pad[128 - 2 * sizeof(uint32_t)];
+};
+
+/** Index statistics collected by `ejdb_analyze()` */
+struct _JBIDXSTAT {
+  int64_t rnum;             /**< Number of index records at the time of analyze */
+  int64_t ndv;              /**< Number of distinct index keys */
+  int64_t mcv_rnum;         /**< Number of index records having one of most common keys */
+  uint32_t bnum;            /**< Number of equi-depth histogram bounds */
+  uint32_t mnum;            /**< Number of most common keys */
+  IWKV_val *bounds;         /**< Histogram bounds in ascending key order */
+  IWKV_val *mcvs;           /**< Most common keys */
+  int64_t *mfreqs;          /**< Number of index records of every most common key */
+  IWPOOL *pool;             /**< Memory pool for keys data */
+};
+
 /** Database collection index */
 struct _JBIDX {
   ejdb_idx_mode_t mode;     /**< Index mode/type mask */
   iwdb_flags_t idbf;        /**< Index database flags */
   JBCOLL jbc;               /**< Owner document collection */
   JBL_PTR ptr;              /**< Indexed JSON path poiner 0*/
+  JBL_PTR *cptrs;           /**< Pointers to fields of composite index, `ptr` is the first one */
+  int cnum;                 /**< Number of fields of composite index, zero for single field index */
+  uint32_t ckv;             /**< Keys format version of composite index */
+  bool coerced;             /**< Index has keys converted from JSON values of other type, see `jbi_jbl_fill_ikey()` */
+  JQL fq;                   /**< Filter of partial index (optional) */
+  char *fqs;                /**< Filter query text of partial index */
   IWDB idb;                 /**< KV database for this index */
   uint32_t dbid;            /**< IWKV collection database ID */
   int64_t rnum;             /**< Number of records stored in index */
+  struct _JBIDXSTAT *stat;  /**< Index statistics (optional) */
+  int64_t build_fence;      /**< Online build: documents with ids up to fence are indexed */
+  bool build_fenced;        /**< Online build: `build_fence` is set by the first indexed document */
+  iwrc build_rc;            /**< Online build: first error of index maintenance by writers */
   struct _JBIDX *next;      /**< Next index in chain */
 };
 
+/** Parsed query cache entry */
+struct _JBQCE {
+  JQL q;                    /**< Parsed query */
+  char *key;                /**< Cache key: collection name and query text */
+  struct _JBQCACHE *qc;     /**< Cache entry belongs to */
+  struct _JBQCE *prev;      /**< Previous entry in LRU list */
+  struct _JBQCE *next;      /**< Next entry in LRU list */
+  struct _JBQCE *knext;     /**< Next idle entry with the same key */
+};
+
 KHASH_MAP_INIT_STR(JBCOLLM, JBCOLL)
+KHASH_MAP_INIT_STR(JBQCM, struct _JBQCE *)
+
+/**
+ * LRU cache of idle parsed queries.
+ * Referenced by database and by every acquired entry, so queries
+ * acquired from cache may be released after database is closed.
+ */
+struct _JBQCACHE {
+  khash_t(JBQCM) *map;      /**< Cache key to the chain of idle entries. Zero when database is closed */
+  struct _JBQCE *head;      /**< Most recently used entry */
+  struct _JBQCE *tail;      /**< Least recently used entry */
+  uint32_t num;             /**< Number of idle entries */
+  uint32_t max;             /**< Max number of idle entries */
+  uint32_t refs;            /**< Number of references: database and acquired entries */
+  pthread_mutex_t mtx;
+};
 
 struct _EJDB {
   IWKV iwkv;
@@ -122,6 +294,13 @@ struct _EJDB {
   JBR  jbr;
 #endif
   khash_t(JBCOLLM) *mcolls;
+  struct _JBCREG *creg;       /**< Collections registry of read path */
+  struct _JBCREG *cregs;      /**< Retired registries not released yet */
+  JBCOLL rcolls;              /**< Removed collections not released yet */
+  uint64_t creg_epoch;        /**< Registry epoch, advanced by reclamation of retired objects */
+  pthread_mutex_t creg_mtx;   /**< Guards retired registries and removed collections */
+  struct _JBCREGSLOT creg_slots[JB_CREG_SLOTS]; /**< Reader slots of registry read section */
+  struct _JBQCACHE *qcache;   /**< Parsed queries cache (optional) */
   iwkv_openflags oflags;
   pthread_rwlock_t rwl;       /**< Main RWL */
   struct _EJDB_OPTS opts;
@@ -135,27 +314,77 @@ struct _JBPHCTX {
   IWKV_val oldval;
 };
 
+/** Document of batch put */
+struct _JBBATCHREC {
+  int64_t id;
+  JBL jbl;
+  size_t pos;               /**< Position of document in batch */
+};
+
 struct _JBEXEC;
 
 typedef iwrc(*JB_SCAN_CONSUMER)(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id,
                                 int64_t *step, bool *matched, iwrc err);
 
+/** Snapshot of collection used by query executed in snapshot read mode */
+struct _JBSNAP {
+  uint64_t ver;                 /**< Version of the last collection write visible in snapshot */
+  struct _JBSNAP *next;         /**< Next active snapshot of collection */
+  khash_t(JBIDS) *ids;          /**< Ids of documents matched by scan */
+  JB_SCAN_CONSUMER consumer;    /**< Target consumer */
+  bool final;                   /**< Scan is finished, documents are fetched as of snapshot version */
+};
+
 /**
- * @brief Index can sorter consumer context
+ * @brief Sorted run of records spilled into sort overflow file
+ */
+struct _JBSRUN {
+  off_t rpos;                 /**< Next read position in sort overflow file */
+  off_t end;                  /**< End position of run in sort overflow file */
+  uint8_t *buf;               /**< Read buffer */
+  size_t bufsz;               /**< Allocated size of buf */
+  size_t bpos;                /**< Current record offset in buf */
+  size_t blen;                /**< Number of bytes read into buf */
+};
+
+/**
+ * @brief Result set sorter consumer context
+ *
+ * Sort record layout: `[key length:u32][normalized sort key][document id:i64]`
  */
 struct _JBSSC {
-  iwrc rc;                    /**< RC code used for in `_jb_do_sorting` */
-  uint32_t *refs;             /**< Document references array */
-  uint32_t refs_asz;          /**< Document references array allocated size */
-  uint32_t refs_num;          /**< Document references array elements count */
-  uint32_t docs_asz;          /**< Documents array allocated size */
-  uint8_t *docs;              /**< Documents byte array */
-  uint32_t docs_npos;         /**< Next document offset */
-  jmp_buf fatal_jmp;
+  uint32_t *refs;             /**< Offsets of sort records in recs */
+  uint32_t refs_asz;          /**< Refs array allocated number of elements */
+  uint32_t refs_num;          /**< Refs array elements count */
+  uint8_t *recs;              /**< Sort records buffer */
+  uint32_t recs_asz;          /**< Sort records buffer allocated size */
+  uint32_t recs_npos;         /**< Next sort record offset */
+  uint8_t *kbuf;              /**< Buffer used to build sort key of current document */
+  size_t kbuf_asz;            /**< Key buffer allocated size */
+  struct _JBSRUN *runs;       /**< Sorted runs spilled into sort overflow file */
+  uint32_t runs_num;          /**< Number of spilled runs */
+  uint32_t *heap;             /**< Binary heap of runs indexes used by runs merge */
+  uint32_t heap_num;          /**< Number of elements in heap */
+  uint8_t **topk;             /**< Top-K collector heap of records, the worst record on top */
+  uint32_t topk_num;          /**< Number of records in topk heap */
+  uint32_t topk_max;          /**< Max number of records kept by top-K collector, zero if not used */
+  uint64_t seq;               /**< Sequence number of the next matched document */
+  int64_t pos;                /**< Current record position of sorted result set */
+  off_t sof_npos;             /**< Next write position in sort overflow file */
   IWFS_EXT sof;               /**< Sort overflow file */
   bool sof_active;
 };
 
+/**
+ * @brief Index intersection context
+ */
+struct _JBISECT {
+  int64_t *ids;               /**< Sorted ids of documents matched by all secondary indexes */
+  size_t num;                 /**< Number of elements in ids array */
+  bool active;                /**< Intersection filter is active */
+  bool inexact;               /**< Keys of some intersected index do not reproduce JQL equality */
+};
+
 struct _JBMIDX {
   JBIDX idx;                          /**< Index matched this filter */
   JQP_FILTER *filter;                 /**< Query filter */
@@ -165,6 +394,25 @@ struct _JBMIDX {
   IWKV_cursor_op cursor_init;         /**< Initial index cursor position (optional) */
   IWKV_cursor_op cursor_step;         /**< Next index cursor step */
   bool orderby_support;               /**< Index supported first order-by clause */
+  const char *prefix;                 /**< Common prefix of scanned string keys of `sw` or anchored `re` expression (optional) */
+  int64_t rows;                       /**< Estimated number of index records to scan, zero if unknown */
+  int64_t cost;                       /**< Selection cost of candidate index, see `_jbi_idx_sort()` */
+  size_t ord;                         /**< Position of candidate index before sorting */
+  JQP_EXPR *ceq[JB_IDX_COMPOSITE_MAX_FIELDS]; /**< Composite index: equality expressions of leading fields */
+  int ceq_num;                        /**< Composite index: number of leading fields bound by equality */
+  JQP_EXPR *clower;                   /**< Composite index: lower bound of the next field (optional) */
+  JQP_EXPR *cupper;                   /**< Composite index: upper bound of the next field (optional) */
+};
+
+/**
+ * @brief Index union context used for OR queries
+ */
+struct _JBUNION {
+  struct _JBMIDX *midx;       /**< Index matching contexts, one per OR branch */
+  size_t num;                 /**< Number of OR branches */
+  khash_t(JBIDS) *ids;        /**< Ids of documents already passed to the consumer */
+  JB_SCAN_CONSUMER consumer;  /**< Target consumer */
+  bool stop;                  /**< Scan of remaining branches is not needed */
 };
 
 typedef struct _JBEXEC {
@@ -175,38 +423,118 @@ typedef struct _JBEXEC {
   iwrc (*scanner)(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
   uint8_t *jblbuf;         /**< Buffer used to keep currently processed document */
   size_t jblbufsz;         /**< Size of jblbuf allocated memory */
+  uint8_t *zbuf;           /**< Buffer swapped with jblbuf on decompression of document */
+  size_t zbufsz;           /**< Size of zbuf allocated memory */
   bool sorting;            /**< Resultset sorting needed */
+  bool index_only;         /**< Query is answered by index keys, documents are not fetched */
+  uint32_t parallel;       /**< Number of threads used by parallel full collection scan */
   IWKV_cursor_op cursor_init;         /**< Initial index cursor position (optional) */
   IWKV_cursor_op cursor_step;         /**< Next index cursor step */
   struct _JBMIDX midx;     /**< Index matching context */
   struct _JBSSC ssc;       /**< Result set sorting context */
+  struct _JBISECT isect;   /**< Secondary indexes intersection context */
+  struct _JBUNION iunion;  /**< OR branches index union context */
+  struct _JBSNAP *snap;    /**< Collection snapshot of query executed in snapshot read mode (optional) */
 } JBEXEC;
 
 
 typedef uint8_t jb_coll_acquire_t;
 #define JB_COLL_ACQUIRE_WRITE     ((jb_coll_acquire_t) 0x01U)
 #define JB_COLL_ACQUIRE_EXISTING  ((jb_coll_acquire_t) 0x02U)
+#define JB_COLL_ACQUIRE_SNAPSHOT  ((jb_coll_acquire_t) 0x04U)
 
 // Index selector empiric constants
 #define JB_IDX_EMPIRIC_MAX_INOP_ARRAY_SIZE 500
 #define JB_IDX_EMPIRIC_MIN_INOP_ARRAY_SIZE 10
 #define JB_IDX_EMPIRIC_MAX_INOP_ARRAY_RATIO 200
+#define JB_IDX_EMPIRIC_INOP_SEEK_COST 16
+#define JB_IDX_EMPIRIC_MAX_INTERSECT_IDS 1048576
+#define JB_IDX_EMPIRIC_MAX_INTERSECT_RATIO 8
+#define JB_IDX_EMPIRIC_MAX_SCAN_PCT 30
+#define JB_IDX_EMPIRIC_SORT_COST_FACTOR 2
+
+// Documents compression dictionary parameters
+#define JB_ZDICT_SIZE (32 * 1024)   // Max size of dictionary
+#define JB_ZDICT_SAMPLES 64         // Max number of sampled documents
+
+// Parallel full scan parameters
+#define JB_PARALLEL_SCAN_MAX_THREADS 64
+#define JB_PARALLEL_SCAN_MIN_RANGE 256
+#define JB_PARALLEL_SCAN_MAX_RANGE 16384
+
+// Max `skip + limit` of sorted query collected by top-K heap
+#define JB_SORT_TOPK_MAX_ROWS 10000
+
+// Number of documents indexed by `ejdb_ensure_index_online()` under a single collection lock
+#define JB_IDX_BUILD_CHUNK_SIZE 1024
+
+// Index bulk load parameters
+#define JB_IDX_LOAD_MAX_THREADS 8
+#define JB_IDX_LOAD_MIN_RANGE 4096
+
+// Index statistics parameters
+#define JB_IDX_STAT_BUCKETS 32
+#define JB_IDX_STAT_MCV_NUM 16
 
 void jbi_jbl_fill_ikey(JBIDX idx, JBL jbv, IWKV_val *ikey, char numbuf[static JBNUMBUF_SIZE]);
 void jbi_jqval_fill_ikey(JBIDX idx, const JQVAL *jqval, IWKV_val *ikey, char numbuf[static JBNUMBUF_SIZE]);
 void jbi_node_fill_ikey(JBIDX idx, JBL_NODE node, IWKV_val *ikey, char numbuf[static JBNUMBUF_SIZE]);
+uint64_t jbi_f64_ordered_bits(double v);
+double jbi_f64b_ikey_value(const void *data);
+
+/** Visitor of words of `EJDB_IDX_FTS` indexed text */
+typedef iwrc (*JBI_FTS_VISITOR)(const char *term, size_t len, void *op);
+
+/**
+ * @brief Splits string value `jbv` into normalized words stored as `EJDB_IDX_FTS` index keys.
+ * Values of other types are ignored.
+ */
+iwrc jbi_fts_jbl_visit(JBL jbv, JBI_FTS_VISITOR visitor, void *op);
 
 iwrc jbi_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, int64_t *step, bool *matched, iwrc err);
+iwrc jbi_doc_fetch(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, size_t *vszp);
+iwrc jbi_snapshot_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, int64_t *step, bool *matched, iwrc err);
+struct _JBDVER *jbi_snapshot_version(JBCOLL jbc, int64_t id, uint64_t ver);
 iwrc jbi_sorter_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, int64_t *step, bool *matched, iwrc err);
+iwrc jbi_consumer_matched(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, JBL jbl, int64_t *step);
 iwrc jbi_full_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
+uint32_t jbi_parallel_threads(struct _JBEXEC *ctx);
+iwrc jbi_parallel_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
 iwrc jbi_selection(JBEXEC *ctx);
+bool jbi_index_covered(JBEXEC *ctx);
 iwrc jbi_uniq_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
 iwrc jbi_dup_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
+iwrc jbi_union_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
+iwrc jbi_in_scanner(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER consumer);
+iwrc jbi_isect_add(struct _JBEXEC *ctx, struct _JBMIDX *midx, bool *addedp);
+bool jbi_isect_contains(struct _JBEXEC *ctx, int64_t id);
+void jbi_isect_release(struct _JBEXEC *ctx);
+iwrc jbi_stat_collect(JBIDX idx, struct _JBIDXSTAT **statp);
+iwrc jbi_stat_to_binn(JBIDX idx, struct _JBIDXSTAT *stat, binn **bnp);
+iwrc jbi_stat_from_buf(JBIDX idx, void *buf, size_t bufsz, struct _JBIDXSTAT **statp);
+void jbi_stat_release(struct _JBIDXSTAT **statp);
+int64_t jbi_stat_estimate(JBEXEC *ctx, struct _JBMIDX *midx);
+uint32_t jbi_idx_load_threads(JBIDX idx);
+iwrc jbi_idx_load(JBIDX idx, uint32_t threads, int64_t *rnum);
 bool jbi_node_expr_matched(JQP_AUX *aux, JBIDX idx, IWKV_cursor cur, JQP_EXPR *expr, iwrc *rcp);
+bool jbi_ikey_prefix_matched(IWKV_cursor cur, const char *prefix, iwrc *rcp);
+iwrc jbi_idx_ptr_serialize(JBIDX idx, IWXSTR *xstr);
+iwrc jbi_composite_fill_ikey(JBIDX idx, JBL jbl, IWXSTR *xstr, IWKV_val *ikey);
+iwrc jbi_composite_jqval_add(const JQVAL *jqval, IWXSTR *xstr);
+bool jbi_composite_jqval_exact(const JQVAL *jqval);
+iwrc jbi_composite_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
+iwrc jbi_fts_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer);
+iwrc jbi_idx_filter_prepare(JBIDX idx);
 
 iwrc jb_put(JBCOLL jbc, JBL jbl, int64_t id);
 iwrc jb_del(JBCOLL jbc, JBL jbl, int64_t id);
+void jb_snapshot_commit(JBCOLL jbc);
 iwrc jb_cursor_set(JBCOLL jbc, IWKV_cursor cur, int64_t id, JBL jbl);
 iwrc jb_cursor_del(JBCOLL jbc, IWKV_cursor cur, int64_t id, JBL jbl);
+struct _JBDCE *jb_dcache_acquire(JBCOLL jbc, int64_t id);
+void jb_dcache_release(struct _JBDCE *e);
+void jb_dcache_put(JBCOLL jbc, int64_t id, const void *data, size_t size);
+iwrc jb_doc_unpack(JBCOLL jbc, const void *data, size_t size, void *buf, size_t bufsz, size_t *vszp);
+iwrc jb_doc_unpack_val(JBCOLL jbc, IWKV_val *val);
 
 #endif
@@ -0,0 +1,246 @@
+#include "ejdb2_internal.h"
+
+/**
+ * @brief Composite index scan bounds.
+ *
+ * Every matched index key starts with `prefix` built from equality expressions of leading fields
+ * followed by type tag of range field if any. Range of next field is limited by `lower` and `upper` keys.
+ */
+struct _JBICS {
+  IWXSTR *prefix;             /**< Common prefix of matched keys */
+  IWXSTR *lower;              /**< Lower bound key (optional) */
+  IWXSTR *upper;              /**< Upper bound key (optional) */
+  bool lower_incl;            /**< Lower bound is inclusive */
+  bool upper_incl;            /**< Upper bound is inclusive */
+};
+
+static void _jbi_cs_release(struct _JBICS *cs) {
+  iwxstr_destroy(cs->prefix);
+  iwxstr_destroy(cs->lower);
+  iwxstr_destroy(cs->upper);
+}
+
+static iwrc _jbi_cs_bound(struct _JBEXEC *ctx, struct _JBICS *cs, JQP_EXPR *expr, IWXSTR **bp) {
+  iwrc rc = 0;
+  JQVAL *rv = jql_unit_to_jqval(ctx->ux->q->aux, expr->right, &rc);
+  RCRET(rc);
+  *bp = iwxstr_new();
+  if (!*bp) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  rc = iwxstr_cat(*bp, iwxstr_ptr(cs->prefix), iwxstr_size(cs->prefix));
+  RCRET(rc);
+  return jbi_composite_jqval_add(rv, *bp);
+}
+
+/**
+ * @brief Builds scan bounds of selected composite index.
+ * Sets `*emptyp` to true if no keys can be matched.
+ */
+static iwrc _jbi_cs_init(struct _JBEXEC *ctx, struct _JBICS *cs, bool *emptyp) {
+  iwrc rc = 0;
+  struct _JBMIDX *midx = &ctx->midx;
+  *emptyp = false;
+  cs->prefix = iwxstr_new();
+  if (!cs->prefix) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (int i = 0; i < midx->ceq_num; ++i) {
+    JQVAL *rv = jql_unit_to_jqval(ctx->ux->q->aux, midx->ceq[i]->right, &rc);
+    RCRET(rc);
+    rc = jbi_composite_jqval_add(rv, cs->prefix);
+    RCRET(rc);
+  }
+  size_t psz = iwxstr_size(cs->prefix);
+  if (midx->clower) {
+    rc = _jbi_cs_bound(ctx, cs, midx->clower, &cs->lower);
+    RCRET(rc);
+    cs->lower_incl = midx->clower->op->value == JQP_OP_GTE;
+  }
+  if (midx->cupper) {
+    rc = _jbi_cs_bound(ctx, cs, midx->cupper, &cs->upper);
+    RCRET(rc);
+    cs->upper_incl = midx->cupper->op->value == JQP_OP_LTE;
+  }
+  if (cs->lower || cs->upper) { // Range is limited by type of bound values
+    char ltag = cs->lower ? iwxstr_ptr(cs->lower)[psz] : 0;
+    char utag = cs->upper ? iwxstr_ptr(cs->upper)[psz] : 0;
+    if (ltag && utag && ltag != utag) {
+      *emptyp = true;
+      return 0;
+    }
+    rc = iwxstr_cat(cs->prefix, ltag ? &ltag : &utag, 1);
+  }
+  return rc;
+}
+
+/**
+ * @brief Compares `key` with bound key.
+ * @return Zero if bound is a prefix of key,
+ *         negative/positive number if key is less/greater than bound.
+ */
+static int _jbi_cs_bound_cmp(const uint8_t *key, size_t ksz, IWXSTR *bound) {
+  size_t bsz = iwxstr_size(bound);
+  int rv = memcmp(key, iwxstr_ptr(bound), MIN(ksz, bsz));
+  if (rv) {
+    return rv;
+  }
+  return ksz < bsz ? -1 : 0;
+}
+
+/**
+ * @brief Checks index key against scan bounds.
+ * @return `-1` if key is below scan range, `1` if above, zero if key is matched.
+ */
+static int _jbi_cs_check(struct _JBICS *cs, const uint8_t *key, size_t ksz) {
+  int rv = _jbi_cs_bound_cmp(key, ksz, cs->prefix);
+  if (rv) {
+    return rv < 0 ? -1 : 1;
+  }
+  if (cs->lower) {
+    rv = _jbi_cs_bound_cmp(key, ksz, cs->lower);
+    if (rv < 0 || (!rv && !cs->lower_incl)) {
+      return -1;
+    }
+  }
+  if (cs->upper) {
+    rv = _jbi_cs_bound_cmp(key, ksz, cs->upper);
+    if (rv > 0 || (!rv && !cs->upper_incl)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Opens index cursor at the first key of scan range according to scan direction.
+ */
+static iwrc _jbi_cs_cursor_open(struct _JBEXEC *ctx, struct _JBICS *cs, IWKV_cursor *curp) {
+  iwrc rc;
+  IWDB idb = ctx->midx.idx->idb;
+  IWKV_val key = { .compound = INT64_MIN };
+
+  if (ctx->midx.cursor_step == IWKV_CURSOR_PREV) { // Ascending scan
+    IWXSTR *start = cs->lower ? cs->lower : cs->prefix;
+    key.data = iwxstr_ptr(start);
+    key.size = iwxstr_size(start);
+    return iwkv_cursor_open(idb, curp, IWKV_CURSOR_GE, &key);
+  }
+
+  // Descending scan starts before the least key greater than all matched keys
+  IWXSTR *end = cs->upper ? cs->upper : cs->prefix;
+  size_t esz = iwxstr_size(end);
+  uint8_t *ep = malloc(esz);
+  if (!ep) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  memcpy(ep, iwxstr_ptr(end), esz);
+  if (!cs->upper || cs->upper_incl) {
+    for ( ; esz && ep[esz - 1] == 0xffU; --esz); // Successor of all keys prefixed by end
+    if (esz) {
+      ep[esz - 1]++;
+    }
+  }
+  if (esz) {
+    key.data = ep;
+    key.size = esz;
+    rc = iwkv_cursor_open(idb, curp, IWKV_CURSOR_GE, &key);
+    free(ep);
+    if (!rc) {
+      return iwkv_cursor_to(*curp, IWKV_CURSOR_NEXT);
+    } else if (rc != IWKV_ERROR_NOTFOUND) {
+      return rc;
+    }
+    iwkv_cursor_close(curp);
+  } else {
+    free(ep);
+  }
+  rc = iwkv_cursor_open(idb, curp, IWKV_CURSOR_BEFORE_FIRST, 0);
+  RCRET(rc);
+  return iwkv_cursor_to(*curp, IWKV_CURSOR_NEXT);
+}
+
+iwrc jbi_composite_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
+  size_t sz;
+  bool empty;
+  struct _JBICS cs = { 0 };
+  IWKV_cursor cur = 0;
+  char numbuf[JBNUMBUF_SIZE];
+  uint8_t skbuf[256];
+  uint8_t *kbuf = skbuf;
+  size_t kbufsz = sizeof(skbuf);
+
+  int64_t step = 1;
+  bool started = false;
+  struct _JBMIDX *midx = &ctx->midx;
+  bool compound = midx->idx->idbf & IWDB_COMPOUND_KEYS;
+  IWKV_cursor_op cursor_reverse_step = (midx->cursor_step == IWKV_CURSOR_PREV)
+                                       ? IWKV_CURSOR_NEXT : IWKV_CURSOR_PREV;
+  // Keys outside of scan range met before the first matched key are skipped
+  int skip_side = (midx->cursor_step == IWKV_CURSOR_PREV) ? -1 : 1;
+
+  iwrc rc = _jbi_cs_init(ctx, &cs, &empty);
+  if (rc || empty) {
+    goto finish;
+  }
+  rc = _jbi_cs_cursor_open(ctx, &cs, &cur);
+  RCGO(rc, finish);
+
+  do {
+    if (step > 0) --step;
+    else if (step < 0) ++step;
+    if (!step) {
+      int64_t id;
+      bool matched = false;
+      rc = iwkv_cursor_copy_key(cur, kbuf, kbufsz, &sz, &id);
+      RCGO(rc, finish);
+      if (sz > kbufsz) {
+        uint8_t *nbuf = malloc(sz);
+        if (!nbuf) {
+          rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+          goto finish;
+        }
+        if (kbuf != skbuf) {
+          free(kbuf);
+        }
+        kbuf = nbuf;
+        kbufsz = sz;
+        rc = iwkv_cursor_copy_key(cur, kbuf, kbufsz, &sz, &id);
+        RCGO(rc, finish);
+      }
+      int cv = _jbi_cs_check(&cs, kbuf, sz);
+      if (cv) {
+        if (cv == skip_side && !started) {
+          step = 1;
+          continue;
+        }
+        break;
+      }
+      if (!compound) {
+        rc = iwkv_cursor_copy_val(cur, numbuf, IW_VNUMBUFSZ, &sz);
+        RCGO(rc, finish);
+        if (sz > IW_VNUMBUFSZ) {
+          rc = IWKV_ERROR_CORRUPTED;
+          iwlog_ecode_error3(rc);
+          break;
+        }
+        IW_READVNUMBUF64_2(numbuf, id);
+      }
+      started = true;
+      step = 1;
+      rc = consumer(ctx, 0, id, &step, &matched, 0);
+      RCGO(rc, finish);
+    }
+  } while (step && !(rc = iwkv_cursor_to(cur, step > 0 ? midx->cursor_step : cursor_reverse_step)));
+
+finish:
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  if (cur) {
+    iwkv_cursor_close(&cur);
+  }
+  if (kbuf != skbuf) {
+    free(kbuf);
+  }
+  _jbi_cs_release(&cs);
+  return consumer(ctx, 0, 0, 0, 0, rc);
+}
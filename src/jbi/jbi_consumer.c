@@ -1,49 +1,183 @@
 #include "ejdb2_internal.h"
 
-iwrc jbi_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, int64_t *step, bool *matched, iwrc err) {
-  if (!id) { // EOF scan
-    return err;
+static iwrc _jbi_buf_ensure(struct _JBEXEC *ctx, size_t size) {
+  if (size <= ctx->jblbufsz) {
+    return 0;
+  }
+  size_t nsize = MAX(size, ctx->jblbufsz * 2);
+  void *nbuf = realloc(ctx->jblbuf, nsize);
+  if (!nbuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
+  ctx->jblbuf = nbuf;
+  ctx->jblbufsz = nsize;
+  return 0;
+}
 
-  iwrc rc;
-  struct _JBL jbl;
-  size_t vsz = 0;
-  EJDB_EXEC *ux = ctx->ux;
-  IWPOOL *pool = ux->pool;
+/**
+ * Decompresses document fetched into `ctx->jblbuf` using `ctx->zbuf`, then buffers are swapped.
+ */
+static iwrc _jbi_doc_unpack(struct _JBEXEC *ctx, size_t *vszp) {
+  size_t vsz;
+  iwrc rc = jb_doc_unpack(ctx->jbc, ctx->jblbuf, *vszp, ctx->zbuf, ctx->zbufsz, &vsz);
+  RCRET(rc);
+  if (vsz > ctx->zbufsz) {
+    size_t nsize = MAX(vsz, ctx->jblbufsz);
+    void *nbuf = realloc(ctx->zbuf, nsize);
+    if (!nbuf) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    ctx->zbuf = nbuf;
+    ctx->zbufsz = nsize;
+    rc = jb_doc_unpack(ctx->jbc, ctx->jblbuf, *vszp, ctx->zbuf, ctx->zbufsz, &vsz);
+    RCRET(rc);
+  }
+  uint8_t *buf = ctx->jblbuf;
+  size_t bufsz = ctx->jblbufsz;
+  ctx->jblbuf = ctx->zbuf;
+  ctx->jblbufsz = ctx->zbufsz;
+  ctx->zbuf = buf;
+  ctx->zbufsz = bufsz;
+  *vszp = vsz;
+  return 0;
+}
 
-start: {
-    if (cur) {
-      rc = iwkv_cursor_copy_val(cur, ctx->jblbuf, ctx->jblbufsz, &vsz);
-    } else {
-      IWKV_val key = {
-        .data = &id,
-        .size = sizeof(id)
-      };
-      rc = iwkv_get_copy(ctx->jbc->cdb, &key, ctx->jblbuf, ctx->jblbufsz, &vsz);
+/**
+ * Fetches document into `ctx->jblbuf`, zero `vszp` is set if document is not found.
+ * Documents looked up by id are served from collection documents cache if it is enabled.
+ * Compressed documents are decompressed.
+ * Documents modified after snapshot of query are not fetched by scan
+ * and fetched as of snapshot version when scan is finished.
+ */
+iwrc jbi_doc_fetch(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, size_t *vszp) {
+  iwrc rc = 0;
+  size_t vsz = 0;
+  struct _JBSNAP *snap = ctx->snap;
+  *vszp = 0;
+  if (snap) {
+    int rci = pthread_rwlock_rdlock(&ctx->jbc->vlock);
+    if (rci) {
+      return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    }
+    struct _JBDVER *v = jbi_snapshot_version(ctx->jbc, id, snap->ver);
+    if (v) {
+      if (snap->final && v->size) {
+        rc = _jbi_buf_ensure(ctx, v->size);
+        if (!rc) {
+          memcpy(ctx->jblbuf, v->data, v->size);
+          vsz = v->size;
+        }
+      }
+      goto finish;
     }
-    if (rc == IWKV_ERROR_NOTFOUND) {
-      rc = 0;
+  }
+  if (!cur) {
+    struct _JBDCE *e = jb_dcache_acquire(ctx->jbc, id);
+    if (e) {
+      rc = _jbi_buf_ensure(ctx, e->size);
+      if (!rc) {
+        memcpy(ctx->jblbuf, e->data, e->size);
+        vsz = e->size;
+      }
+      jb_dcache_release(e);
+      goto finish;
     }
+  }
+
+start:
+  if (cur) {
+    rc = iwkv_cursor_copy_val(cur, ctx->jblbuf, ctx->jblbufsz, &vsz);
+  } else {
+    IWKV_val key = {
+      .data = &id,
+      .size = sizeof(id)
+    };
+    rc = iwkv_get_copy(ctx->jbc->cdb, &key, ctx->jblbuf, ctx->jblbufsz, &vsz);
+  }
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    rc = 0;
+    vsz = 0;
+  }
+  RCGO(rc, finish);
+  if (vsz > ctx->jblbufsz) {
+    rc = _jbi_buf_ensure(ctx, vsz);
     RCGO(rc, finish);
-    if (vsz > ctx->jblbufsz) {
-      size_t nsize = MAX(vsz, ctx->jblbufsz * 2);
-      void *nbuf = realloc(ctx->jblbuf, nsize);
-      if (!nbuf) {
-        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-        goto finish;
+    goto start;
+  }
+  if (JB_ZDOC_PACKED(ctx->jblbuf, vsz)) {
+    rc = _jbi_doc_unpack(ctx, &vsz);
+    RCGO(rc, finish);
+  }
+  if (!cur && vsz) {
+    jb_dcache_put(ctx->jbc, id, ctx->jblbuf, vsz);
+  }
+
+finish:
+  if (snap) {
+    pthread_rwlock_unlock(&ctx->jbc->vlock);
+  }
+  if (!rc) {
+    *vszp = vsz;
+  }
+  return rc;
+}
+
+iwrc jbi_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, int64_t *step, bool *matched, iwrc err) {
+  if (!id) { // EOF scan
+    return err;
+  }
+  if (ctx->isect.active && !jbi_isect_contains(ctx, id)) {
+    // Document rejected by index intersection, skip it without fetching
+    return 0;
+  }
+
+  EJDB_EXEC *ux = ctx->ux;
+  if (ctx->index_only) {
+    if (ctx->snap) { // Document modified after snapshot is passed again when scan is finished
+      struct _JBDVER *v;
+      int rci = pthread_rwlock_rdlock(&ctx->jbc->vlock);
+      if (rci) {
+        return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+      }
+      v = jbi_snapshot_version(ctx->jbc, id, ctx->snap->ver);
+      pthread_rwlock_unlock(&ctx->jbc->vlock);
+      if (v) {
+        return 0;
       }
-      ctx->jblbuf = nbuf;
-      ctx->jblbufsz = nsize;
-      goto start;
     }
+    // Query is satisfied by index key, no need to fetch and match document
+    *matched = true;
+    if (ux->skip && ux->skip-- > 0) {
+      return 0;
+    }
+    ++ux->cnt;
+    *step = 1;
+    if (--ux->limit < 1) *step = 0;
+    return 0;
   }
 
+  size_t vsz;
+  struct _JBL jbl;
+  iwrc rc = jbi_doc_fetch(ctx, cur, id, &vsz);
+  if (rc || !vsz) {
+    return rc;
+  }
   rc = jbl_from_buf_keep_onstack(&jbl, ctx->jblbuf, vsz);
-  RCGO(rc, finish);
+  RCRET(rc);
 
   rc = jql_matched(ux->q, &jbl, matched);
-  if (rc || !*matched || (ux->skip && ux->skip-- > 0)) {
-    goto finish;
+  if (rc || !*matched) {
+    return rc;
+  }
+  return jbi_consumer_matched(ctx, cur, id, &jbl, step);
+}
+
+iwrc jbi_consumer_matched(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, JBL jbl, int64_t *step) {
+  iwrc rc = 0;
+  EJDB_EXEC *ux = ctx->ux;
+  IWPOOL *pool = ux->pool;
+  if (ux->skip && ux->skip-- > 0) {
+    return 0;
   }
   if (ctx->istep > 0) {
     --ctx->istep;
@@ -56,25 +190,25 @@ start: {
     struct JQP_AUX *aux = q->aux;
     struct _EJDB_DOC doc = {
       .id = id,
-      .raw = &jbl
+      .raw = jbl
     };
     if (aux->apply || aux->apply_placeholder || aux->projection) {
       JBL_NODE root;
       if (!pool) {
-        pool = iwpool_create(jbl.bn.size * 2);
+        pool = iwpool_create(jbl->bn.size * 2);
         if (!pool) {
           rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
           goto finish;
         }
       }
-      rc = jbl_to_node(&jbl, &root, pool);
+      rc = jbl_to_node(jbl, &root, pool);
       RCGO(rc, finish);
       doc.node = root;
       if (aux->qmode & JQP_QRY_APPLY_DEL) {
         if (cur) {
-          rc = jb_cursor_del(ctx->jbc, cur, id, &jbl);
+          rc = jb_cursor_del(ctx->jbc, cur, id, jbl);
         } else {
-          rc = jb_del(ctx->jbc, &jbl, id);
+          rc = jb_del(ctx->jbc, jbl, id);
         }
       } else if (aux->apply || aux->apply_placeholder) {
         struct _JBL sn = {0};
@@ -96,9 +230,9 @@ start: {
       }
     } else if (aux->qmode & JQP_QRY_APPLY_DEL) {
       if (cur) {
-        rc = jb_cursor_del(ctx->jbc, cur, id, &jbl);
+        rc = jb_cursor_del(ctx->jbc, cur, id, jbl);
       } else {
-        rc = jb_del(ctx->jbc, &jbl, id);
+        rc = jb_del(ctx->jbc, jbl, id);
       }
        RCGO(rc, finish);
     }
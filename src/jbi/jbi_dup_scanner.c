@@ -47,85 +47,6 @@ finish:
   return consumer(ctx, 0, 0, 0, 0, rc);
 }
 
-static int _jbi_cmp_jqval(const void *v1, const void *v2) {
-  iwrc rc;
-  const JQVAL *jqv1 = v1;
-  const JQVAL *jqv2 = v2;
-  return jql_cmp_jqval_pair(jqv1, jqv2, &rc);
-}
-
-static iwrc _jbi_consume_in_node(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER consumer) {
-  int i;
-  int64_t id;
-  bool matched;
-  char jqvarrbuf[512];
-  char numbuf[JBNUMBUF_SIZE];
-
-  iwrc rc = 0;
-  int64_t step = 1;
-  IWKV_cursor cur = 0;
-  struct _JBMIDX *midx = &ctx->midx;
-  JBIDX idx = midx->idx;
-  IWKV_val key = {.compound = INT64_MIN};
-  JBL_NODE nv = jqval->vnode->child;
-
-  for (i = 0; nv; nv = nv->next) {
-    if (nv->type >= JBV_BOOL && nv->type <= JBV_STR) ++i;
-  }
-  if (i == 0) {
-    return consumer(ctx, 0, 0, 0, 0, 0);
-  }
-
-  JQVAL *jqvarr = (i * sizeof(*jqvarr)) <= sizeof(jqvarrbuf)
-                  ? jqvarrbuf : malloc(i * sizeof(*jqvarr));
-  if (!jqvarr) {
-    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
-  }
-  for (i = 0, nv = jqval->vnode->child; nv; nv = nv->next) {
-    if (nv->type >= JBV_BOOL && nv->type <= JBV_STR) {
-      JQVAL jqv;
-      jql_node_to_jqval(nv, &jqv);
-      memcpy(&jqvarr[i++], &jqv, sizeof(jqv));
-    }
-  }
-  // Sort jqvarr according to index order, lowest first (asc)
-  qsort(jqvarr, i, sizeof(jqvarr[0]), _jbi_cmp_jqval);
-
-  for (int c = 0; c < i && !rc; ++c) {
-    JQVAL *jqv = &jqvarr[c];
-    jbi_jqval_fill_ikey(idx, jqv, &key, numbuf);
-    if (cur) {
-      iwkv_cursor_close(&cur);
-    }
-    rc = iwkv_cursor_open(idx->idb, &cur, IWKV_CURSOR_GE, &key);
-    RCGO(rc, finish);
-    do {
-      if (step > 0) --step;
-      else if (step < 0) ++step;
-      if (!step) {
-        rc = iwkv_cursor_is_matched_key(cur, &key, &matched, &id);
-        RCGO(rc, finish);
-        if (!matched) {
-          break;
-        }
-        step = 1;
-        rc = consumer(ctx, 0, id, &step, &matched, 0);
-        RCGO(rc, finish);
-      }
-    } while (step && !(rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV))); // !!! only one direction
-  }
-
-finish:
-  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
-  if (cur) {
-    iwkv_cursor_close(&cur);
-  }
-  if ((char *) jqvarr != jqvarrbuf) {
-    free(jqvarr);
-  }
-  return consumer(ctx, 0, 0, 0, 0, rc);
-}
-
 static iwrc _jbi_consume_scan(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER consumer) {
   size_t sz;
   IWKV_cursor cur;
@@ -172,6 +93,10 @@ static iwrc _jbi_consume_scan(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUME
       bool matched = false;
       rc = iwkv_cursor_copy_key(cur, 0, 0, &sz, &id);
       RCGO(rc, finish);
+      if (midx->prefix && !jbi_ikey_prefix_matched(cur, midx->prefix, &rc)) {
+        break;
+      }
+      RCGO(rc, finish);
       if (midx->expr2
           && !midx->expr2->prematched
           && !jbi_node_expr_matched(ctx->ux->q->aux, midx->idx, cur, midx->expr2, &rc)) {
@@ -181,7 +106,7 @@ static iwrc _jbi_consume_scan(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUME
       step = 1;
       rc = consumer(ctx, 0, id, &step, &matched, 0);
       RCGO(rc, finish);
-      if (!midx->expr1->prematched && matched) {
+      if (!midx->expr1->prematched && !midx->prefix && matched) {
         // Further scan will always match main index expression
         midx->expr1->prematched = true;
       }
@@ -246,7 +171,7 @@ iwrc jbi_dup_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
       return _jbi_consume_eq(ctx, jqval, consumer);
     case JQP_OP_IN:
       if (jqval->type == JQVAL_JBLNODE) {
-        return _jbi_consume_in_node(ctx, jqval, consumer);
+        return jbi_in_scanner(ctx, jqval, consumer);
       } else {
         iwlog_ecode_error3(IW_ERROR_ASSERTION);
         return IW_ERROR_ASSERTION;
@@ -255,6 +180,13 @@ iwrc jbi_dup_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
     default:
       break;
   }
+  if (midx->prefix) { // Scan of keys starting with prefix, expression is checked by consumer
+    JQVAL pjqv = {
+      .type = JQVAL_STR,
+      .vstr = midx->prefix
+    };
+    return _jbi_consume_scan(ctx, &pjqv, consumer);
+  }
 
   if (midx->expr1->op->value == JQP_OP_GT && jqval->type == JQVAL_I64) {
     JQVAL mjqv;
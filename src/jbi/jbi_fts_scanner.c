@@ -0,0 +1,139 @@
+#include "ejdb2_internal.h"
+
+/** Sorted set of document ids of posting list */
+struct _JBIFTSIDS {
+  int64_t *ids;
+  size_t num;
+  size_t asz;
+};
+
+static int _jbi_fts_id_cmp(const void *o1, const void *o2) {
+  int64_t v1 = *(const int64_t *) o1, v2 = *(const int64_t *) o2;
+  return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+static iwrc _jbi_fts_ids_add(struct _JBIFTSIDS *pl, int64_t id) {
+  if (pl->num >= pl->asz) {
+    size_t nsz = pl->asz ? pl->asz * 2 : 64;
+    int64_t *nids = realloc(pl->ids, nsz * sizeof(pl->ids[0]));
+    if (!nids) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    pl->ids = nids;
+    pl->asz = nsz;
+  }
+  pl->ids[pl->num++] = id;
+  return 0;
+}
+
+/**
+ * @brief Reads posting list of query term.
+ * Prefix term posting list is a union of posting lists of all words starting with term.
+ */
+static iwrc _jbi_fts_term_ids(JBIDX idx, const struct JQL_FTS_TERM *qt, struct _JBIFTSIDS *pl) {
+  iwrc rc;
+  size_t sz;
+  int64_t id;
+  bool matched;
+  IWKV_cursor cur;
+  uint8_t kbuf[JQL_FTS_TERM_MAX_SIZE];
+  IWKV_val key = {
+    .data = (void *) qt->term,
+    .size = qt->len,
+    .compound = INT64_MIN
+  };
+
+  pl->num = 0;
+  rc = iwkv_cursor_open(idx->idb, &cur, IWKV_CURSOR_GE, &key);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    return 0;
+  }
+  RCRET(rc);
+  do {
+    if (qt->prefix) {
+      rc = iwkv_cursor_copy_key(cur, kbuf, sizeof(kbuf), &sz, &id);
+      RCBREAK(rc);
+      if (sz < qt->len || memcmp(kbuf, qt->term, qt->len)) {
+        break;
+      }
+    } else {
+      rc = iwkv_cursor_is_matched_key(cur, &key, &matched, &id);
+      if (rc || !matched) {
+        break;
+      }
+    }
+    rc = _jbi_fts_ids_add(pl, id);
+    RCBREAK(rc);
+  } while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV)));
+
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  iwkv_cursor_close(&cur);
+  RCRET(rc);
+
+  if (pl->num > 1) {
+    qsort(pl->ids, pl->num, sizeof(pl->ids[0]), _jbi_fts_id_cmp);
+    size_t num = 1;
+    for (size_t i = 1; i < pl->num; ++i) { // Document may contain several words with the same prefix
+      if (pl->ids[num - 1] != pl->ids[i]) {
+        pl->ids[num++] = pl->ids[i];
+      }
+    }
+    pl->num = num;
+  }
+  return 0;
+}
+
+/** Leaves in `res` only ids contained in `pl` */
+static void _jbi_fts_ids_intersect(struct _JBIFTSIDS *res, const struct _JBIFTSIDS *pl) {
+  size_t num = 0;
+  for (size_t i = 0, j = 0; i < res->num && j < pl->num; ) {
+    if (res->ids[i] < pl->ids[j]) {
+      ++i;
+    } else if (res->ids[i] > pl->ids[j]) {
+      ++j;
+    } else {
+      res->ids[num++] = res->ids[i];
+      ++i, ++j;
+    }
+  }
+  res->num = num;
+}
+
+iwrc jbi_fts_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
+  iwrc rc = 0;
+  JQL_FTS_QUERY *fq;
+  struct _JBIFTSIDS res = { 0 }, pl = { 0 };
+  struct _JBMIDX *midx = &ctx->midx;
+  JQP_AUX *aux = ctx->ux->q->aux;
+
+  JQVAL *rv = jql_unit_to_jqval(aux, midx->expr1->right, &rc);
+  RCGO(rc, finish);
+  rc = jql_fts_query(aux, midx->expr1->op, rv, &fq);
+  if (rc || !fq->num) {
+    goto finish;
+  }
+  // Documents matched by query are contained in posting lists of all query terms
+  for (size_t i = 0; i < fq->num; ++i) {
+    rc = _jbi_fts_term_ids(midx->idx, &fq->terms[i], i ? &pl : &res);
+    RCGO(rc, finish);
+    if (i) {
+      _jbi_fts_ids_intersect(&res, &pl);
+    }
+    if (!res.num) {
+      goto finish;
+    }
+  }
+
+  int64_t step = 1;
+  for (int64_t i = 0; step && i >= 0 && i < res.num; i += step) {
+    bool matched = false;
+    step = 1;
+    rc = consumer(ctx, 0, res.ids[i], &step, &matched, 0);
+    RCGO(rc, finish);
+  }
+
+finish:
+  free(res.ids);
+  free(pl.ids);
+  return consumer(ctx, 0, 0, 0, 0, rc);
+}
@@ -0,0 +1,737 @@
+#include "ejdb2_internal.h"
+#include "sort_r.h"
+#include <ejdb2/iowow/iwp.h>
+
+// Load record layout: [key length:u32][load key][document id:i64]
+#define _JBIL_REC_HDR_SZ sizeof(uint32_t)
+
+// Min size of run read buffer used by runs merge
+#define _JBIL_RUN_BUF_MIN_SZ (16 * 1024)
+
+// Min size of worker records buffer
+#define _JBIL_BUF_MIN_SZ (64 * 1024)
+
+/**
+ * @brief Sorted run of index records.
+ *
+ * Last run of every worker is kept in memory,
+ * others are spilled into the worker overflow file.
+ */
+struct _JBILRUN {
+  IWFS_EXT *f;              /**< Overflow file of run, zero for in-memory run */
+  uint8_t *mem;             /**< Records of in-memory run */
+  off_t rpos;               /**< Next read position */
+  off_t end;                /**< End position of run */
+  uint8_t *buf;             /**< Read buffer of file run */
+  size_t bufsz;             /**< Allocated size of buf */
+  size_t bpos;              /**< Current record offset in buf */
+  size_t blen;              /**< Number of bytes read into buf */
+  uint8_t *rec;             /**< Current record or zero if run is exhausted */
+};
+
+struct _JBILOAD;
+
+/**
+ * @brief Index records extractor of documents ids range.
+ */
+struct _JBILWORKER {
+  struct _JBILOAD *ld;
+  int64_t lo;               /**< Lower id of range, inclusive */
+  int64_t hi;               /**< Upper id of range, inclusive */
+  uint8_t *recs;            /**< Index records buffer */
+  size_t recs_asz;          /**< Allocated size of recs */
+  size_t recs_npos;         /**< Next record offset in recs */
+  uint32_t *refs;           /**< Offsets of records in recs */
+  size_t refs_asz;          /**< Allocated number of refs elements */
+  size_t refs_num;          /**< Number of records in recs */
+  struct _JBILRUN *runs;    /**< Sorted runs */
+  uint32_t runs_num;        /**< Number of sorted runs */
+  IWFS_EXT f;               /**< Overflow file for spilled runs */
+  off_t f_npos;             /**< Next write position in overflow file */
+  bool f_active;
+  IWXSTR *ckey;             /**< Key buffer of composite index */
+  JQL fq;                   /**< Worker own copy of partial index filter */
+  pthread_t thr;
+  bool started;
+  iwrc rc;
+};
+
+/**
+ * @brief Index bulk load context
+ */
+struct _JBILOAD {
+  JBIDX idx;
+  size_t bufsz;              /**< Max size of records buffer of every worker */
+  struct _JBILWORKER *workers;
+  uint32_t workers_num;
+  struct _JBILRUN **heap;    /**< Binary heap of runs used by runs merge */
+  uint32_t heap_num;
+  bool stop;                 /**< Extraction should be stopped, checked by workers without lock */
+};
+
+IW_INLINE uint32_t _jbi_il_rec_klen(const uint8_t *rec) {
+  uint32_t klen;
+  memcpy(&klen, rec, sizeof(klen));
+  return klen;
+}
+
+IW_INLINE size_t _jbi_il_rec_size(const uint8_t *rec) {
+  return _JBIL_REC_HDR_SZ + _jbi_il_rec_klen(rec) + sizeof(int64_t);
+}
+
+IW_INLINE int64_t _jbi_il_rec_id(const uint8_t *rec) {
+  int64_t id;
+  memcpy(&id, rec + _JBIL_REC_HDR_SZ + _jbi_il_rec_klen(rec), sizeof(id));
+  return id;
+}
+
+IW_INLINE int _jbi_il_rec_key_cmp(const uint8_t *rec1, const uint8_t *rec2) {
+  uint32_t l1 = _jbi_il_rec_klen(rec1), l2 = _jbi_il_rec_klen(rec2);
+  int rv = memcmp(rec1 + _JBIL_REC_HDR_SZ, rec2 + _JBIL_REC_HDR_SZ, MIN(l1, l2));
+  if (!rv) {
+    rv = l1 > l2 ? 1 : l1 < l2 ? -1 : 0;
+  }
+  return rv;
+}
+
+static int _jbi_il_rec_cmp(const uint8_t *rec1, const uint8_t *rec2) {
+  int rv = _jbi_il_rec_key_cmp(rec1, rec2);
+  if (!rv) {
+    int64_t id1 = _jbi_il_rec_id(rec1), id2 = _jbi_il_rec_id(rec2);
+    rv = id1 > id2 ? 1 : id1 < id2 ? -1 : 0;
+  }
+  return rv;
+}
+
+static int _jbi_il_refs_cmp(const void *o1, const void *o2, void *op) {
+  uint32_t r1, r2;
+  const uint8_t *recs = op;
+  memcpy(&r1, o1, sizeof(r1));
+  memcpy(&r2, o2, sizeof(r2));
+  return _jbi_il_rec_cmp(recs + r1, recs + r2);
+}
+
+IW_INLINE void _jbi_il_u64_write(uint8_t *wp, uint64_t v) {
+  for (int i = 7; i >= 0; --i) {
+    wp[i] = (uint8_t) v;
+    v >>= 8;
+  }
+}
+
+IW_INLINE uint64_t _jbi_il_u64_read(const uint8_t *rp) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i) {
+    v = (v << 8) | rp[i];
+  }
+  return v;
+}
+
+//--------------------------- Load keys
+
+/**
+ * @brief Converts index key into load key.
+ *
+ * Load keys are compared by `memcmp()` in the same order as index keys are ordered by IWKV:
+ * - `EJDB_IDX_I64` sign-flipped big-endian integer
+ * - `EJDB_IDX_F64` order-preserving IEEE-754 bits of number followed by index key
+ * - `EJDB_IDX_STR`, `EJDB_IDX_F64B`, `EJDB_IDX_COMPOSITE` index key as is
+ */
+static size_t _jbi_il_key_encode(JBIDX idx, const IWKV_val *ikey, uint8_t *out) {
+  switch (idx->mode & (EJDB_IDX_STR | EJDB_IDX_I64 | EJDB_IDX_F64)) {
+    case EJDB_IDX_I64: {
+      int64_t llv;
+      memcpy(&llv, ikey->data, sizeof(llv));
+      _jbi_il_u64_write(out, (uint64_t) llv ^ (1ULL << 63));
+      return sizeof(uint64_t);
+    }
+    case EJDB_IDX_F64: {
+      // Index key is zero terminated by `jbi_ftoa()`
+      uint64_t u = jbi_f64_ordered_bits(strtod(ikey->data, 0));
+      _jbi_il_u64_write(out, u);
+      memcpy(out + sizeof(u), ikey->data, ikey->size);
+      return sizeof(u) + ikey->size;
+    }
+    default:
+      memcpy(out, ikey->data, ikey->size);
+      return ikey->size;
+  }
+}
+
+/**
+ * @brief Restores index key from load key of `rec`.
+ */
+static void _jbi_il_key_decode(JBIDX idx, const uint8_t *rec, IWKV_val *ikey, char numbuf[static JBNUMBUF_SIZE]) {
+  uint32_t klen = _jbi_il_rec_klen(rec);
+  const uint8_t *kp = rec + _JBIL_REC_HDR_SZ;
+  switch (idx->mode & (EJDB_IDX_STR | EJDB_IDX_I64 | EJDB_IDX_F64)) {
+    case EJDB_IDX_I64: {
+      int64_t llv = (int64_t) (_jbi_il_u64_read(kp) ^ (1ULL << 63));
+      memcpy(numbuf, &llv, sizeof(llv));
+      ikey->data = numbuf;
+      ikey->size = sizeof(llv);
+      break;
+    }
+    case EJDB_IDX_F64:
+      ikey->data = (void *) (kp + sizeof(uint64_t));
+      ikey->size = klen - sizeof(uint64_t);
+      break;
+    default:
+      ikey->data = (void *) kp;
+      ikey->size = klen;
+      break;
+  }
+}
+
+//--------------------------- Records extraction
+
+static iwrc _jbi_il_file_init(struct _JBILWORKER *w) {
+  IWFS_EXT_OPTS opts = {
+    .initial_size = w->ld->bufsz,
+    .rspolicy = iw_exfile_szpolicy_fibo,
+    .file = {
+      .path = "jb-",
+      .omode = IWFS_OTMP | IWFS_OUNLINK
+    }
+  };
+  iwrc rc = iwfs_exfile_open(&w->f, &opts);
+  RCRET(rc);
+  w->f_active = true;
+  return 0;
+}
+
+static iwrc _jbi_il_run_add(struct _JBILWORKER *w, struct _JBILRUN **runp) {
+  struct _JBILRUN *nruns = realloc(w->runs, (w->runs_num + 1) * sizeof(*w->runs));
+  if (!nruns) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  w->runs = nruns;
+  *runp = &w->runs[w->runs_num++];
+  memset(*runp, 0, sizeof(**runp));
+  return 0;
+}
+
+/**
+ * @brief Sorts records buffer and writes it into worker overflow file as new sorted run.
+ */
+static iwrc _jbi_il_spill(struct _JBILWORKER *w) {
+  iwrc rc = 0;
+  size_t sz, wpos = 0;
+  uint8_t *wbuf;
+  struct _JBILRUN *run;
+  if (!w->f_active) {
+    rc = _jbi_il_file_init(w);
+    RCRET(rc);
+  }
+  rc = _jbi_il_run_add(w, &run);
+  RCRET(rc);
+  run->f = &w->f;
+  run->rpos = w->f_npos;
+  run->end = w->f_npos;
+  sort_r(w->refs, w->refs_num, sizeof(w->refs[0]), _jbi_il_refs_cmp, w->recs);
+
+  // Records are written in sorted order through the staging buffer
+  wbuf = malloc(_JBIL_RUN_BUF_MIN_SZ);
+  if (!wbuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (size_t i = 0; i < w->refs_num; ++i) {
+    const uint8_t *rec = w->recs + w->refs[i];
+    size_t rsz = _jbi_il_rec_size(rec);
+    if (wpos + rsz > _JBIL_RUN_BUF_MIN_SZ) {
+      if (wpos) {
+        rc = w->f.write(&w->f, w->f_npos, wbuf, wpos, &sz);
+        RCGO(rc, finish);
+        w->f_npos += wpos;
+        wpos = 0;
+      }
+      if (rsz > _JBIL_RUN_BUF_MIN_SZ) {
+        rc = w->f.write(&w->f, w->f_npos, rec, rsz, &sz);
+        RCGO(rc, finish);
+        w->f_npos += rsz;
+        continue;
+      }
+    }
+    memcpy(wbuf + wpos, rec, rsz);
+    wpos += rsz;
+  }
+  if (wpos) {
+    rc = w->f.write(&w->f, w->f_npos, wbuf, wpos, &sz);
+    RCGO(rc, finish);
+    w->f_npos += wpos;
+  }
+  run->end = w->f_npos;
+  w->refs_num = 0;
+  w->recs_npos = 0;
+
+finish:
+  free(wbuf);
+  return rc;
+}
+
+/**
+ * @brief Sorts records buffer into the last in-memory run of worker.
+ */
+static iwrc _jbi_il_finish(struct _JBILWORKER *w) {
+  struct _JBILRUN *run;
+  if (!w->refs_num) {
+    return 0;
+  }
+  iwrc rc = _jbi_il_run_add(w, &run);
+  RCRET(rc);
+  run->mem = malloc(w->recs_npos);
+  if (!run->mem) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  sort_r(w->refs, w->refs_num, sizeof(w->refs[0]), _jbi_il_refs_cmp, w->recs);
+  for (size_t i = 0; i < w->refs_num; ++i) {
+    const uint8_t *rec = w->recs + w->refs[i];
+    size_t rsz = _jbi_il_rec_size(rec);
+    memcpy(run->mem + run->end, rec, rsz);
+    run->end += rsz;
+  }
+  free(w->recs);
+  w->recs = 0;
+  w->recs_asz = 0;
+  w->recs_npos = 0;
+  free(w->refs);
+  w->refs = 0;
+  w->refs_asz = 0;
+  w->refs_num = 0;
+  return 0;
+}
+
+static iwrc _jbi_il_rec_add(struct _JBILWORKER *w, const IWKV_val *ikey, int64_t id) {
+  iwrc rc;
+  // Load key is at most 8 bytes longer than index key
+  size_t rsz = _JBIL_REC_HDR_SZ + sizeof(uint64_t) + ikey->size + sizeof(id);
+  if (w->recs_npos + rsz > w->ld->bufsz && w->refs_num) {
+    rc = _jbi_il_spill(w);
+    RCRET(rc);
+  }
+  if (w->recs_npos + rsz > w->recs_asz) {
+    size_t nsz = MAX(w->recs_npos + rsz, w->recs_asz * 2);
+    nsz = MAX(nsz, 1024);
+    uint8_t *nrecs = realloc(w->recs, nsz);
+    if (!nrecs) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    w->recs = nrecs;
+    w->recs_asz = nsz;
+  }
+  if (w->refs_num >= w->refs_asz) {
+    size_t nsz = w->refs_asz ? w->refs_asz * 2 : 256;
+    uint32_t *nrefs = realloc(w->refs, nsz * sizeof(w->refs[0]));
+    if (!nrefs) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    w->refs = nrefs;
+    w->refs_asz = nsz;
+  }
+  uint8_t *wp = w->recs + w->recs_npos;
+  uint32_t klen = (uint32_t) _jbi_il_key_encode(w->ld->idx, ikey, wp + _JBIL_REC_HDR_SZ);
+  memcpy(wp, &klen, sizeof(klen));
+  memcpy(wp + _JBIL_REC_HDR_SZ + klen, &id, sizeof(id));
+  w->refs[w->refs_num++] = (uint32_t) w->recs_npos;
+  w->recs_npos += _JBIL_REC_HDR_SZ + klen + sizeof(id);
+  return 0;
+}
+
+/**
+ * @brief Adds index records of document to the worker records buffer.
+ * Documents values are filtered as by `_jb_idx_record_add()`.
+ */
+struct _JBILFTS {
+  struct _JBILWORKER *w;
+  int64_t id;
+};
+
+static iwrc _jbi_il_fts_term_add(const char *term, size_t len, void *op) {
+  struct _JBILFTS *fts = op;
+  IWKV_val ikey = {
+    .data = (void *) term,
+    .size = len
+  };
+  return _jbi_il_rec_add(fts->w, &ikey, fts->id);
+}
+
+/** Adds load records of field value, every word of text is a separate `EJDB_IDX_FTS` index key */
+static iwrc _jbi_il_value_add(struct _JBILWORKER *w, int64_t id, JBL jbv) {
+  IWKV_val ikey;
+  char numbuf[JBNUMBUF_SIZE];
+  JBIDX idx = w->ld->idx;
+  if (idx->mode & EJDB_IDX_FTS) {
+    struct _JBILFTS fts = { .w = w, .id = id };
+    return jbi_fts_jbl_visit(jbv, _jbi_il_fts_term_add, &fts);
+  }
+  jbi_jbl_fill_ikey(idx, jbv, &ikey, numbuf);
+  if (ikey.size) {
+    return _jbi_il_rec_add(w, &ikey, id);
+  }
+  return 0;
+}
+
+static iwrc _jbi_il_doc(struct _JBILWORKER *w, int64_t id, JBL jbl) {
+  iwrc rc = 0;
+  IWKV_val ikey;
+  struct _JBL jbv = { 0 };
+  JBIDX idx = w->ld->idx;
+  bool compound = idx->idbf & IWDB_COMPOUND_KEYS;
+
+  if (idx->fqs) { // Compiled query keeps matching state so it cannot be shared between workers
+    bool matched;
+    if (!w->fq) {
+      rc = jql_create(&w->fq, idx->jbc->name, idx->fqs);
+      RCRET(rc);
+    }
+    rc = jql_matched(w->fq, jbl, &matched);
+    if (rc || !matched) {
+      return rc;
+    }
+  }
+  if (idx->cnum) {
+    if (!w->ckey) {
+      w->ckey = iwxstr_new();
+      if (!w->ckey) {
+        return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      }
+    }
+    rc = jbi_composite_fill_ikey(idx, jbl, w->ckey, &ikey);
+    if (!rc && ikey.size) {
+      rc = _jbi_il_rec_add(w, &ikey, id);
+    }
+    return rc;
+  }
+  if (!_jbl_at(jbl, idx->ptr, &jbv)) {
+    return 0;
+  }
+  jbl_type_t jbv_type = jbl_type(&jbv);
+  if (jbv_type == JBV_OBJECT || jbv_type <= JBV_NULL || (jbv_type == JBV_ARRAY && !compound)) {
+    return 0;
+  }
+  if (jbv_type == JBV_ARRAY) { // Array elements are read directly from binn
+    JBL_iterator it;
+    struct _JBL holder;
+    rc = jbl_iterator_init(&jbv, &it);
+    while (!rc && jbl_iterator_next(&it, &holder, 0, 0)) {
+      rc = _jbi_il_value_add(w, id, &holder);
+    }
+  } else {
+    rc = _jbi_il_value_add(w, id, &jbv);
+  }
+  return rc;
+}
+
+static iwrc _jbi_il_range_scan(struct _JBILWORKER *w) {
+  IWKV_cursor cur;
+  IWKV_val key, val;
+  struct _JBL jbl;
+  int64_t id = w->lo;
+  key.data = &id;
+  key.size = sizeof(id);
+
+  iwrc rc = iwkv_cursor_open(w->ld->idx->jbc->cdb, &cur, IWKV_CURSOR_GE, &key);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    return 0;
+  }
+  RCRET(rc);
+  // Iteration towards greater ids is done by IWKV_CURSOR_PREV
+  do {
+    rc = iwkv_cursor_get(cur, &key, &val);
+    RCBREAK(rc);
+    memcpy(&id, key.data, sizeof(id));
+    if (id > w->hi) {
+      iwkv_kv_dispose(&key, &val);
+      break;
+    }
+    rc = jb_doc_unpack_val(w->ld->idx->jbc, &val);
+    if (rc) {
+      iwkv_kv_dispose(&key, &val);
+      break;
+    }
+    if (!binn_load(val.data, &jbl.bn)) {
+      rc = JBL_ERROR_CREATION;
+    } else {
+      rc = _jbi_il_doc(w, id, &jbl);
+    }
+    iwkv_kv_dispose(&key, &val);
+    RCBREAK(rc);
+  } while (!__atomic_load_n(&w->ld->stop, __ATOMIC_RELAXED) && !(rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV)));
+
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  iwkv_cursor_close(&cur);
+  return rc;
+}
+
+static void *_jbi_il_worker(void *op) {
+  struct _JBILWORKER *w = op;
+  w->rc = _jbi_il_range_scan(w);
+  if (!w->rc) {
+    w->rc = _jbi_il_finish(w);
+  }
+  if (w->rc) {
+    __atomic_store_n(&w->ld->stop, true, __ATOMIC_RELAXED);
+  }
+  return 0;
+}
+
+//--------------------------- Runs merge
+
+/**
+ * @brief Moves `run` to the next record.
+ */
+static iwrc _jbi_il_run_next(struct _JBILRUN *run) {
+  iwrc rc = 0;
+  size_t sz, need = _JBIL_REC_HDR_SZ;
+  if (run->mem) {
+    if (run->rec) {
+      run->rpos += _jbi_il_rec_size(run->rec);
+    }
+    run->rec = run->rpos < run->end ? run->mem + run->rpos : 0;
+    return 0;
+  }
+  if (run->rec) { // Skip current record
+    run->bpos += _jbi_il_rec_size(run->rec);
+    run->rec = 0;
+  }
+  while (1) {
+    size_t avail = run->blen - run->bpos;
+    if (avail >= _JBIL_REC_HDR_SZ) {
+      need = _jbi_il_rec_size(run->buf + run->bpos);
+      if (avail >= need) {
+        run->rec = run->buf + run->bpos;
+        return 0;
+      }
+    }
+    if (run->rpos >= run->end) {
+      return 0;
+    }
+    // Move remaining bytes to the start of buffer then read more
+    if (run->bpos) {
+      memmove(run->buf, run->buf + run->bpos, avail);
+      run->bpos = 0;
+      run->blen = avail;
+    }
+    if (need > run->bufsz) {
+      uint8_t *nbuf = realloc(run->buf, need);
+      if (!nbuf) {
+        return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      }
+      run->buf = nbuf;
+      run->bufsz = need;
+    }
+    size_t rsz = MIN(run->bufsz - run->blen, (size_t) (run->end - run->rpos));
+    rc = run->f->read(run->f, run->rpos, run->buf + run->blen, rsz, &sz);
+    RCRET(rc);
+    if (sz != rsz) {
+      return IW_ERROR_IO;
+    }
+    run->rpos += sz;
+    run->blen += sz;
+  }
+}
+
+static void _jbi_il_heap_down(struct _JBILOAD *ld, uint32_t i) {
+  while (1) {
+    uint32_t m = i, l = 2 * i + 1, r = l + 1;
+    if (l < ld->heap_num && _jbi_il_rec_cmp(ld->heap[l]->rec, ld->heap[m]->rec) < 0) {
+      m = l;
+    }
+    if (r < ld->heap_num && _jbi_il_rec_cmp(ld->heap[r]->rec, ld->heap[m]->rec) < 0) {
+      m = r;
+    }
+    if (m == i) {
+      break;
+    }
+    struct _JBILRUN *tmp = ld->heap[i];
+    ld->heap[i] = ld->heap[m];
+    ld->heap[m] = tmp;
+    i = m;
+  }
+}
+
+static iwrc _jbi_il_merge_init(struct _JBILOAD *ld) {
+  iwrc rc = 0;
+  uint32_t runs_num = 0;
+  for (uint32_t i = 0; i < ld->workers_num; ++i) {
+    runs_num += ld->workers[i].runs_num;
+  }
+  if (!runs_num) {
+    return 0;
+  }
+  size_t bufsz = MAX(ld->bufsz * ld->workers_num / runs_num, _JBIL_RUN_BUF_MIN_SZ);
+  ld->heap = malloc(runs_num * sizeof(*ld->heap));
+  if (!ld->heap) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (uint32_t i = 0; i < ld->workers_num; ++i) {
+    struct _JBILWORKER *w = &ld->workers[i];
+    for (uint32_t j = 0; j < w->runs_num; ++j) {
+      struct _JBILRUN *run = &w->runs[j];
+      if (!run->mem) {
+        run->buf = malloc(bufsz);
+        if (!run->buf) {
+          return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        }
+        run->bufsz = bufsz;
+      }
+      rc = _jbi_il_run_next(run);
+      RCRET(rc);
+      if (run->rec) {
+        ld->heap[ld->heap_num++] = run;
+      }
+    }
+  }
+  for (uint32_t i = ld->heap_num / 2; i-- > 0;) {
+    _jbi_il_heap_down(ld, i);
+  }
+  return rc;
+}
+
+/**
+ * @brief Puts merged records into index database in ascending order of keys.
+ */
+static iwrc _jbi_il_merge(struct _JBILOAD *ld, int64_t *rnum) {
+  IWKV_val ikey, idval;
+  uint8_t step;
+  char vnbuf[IW_VNUMBUFSZ];
+  char numbuf[JBNUMBUF_SIZE];
+  uint8_t *prev = 0;
+  size_t prev_asz = 0;
+  JBIDX idx = ld->idx;
+  bool compound = idx->idbf & IWDB_COMPOUND_KEYS;
+
+  iwrc rc = _jbi_il_merge_init(ld);
+  RCRET(rc);
+
+  while (ld->heap_num) {
+    struct _JBILRUN *run = ld->heap[0];
+    const uint8_t *rec = run->rec;
+    int64_t id = _jbi_il_rec_id(rec);
+    bool dup = false;
+    if (prev && !_jbi_il_rec_key_cmp(prev, rec)) {
+      if (!compound) {
+        rc = EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED;
+        break;
+      }
+      dup = (_jbi_il_rec_id(prev) == id); // Duplicated array element
+    }
+    if (!dup) {
+      _jbi_il_key_decode(idx, rec, &ikey, numbuf);
+      if (compound) {
+        ikey.compound = id;
+        idval.data = 0;
+        idval.size = 0;
+      } else {
+        IW_SETVNUMBUF64(step, vnbuf, id);
+        idval.data = vnbuf;
+        idval.size = step;
+      }
+      rc = iwkv_put(idx->idb, &ikey, &idval, IWKV_NO_OVERWRITE);
+      if (rc == IWKV_ERROR_KEY_EXISTS) {
+        rc = compound ? 0 : EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED;
+      } else if (!rc) {
+        ++*rnum;
+      }
+      RCBREAK(rc);
+    }
+    size_t rsz = _jbi_il_rec_size(rec);
+    if (rsz > prev_asz) {
+      uint8_t *nprev = realloc(prev, rsz);
+      if (!nprev) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        break;
+      }
+      prev = nprev;
+      prev_asz = rsz;
+    }
+    memcpy(prev, rec, rsz);
+    rc = _jbi_il_run_next(run);
+    RCBREAK(rc);
+    if (!run->rec) {
+      ld->heap[0] = ld->heap[--ld->heap_num];
+    }
+    _jbi_il_heap_down(ld, 0);
+  }
+  free(prev);
+  return rc;
+}
+
+//--------------------------- Public
+
+uint32_t jbi_idx_load_threads(JBIDX idx) {
+  int64_t num = __atomic_load_n(&idx->jbc->id_seq, __ATOMIC_RELAXED);
+  uint32_t threads = MIN(iwp_num_cpu_cores(), JB_IDX_LOAD_MAX_THREADS);
+  if (num / JB_IDX_LOAD_MIN_RANGE < threads) {
+    threads = (uint32_t) (num / JB_IDX_LOAD_MIN_RANGE);
+  }
+  return MAX(threads, 1);
+}
+
+iwrc jbi_idx_load(JBIDX idx, uint32_t threads, int64_t *rnum) {
+  iwrc rc = 0;
+  int rci;
+  int64_t maxid = __atomic_load_n(&idx->jbc->id_seq, __ATOMIC_RELAXED);
+  struct _JBILOAD ld = {
+    .idx = idx,
+    .workers_num = MAX(threads, 1)
+  };
+  *rnum = 0;
+  ld.bufsz = MAX(idx->jbc->db->opts.sort_buffer_sz / ld.workers_num, _JBIL_BUF_MIN_SZ);
+  ld.workers = calloc(ld.workers_num, sizeof(*ld.workers));
+  if (!ld.workers) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  int64_t rsz = maxid / ld.workers_num + 1;
+  for (uint32_t i = 0; i < ld.workers_num; ++i) {
+    struct _JBILWORKER *w = &ld.workers[i];
+    w->ld = &ld;
+    // Ranges of the first and the last workers are open to cover negative and explicitly set ids
+    w->lo = i ? 1 + (int64_t) i * rsz : INT64_MIN;
+    w->hi = (i == ld.workers_num - 1) ? INT64_MAX : (int64_t) (i + 1) * rsz;
+  }
+  if (ld.workers_num == 1) {
+    _jbi_il_worker(&ld.workers[0]);
+  } else {
+    for (uint32_t i = 0; i < ld.workers_num; ++i) {
+      rci = pthread_create(&ld.workers[i].thr, 0, _jbi_il_worker, &ld.workers[i]);
+      if (rci) {
+        rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+        __atomic_store_n(&ld.stop, true, __ATOMIC_RELAXED);
+        break;
+      }
+      ld.workers[i].started = true;
+    }
+    for (uint32_t i = 0; i < ld.workers_num; ++i) {
+      if (ld.workers[i].started) {
+        pthread_join(ld.workers[i].thr, 0);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < ld.workers_num && !rc; ++i) {
+    rc = ld.workers[i].rc;
+  }
+  if (!rc) {
+    rc = _jbi_il_merge(&ld, rnum);
+  }
+
+  for (uint32_t i = 0; i < ld.workers_num; ++i) {
+    struct _JBILWORKER *w = &ld.workers[i];
+    for (uint32_t j = 0; j < w->runs_num; ++j) {
+      free(w->runs[j].buf);
+      free(w->runs[j].mem);
+    }
+    free(w->runs);
+    free(w->recs);
+    free(w->refs);
+    iwxstr_destroy(w->ckey);
+    if (w->fq) {
+      jql_destroy(&w->fq);
+    }
+    if (w->f_active) {
+      w->f.close(&w->f);
+    }
+  }
+  free(ld.workers);
+  free(ld.heap);
+  return rc;
+}
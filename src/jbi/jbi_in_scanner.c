@@ -0,0 +1,277 @@
+#include "ejdb2_internal.h"
+
+static khint_t _jbi_in_key_hash(IWKV_val key) {
+  khint_t h = 0;
+  const uint8_t *p = key.data;
+  for (size_t i = 0; i < key.size; ++i) {
+    h = (h << 5) - h + p[i];
+  }
+  return h;
+}
+
+#define _jbi_in_key_equal(k1_, k2_) \
+  ((k1_).size == (k2_).size && !memcmp((k1_).data, (k2_).data, (k1_).size))
+
+KHASH_INIT(JBINKEYS, IWKV_val, char, 0, _jbi_in_key_hash, _jbi_in_key_equal)
+
+/**
+ * @brief Unique index keys of `in` array values.
+ */
+struct _JBIIN {
+  IWPOOL *pool;               /**< Pool of keys data */
+  IWKV_val *keys;             /**< Index keys in scan order */
+  size_t num;                 /**< Number of keys */
+  size_t maxsz;               /**< Size of the longest key */
+  khash_t(JBINKEYS) *set;     /**< Hash set of keys */
+};
+
+static void _jbi_in_release(struct _JBIIN *in) {
+  if (in->set) {
+    kh_destroy(JBINKEYS, in->set);
+  }
+  free(in->keys);
+  iwpool_destroy(in->pool);
+}
+
+static int _jbi_in_cmp_jqval(const void *v1, const void *v2) {
+  iwrc rc;
+  const JQVAL *jqv1 = v1;
+  const JQVAL *jqv2 = v2;
+  return jql_cmp_jqval_pair(jqv1, jqv2, &rc);
+}
+
+/**
+ * @brief Builds set of index keys of scalar `in` array values.
+ * Keys of non unique index are ordered according to values order (lowest first),
+ * keys of unique index follow the order of array.
+ */
+static iwrc _jbi_in_init(JBIDX idx, JQVAL *jqval, struct _JBIIN *in) {
+  iwrc rc = 0;
+  size_t num = 0;
+  char numbuf[JBNUMBUF_SIZE];
+  JQVAL *jqvarr = 0;
+
+  for (JBL_NODE nv = jqval->vnode->child; nv; nv = nv->next) {
+    if (nv->type >= JBV_BOOL && nv->type <= JBV_STR) ++num;
+  }
+  if (!num) {
+    return 0;
+  }
+  in->pool = iwpool_create(num * 16);
+  in->set = kh_init(JBINKEYS);
+  in->keys = malloc(num * sizeof(in->keys[0]));
+  jqvarr = malloc(num * sizeof(jqvarr[0]));
+  if (!in->pool || !in->set || !in->keys || !jqvarr) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  num = 0;
+  for (JBL_NODE nv = jqval->vnode->child; nv; nv = nv->next) {
+    if (nv->type >= JBV_BOOL && nv->type <= JBV_STR) {
+      jql_node_to_jqval(nv, &jqvarr[num++]);
+    }
+  }
+  if (!(idx->mode & EJDB_IDX_UNIQUE)) {
+    // Sort values according to index order, lowest first (asc)
+    qsort(jqvarr, num, sizeof(jqvarr[0]), _jbi_in_cmp_jqval);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    int ret;
+    IWKV_val key;
+    jbi_jqval_fill_ikey(idx, &jqvarr[i], &key, numbuf);
+    if (!key.size) {
+      continue;
+    }
+    void *data = iwpool_alloc(key.size, in->pool);
+    if (!data) {
+      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      goto finish;
+    }
+    memcpy(data, key.data, key.size);
+    key.data = data;
+    key.compound = INT64_MIN;
+    kh_put(JBINKEYS, in->set, key, &ret);
+    if (ret < 0) {
+      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      goto finish;
+    } else if (ret == 0) { // Duplicated value
+      continue;
+    }
+    in->keys[in->num++] = key;
+    if (key.size > in->maxsz) {
+      in->maxsz = key.size;
+    }
+  }
+
+finish:
+  free(jqvarr);
+  return rc;
+}
+
+/**
+ * @brief Consumes documents of index keys found by point lookups or seeks of every key.
+ */
+static iwrc _jbi_in_seek(struct _JBEXEC *ctx, struct _JBIIN *in, JB_SCAN_CONSUMER consumer) {
+  iwrc rc = 0;
+  int64_t id;
+  size_t sz;
+  bool matched;
+  char numbuf[JBNUMBUF_SIZE];
+  IWKV_cursor cur = 0;
+  int64_t step = 1;
+  JBIDX idx = ctx->midx.idx;
+
+  if (!(idx->idbf & IWDB_COMPOUND_KEYS)) {
+    for (int64_t i = 0; step && i >= 0 && i < in->num; i += (step > 0 ? 1 : -1)) {
+      rc = iwkv_get_copy(idx->idb, &in->keys[i], numbuf, sizeof(numbuf), &sz);
+      if (rc == IWKV_ERROR_NOTFOUND) {
+        rc = 0;
+        continue;
+      }
+      RCRET(rc);
+      if (step > 0) --step;
+      else if (step < 0) ++step;
+      if (!step) {
+        IW_READVNUMBUF64_2(numbuf, id);
+        step = 1;
+        rc = consumer(ctx, 0, id, &step, &matched, 0);
+        RCRET(rc);
+      }
+    }
+    return rc;
+  }
+
+  // Single cursor is moved to the next key by skip-ahead seek
+  // only if it is not already positioned at this key after previous key records.
+  bool positioned = false;
+  rc = iwkv_cursor_open(idx->idb, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  RCRET(rc);
+  for (size_t i = 0; i < in->num && step; ++i) {
+    IWKV_val *key = &in->keys[i];
+    matched = false;
+    if (positioned) {
+      rc = iwkv_cursor_is_matched_key(cur, key, &matched, &id);
+      RCGO(rc, finish);
+    }
+    if (!matched) {
+      rc = iwkv_cursor_to_key(cur, IWKV_CURSOR_GE, key);
+      if (rc == IWKV_ERROR_NOTFOUND) {
+        rc = 0;
+        positioned = false;
+        continue;
+      }
+      RCGO(rc, finish);
+      positioned = true;
+    }
+    do {
+      if (step > 0) --step;
+      else if (step < 0) ++step;
+      if (!step) {
+        rc = iwkv_cursor_is_matched_key(cur, key, &matched, &id);
+        RCGO(rc, finish);
+        if (!matched) { // Cursor is positioned at the key following records of this key
+          step = 1;
+          break;
+        }
+        step = 1;
+        rc = consumer(ctx, 0, id, &step, &matched, 0);
+        RCGO(rc, finish);
+      }
+    } while (step && !(rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV))); // !!! only one direction
+    if (rc == IWKV_ERROR_NOTFOUND) {
+      rc = 0;
+      positioned = false;
+    }
+    RCGO(rc, finish);
+  }
+
+finish:
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  iwkv_cursor_close(&cur);
+  return rc;
+}
+
+/**
+ * @brief Consumes documents of index keys found by single pass over the whole index
+ * probing every index key in the hash set of `in` keys.
+ */
+static iwrc _jbi_in_probe(struct _JBEXEC *ctx, struct _JBIIN *in, JB_SCAN_CONSUMER consumer) {
+  size_t sz;
+  int64_t id;
+  IWKV_cursor cur = 0;
+  char numbuf[JBNUMBUF_SIZE];
+  int64_t step = 1;
+  JBIDX idx = ctx->midx.idx;
+  bool compound = idx->idbf & IWDB_COMPOUND_KEYS;
+  IWKV_val key = { 0 };
+
+  uint8_t *kbuf = malloc(in->maxsz);
+  if (!kbuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  // Ascending scan starts after the last record of descending keys order
+  iwrc rc = iwkv_cursor_open(idx->idb, &cur, IWKV_CURSOR_AFTER_LAST, 0);
+  RCGO(rc, finish);
+  while (step && !(rc = iwkv_cursor_to(cur, step > 0 ? IWKV_CURSOR_PREV : IWKV_CURSOR_NEXT))) {
+    bool matched = false;
+    rc = iwkv_cursor_copy_key(cur, kbuf, in->maxsz, &sz, &id);
+    RCGO(rc, finish);
+    if (sz > in->maxsz) {
+      continue;
+    }
+    key.data = kbuf;
+    key.size = sz;
+    if (kh_get(JBINKEYS, in->set, key) == kh_end(in->set)) {
+      continue;
+    }
+    if (step > 0) --step;
+    else if (step < 0) ++step;
+    if (!step) {
+      if (!compound) {
+        rc = iwkv_cursor_copy_val(cur, numbuf, IW_VNUMBUFSZ, &sz);
+        RCGO(rc, finish);
+        if (sz > IW_VNUMBUFSZ) {
+          rc = IWKV_ERROR_CORRUPTED;
+          iwlog_ecode_error3(rc);
+          goto finish;
+        }
+        IW_READVNUMBUF64_2(numbuf, id);
+      }
+      step = 1;
+      rc = consumer(ctx, 0, id, &step, &matched, 0);
+      RCGO(rc, finish);
+    }
+  }
+
+finish:
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  if (cur) {
+    iwkv_cursor_close(&cur);
+  }
+  free(kbuf);
+  return rc;
+}
+
+iwrc jbi_in_scanner(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER consumer) {
+  struct _JBIIN in = { 0 };
+  JBIDX idx = ctx->midx.idx;
+  iwrc rc = _jbi_in_init(idx, jqval, &in);
+  if (rc || !in.num) {
+    goto finish;
+  }
+  // Key seek costs about as much as passing of several index records,
+  // so index is scanned in one pass if it is not large enough relative to number of keys
+  bool probe = idx->rnum <= (int64_t) in.num * JB_IDX_EMPIRIC_INOP_SEEK_COST;
+  if (ctx->ux->log) {
+    iwxstr_printf(ctx->ux->log, "[INDEX] IN %s %zu\n", probe ? "PROBE" : "SEEK", in.num);
+  }
+  if (probe) {
+    rc = _jbi_in_probe(ctx, &in, consumer);
+  } else {
+    rc = _jbi_in_seek(ctx, &in, consumer);
+  }
+
+finish:
+  _jbi_in_release(&in);
+  return consumer(ctx, 0, 0, 0, 0, rc);
+}
@@ -0,0 +1,140 @@
+#include "ejdb2_internal.h"
+
+static int _jbi_isect_id_cmp(const void *o1, const void *o2) {
+  int64_t v1, v2;
+  memcpy(&v1, o1, sizeof(v1));
+  memcpy(&v2, o2, sizeof(v2));
+  return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+/**
+ * @brief Collect ids of documents matched by `IWKV_CURSOR_EQ` expression of given index.
+ *
+ * Resulting array is sorted in ascending order.
+ * If number of ids exceeds `JB_IDX_EMPIRIC_MAX_INTERSECT_IDS` index is considered
+ * as not selective enough and `*idsp` is set to zero.
+ */
+static iwrc _jbi_isect_collect(struct _JBEXEC *ctx, struct _JBMIDX *midx, int64_t **idsp, size_t *nump) {
+  bool matched;
+  IWKV_cursor cur;
+  char numbuf[JBNUMBUF_SIZE];
+  JBIDX idx = midx->idx;
+  size_t num = 0, asz = 64;
+  bool sorted = true;
+
+  *idsp = 0;
+  *nump = 0;
+
+  iwrc rc = 0;
+  JQVAL *jqval = jql_unit_to_jqval(ctx->ux->q->aux, midx->expr1->right, &rc);
+  RCRET(rc);
+
+  IWKV_val key;
+  jbi_jqval_fill_ikey(idx, jqval, &key, numbuf);
+  key.compound = INT64_MIN;
+
+  int64_t *ids = malloc(asz * sizeof(*ids));
+  if (!ids) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  if (!key.size) { // Nothing can be matched
+    *idsp = ids;
+    return 0;
+  }
+  rc = iwkv_cursor_open(idx->idb, &cur, IWKV_CURSOR_GE, &key);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    *idsp = ids;
+    return 0;
+  } else if (rc) {
+    free(ids);
+    return rc;
+  }
+  do {
+    int64_t id;
+    rc = iwkv_cursor_is_matched_key(cur, &key, &matched, &id);
+    RCGO(rc, finish);
+    if (!matched) {
+      break;
+    }
+    if (num >= JB_IDX_EMPIRIC_MAX_INTERSECT_IDS) {
+      // Index is not selective enough, don't use it
+      free(ids);
+      ids = 0;
+      num = 0;
+      goto finish;
+    }
+    if (num >= asz) {
+      asz *= 2;
+      int64_t *nids = realloc(ids, asz * sizeof(*ids));
+      if (!nids) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        goto finish;
+      }
+      ids = nids;
+    }
+    if (num && ids[num - 1] > id) {
+      sorted = false;
+    }
+    ids[num++] = id;
+  } while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV)));
+
+finish:
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  iwkv_cursor_close(&cur);
+  if (rc) {
+    free(ids);
+    return rc;
+  }
+  if (ids && !sorted) {
+    qsort(ids, num, sizeof(ids[0]), _jbi_isect_id_cmp);
+  }
+  *idsp = ids;
+  *nump = num;
+  return 0;
+}
+
+iwrc jbi_isect_add(struct _JBEXEC *ctx, struct _JBMIDX *midx, bool *addedp) {
+  int64_t *ids;
+  size_t num;
+  struct _JBISECT *isect = &ctx->isect;
+  *addedp = false;
+  iwrc rc = _jbi_isect_collect(ctx, midx, &ids, &num);
+  RCRET(rc);
+  if (!ids) {
+    return 0;
+  }
+  if (!isect->active) {
+    isect->ids = ids;
+    isect->num = num;
+    isect->active = true;
+  } else { // Merge two sorted id streams keeping common ids only
+    size_t i = 0, j = 0, n = 0;
+    while (i < isect->num && j < num) {
+      if (isect->ids[i] < ids[j]) {
+        ++i;
+      } else if (isect->ids[i] > ids[j]) {
+        ++j;
+      } else {
+        isect->ids[n++] = isect->ids[i];
+        ++i, ++j;
+      }
+    }
+    isect->num = n;
+    free(ids);
+  }
+  *addedp = true;
+  return 0;
+}
+
+bool jbi_isect_contains(struct _JBEXEC *ctx, int64_t id) {
+  struct _JBISECT *isect = &ctx->isect;
+  return bsearch(&id, isect->ids, isect->num, sizeof(isect->ids[0]), _jbi_isect_id_cmp) != 0;
+}
+
+void jbi_isect_release(struct _JBEXEC *ctx) {
+  struct _JBISECT *isect = &ctx->isect;
+  if (isect->ids) {
+    free(isect->ids);
+  }
+  memset(isect, 0, sizeof(*isect));
+}
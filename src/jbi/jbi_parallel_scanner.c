@@ -0,0 +1,379 @@
+#include "ejdb2_internal.h"
+
+// Matched document record header: [id:int64][size:uint32]
+#define _JBPS_REC_HDR_SZ (sizeof(int64_t) + sizeof(uint32_t))
+
+/**
+ * @brief Range of document ids scanned by single worker
+ */
+struct _JBPSRANGE {
+  int64_t lo;               /**< Lower id of range, inclusive */
+  int64_t hi;               /**< Upper id of range, inclusive */
+  uint8_t *buf;             /**< Matched documents records */
+  size_t bufsz;             /**< Allocated size of buf */
+  size_t npos;              /**< Next record offset in buf */
+  bool done;                /**< Range scan completed */
+};
+
+struct _JBPSCAN;
+
+struct _JBPSWORKER {
+  struct _JBPSCAN *ps;
+  JQL q;                    /**< Worker own copy of query */
+  uint8_t *zbuf;            /**< Compressed document being decompressed into range buffer */
+  size_t zbufsz;            /**< Allocated size of zbuf */
+  pthread_t thr;
+  bool started;
+};
+
+/**
+ * @brief Parallel scan context
+ */
+struct _JBPSCAN {
+  JBEXEC *ctx;
+  struct _JBPSRANGE *ranges; /**< Ranges in order of delivery to the consumer */
+  size_t num;                /**< Number of ranges */
+  size_t next;               /**< Next range to scan */
+  size_t *ready;             /**< Indexes of scanned ranges in order of completion */
+  size_t ready_num;          /**< Number of elements in ready */
+  size_t delivered;          /**< Number of ranges passed to the consumer */
+  size_t window;             /**< Max number of scanned but not delivered ranges */
+  bool ascending;            /**< Documents are delivered in ascending id order */
+  bool ids_only;             /**< Document bodies are not needed by the consumer */
+  bool stop;                 /**< Scan should be stopped, checked by workers without lock */
+  iwrc rc;                   /**< First error of workers */
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;       /**< Signaled on range completion and delivery */
+};
+
+static iwrc _jbi_ps_range_ensure(struct _JBPSRANGE *r, size_t sz) {
+  if (r->npos + sz <= r->bufsz) {
+    return 0;
+  }
+  size_t nsize = MAX(r->npos + sz, r->bufsz * 2);
+  void *nbuf = realloc(r->buf, nsize);
+  if (!nbuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  r->buf = nbuf;
+  r->bufsz = nsize;
+  return 0;
+}
+
+/** Decompresses document copied into range buffer */
+static iwrc _jbi_ps_doc_unpack(struct _JBPSWORKER *w, struct _JBPSRANGE *r, size_t *vszp) {
+  size_t vsz;
+  if (*vszp > w->zbufsz) {
+    void *nbuf = realloc(w->zbuf, *vszp);
+    if (!nbuf) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    w->zbuf = nbuf;
+    w->zbufsz = *vszp;
+  }
+  memcpy(w->zbuf, r->buf + r->npos + _JBPS_REC_HDR_SZ, *vszp);
+  iwrc rc = jb_doc_unpack(w->ps->ctx->jbc, w->zbuf, *vszp, 0, 0, &vsz);
+  RCRET(rc);
+  rc = _jbi_ps_range_ensure(r, _JBPS_REC_HDR_SZ + vsz);
+  RCRET(rc);
+  rc = jb_doc_unpack(w->ps->ctx->jbc, w->zbuf, *vszp, r->buf + r->npos + _JBPS_REC_HDR_SZ, vsz, &vsz);
+  RCRET(rc);
+  *vszp = vsz;
+  return 0;
+}
+
+static iwrc _jbi_ps_range_doc(struct _JBPSWORKER *w, struct _JBPSRANGE *r, IWKV_cursor cur, int64_t id) {
+  iwrc rc;
+  bool matched;
+  size_t vsz = 0;
+  struct _JBL jbl;
+  struct _JBPSCAN *ps = w->ps;
+  uint32_t dsz;
+
+  rc = _jbi_ps_range_ensure(r, _JBPS_REC_HDR_SZ + ps->ctx->jbc->db->opts.document_buffer_sz);
+  RCRET(rc);
+  while (1) {
+    size_t hpos = r->npos + _JBPS_REC_HDR_SZ;
+    rc = iwkv_cursor_copy_val(cur, r->buf + hpos, r->bufsz - hpos, &vsz);
+    RCRET(rc);
+    if (vsz <= r->bufsz - hpos) {
+      break;
+    }
+    rc = _jbi_ps_range_ensure(r, _JBPS_REC_HDR_SZ + vsz);
+    RCRET(rc);
+  }
+  if (JB_ZDOC_PACKED(r->buf + r->npos + _JBPS_REC_HDR_SZ, vsz)) {
+    rc = _jbi_ps_doc_unpack(w, r, &vsz);
+    RCRET(rc);
+  }
+  rc = jbl_from_buf_keep_onstack(&jbl, r->buf + r->npos + _JBPS_REC_HDR_SZ, vsz);
+  RCRET(rc);
+  rc = jql_matched(w->q, &jbl, &matched);
+  if (rc || !matched) {
+    return rc;
+  }
+  dsz = ps->ids_only ? 0 : (uint32_t) vsz;
+  memcpy(r->buf + r->npos, &id, sizeof(id));
+  memcpy(r->buf + r->npos + sizeof(id), &dsz, sizeof(dsz));
+  r->npos += _JBPS_REC_HDR_SZ + dsz;
+  return 0;
+}
+
+static iwrc _jbi_ps_range_scan(struct _JBPSWORKER *w, struct _JBPSRANGE *r) {
+  struct _JBPSCAN *ps = w->ps;
+  IWKV_cursor cur;
+  IWKV_val key;
+  int64_t id = r->lo;
+  key.data = &id;
+  key.size = sizeof(id);
+
+  iwrc rc = iwkv_cursor_open(ps->ctx->jbc->cdb, &cur, IWKV_CURSOR_GE, &key);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    return 0;
+  }
+  RCRET(rc);
+  // Cursor is positioned at the first document of range,
+  // iteration towards greater ids is done by IWKV_CURSOR_PREV
+  do {
+    size_t sz;
+    rc = iwkv_cursor_copy_key(cur, &id, sizeof(id), &sz, 0);
+    RCBREAK(rc);
+    if (sz != sizeof(id)) {
+      rc = IWKV_ERROR_CORRUPTED;
+      iwlog_ecode_error3(rc);
+      break;
+    }
+    if (id > r->hi) {
+      break;
+    }
+    rc = _jbi_ps_range_doc(w, r, cur, id);
+    RCBREAK(rc);
+  } while (!__atomic_load_n(&ps->stop, __ATOMIC_RELAXED) && !(rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV)));
+
+  if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
+  iwkv_cursor_close(&cur);
+  return rc;
+}
+
+static void *_jbi_ps_worker(void *op) {
+  struct _JBPSWORKER *w = op;
+  struct _JBPSCAN *ps = w->ps;
+  while (1) {
+    struct _JBPSRANGE *r;
+    size_t ri;
+    pthread_mutex_lock(&ps->mtx);
+    while (!ps->stop && ps->next < ps->num && ps->next - ps->delivered >= ps->window) {
+      pthread_cond_wait(&ps->cond, &ps->mtx);
+    }
+    if (ps->stop || ps->next >= ps->num) {
+      pthread_mutex_unlock(&ps->mtx);
+      break;
+    }
+    ri = ps->next++;
+    r = &ps->ranges[ri];
+    pthread_mutex_unlock(&ps->mtx);
+
+    iwrc rc = _jbi_ps_range_scan(w, r);
+
+    pthread_mutex_lock(&ps->mtx);
+    if (rc) {
+      if (!ps->rc) {
+        ps->rc = rc;
+      }
+      __atomic_store_n(&ps->stop, true, __ATOMIC_RELAXED);
+    } else {
+      r->done = true;
+      ps->ready[ps->ready_num++] = ri;
+    }
+    pthread_cond_broadcast(&ps->cond);
+    pthread_mutex_unlock(&ps->mtx);
+  }
+  return 0;
+}
+
+static iwrc _jbi_ps_deliver_rec(struct _JBPSCAN *ps, const uint8_t *rec, bool *stop) {
+  int64_t id, step = 1;
+  uint32_t dsz;
+  struct _JBL jbl = { 0 };
+  memcpy(&id, rec, sizeof(id));
+  memcpy(&dsz, rec + sizeof(id), sizeof(dsz));
+  if (dsz) {
+    iwrc rc = jbl_from_buf_keep_onstack(&jbl, (void *) (rec + _JBPS_REC_HDR_SZ), dsz);
+    RCRET(rc);
+  }
+  iwrc rc = jbi_consumer_matched(ps->ctx, 0, id, &jbl, &step);
+  if (!rc && !step) {
+    *stop = true;
+  }
+  return rc;
+}
+
+IW_INLINE size_t _jbi_ps_rec_size(const uint8_t *rec) {
+  uint32_t dsz;
+  memcpy(&dsz, rec + sizeof(int64_t), sizeof(dsz));
+  return _JBPS_REC_HDR_SZ + dsz;
+}
+
+static iwrc _jbi_ps_deliver(struct _JBPSCAN *ps, struct _JBPSRANGE *r, bool *stop) {
+  iwrc rc = 0;
+  if (ps->ascending) {
+    for (size_t pos = 0; pos < r->npos && !rc && !*stop; pos += _jbi_ps_rec_size(r->buf + pos)) {
+      rc = _jbi_ps_deliver_rec(ps, r->buf + pos, stop);
+    }
+    return rc;
+  }
+  // Records are stored in ascending id order, deliver them backward
+  size_t num = 0, asz = 0, *offs = 0;
+  for (size_t pos = 0; pos < r->npos; pos += _jbi_ps_rec_size(r->buf + pos)) {
+    if (num >= asz) {
+      asz = asz ? asz * 2 : 64;
+      size_t *noffs = realloc(offs, asz * sizeof(*offs));
+      if (!noffs) {
+        free(offs);
+        return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      }
+      offs = noffs;
+    }
+    offs[num++] = pos;
+  }
+  while (num-- > 0 && !rc && !*stop) {
+    rc = _jbi_ps_deliver_rec(ps, r->buf + offs[num], stop);
+  }
+  free(offs);
+  return rc;
+}
+
+uint32_t jbi_parallel_threads(struct _JBEXEC *ctx) {
+  EJDB_EXEC *ux = ctx->ux;
+  int64_t num = __atomic_load_n(&ctx->jbc->id_seq, __ATOMIC_RELAXED);
+  uint32_t threads = MIN(ux->parallel, JB_PARALLEL_SCAN_MAX_THREADS);
+  if (threads < 2 || ctx->sorting || ctx->snap || jql_has_apply(ux->q)) {
+    return 0;
+  }
+  if (num / JB_PARALLEL_SCAN_MIN_RANGE < threads) {
+    threads = (uint32_t) (num / JB_PARALLEL_SCAN_MIN_RANGE);
+  }
+  return threads > 1 ? threads : 0;
+}
+
+iwrc jbi_parallel_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
+  iwrc rc = 0;
+  int rci;
+  bool stop = false;
+  uint32_t threads = ctx->parallel;
+  int64_t maxid = __atomic_load_n(&ctx->jbc->id_seq, __ATOMIC_RELAXED);
+  struct JQP_AUX *aux = ctx->ux->q->aux;
+  struct _JBPSWORKER *workers = 0;
+  struct _JBPSCAN ps = {
+    .ctx = ctx,
+    .window = 2 * threads,
+    .ascending = (ctx->cursor_step == IWKV_CURSOR_PREV),
+    .ids_only = (aux->qmode & JQP_QRY_AGGREGATE) && !aux->projection
+  };
+
+  int64_t rsz = maxid / (threads * 4);
+  rsz = MAX(rsz, JB_PARALLEL_SCAN_MIN_RANGE);
+  rsz = MIN(rsz, JB_PARALLEL_SCAN_MAX_RANGE);
+  ps.num = (size_t) ((maxid + rsz - 1) / rsz);
+  ps.ranges = calloc(ps.num, sizeof(*ps.ranges));
+  ps.ready = calloc(ps.num, sizeof(*ps.ready));
+  workers = calloc(threads, sizeof(*workers));
+  if (!ps.ranges || !ps.ready || !workers) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    free(ps.ranges);
+    free(ps.ready);
+    free(workers);
+    return consumer(ctx, 0, 0, 0, 0, rc);
+  }
+  for (size_t i = 0; i < ps.num; ++i) {
+    struct _JBPSRANGE *r = &ps.ranges[i];
+    if (ps.ascending) {
+      r->lo = 1 + (int64_t) i * rsz;
+      r->hi = MIN(r->lo + rsz - 1, maxid);
+    } else {
+      r->hi = maxid - (int64_t) i * rsz;
+      r->lo = MAX(r->hi - rsz + 1, 1);
+    }
+  }
+  // Documents may have negative ids, outer ranges are open
+  if (ps.ascending) {
+    ps.ranges[0].lo = INT64_MIN;
+    ps.ranges[ps.num - 1].hi = INT64_MAX;
+  } else {
+    ps.ranges[0].hi = INT64_MAX;
+    ps.ranges[ps.num - 1].lo = INT64_MIN;
+  }
+  pthread_mutex_init(&ps.mtx, 0);
+  pthread_cond_init(&ps.cond, 0);
+
+  for (uint32_t i = 0; i < threads; ++i) {
+    workers[i].ps = &ps;
+    rc = jql_clone(ctx->ux->q, &workers[i].q);
+    RCGO(rc, finish);
+  }
+  for (uint32_t i = 0; i < threads; ++i) {
+    rci = pthread_create(&workers[i].thr, 0, _jbi_ps_worker, &workers[i]);
+    if (rci) {
+      rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+      goto finish;
+    }
+    workers[i].started = true;
+  }
+
+  for (size_t n = 0; n < ps.num && !stop; ++n) {
+    struct _JBPSRANGE *r = 0;
+    pthread_mutex_lock(&ps.mtx);
+    while (!r && !ps.rc) {
+      if (!ctx->ux->parallel_unordered) {
+        if (ps.ranges[n].done) {
+          r = &ps.ranges[n];
+        }
+      } else if (n < ps.ready_num) {
+        r = &ps.ranges[ps.ready[n]];
+      }
+      if (!r && !ps.rc) {
+        pthread_cond_wait(&ps.cond, &ps.mtx);
+      }
+    }
+    rc = ps.rc;
+    pthread_mutex_unlock(&ps.mtx);
+    RCBREAK(rc);
+
+    rc = _jbi_ps_deliver(&ps, r, &stop);
+    free(r->buf);
+    r->buf = 0;
+
+    pthread_mutex_lock(&ps.mtx);
+    ++ps.delivered;
+    if (rc || stop) {
+      __atomic_store_n(&ps.stop, true, __ATOMIC_RELAXED);
+    }
+    pthread_cond_broadcast(&ps.cond);
+    pthread_mutex_unlock(&ps.mtx);
+    RCBREAK(rc);
+  }
+
+finish:
+  pthread_mutex_lock(&ps.mtx);
+  __atomic_store_n(&ps.stop, true, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&ps.cond);
+  pthread_mutex_unlock(&ps.mtx);
+  for (uint32_t i = 0; i < threads; ++i) {
+    if (workers[i].started) {
+      pthread_join(workers[i].thr, 0);
+    }
+    if (workers[i].q) {
+      jql_destroy(&workers[i].q);
+    }
+    free(workers[i].zbuf);
+  }
+  for (size_t i = 0; i < ps.num; ++i) {
+    free(ps.ranges[i].buf);
+  }
+  pthread_cond_destroy(&ps.cond);
+  pthread_mutex_destroy(&ps.mtx);
+  free(ps.ranges);
+  free(ps.ready);
+  free(workers);
+  return consumer(ctx, 0, 0, 0, 0, rc);
+}
@@ -21,9 +21,24 @@ static void _jbi_print_index(struct _JBIDX *idx, IWXSTR *xstr) {
     if (cnt++) iwxstr_cat2(xstr, "|");
     iwxstr_cat2(xstr, "F64");
   }
+  if (m & EJDB_IDX_F64B) {
+    if (cnt++) iwxstr_cat2(xstr, "|");
+    iwxstr_cat2(xstr, "F64B");
+  }
+  if (m & EJDB_IDX_COMPOSITE) {
+    if (cnt++) iwxstr_cat2(xstr, "|");
+    iwxstr_cat2(xstr, "COMPOSITE");
+  }
+  if (m & EJDB_IDX_FTS) {
+    if (cnt++) iwxstr_cat2(xstr, "|");
+    iwxstr_cat2(xstr, "FTS");
+  }
   if (cnt++) iwxstr_cat2(xstr, "|");
   iwxstr_printf(xstr, "%lld ", idx->rnum);
-  jbl_ptr_serialize(idx->ptr, xstr);
+  jbi_idx_ptr_serialize(idx, xstr);
+  if (idx->fqs) {
+    iwxstr_printf(xstr, " FILTER: '%s'", idx->fqs);
+  }
 }
 
 static void _jbi_log_cursor_op(IWXSTR *xstr, IWKV_cursor_op op) {
@@ -49,17 +64,32 @@ static void _jbi_log_cursor_op(IWXSTR *xstr, IWKV_cursor_op op) {
   }
 }
 
+static void _jbi_log_expr(IWXSTR *xstr, const char *name, JQP_EXPR *expr) {
+  iwxstr_printf(xstr, " %s: \'", name);
+  jqp_print_filter_node_expr(expr, jbl_xstr_json_printer, xstr);
+  iwxstr_cat2(xstr, "\'");
+}
+
 static void _jbi_log_index_rules(IWXSTR *xstr, struct _JBMIDX *mctx) {
   _jbi_print_index(mctx->idx, xstr);
-  if (mctx->expr1) {
-    iwxstr_cat2(xstr, " EXPR1: \'");
-    jqp_print_filter_node_expr(mctx->expr1, jbl_xstr_json_printer, xstr);
-    iwxstr_cat2(xstr, "\'");
+  if (mctx->idx->cnum) {
+    for (int i = 0; i < mctx->ceq_num; ++i) {
+      _jbi_log_expr(xstr, "EQ", mctx->ceq[i]);
+    }
+    if (mctx->clower) {
+      _jbi_log_expr(xstr, "LOWER", mctx->clower);
+    }
+    if (mctx->cupper) {
+      _jbi_log_expr(xstr, "UPPER", mctx->cupper);
+    }
+  } else if (mctx->expr1) {
+    _jbi_log_expr(xstr, "EXPR1", mctx->expr1);
+  }
+  if (mctx->prefix) {
+    iwxstr_printf(xstr, " PREFIX: '%s'", mctx->prefix);
   }
   if (mctx->expr2) {
-    iwxstr_cat2(xstr, " EXPR2: \'");
-    jqp_print_filter_node_expr(mctx->expr2, jbl_xstr_json_printer, xstr);
-    iwxstr_cat2(xstr, "\'");
+    _jbi_log_expr(xstr, "EXPR2", mctx->expr2);
   }
   if (mctx->cursor_init) {
     iwxstr_cat2(xstr, " INIT: ");
@@ -72,6 +102,9 @@ static void _jbi_log_index_rules(IWXSTR *xstr, struct _JBMIDX *mctx) {
   if (mctx->orderby_support) {
     iwxstr_cat2(xstr, " ORDERBY");
   }
+  if (mctx->rows) {
+    iwxstr_printf(xstr, " ROWS: %lld", (long long) mctx->rows);
+  }
   iwxstr_cat2(xstr, "\n");
 }
 
@@ -81,6 +114,7 @@ IW_INLINE int _jbi_idx_expr_op_weight(struct _JBMIDX *midx) {
     case JQP_OP_EQ:
       return 10;
     case JQP_OP_IN:
+    case JQP_OP_FT:
       //case JQP_OP_NI: todo
       return 9;
     default:
@@ -92,6 +126,8 @@ IW_INLINE int _jbi_idx_expr_op_weight(struct _JBMIDX *midx) {
   switch (op) {
     case JQP_OP_GT:
     case JQP_OP_GTE:
+    case JQP_OP_RE:
+    case JQP_OP_PREFIX:
       return 7;
     case JQP_OP_LT:
     case JQP_OP_LTE:
@@ -106,9 +142,8 @@ static bool _jbi_is_solid_node_expression(const JQP_NODE *n) {
   for (const JQP_EXPR *expr = &unit->expr; expr; expr = expr->next) {
     if (
       expr->op->negate
-      || (expr->join && (expr->join->negate || expr->join->value == JQP_JOIN_OR))
-      || expr->op->value == JQP_OP_RE) {
-      // No negate conditions, No OR, No regexp
+      || (expr->join && (expr->join->negate || expr->join->value == JQP_JOIN_OR))) {
+      // No negate conditions, No OR
       return false;
     }
     JQPUNIT *left = expr->left;
@@ -134,6 +169,10 @@ static iwrc _jbi_compute_index_rules(JBEXEC *ctx, struct _JBMIDX *mctx) {
     if (expr->left->type != JQP_STRING_TYPE) {
       continue;
     }
+    if ((op == JQP_OP_FT) != ((mctx->idx->mode & EJDB_IDX_FTS) != 0)) {
+      // Full-text index is used only by `ft` expressions
+      continue;
+    }
     switch (rv->type) {
       case JQVAL_NULL:
       case JQVAL_RE:
@@ -143,15 +182,19 @@ static iwrc _jbi_compute_index_rules(JBEXEC *ctx, struct _JBMIDX *mctx) {
         if (op != JQP_OP_IN || rv->vnode->type != JBV_ARRAY) {
           continue;
         }
-        int vcnt = 0;
-        for (JBL_NODE n = rv->vnode->child; n; n = n->next, ++vcnt);
-        if (
-          vcnt > JB_IDX_EMPIRIC_MIN_INOP_ARRAY_SIZE
-          && (vcnt > JB_IDX_EMPIRIC_MAX_INOP_ARRAY_SIZE
-              || mctx->idx->rnum < rv->vbinn->count * JB_IDX_EMPIRIC_MAX_INOP_ARRAY_RATIO)
-        ) {
-          // No index for large IN array | small collection size
-          continue;
+        // With index statistics any size of IN array is served by index: large arrays
+        // are matched by single index pass, full scan is preferred by estimated rows
+        if (!mctx->idx->stat) {
+          int vcnt = 0;
+          for (JBL_NODE n = rv->vnode->child; n; n = n->next, ++vcnt);
+          if (
+            vcnt > JB_IDX_EMPIRIC_MIN_INOP_ARRAY_SIZE
+            && (vcnt > JB_IDX_EMPIRIC_MAX_INOP_ARRAY_SIZE
+                || mctx->idx->rnum < (int64_t) vcnt * JB_IDX_EMPIRIC_MAX_INOP_ARRAY_RATIO)
+          ) {
+            // No index for large IN array | small collection size
+            continue;
+          }
         }
         break;
       }
@@ -163,10 +206,11 @@ static iwrc _jbi_compute_index_rules(JBEXEC *ctx, struct _JBMIDX *mctx) {
         mctx->cursor_init = IWKV_CURSOR_EQ;
         mctx->expr1 = expr;
         mctx->expr2 = 0;
+        mctx->prefix = 0;
         return 0;
       case JQP_OP_GT:
       case JQP_OP_GTE:
-        if (mctx->cursor_init != IWKV_CURSOR_EQ) {
+        if (mctx->cursor_init != IWKV_CURSOR_EQ && !mctx->prefix) {
           if (mctx->expr1 && mctx->cursor_init == IWKV_CURSOR_GE) {
             JQVAL *pval = jql_unit_to_jqval(aux, mctx->expr1->right, &rc);
             RCRET(rc);
@@ -198,9 +242,46 @@ static iwrc _jbi_compute_index_rules(JBEXEC *ctx, struct _JBMIDX *mctx) {
         if (mctx->cursor_init != IWKV_CURSOR_EQ && rv->type >= JQVAL_JBLNODE) {
           mctx->expr1 = expr;
           mctx->expr2 = 0;
+          mctx->prefix = 0;
           mctx->cursor_init = IWKV_CURSOR_EQ;
         }
         break;
+      case JQP_OP_RE:
+      case JQP_OP_PREFIX: {
+        // Strings with common prefix are the range of string index keys starting from prefix
+        const char *prefix = 0;
+        if (mctx->cursor_init == IWKV_CURSOR_EQ
+            || mctx->prefix
+            || (mctx->idx->mode & JB_IDX_TYPE_MASK) != EJDB_IDX_STR
+            || rv->type != JQVAL_STR) {
+          continue;
+        }
+        if (op == JQP_OP_RE) {
+          prefix = jql_regexp_prefix(rv->vstr, aux->pool, &rc);
+          RCRET(rc);
+        } else if (*rv->vstr != '\0') {
+          prefix = rv->vstr;
+        }
+        if (!prefix) {
+          continue;
+        }
+        mctx->prefix = prefix;
+        mctx->expr1 = expr;
+        mctx->cursor_init = IWKV_CURSOR_GE;
+        mctx->cursor_step = IWKV_CURSOR_PREV;
+        break;
+      }
+      case JQP_OP_FT:
+        if (rv->type != JQVAL_STR) {
+          continue;
+        }
+        // Documents are fetched in order of ids of intersected posting lists
+        mctx->expr1 = expr;
+        mctx->expr2 = 0;
+        mctx->cursor_init = IWKV_CURSOR_GE;
+        mctx->cursor_step = IWKV_CURSOR_PREV;
+        mctx->orderby_support = false;
+        return 0;
       default:
         continue;
     }
@@ -228,7 +309,7 @@ static iwrc _jbi_compute_index_rules(JBEXEC *ctx, struct _JBMIDX *mctx) {
           mctx->orderby_support = false;
         }
       }
-      if (!mctx->orderby_support && mctx->expr2) {
+      if (!mctx->orderby_support && mctx->expr2 && !mctx->prefix) {
         JQP_EXPR *tmp = mctx->expr1;
         mctx->expr1 = mctx->expr2;
         mctx->expr2 = tmp;
@@ -247,8 +328,231 @@ static iwrc _jbi_compute_index_rules(JBEXEC *ctx, struct _JBMIDX *mctx) {
   return 0;
 }
 
+/** Filter expression over field addressed by leading field nodes of filter */
+struct _JBATOM {
+  JQP_FILTER *f;              /**< Filter */
+  JQP_EXPR *expr;             /**< Expression of the last filter node */
+  int fcnt;                   /**< Number of field nodes before expression node */
+};
+
+/**
+ * @brief Collects expressions of top level `and` chain of simple filters.
+ * Sets `*completep` to false if some filters of chain are not collected.
+ */
+static void _jbi_collect_atoms(const struct JQP_EXPR_NODE *en,
+                               struct _JBATOM atoms[static JB_SOLID_EXPRNUM],
+                               int *anp,
+                               bool *completep) {
+  if (en->type == JQP_EXPR_NODE_TYPE) {
+    struct JQP_EXPR_NODE *cn = en->chain;
+    for (; cn; cn = cn->next) {
+      if (cn->join && cn->join->value == JQP_JOIN_OR) {
+        *completep = false;
+        return;
+      }
+    }
+    for (cn = en->chain; cn; cn = cn->next) {
+      if (!cn->join || !cn->join->negate) {
+        _jbi_collect_atoms(cn, atoms, anp, completep);
+      } else {
+        *completep = false;
+      }
+    }
+  } else if (en->type == JQP_FILTER_TYPE) {
+    int fcnt = 0;
+    JQP_FILTER *f = (JQP_FILTER *) en;
+    JQP_NODE *n = f->node;
+    for ( ; n && n->ntype == JQP_NODE_FIELD; n = n->next, ++fcnt);
+    if (!n || n->next || n->ntype != JQP_NODE_EXPR || !_jbi_is_solid_node_expression(n)) {
+      *completep = false;
+      return;
+    }
+    // All expressions of node are applied to the same object field,
+    // so expressions over different fields are never matched together
+    const char *field = n->value->expr.left->string.value;
+    for (JQP_EXPR *expr = &n->value->expr; expr; expr = expr->next) {
+      JQPUNIT *left = expr->left;
+      if ((left->string.flavour & JQP_STR_DBL_STAR) || strcmp(left->string.value, field) != 0) {
+        *completep = false;
+        return;
+      }
+    }
+    for (JQP_EXPR *expr = &n->value->expr; expr; expr = expr->next) {
+      if (*anp >= JB_SOLID_EXPRNUM) {
+        *completep = false;
+        return;
+      }
+      atoms[*anp] = (struct _JBATOM) {
+        .f = f, .expr = expr, .fcnt = fcnt
+      };
+      *anp = *anp + 1;
+    }
+  }
+}
+
+static bool _jbi_atom_is_field(const struct _JBATOM *a, const struct _JBL_PTR *ptr) {
+  if (ptr->cnt != a->fcnt + 1) {
+    return false;
+  }
+  JQP_NODE *n = a->f->node;
+  for (int i = 0; i < a->fcnt; ++i, n = n->next) {
+    if (strcmp(n->value->string.value, ptr->n[i]) != 0) {
+      return false;
+    }
+  }
+  return !strcmp(a->expr->left->string.value, ptr->n[a->fcnt]);
+}
+
+static bool _jbi_ptr_eq(const struct _JBL_PTR *p1, const struct _JBL_PTR *p2) {
+  if (p1->cnt != p2->cnt) {
+    return false;
+  }
+  for (int i = 0; i < p1->cnt; ++i) {
+    if (strcmp(p1->n[i], p2->n[i]) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _jbi_atoms_same_field(const struct _JBATOM *a1, const struct _JBATOM *a2) {
+  if (a1->fcnt != a2->fcnt) {
+    return false;
+  }
+  JQP_NODE *n1 = a1->f->node, *n2 = a2->f->node;
+  for (int i = 0; i < a1->fcnt; ++i, n1 = n1->next, n2 = n2->next) {
+    if (strcmp(n1->value->string.value, n2->value->string.value) != 0) {
+      return false;
+    }
+  }
+  return !strcmp(a1->expr->left->string.value, a2->expr->left->string.value);
+}
+
+/**
+ * @brief Returns true if scalar values `v1` and `v2` are compared by JQL without type coercion:
+ *        both are numbers, both are strings or both are booleans.
+ *        Only such comparisons are transitive.
+ */
+IW_INLINE bool _jbi_jqval_same_type(const JQVAL *v1, const JQVAL *v2) {
+  bool num1 = v1->type == JQVAL_I64 || v1->type == JQVAL_F64;
+  bool num2 = v2->type == JQVAL_I64 || v2->type == JQVAL_F64;
+  if (num1 || num2) {
+    return num1 && num2;
+  }
+  return v1->type == v2->type && (v1->type == JQVAL_STR || v1->type == JQVAL_BOOL);
+}
+
+/**
+ * @brief Returns true if query value `qv` matches expression `fa` of partial index filter
+ *        having value `fv` without type coercion.
+ */
+static bool _jbi_jqval_implies(JQP_AUX *faux, JQVAL *qv, const struct _JBATOM *fa, JQVAL *fv, iwrc *rcp) {
+  if (fa->expr->op->value == JQP_OP_IN && fv->type == JQVAL_JBLNODE && fv->vnode->type == JBV_ARRAY) {
+    for (JBL_NODE n = fv->vnode->child; n; n = n->next) {
+      JQVAL ev;
+      jql_node_to_jqval(n, &ev);
+      if (_jbi_jqval_same_type(qv, &ev)) {
+        int cv = jql_cmp_jqval_pair(qv, &ev, rcp);
+        if (*rcp) return false;
+        if (!cv) return true;
+      }
+    }
+    return false;
+  }
+  return _jbi_jqval_same_type(qv, fv) && jql_match_jqval_pair(faux, qv, fa->expr->op, fv, rcp);
+}
+
+/**
+ * @brief Returns true if every field value matched by query expression `qa`
+ *        is matched by expression `fa` of partial index filter.
+ */
+static bool _jbi_atom_implies(JQP_AUX *qaux, const struct _JBATOM *qa,
+                              JQP_AUX *faux, const struct _JBATOM *fa, iwrc *rcp) {
+  if (!_jbi_atoms_same_field(qa, fa)) {
+    return false;
+  }
+  JQVAL *qv = jql_unit_to_jqval(qaux, qa->expr->right, rcp);
+  if (*rcp) return false;
+  JQVAL *fv = jql_unit_to_jqval(faux, fa->expr->right, rcp);
+  if (*rcp) return false;
+  jqp_op_t qop = qa->expr->op->value;
+  jqp_op_t fop = fa->expr->op->value;
+
+  switch (qop) {
+    case JQP_OP_EQ:
+      return _jbi_jqval_implies(faux, qv, fa, fv, rcp);
+    case JQP_OP_IN:
+      if (qv->type != JQVAL_JBLNODE || qv->vnode->type != JBV_ARRAY) {
+        return false;
+      }
+      for (JBL_NODE n = qv->vnode->child; n; n = n->next) {
+        JQVAL ev;
+        jql_node_to_jqval(n, &ev);
+        if (!_jbi_jqval_implies(faux, &ev, fa, fv, rcp)) {
+          return false;
+        }
+      }
+      return true;
+    case JQP_OP_GT:
+    case JQP_OP_GTE:
+    case JQP_OP_LT:
+    case JQP_OP_LTE: {
+      bool lower = (qop == JQP_OP_GT || qop == JQP_OP_GTE);
+      if (lower ? (fop != JQP_OP_GT && fop != JQP_OP_GTE) : (fop != JQP_OP_LT && fop != JQP_OP_LTE)) {
+        return false;
+      }
+      // Range bounds are comparable if both are numbers or both are strings
+      if (!_jbi_jqval_same_type(qv, fv) || qv->type == JQVAL_BOOL) {
+        return false;
+      }
+      int cv = jql_cmp_jqval_pair(qv, fv, rcp);
+      if (*rcp) return false;
+      if (!lower) {
+        cv = -cv;
+      }
+      // Query bound is tighter or equal to filter bound
+      return cv > 0 || (!cv && (fop == JQP_OP_GTE || fop == JQP_OP_LTE || qop == JQP_OP_GT || qop == JQP_OP_LT));
+    }
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Returns true if query filter `qatoms` implies filter of partial index `idx`.
+ *
+ * Every expression of index filter must be implied by some query expression over the same field.
+ * Partial index with filter not representable by expressions of simple filters is never used.
+ */
+static bool _jbi_idx_filter_implied(struct _JBIDX *idx, JQP_AUX *qaux,
+                                    const struct _JBATOM *qatoms, int qnum, iwrc *rcp) {
+  if (!idx->fq) {
+    return true;
+  }
+  int fnum = 0;
+  bool complete = true;
+  struct _JBATOM fatoms[JB_SOLID_EXPRNUM];
+  JQP_AUX *faux = idx->fq->aux;
+  _jbi_collect_atoms(faux->expr, fatoms, &fnum, &complete);
+  if (!complete || !fnum) {
+    return false;
+  }
+  for (int i = 0; i < fnum; ++i) {
+    int j = 0;
+    for ( ; j < qnum && !_jbi_atom_implies(qaux, &qatoms[j], faux, &fatoms[i], rcp); ++j) {
+      if (*rcp) return false;
+    }
+    if (j == qnum) {
+      return false;
+    }
+  }
+  return true;
+}
+
 static iwrc _jbi_collect_indexes(JBEXEC *ctx,
                                  const struct JQP_EXPR_NODE *en,
+                                 const struct _JBATOM *qatoms,
+                                 int qnum,
                                  struct _JBMIDX marr[static JB_SOLID_EXPRNUM],
                                  size_t *snp) {
 
@@ -265,7 +569,7 @@ static iwrc _jbi_collect_indexes(JBEXEC *ctx,
     }
     for (cn = en->chain; cn; cn = cn->next) {
       if (!cn->join || !cn->join->negate) {
-        rc = _jbi_collect_indexes(ctx, cn, marr, snp);
+        rc = _jbi_collect_indexes(ctx, cn, qatoms, qnum, marr, snp);
         RCRET(rc);
       }
     }
@@ -293,7 +597,11 @@ static iwrc _jbi_collect_indexes(JBEXEC *ctx,
     for (struct _JBIDX *idx = ctx->jbc->idx; idx && *snp < JB_SOLID_EXPRNUM; idx = idx->next) {
       struct _JBMIDX mctx = {.filter = f};
       struct _JBL_PTR *ptr = idx->ptr;
-      if (ptr->cnt > fnc) continue;
+      if (idx->cnum || ptr->cnt > fnc) continue;
+      if (!_jbi_idx_filter_implied(idx, aux, qatoms, qnum, &rc)) {
+        RCRET(rc);
+        continue;
+      }
 
       JQP_EXPR *nexpr = 0;
       int i = 0, j = 0;
@@ -337,6 +645,7 @@ static iwrc _jbi_collect_indexes(JBEXEC *ctx,
         if (!mctx.expr1) { // Cannot find matching expressions
           continue;
         }
+        mctx.rows = jbi_stat_estimate(ctx, &mctx);
         if (ctx->ux->log) {
           iwxstr_cat2(ctx->ux->log, "[INDEX] MATCHED  ");
           _jbi_log_index_rules(ctx->ux->log, &mctx);
@@ -349,15 +658,135 @@ static iwrc _jbi_collect_indexes(JBEXEC *ctx,
   return rc;
 }
 
+/**
+ * @brief Matches composite indexes against top level `and` chain of filters.
+ *
+ * Composite index is used when its leading fields are bound by equality expressions,
+ * next field may be bounded by range expressions and may be ordered by the first order-by clause.
+ */
+static iwrc _jbi_collect_composite_indexes(JBEXEC *ctx,
+                                           const struct _JBATOM *atoms,
+                                           int anum,
+                                           struct _JBMIDX marr[static JB_SOLID_EXPRNUM],
+                                           size_t *snp) {
+  iwrc rc = 0;
+  struct JQP_AUX *aux = ctx->ux->q->aux;
+  struct _JBL_PTR *obp = aux->orderby_num == 1 ? aux->orderby_ptrs[0] : 0;
+
+  if (!anum) {
+    return 0;
+  }
+  for (struct _JBIDX *idx = ctx->jbc->idx; idx && *snp < JB_SOLID_EXPRNUM; idx = idx->next) {
+    if (!idx->cnum || idx->ckv != JB_IDX_CK_VERSION) { // Keys of previous format are rebuilt on open
+      continue;
+    }
+    if (!_jbi_idx_filter_implied(idx, aux, atoms, anum, &rc)) {
+      RCRET(rc);
+      continue;
+    }
+    int k = 0;
+    struct _JBMIDX mctx = { .idx = idx };
+    for ( ; k < idx->cnum; ++k) {
+      for (int i = 0; i < anum && !mctx.ceq[k]; ++i) {
+        JQP_EXPR *expr = atoms[i].expr;
+        if (expr->op->value != JQP_OP_EQ || !_jbi_atom_is_field(&atoms[i], idx->cptrs[k])) {
+          continue;
+        }
+        JQVAL *rv = jql_unit_to_jqval(aux, expr->right, &rc);
+        RCRET(rc);
+        if (rv->type >= JQVAL_I64 && rv->type <= JQVAL_BOOL && jbi_composite_jqval_exact(rv)) {
+          mctx.ceq[k] = expr;
+          if (!k) {
+            mctx.filter = atoms[i].f;
+          }
+        }
+      }
+      if (!mctx.ceq[k]) {
+        break;
+      }
+    }
+    mctx.ceq_num = k;
+    if (k < idx->cnum) {
+      for (int i = 0; i < anum; ++i) {
+        JQP_EXPR *expr = atoms[i].expr;
+        jqp_op_t op = expr->op->value;
+        if (op != JQP_OP_GT && op != JQP_OP_GTE && op != JQP_OP_LT && op != JQP_OP_LTE) {
+          continue;
+        }
+        if (!_jbi_atom_is_field(&atoms[i], idx->cptrs[k])) {
+          continue;
+        }
+        JQVAL *rv = jql_unit_to_jqval(aux, expr->right, &rc);
+        RCRET(rc);
+        if (rv->type < JQVAL_I64 || rv->type > JQVAL_BOOL) {
+          continue;
+        }
+        if ((op == JQP_OP_GT || op == JQP_OP_GTE) && !mctx.clower) {
+          mctx.clower = expr;
+        } else if ((op == JQP_OP_LT || op == JQP_OP_LTE) && !mctx.cupper) {
+          mctx.cupper = expr;
+        } else {
+          continue;
+        }
+        if (!k && !mctx.filter) {
+          mctx.filter = atoms[i].f;
+        }
+      }
+    }
+    if (!k && !mctx.clower && !mctx.cupper) {
+      continue;
+    }
+    mctx.expr1 = k ? mctx.ceq[0] : (mctx.clower ? mctx.clower : mctx.cupper);
+    mctx.nexpr = mctx.expr1;
+    mctx.cursor_init = IWKV_CURSOR_GE;
+    mctx.cursor_step = IWKV_CURSOR_PREV;
+    if (obp) {
+      for (int i = 0; i <= k && i < idx->cnum; ++i) {
+        if (_jbi_ptr_eq(obp, idx->cptrs[i])) {
+          // Fields bound by equality have the same value in all matched documents
+          mctx.orderby_support = true;
+          if (i == k && (obp->op & 1)) { // Desc sort
+            mctx.cursor_step = IWKV_CURSOR_NEXT;
+          }
+          break;
+        }
+      }
+    }
+    mctx.rows = jbi_stat_estimate(ctx, &mctx);
+    if (ctx->ux->log) {
+      iwxstr_cat2(ctx->ux->log, "[INDEX] MATCHED  ");
+      _jbi_log_index_rules(ctx->ux->log, &mctx);
+    }
+    marr[*snp] = mctx;
+    *snp = *snp + 1;
+  }
+  return rc;
+}
+
+IW_INLINE int _jbi_idx_bound_fields(struct _JBMIDX *midx) {
+  if (!midx->idx->cnum) {
+    return 1;
+  }
+  return midx->ceq_num + ((midx->clower || midx->cupper) ? 1 : 0);
+}
+
 static int _jbi_idx_cmp(const void *o1, const void *o2) {
   struct _JBMIDX *d1 = (struct _JBMIDX *) o1;
   struct _JBMIDX *d2 = (struct _JBMIDX *) o2;
   assert(d1 && d2);
+  if (d1->cost != d2->cost) {
+    return d1->cost < d2->cost ? -1 : 1;
+  }
   int w1 = _jbi_idx_expr_op_weight(d1);
   int w2 = _jbi_idx_expr_op_weight(d2);
   if (w2 - w1) {
     return w2 - w1;
   }
+  w1 = _jbi_idx_bound_fields(d1);
+  w2 = _jbi_idx_bound_fields(d2);
+  if (w2 - w1) {
+    return w2 - w1;
+  }
   w1 = d1->expr2 != 0;
   w2 = d2->expr2 != 0;
   if (w2 - w1) {
@@ -366,16 +795,49 @@ static int _jbi_idx_cmp(const void *o1, const void *o2) {
   if (d1->idx->rnum - d2->idx->rnum) {
     return (d1->idx->rnum - d2->idx->rnum) > 0 ? 1 : -1;
   }
-  return (d1->idx->ptr->cnt - d2->idx->ptr->cnt);
+  if (d1->idx->ptr->cnt - d2->idx->ptr->cnt) {
+    return d1->idx->ptr->cnt - d2->idx->ptr->cnt;
+  }
+  return d1->ord < d2->ord ? -1 : d1->ord > d2->ord;
 }
 
-static struct _JBIDX *_jbi_select_index_for_orderby(JBEXEC *ctx) {
+/**
+ * @brief Sorts candidate indexes, the best one goes first.
+ *
+ * If every candidate has statistics its cost is the estimated number of scanned index records,
+ * scaled if result set must be sorted afterwards. Otherwise all costs are equal and candidates
+ * are ordered by heuristic rules of `_jbi_idx_cmp()`. Costs are computed for the whole set at once,
+ * so candidates are compared by the same keys and ordering is transitive.
+ */
+static void _jbi_idx_sort(struct _JBMIDX *marr, size_t num) {
+  bool stats = true;
+  for (size_t i = 0; i < num && stats; ++i) {
+    stats = marr[i].rows > 0;
+  }
+  for (size_t i = 0; i < num; ++i) {
+    struct _JBMIDX *midx = &marr[i];
+    midx->ord = i;
+    midx->cost = 0;
+    if (stats) {
+      // Resultset fetched by index not supporting order-by clause must be sorted
+      midx->cost = midx->orderby_support ? midx->rows : midx->rows * JB_IDX_EMPIRIC_SORT_COST_FACTOR;
+    }
+  }
+  qsort(marr, num, sizeof(marr[0]), _jbi_idx_cmp);
+}
+
+static struct _JBIDX *_jbi_select_index_for_orderby(JBEXEC *ctx, const struct _JBATOM *qatoms, int qnum,
+                                                     iwrc *rcp) {
   struct JQP_AUX *aux = ctx->ux->q->aux;
   struct _JBL_PTR *obp = aux->orderby_ptrs[0];
   assert(obp);
   for (struct _JBIDX *idx = ctx->jbc->idx; idx; idx = idx->next) {
     struct _JBL_PTR *ptr = idx->ptr;
-    if (obp->cnt != ptr->cnt) {
+    if (idx->cnum || (idx->mode & EJDB_IDX_FTS) || obp->cnt != ptr->cnt) {
+      continue;
+    }
+    if (!_jbi_idx_filter_implied(idx, aux, qatoms, qnum, rcp)) {
+      if (*rcp) return 0;
       continue;
     }
     int i = 0;
@@ -397,10 +859,245 @@ static struct _JBIDX *_jbi_select_index_for_orderby(JBEXEC *ctx) {
   return 0;
 }
 
+/**
+ * @brief Returns true if keys of single field index `idx` compare the same way as JQL compares
+ *        indexed values with query value `rv`: I64 index having only I64 values and I64 query value,
+ *        F64B index having only numbers and numeric query value.
+ *        Keys of STR and F64 indexes never reproduce JQL comparison of numbers.
+ */
+static bool _jbi_idx_keys_exact(JBIDX idx, const JQVAL *rv) {
+  if (idx->cnum || __atomic_load_n(&idx->coerced, __ATOMIC_RELAXED)) {
+    return false;
+  }
+  if (idx->mode & EJDB_IDX_I64) {
+    return rv->type == JQVAL_I64;
+  } else if (idx->mode & EJDB_IDX_F64B) {
+    return rv->type == JQVAL_I64 || rv->type == JQVAL_F64;
+  }
+  return false;
+}
+
+static iwrc _jbi_select_intersection(JBEXEC *ctx, struct _JBMIDX *marr, size_t num) {
+  iwrc rc = 0;
+  for (size_t i = 0; i < num; ++i) {
+    bool added;
+    struct _JBMIDX *mctx = &marr[i];
+    if (mctx->idx == ctx->midx.idx
+        || mctx->idx->cnum
+        || mctx->expr1->prematched // Already matched by primary index
+        || !(mctx->idx->idbf & IWDB_COMPOUND_KEYS)
+        || mctx->cursor_init != IWKV_CURSOR_EQ
+        || mctx->expr1->op->value != JQP_OP_EQ) {
+      continue;
+    }
+    if (ctx->midx.rows && mctx->rows > ctx->midx.rows * JB_IDX_EMPIRIC_MAX_INTERSECT_RATIO) {
+      // Reading of secondary index costs more than fetching of documents by primary index
+      continue;
+    }
+    rc = jbi_isect_add(ctx, mctx, &added);
+    RCRET(rc);
+    if (!added) {
+      continue;
+    }
+    // Every document passed through intersection filter matches this expression
+    mctx->expr1->prematched = true;
+    JQVAL *rv = jql_unit_to_jqval(ctx->ux->q->aux, mctx->expr1->right, &rc);
+    if (rc || !_jbi_idx_keys_exact(mctx->idx, rv)) {
+      rc = 0;
+      ctx->isect.inexact = true;
+    }
+    if (ctx->ux->log) {
+      iwxstr_cat2(ctx->ux->log, "[INDEX] INTERSECT ");
+      _jbi_log_index_rules(ctx->ux->log, mctx);
+    }
+    if (!ctx->isect.num) { // Nothing can be matched
+      break;
+    }
+  }
+  return 0;
+}
+
+static iwrc _jbi_select_union(JBEXEC *ctx, bool *selectedp) {
+  iwrc rc = 0;
+  size_t num = 0;
+  struct _JBMIDX *marr = 0;
+  struct JQP_AUX *aux = ctx->ux->q->aux;
+  struct JQP_EXPR_NODE *en = aux->expr;
+  *selectedp = false;
+
+  if (en->type != JQP_EXPR_NODE_TYPE) {
+    return 0;
+  }
+  for (struct JQP_EXPR_NODE *cn = en->chain; cn; cn = cn->next, ++num) {
+    // Only plain `A or B or C` chains are supported
+    if (cn->join && (cn->join->negate || cn->join->value != JQP_JOIN_OR)) {
+      return 0;
+    }
+  }
+  if (num < 2) {
+    return 0;
+  }
+  marr = malloc(num * sizeof(*marr));
+  if (!marr) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  num = 0;
+  for (struct JQP_EXPR_NODE *cn = en->chain; cn; cn = cn->next) {
+    size_t snp = 0;
+    int qnum = 0;
+    bool complete = true;
+    struct _JBATOM qatoms[JB_SOLID_EXPRNUM];
+    struct _JBMIDX fctx[JB_SOLID_EXPRNUM] = {0};
+    _jbi_collect_atoms(cn, qatoms, &qnum, &complete);
+    rc = _jbi_collect_indexes(ctx, cn, qatoms, qnum, fctx, &snp);
+    RCGO(rc, finish);
+    if (!snp) { // Branch cannot be served by index so full scan is required
+      goto finish;
+    }
+    _jbi_idx_sort(fctx, snp);
+    memcpy(&marr[num], &fctx[0], sizeof(marr[0]));
+    marr[num++].orderby_support = false;
+  }
+  if (ctx->ux->log) {
+    for (size_t i = 0; i < num; ++i) {
+      iwxstr_cat2(ctx->ux->log, "[INDEX] UNION ");
+      _jbi_log_index_rules(ctx->ux->log, &marr[i]);
+    }
+  }
+  ctx->iunion.midx = marr;
+  ctx->iunion.num = num;
+  *selectedp = true;
+
+finish:
+  if (!*selectedp) {
+    free(marr);
+  }
+  return rc;
+}
+
+static bool _jbi_is_expr_covered(JBEXEC *ctx, JQP_EXPR *expr) {
+  iwrc rc = 0;
+  struct _JBMIDX *midx = &ctx->midx;
+  if (expr != midx->expr1 && expr != midx->expr2) {
+    // Equality expressions of composite index fields are encoded as JQL equality coerces them
+    for (int i = 0; i < midx->ceq_num; ++i) {
+      if (midx->ceq[i] == expr) {
+        return expr->prematched;
+      }
+    }
+    // Equality expressions of intersected indexes
+    return expr->prematched && !ctx->isect.inexact;
+  }
+  if (midx->idx->cnum) {
+    return expr->prematched;
+  }
+  JQVAL *rv = jql_unit_to_jqval(ctx->ux->q->aux, expr->right, &rc);
+  if (rc || !_jbi_idx_keys_exact(midx->idx, rv)) {
+    return false;
+  }
+  if (expr->prematched || expr == midx->expr2) { // Matched by index keys
+    return true;
+  }
+  // Scan of lower bound expression starts exactly from the first matching key
+  switch (expr->op->value) {
+    case JQP_OP_GT:
+    case JQP_OP_GTE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool _jbi_is_filter_covered(JBEXEC *ctx, JQP_FILTER *f) {
+  JQP_NODE *n = f->node;
+  for (; n && n->next; n = n->next) {
+    if (n->ntype != JQP_NODE_FIELD) {
+      return false;
+    }
+  }
+  if (!n || n->ntype != JQP_NODE_EXPR) {
+    return false;
+  }
+  for (JQP_EXPR *expr = &n->value->expr; expr; expr = expr->next) {
+    if (expr->join && (expr->join->negate || expr->join->value != JQP_JOIN_AND)) {
+      return false;
+    }
+    if (!_jbi_is_expr_covered(ctx, expr)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool jbi_index_covered(JBEXEC *ctx) {
+  struct JQP_AUX *aux = ctx->ux->q->aux;
+  struct JQP_EXPR_NODE *en = aux->expr;
+  if (!ctx->midx.idx
+      || !ctx->midx.expr1
+      || ctx->sorting
+      || aux->apply
+      || aux->apply_placeholder
+      || (aux->qmode & JQP_QRY_APPLY_DEL)
+      || en->type != JQP_EXPR_NODE_TYPE) {
+    return false;
+  }
+  for (en = en->chain; en; en = en->next) {
+    if (en->join && (en->join->negate || en->join->value != JQP_JOIN_AND)) {
+      return false;
+    }
+    if (en->type != JQP_FILTER_TYPE || !_jbi_is_filter_covered(ctx, (JQP_FILTER *) en)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Sets prematched flag of expressions matched by index keys:
+ *        `expr1` of single field index or equality expressions of composite index fields.
+ *        Range bounds of composite index field are always checked against documents:
+ *        keys of coerced numeric strings are ordered as numbers while JQL compares them as strings.
+ *        Reset clears flags of all bound expressions.
+ */
+static void _jbi_midx_prematched_set(struct _JBMIDX *midx, bool prematched) {
+  if (!prematched || !midx->idx->cnum) {
+    midx->expr1->prematched = prematched;
+  }
+  for (int i = 0; i < midx->ceq_num; ++i) {
+    midx->ceq[i]->prematched = prematched;
+  }
+  if (!prematched) {
+    if (midx->clower) {
+      midx->clower->prematched = false;
+    }
+    if (midx->cupper) {
+      midx->cupper->prematched = false;
+    }
+  }
+}
+
+static bool _jbi_is_full_scan_preferred(JBEXEC *ctx) {
+  struct _JBMIDX *midx = &ctx->midx;
+  struct JQP_AUX *aux = ctx->ux->q->aux;
+  if (!midx->rows || midx->rows * 100 <= ctx->jbc->rnum * JB_IDX_EMPIRIC_MAX_SCAN_PCT) {
+    return false;
+  }
+  if (midx->orderby_support && aux->orderby_num == 1) { // Index scan saves sorting
+    return false;
+  }
+  if (jql_has_aggregate_count(ctx->ux->q) && jbi_index_covered(ctx)) { // Documents will not be fetched
+    return false;
+  }
+  return true;
+}
+
 iwrc jbi_selection(JBEXEC *ctx) {
   iwrc rc = 0;
   size_t snp = 0;
+  int qnum = 0;
+  bool complete = true;
   struct JQP_AUX *aux = ctx->ux->q->aux;
+  struct _JBATOM qatoms[JB_SOLID_EXPRNUM];
   struct _JBMIDX fctx[JB_SOLID_EXPRNUM] = {0};
 
   ctx->cursor_init = IWKV_CURSOR_BEFORE_FIRST;
@@ -415,32 +1112,71 @@ iwrc jbi_selection(JBEXEC *ctx) {
   }
 
   if (!(aux->qmode & JQP_QRY_NOIDX) && ctx->jbc->idx) { // we have indexes associated with collection
-    rc = _jbi_collect_indexes(ctx, aux->expr, fctx, &snp);
+    _jbi_collect_atoms(aux->expr, qatoms, &qnum, &complete);
+    rc = _jbi_collect_indexes(ctx, aux->expr, qatoms, qnum, fctx, &snp);
+    RCRET(rc);
+    rc = _jbi_collect_composite_indexes(ctx, qatoms, qnum, fctx, &snp);
     RCRET(rc);
     if (snp) { // Index selected
-      qsort(fctx, snp, sizeof(fctx[0]), _jbi_idx_cmp);
+      _jbi_idx_sort(fctx, snp);
       memcpy(&ctx->midx, &fctx[0], sizeof(ctx->midx));
       struct _JBMIDX *midx = &ctx->midx;
       jqp_op_t op = midx->expr1->op->value;
-      if (op == JQP_OP_EQ || op == JQP_OP_IN || (op == JQP_OP_GTE && ctx->cursor_init == IWKV_CURSOR_GE)) {
+      if (midx->idx->cnum) { // Composite index scan is limited by keys of equality bound fields
+        _jbi_midx_prematched_set(midx, true);
+      } else if (op == JQP_OP_EQ || op == JQP_OP_IN || (op == JQP_OP_GTE && ctx->cursor_init == IWKV_CURSOR_GE)) {
         midx->expr1->prematched = true;
       }
+      if (_jbi_is_full_scan_preferred(ctx)) {
+        if (ctx->ux->log) {
+          iwxstr_cat2(ctx->ux->log, "[INDEX] SKIPPED ");
+          _jbi_log_index_rules(ctx->ux->log, &ctx->midx);
+        }
+        _jbi_midx_prematched_set(midx, false);
+        memset(midx, 0, sizeof(*midx));
+        return 0;
+      }
       if (ctx->ux->log) {
         iwxstr_cat2(ctx->ux->log, "[INDEX] SELECTED ");
         _jbi_log_index_rules(ctx->ux->log, &ctx->midx);
       }
+      if (snp > 1 && !((midx->idx->mode & EJDB_IDX_UNIQUE) && (op == JQP_OP_EQ || op == JQP_OP_IN))) {
+        // Filter documents fetched by primary index using other equality indexes
+        rc = _jbi_select_intersection(ctx, fctx + 1, snp - 1);
+        RCRET(rc);
+      }
       if (midx->orderby_support && aux->orderby_num == 1) {
         // Turn off final sorting since it supported by natural index scan order
         ctx->sorting = false;
       } else if (aux->orderby_num) {
         ctx->sorting = true;
       }
-    } else if (ctx->sorting) { // Last chance to use index and avoid sorting
-      if (_jbi_select_index_for_orderby(ctx) && ctx->ux->log) {
-        iwxstr_cat2(ctx->ux->log, "[INDEX] SELECTED ");
-        _jbi_log_index_rules(ctx->ux->log, &ctx->midx);
+    } else {
+      bool selected;
+      rc = _jbi_select_union(ctx, &selected);
+      RCRET(rc);
+      if (!selected && ctx->sorting) { // Last chance to use index and avoid sorting
+        if (_jbi_select_index_for_orderby(ctx, qatoms, qnum, &rc) && ctx->ux->log) {
+          iwxstr_cat2(ctx->ux->log, "[INDEX] SELECTED ");
+          _jbi_log_index_rules(ctx->ux->log, &ctx->midx);
+        }
       }
     }
   }
   return rc;
 }
+
+iwrc jbi_idx_filter_prepare(struct _JBIDX *idx) {
+  iwrc rc = 0;
+  int anum = 0;
+  bool complete = true;
+  struct _JBATOM atoms[JB_SOLID_EXPRNUM];
+  JQP_AUX *aux = idx->fq->aux;
+  // Values of filter expressions are converted once, so queries may check filter concurrently
+  _jbi_collect_atoms(aux->expr, atoms, &anum, &complete);
+  for (int i = 0; i < anum; ++i) {
+    jql_unit_to_jqval(aux, atoms[i].expr->right, &rc);
+    RCRET(rc);
+  }
+  return rc;
+}
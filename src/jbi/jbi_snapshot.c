@@ -0,0 +1,109 @@
+#include "ejdb2_internal.h"
+
+struct _JBDVER *jbi_snapshot_version(JBCOLL jbc, int64_t id, uint64_t ver) {
+  struct _JBDVER *res = 0;
+  khiter_t k = kh_get(JBDVERS, jbc->dvers, id);
+  if (k == kh_end(jbc->dvers)) {
+    return 0;
+  }
+  // Versions are ordered from the newest, the oldest one made after snapshot keeps its state
+  for (struct _JBDVER *v = kh_value(jbc->dvers, k); v && v->ver > ver; v = v->next) {
+    res = v;
+  }
+  return res;
+}
+
+static int _jbi_snapshot_id_cmp(const void *o1, const void *o2) {
+  int64_t v1 = *(const int64_t *) o1, v2 = *(const int64_t *) o2;
+  return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+/**
+ * @brief Passes to the consumer documents modified by writers after snapshot was taken
+ * and not matched by scan. Such documents are skipped by scan and matched against query
+ * as of snapshot version.
+ */
+static iwrc _jbi_snapshot_final(struct _JBEXEC *ctx) {
+  iwrc rc = 0;
+  size_t num = 0, asz = 0;
+  int64_t *ids = 0;
+  JBCOLL jbc = ctx->jbc;
+  struct _JBSNAP *snap = ctx->snap;
+
+  snap->final = true;
+  if (ctx->ux->limit < 1 || !ctx->istep) {
+    return 0;
+  }
+  int rci = pthread_rwlock_rdlock(&jbc->vlock);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  for (khiter_t k = kh_begin(jbc->dvers); k != kh_end(jbc->dvers); ++k) {
+    if (!kh_exist(jbc->dvers, k)) continue;
+    int64_t id = kh_key(jbc->dvers, k);
+    if (kh_get(JBIDS, snap->ids, id) != kh_end(snap->ids)) {
+      continue;
+    }
+    struct _JBDVER *v = jbi_snapshot_version(jbc, id, snap->ver);
+    if (!v || !v->size) { // Document is not changed or not exists in snapshot
+      continue;
+    }
+    if (num >= asz) {
+      size_t nsz = asz ? asz * 2 : 64;
+      int64_t *nids = realloc(ids, nsz * sizeof(ids[0]));
+      if (!nids) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        break;
+      }
+      ids = nids;
+      asz = nsz;
+    }
+    ids[num++] = id;
+  }
+  pthread_rwlock_unlock(&jbc->vlock);
+  RCGO(rc, finish);
+  if (!num) {
+    goto finish;
+  }
+  qsort(ids, num, sizeof(ids[0]), _jbi_snapshot_id_cmp);
+
+  // Documents are matched by the whole query
+  ctx->index_only = false;
+  ctx->isect.active = false;
+  jql_reset(ctx->ux->q, true, false);
+
+  for (size_t i = 0; i < num; ++i) {
+    bool matched = false;
+    int64_t step = 1;
+    rc = snap->consumer(ctx, 0, ids[i], &step, &matched, 0);
+    if (rc || !step) {
+      break;
+    }
+  }
+
+finish:
+  free(ids);
+  return rc;
+}
+
+iwrc jbi_snapshot_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id, int64_t *step, bool *matched, iwrc err) {
+  struct _JBSNAP *snap = ctx->snap;
+  if (id) {
+    *matched = false;
+    iwrc rc = snap->consumer(ctx, cur, id, step, matched, err);
+    if (!rc && *matched) {
+      int ret;
+      kh_put(JBIDS, snap->ids, id, &ret);
+      if (ret < 0) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      }
+    }
+    return rc;
+  }
+  if (!err) { // EOF scan
+    err = _jbi_snapshot_final(ctx);
+  } else {
+    snap->final = true;
+  }
+  return snap->consumer(ctx, 0, 0, 0, 0, err);
+}
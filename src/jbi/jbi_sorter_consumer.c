@@ -1,59 +1,542 @@
 #include "ejdb2_internal.h"
 #include "sort_r.h"
 
+// Sort record header: key length
+#define _JBS_REC_HDR_SZ sizeof(uint32_t)
+
+// Min size of run read buffer used by runs merge
+#define _JBS_RUN_BUF_MIN_SZ (16 * 1024)
+
+IW_INLINE uint32_t _jbi_sorter_rec_klen(const uint8_t *rec) {
+  uint32_t klen;
+  memcpy(&klen, rec, sizeof(klen));
+  return klen;
+}
+
+IW_INLINE uint32_t _jbi_sorter_rec_size(const uint8_t *rec) {
+  return _JBS_REC_HDR_SZ + _jbi_sorter_rec_klen(rec) + sizeof(int64_t);
+}
+
+IW_INLINE int64_t _jbi_sorter_rec_id(const uint8_t *rec) {
+  int64_t id;
+  memcpy(&id, rec + _JBS_REC_HDR_SZ + _jbi_sorter_rec_klen(rec), sizeof(id));
+  return id;
+}
+
+IW_INLINE int _jbi_sorter_key_cmp(const uint8_t *k1, uint32_t l1, const uint8_t *k2, uint32_t l2) {
+  int rv = memcmp(k1, k2, MIN(l1, l2));
+  if (!rv) {
+    rv = l1 > l2 ? 1 : l1 < l2 ? -1 : 0;
+  }
+  return rv;
+}
+
+IW_INLINE int _jbi_sorter_rec_cmp(const uint8_t *rec1, const uint8_t *rec2) {
+  return _jbi_sorter_key_cmp(rec1 + _JBS_REC_HDR_SZ, _jbi_sorter_rec_klen(rec1),
+                             rec2 + _JBS_REC_HDR_SZ, _jbi_sorter_rec_klen(rec2));
+}
+
 static void _jbi_scan_sorter_release(struct _JBEXEC *ctx) {
   struct _JBSSC *ssc = &ctx->ssc;
-  if (ssc->refs) {
-    free(ssc->refs);
+  free(ssc->refs);
+  free(ssc->recs);
+  free(ssc->kbuf);
+  free(ssc->heap);
+  if (ssc->topk) {
+    for (uint32_t i = 0; i < ssc->topk_num; ++i) {
+      free(ssc->topk[i]);
+    }
+    free(ssc->topk);
+  }
+  for (uint32_t i = 0; i < ssc->runs_num; ++i) {
+    free(ssc->runs[i].buf);
   }
+  free(ssc->runs);
   if (ssc->sof_active) {
     ssc->sof.close(&ssc->sof);
-  } else if (ssc->docs) {
-    free(ssc->docs);
   }
   memset(ssc, 0, sizeof(*ssc));
 }
 
 static int _jbi_scan_sorter_cmp(const void *o1, const void *o2, void *op) {
-  int rv = 0;
   uint32_t r1, r2;
-  struct _JBL d1, d2;
-  struct _JBEXEC *ctx = op;
-  struct _JBSSC *ssc = &ctx->ssc;
-  struct JQP_AUX *aux = ctx->ux->q->aux;
-  uint8_t *p1, *p2;
-  assert(aux->orderby_num > 0);
-
+  const uint8_t *recs = op;
   memcpy(&r1, o1, sizeof(r1));
   memcpy(&r2, o2, sizeof(r2));
+  int rv = _jbi_sorter_rec_cmp(recs + r1, recs + r2);
+  if (!rv) { // Keep scan order of documents with equal keys
+    rv = r1 > r2 ? 1 : r1 < r2 ? -1 : 0;
+  }
+  return rv;
+}
 
-  p1 = ssc->docs + r1 + sizeof(uint64_t) /*id*/;
-  p2 = ssc->docs + r2 + sizeof(uint64_t) /*id*/;
+//--------------------------- Sort key
 
-  iwrc rc = jbl_from_buf_keep_onstack2(&d1, p1);
-  RCGO(rc, finish);
-  rc = jbl_from_buf_keep_onstack2(&d2, p2);
-  RCGO(rc, finish);
+static iwrc _jbi_sorter_key_ensure(struct _JBSSC *ssc, size_t len, size_t add) {
+  if (len + add <= ssc->kbuf_asz) {
+    return 0;
+  }
+  size_t nsz = MAX(len + add, ssc->kbuf_asz * 2);
+  nsz = MAX(nsz, 256);
+  uint8_t *nbuf = realloc(ssc->kbuf, nsz);
+  if (!nbuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  ssc->kbuf = nbuf;
+  ssc->kbuf_asz = nsz;
+  return 0;
+}
+
+IW_INLINE void _jbi_sorter_key_u64(uint8_t *wp, uint64_t v) {
+  for (int i = 7; i >= 0; --i) {
+    wp[i] = (uint8_t) v;
+    v >>= 8;
+  }
+}
 
+/**
+ * @brief Appends normalized value `jv` to the sort key being built.
+ *
+ * Normalized values are compared by `memcmp()` in the same order
+ * as `_jbl_cmp_atomic_values()` compares them:
+ * value type first, then value itself.
+ * Bytes of value are inverted if descending order requested.
+ */
+static iwrc _jbi_sorter_key_add(struct _JBSSC *ssc, size_t *lenp, JBL jv, bool desc) {
+  size_t len = *lenp, vlen = 0;
+  const char *str = 0;
+  jbl_type_t t = jbl_type(jv);
+  switch (t) {
+    case JBV_BOOL:
+    case JBV_I64:
+    case JBV_F64:
+      vlen = sizeof(uint64_t);
+      break;
+    case JBV_STR:
+      str = jbl_get_str(jv);
+      vlen = strlen(str) + 1;
+      break;
+    default:
+      break;
+  }
+  iwrc rc = _jbi_sorter_key_ensure(ssc, len, 1 + vlen);
+  RCRET(rc);
+  uint8_t *wp = ssc->kbuf + len;
+  *wp = (uint8_t) t;
+  switch (t) {
+    case JBV_BOOL:
+    case JBV_I64:
+      _jbi_sorter_key_u64(wp + 1, (uint64_t) jbl_get_i64(jv) ^ (1ULL << 63));
+      break;
+    case JBV_F64: {
+      uint64_t u;
+      double v = jbl_get_f64(jv);
+      if (v == 0.0) {
+        v = 0.0; // Positive and negative zero are equal
+      }
+      memcpy(&u, &v, sizeof(u));
+      u = (u & (1ULL << 63)) ? ~u : (u | (1ULL << 63));
+      _jbi_sorter_key_u64(wp + 1, u);
+      break;
+    }
+    case JBV_STR:
+      // Strings are compared up to the terminating zero, as by `strcmp()`
+      memcpy(wp + 1, str, vlen);
+      break;
+    default:
+      break;
+  }
+  if (desc) {
+    for (size_t i = 0; i <= vlen; ++i) {
+      wp[i] = ~wp[i];
+    }
+  }
+  *lenp = len + 1 + vlen;
+  return 0;
+}
+
+static iwrc _jbi_sorter_key_build(struct _JBEXEC *ctx, JBL jbl, size_t *lenp) {
+  iwrc rc = 0;
+  struct JQP_AUX *aux = ctx->ux->q->aux;
+  assert(aux->orderby_num > 0);
+  *lenp = 0;
   for (int i = 0; i < aux->orderby_num; ++i) {
-    struct _JBL v1 = {0};
-    struct _JBL v2 = {0};
+    struct _JBL jv = { 0 };
     JBL_PTR ptr = aux->orderby_ptrs[i];
-    int desc = (ptr->op & 1) ? -1 : 1; // If `-1` do desc sorting
-    _jbl_at(&d1, ptr, &v1);
-    _jbl_at(&d2, ptr, &v2);
-    rv = _jbl_cmp_atomic_values(&v1, &v2) * desc;
-    if (rv) break;
+    _jbl_at(jbl, ptr, &jv);
+    rc = _jbi_sorter_key_add(&ctx->ssc, lenp, &jv, (ptr->op & 1));
+    RCRET(rc);
   }
+  return rc;
+}
+
+//--------------------------- Sorted runs
+
+static iwrc _jbi_sorter_sof_init(struct _JBSSC *ssc) {
+  IWFS_EXT_OPTS opts = {
+    .initial_size = ssc->recs_asz,
+    .rspolicy = iw_exfile_szpolicy_fibo,
+    .file = {
+      .path = "jb-",
+      .omode = IWFS_OTMP | IWFS_OUNLINK
+    }
+  };
+  iwrc rc = iwfs_exfile_open(&ssc->sof, &opts);
+  RCRET(rc);
+  ssc->sof_active = true;
+  return 0;
+}
+
+/**
+ * @brief Sorts records buffer and writes it into sort overflow file as new sorted run.
+ */
+static iwrc _jbi_sorter_spill(struct _JBSSC *ssc) {
+  iwrc rc = 0;
+  size_t sz, wpos = 0;
+  uint8_t *wbuf = 0;
+  if (!ssc->sof_active) {
+    rc = _jbi_sorter_sof_init(ssc);
+    RCRET(rc);
+  }
+  struct _JBSRUN *nruns = realloc(ssc->runs, (ssc->runs_num + 1) * sizeof(*ssc->runs));
+  if (!nruns) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  ssc->runs = nruns;
+  sort_r(ssc->refs, ssc->refs_num, sizeof(ssc->refs[0]), _jbi_scan_sorter_cmp, ssc->recs);
+
+  // Records are written in sorted order through the staging buffer
+  wbuf = malloc(_JBS_RUN_BUF_MIN_SZ);
+  if (!wbuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  struct _JBSRUN *run = &ssc->runs[ssc->runs_num];
+  memset(run, 0, sizeof(*run));
+  run->rpos = ssc->sof_npos;
+  for (uint32_t i = 0; i < ssc->refs_num; ++i) {
+    const uint8_t *rec = ssc->recs + ssc->refs[i];
+    uint32_t rsz = _jbi_sorter_rec_size(rec);
+    if (wpos + rsz > _JBS_RUN_BUF_MIN_SZ) {
+      if (wpos) {
+        rc = ssc->sof.write(&ssc->sof, ssc->sof_npos, wbuf, wpos, &sz);
+        RCGO(rc, finish);
+        ssc->sof_npos += wpos;
+        wpos = 0;
+      }
+      if (rsz > _JBS_RUN_BUF_MIN_SZ) {
+        rc = ssc->sof.write(&ssc->sof, ssc->sof_npos, rec, rsz, &sz);
+        RCGO(rc, finish);
+        ssc->sof_npos += rsz;
+        continue;
+      }
+    }
+    memcpy(wbuf + wpos, rec, rsz);
+    wpos += rsz;
+  }
+  if (wpos) {
+    rc = ssc->sof.write(&ssc->sof, ssc->sof_npos, wbuf, wpos, &sz);
+    RCGO(rc, finish);
+    ssc->sof_npos += wpos;
+  }
+  run->end = ssc->sof_npos;
+  ++ssc->runs_num;
+  ssc->refs_num = 0;
+  ssc->recs_npos = 0;
 
 finish:
-  if (rc) {
-    ssc->rc = rc;
-    longjmp(ssc->fatal_jmp, 1);
+  free(wbuf);
+  return rc;
+}
+
+/**
+ * @brief Reads next record of `run` into its buffer.
+ * @param [out] recp Next record or zero if run is exhausted.
+ */
+static iwrc _jbi_sorter_run_next(struct _JBSSC *ssc, struct _JBSRUN *run, uint8_t **recp) {
+  iwrc rc = 0;
+  size_t sz, need = _JBS_REC_HDR_SZ;
+  *recp = 0;
+  if (run->blen) { // Skip current record
+    run->bpos += _jbi_sorter_rec_size(run->buf + run->bpos);
+  }
+  while (1) {
+    size_t avail = run->blen - run->bpos;
+    if (avail >= _JBS_REC_HDR_SZ) {
+      need = _jbi_sorter_rec_size(run->buf + run->bpos);
+      if (avail >= need) {
+        *recp = run->buf + run->bpos;
+        return 0;
+      }
+    }
+    if (run->rpos >= run->end) {
+      return 0;
+    }
+    // Move remaining bytes to the start of buffer then read more
+    if (run->bpos) {
+      memmove(run->buf, run->buf + run->bpos, avail);
+      run->bpos = 0;
+      run->blen = avail;
+    }
+    if (need > run->bufsz) {
+      uint8_t *nbuf = realloc(run->buf, need);
+      if (!nbuf) {
+        return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      }
+      run->buf = nbuf;
+      run->bufsz = need;
+    }
+    size_t rsz = MIN(run->bufsz - run->blen, (size_t) (run->end - run->rpos));
+    rc = ssc->sof.read(&ssc->sof, run->rpos, run->buf + run->blen, rsz, &sz);
+    RCRET(rc);
+    if (sz != rsz) {
+      return IW_ERROR_IO;
+    }
+    run->rpos += sz;
+    run->blen += sz;
+  }
+}
+
+IW_INLINE bool _jbi_sorter_heap_less(struct _JBSSC *ssc, uint32_t i1, uint32_t i2) {
+  struct _JBSRUN *r1 = &ssc->runs[ssc->heap[i1]];
+  struct _JBSRUN *r2 = &ssc->runs[ssc->heap[i2]];
+  int rv = _jbi_sorter_rec_cmp(r1->buf + r1->bpos, r2->buf + r2->bpos);
+  // Earlier runs contain documents scanned earlier
+  return rv < 0 || (rv == 0 && ssc->heap[i1] < ssc->heap[i2]);
+}
+
+static void _jbi_sorter_heap_down(struct _JBSSC *ssc, uint32_t i) {
+  while (1) {
+    uint32_t m = i, l = 2 * i + 1, r = l + 1;
+    if (l < ssc->heap_num && _jbi_sorter_heap_less(ssc, l, m)) {
+      m = l;
+    }
+    if (r < ssc->heap_num && _jbi_sorter_heap_less(ssc, r, m)) {
+      m = r;
+    }
+    if (m == i) {
+      break;
+    }
+    uint32_t tmp = ssc->heap[i];
+    ssc->heap[i] = ssc->heap[m];
+    ssc->heap[m] = tmp;
+    i = m;
+  }
+}
+
+static iwrc _jbi_sorter_merge_init(struct _JBSSC *ssc) {
+  iwrc rc = 0;
+  size_t bufsz = MAX(ssc->recs_asz / ssc->runs_num, _JBS_RUN_BUF_MIN_SZ);
+  // Records buffer is not needed anymore, free memory for runs buffers
+  free(ssc->recs);
+  ssc->recs = 0;
+  ssc->recs_asz = 0;
+  free(ssc->refs);
+  ssc->refs = 0;
+  ssc->refs_asz = 0;
+
+  ssc->heap = malloc(ssc->runs_num * sizeof(*ssc->heap));
+  if (!ssc->heap) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (uint32_t i = 0; i < ssc->runs_num; ++i) {
+    uint8_t *rec;
+    struct _JBSRUN *run = &ssc->runs[i];
+    run->buf = malloc(bufsz);
+    if (!run->buf) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    run->bufsz = bufsz;
+    rc = _jbi_sorter_run_next(ssc, run, &rec);
+    RCRET(rc);
+    if (rec) {
+      ssc->heap[ssc->heap_num++] = i;
+    }
+  }
+  for (uint32_t i = ssc->heap_num / 2; i-- > 0;) {
+    _jbi_sorter_heap_down(ssc, i);
+  }
+  return rc;
+}
+
+//--------------------------- Top-K collector
+
+// Top-K record is a sort record followed by sequence number of matched document
+IW_INLINE uint64_t _jbi_sorter_topk_seq(const uint8_t *rec) {
+  uint64_t seq;
+  memcpy(&seq, rec + _jbi_sorter_rec_size(rec), sizeof(seq));
+  return seq;
+}
+
+IW_INLINE int _jbi_sorter_topk_cmp(const uint8_t *rec1, const uint8_t *rec2) {
+  int rv = _jbi_sorter_rec_cmp(rec1, rec2);
+  if (!rv) {
+    uint64_t s1 = _jbi_sorter_topk_seq(rec1);
+    uint64_t s2 = _jbi_sorter_topk_seq(rec2);
+    rv = s1 > s2 ? 1 : s1 < s2 ? -1 : 0;
   }
   return rv;
 }
 
+static int _jbi_sorter_topk_sort_cmp(const void *o1, const void *o2, void *op) {
+  return _jbi_sorter_topk_cmp(*(uint8_t**) o1, *(uint8_t**) o2);
+}
+
+static void _jbi_sorter_topk_swap(struct _JBSSC *ssc, uint32_t i1, uint32_t i2) {
+  uint8_t *tmp = ssc->topk[i1];
+  ssc->topk[i1] = ssc->topk[i2];
+  ssc->topk[i2] = tmp;
+}
+
+static void _jbi_sorter_topk_up(struct _JBSSC *ssc, uint32_t i) {
+  while (i > 0) {
+    uint32_t p = (i - 1) / 2;
+    if (_jbi_sorter_topk_cmp(ssc->topk[i], ssc->topk[p]) <= 0) {
+      break;
+    }
+    _jbi_sorter_topk_swap(ssc, i, p);
+    i = p;
+  }
+}
+
+static void _jbi_sorter_topk_down(struct _JBSSC *ssc, uint32_t i) {
+  while (1) {
+    uint32_t m = i, l = 2 * i + 1, r = l + 1;
+    if (l < ssc->topk_num && _jbi_sorter_topk_cmp(ssc->topk[l], ssc->topk[m]) > 0) {
+      m = l;
+    }
+    if (r < ssc->topk_num && _jbi_sorter_topk_cmp(ssc->topk[r], ssc->topk[m]) > 0) {
+      m = r;
+    }
+    if (m == i) {
+      break;
+    }
+    _jbi_sorter_topk_swap(ssc, i, m);
+    i = m;
+  }
+}
+
+/**
+ * @brief Adds document with sort key in `ssc->kbuf` to the top-K heap.
+ *
+ * Heap keeps at most `topk_max` best records, the worst one is on top
+ * and it is replaced by better candidates.
+ */
+static iwrc _jbi_sorter_topk_add(struct _JBSSC *ssc, uint32_t klen, int64_t id) {
+  uint8_t *rec;
+  uint64_t seq = ssc->seq++;
+  size_t rsz = _JBS_REC_HDR_SZ + klen + sizeof(id) + sizeof(seq);
+  if (!ssc->topk) {
+    ssc->topk = malloc(ssc->topk_max * sizeof(ssc->topk[0]));
+    if (!ssc->topk) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+  }
+  if (ssc->topk_num == ssc->topk_max) {
+    uint8_t *top = ssc->topk[0];
+    // Candidate is scanned after all collected records so it loses on equal keys
+    if (_jbi_sorter_key_cmp(ssc->kbuf, klen, top + _JBS_REC_HDR_SZ, _jbi_sorter_rec_klen(top)) >= 0) {
+      return 0;
+    }
+    rec = realloc(top, rsz);
+    if (!rec) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    ssc->topk[0] = rec;
+  } else {
+    rec = malloc(rsz);
+    if (!rec) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    ssc->topk[ssc->topk_num++] = rec;
+  }
+  memcpy(rec, &klen, sizeof(klen));
+  memcpy(rec + _JBS_REC_HDR_SZ, ssc->kbuf, klen);
+  memcpy(rec + _JBS_REC_HDR_SZ + klen, &id, sizeof(id));
+  memcpy(rec + _JBS_REC_HDR_SZ + klen + sizeof(id), &seq, sizeof(seq));
+  if (rec == ssc->topk[0] && ssc->topk_num == ssc->topk_max) {
+    _jbi_sorter_topk_down(ssc, 0);
+  } else {
+    _jbi_sorter_topk_up(ssc, ssc->topk_num - 1);
+  }
+  return 0;
+}
+
+/**
+ * @brief Moves records collected by top-K heap into records buffer in sorted order.
+ */
+static iwrc _jbi_sorter_topk_finish(struct _JBSSC *ssc) {
+  uint32_t npos = 0;
+  sort_r(ssc->topk, ssc->topk_num, sizeof(ssc->topk[0]), _jbi_sorter_topk_sort_cmp, 0);
+  for (uint32_t i = 0; i < ssc->topk_num; ++i) {
+    npos += _jbi_sorter_rec_size(ssc->topk[i]);
+  }
+  ssc->recs = malloc(MAX(npos, 1));
+  ssc->refs = malloc(MAX(ssc->topk_num, 1) * sizeof(ssc->refs[0]));
+  if (!ssc->recs || !ssc->refs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  ssc->recs_asz = npos;
+  ssc->refs_asz = ssc->topk_num;
+  for (uint32_t i = 0; i < ssc->topk_num; ++i) {
+    uint32_t rsz = _jbi_sorter_rec_size(ssc->topk[i]);
+    memcpy(ssc->recs + ssc->recs_npos, ssc->topk[i], rsz);
+    ssc->refs[ssc->refs_num++] = ssc->recs_npos;
+    ssc->recs_npos += rsz;
+  }
+  return 0;
+}
+
+//--------------------------- Sorted result set iteration
+
+/**
+ * @brief Moves position of sorted result set by `step` records.
+ * @param [out] recp Record at new position or zero if end of result set reached.
+ */
+static iwrc _jbi_sorter_seek(struct _JBSSC *ssc, int64_t step, const uint8_t **recp) {
+  iwrc rc = 0;
+  *recp = 0;
+  if (!ssc->runs_num) {
+    ssc->pos += step;
+    if (ssc->pos >= 0 && ssc->pos < ssc->refs_num) {
+      *recp = ssc->recs + ssc->refs[ssc->pos];
+    }
+    return 0;
+  }
+  if (step < 0) {
+    // Merged runs are read only forward
+    return IW_ERROR_INVALID_STATE;
+  }
+  for ( ; step > 0 && ssc->heap_num; --step) {
+    if (ssc->pos++ < 0) {
+      continue;
+    }
+    uint8_t *rec;
+    struct _JBSRUN *run = &ssc->runs[ssc->heap[0]];
+    rc = _jbi_sorter_run_next(ssc, run, &rec);
+    RCRET(rc);
+    if (!rec) {
+      ssc->heap[0] = ssc->heap[--ssc->heap_num];
+    }
+    _jbi_sorter_heap_down(ssc, 0);
+  }
+  if (!step && ssc->heap_num) {
+    struct _JBSRUN *run = &ssc->runs[ssc->heap[0]];
+    *recp = run->buf + run->bpos;
+  }
+  return rc;
+}
+
+static iwrc _jbi_sorter_fetch(struct _JBEXEC *ctx, int64_t id, struct _JBL *jbl, bool *found) {
+  size_t vsz;
+  *found = false;
+  iwrc rc = jbi_doc_fetch(ctx, 0, id, &vsz);
+  if (rc || !vsz) {
+    return rc;
+  }
+  *found = true;
+  return jbl_from_buf_keep_onstack(jbl, ctx->jblbuf, vsz);
+}
+
 static iwrc _jbi_scan_sorter_apply(IWPOOL *pool, struct _JBEXEC *ctx, JQL q, struct _EJDB_DOC *doc) {
   JBL_NODE root;
   JBL jbl = doc->raw;
@@ -82,34 +565,43 @@ static iwrc _jbi_scan_sorter_apply(IWPOOL *pool, struct _JBEXEC *ctx, JQL q, str
 
 static iwrc _jbi_scan_sorter_do(struct _JBEXEC *ctx) {
   iwrc rc = 0;
-  int64_t step = 1, id;
+  bool found;
+  int64_t step = 1;
   struct _JBL jbl;
+  const uint8_t *rec;
   EJDB_EXEC *ux = ctx->ux;
   struct _JBSSC *ssc = &ctx->ssc;
-  uint32_t rnum = ssc->refs_num;
   struct JQP_AUX *aux = ux->q->aux;
   IWPOOL *pool = ux->pool;
 
-  if (rnum) {
-    if (setjmp(ssc->fatal_jmp)) { // Init error jump
-      rc = ssc->rc;
-      goto finish;
-    }
-    if (!ssc->docs) {
-      size_t sp;
-      rc = ssc->sof.probe_mmap(&ssc->sof, 0, &ssc->docs, &sp);
+  if (ssc->topk) {
+    rc = _jbi_sorter_topk_finish(ssc);
+    RCGO(rc, finish);
+  } else if (ssc->runs_num) {
+    if (ssc->refs_num) {
+      rc = _jbi_sorter_spill(ssc);
       RCGO(rc, finish);
     }
-
-    sort_r(ssc->refs, rnum, sizeof(ssc->refs[0]), _jbi_scan_sorter_cmp, ctx);
+    rc = _jbi_sorter_merge_init(ssc);
+    RCGO(rc, finish);
+  } else if (ssc->refs_num) {
+    sort_r(ssc->refs, ssc->refs_num, sizeof(ssc->refs[0]), _jbi_scan_sorter_cmp, ssc->recs);
   }
 
-  for (int64_t i = ux->skip; step && i < rnum && i >= 0;) {
-    uint8_t *rp = ssc->docs + ssc->refs[i];
-    memcpy(&id, rp, sizeof(id));
-    rp += sizeof(id);
-    rc = jbl_from_buf_keep_onstack2(&jbl, rp);
+  ssc->pos = -1;
+  rc = _jbi_sorter_seek(ssc, ux->skip > 0 ? ux->skip + 1 : 1, &rec);
+  RCGO(rc, finish);
+
+  while (rec) {
+    int64_t id = _jbi_sorter_rec_id(rec);
+    // Documents are not kept by sorter, fetch it by id
+    rc = _jbi_sorter_fetch(ctx, id, &jbl, &found);
     RCGO(rc, finish);
+    if (!found) {
+      rc = _jbi_sorter_seek(ssc, 1, &rec);
+      RCGO(rc, finish);
+      continue;
+    }
     struct _EJDB_DOC doc = {
       .id = id,
       .raw = &jbl
@@ -136,14 +628,15 @@ static iwrc _jbi_scan_sorter_do(struct _JBEXEC *ctx) {
       } while (step == -1);
     }
     ++ux->cnt;
-    i += step;
     if (pool != ux->pool) {
       iwpool_destroy(pool);
       pool = 0;
     }
-    if (--ux->limit < 1) {
+    if (!step || --ux->limit < 1) {
       break;
     }
+    rc = _jbi_sorter_seek(ssc, step, &rec);
+    RCGO(rc, finish);
   }
 
 finish:
@@ -154,24 +647,6 @@ finish:
   return rc;
 }
 
-static iwrc _jbi_scan_sorter_init(struct _JBSSC *ssc, off_t initial_size) {
-  IWFS_EXT_OPTS opts = {
-    .initial_size = initial_size,
-    .rspolicy = iw_exfile_szpolicy_fibo,
-    .file = {
-      .path = "jb-",
-      .omode = IWFS_OTMP | IWFS_OUNLINK
-    }
-  };
-  iwrc rc = iwfs_exfile_open(&ssc->sof, &opts);
-  RCRET(rc);
-  rc = ssc->sof.add_mmap(&ssc->sof, 0, SIZE_T_MAX, 0);
-  if (rc) {
-    ssc->sof.close(&ssc->sof);
-  }
-  return rc;
-}
-
 iwrc jbi_sorter_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id,
                          int64_t *step, bool *matched, iwrc err) {
   if (!id) {
@@ -184,39 +659,20 @@ iwrc jbi_sorter_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id,
       return _jbi_scan_sorter_do(ctx);
     }
   }
+  if (ctx->isect.active && !jbi_isect_contains(ctx, id)) {
+    return 0;
+  }
 
-  iwrc rc;
-  size_t vsz = 0;
+  size_t vsz, klen;
   struct _JBL jbl;
   struct _JBSSC *ssc = &ctx->ssc;
   EJDB db = ctx->jbc->db;
-  IWFS_EXT *sof = &ssc->sof;
 
-start: {
-    if (cur) {
-      rc = iwkv_cursor_copy_val(cur, ctx->jblbuf + sizeof(id), ctx->jblbufsz - sizeof(id), &vsz);
-    } else {
-      IWKV_val key = {
-        .data = &id,
-        .size = sizeof(id)
-      };
-      rc = iwkv_get_copy(ctx->jbc->cdb, &key, ctx->jblbuf + sizeof(id), ctx->jblbufsz - sizeof(id), &vsz);
-    }
-    if (rc == IWKV_ERROR_NOTFOUND) rc = 0;
-    else RCRET(rc);
-    if (vsz + sizeof(id) > ctx->jblbufsz) {
-      size_t nsize = MAX(vsz + sizeof(id), ctx->jblbufsz * 2);
-      void *nbuf = realloc(ctx->jblbuf, nsize);
-      if (!nbuf) {
-        return iwrc_set_errno(IW_ERROR_ALLOC, errno);
-      }
-      ctx->jblbuf = nbuf;
-      ctx->jblbufsz = nsize;
-      goto start;
-    }
+  iwrc rc = jbi_doc_fetch(ctx, cur, id, &vsz);
+  if (rc || !vsz) {
+    return rc;
   }
-
-  rc = jbl_from_buf_keep_onstack(&jbl, ctx->jblbuf + sizeof(id), vsz);
+  rc = jbl_from_buf_keep_onstack(&jbl, ctx->jblbuf, vsz);
   RCRET(rc);
 
   rc = jql_matched(ctx->ux->q, &jbl, matched);
@@ -224,61 +680,45 @@ start: {
     return 0;
   }
 
-  if (!ssc->refs) {
-    ssc->refs_asz = 64 * 1024; // 64K
-    ssc->refs = malloc(db->opts.document_buffer_sz);
-    if (!ssc->refs) {
-      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
-    }
-    ssc->docs_asz = 128 * 1024; // 128K
-    ssc->docs = malloc(ssc->docs_asz);
-    if (!ssc->docs) {
-      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
-    }
-  } else if (ssc->refs_asz <= (ssc->refs_num + 1) * sizeof(ssc->refs[0])) {
-    ssc->refs_asz *= 2;
-    uint32_t *nrefs = realloc(ssc->refs, ssc->refs_asz);
+  // Only normalized sort key and document id are kept
+  rc = _jbi_sorter_key_build(ctx, &jbl, &klen);
+  RCRET(rc);
+  if (ssc->topk_max) {
+    return _jbi_sorter_topk_add(ssc, (uint32_t) klen, id);
+  }
+  uint32_t rsz = (uint32_t) (_JBS_REC_HDR_SZ + klen + sizeof(id));
+
+  if (ssc->recs_npos + rsz + (ssc->refs_num + 1) * sizeof(ssc->refs[0]) > db->opts.sort_buffer_sz
+      && ssc->refs_num) {
+    // Sort buffer is exceeded
+    rc = _jbi_sorter_spill(ssc);
+    RCRET(rc);
+  }
+  if (ssc->refs_num >= ssc->refs_asz) {
+    uint32_t nasz = ssc->refs_asz ? ssc->refs_asz * 2 : 1024;
+    uint32_t *nrefs = realloc(ssc->refs, nasz * sizeof(ssc->refs[0]));
     if (!nrefs) {
       return iwrc_set_errno(IW_ERROR_ALLOC, errno);
     }
     ssc->refs = nrefs;
+    ssc->refs_asz = nasz;
   }
-
-  vsz += sizeof(id);
-  memcpy(ctx->jblbuf, &id, sizeof(id));
-
-start2: {
-    if (ssc->docs) {
-      uint32_t rsize = ssc->docs_npos + vsz;
-      if (rsize > ssc->docs_asz) {
-        ssc->docs_asz = MIN(rsize * 2, db->opts.sort_buffer_sz);
-        if (rsize > ssc->docs_asz) {
-          size_t sz;
-          rc = _jbi_scan_sorter_init(ssc, (ssc->docs_npos + vsz) * 2);
-          RCRET(rc);
-          rc = sof->write(sof, 0, ssc->docs, ssc->docs_npos, &sz);
-          RCRET(rc);
-          free(ssc->docs);
-          ssc->docs = 0;
-          ssc->sof_active = true;
-          goto start2;
-        } else {
-          void *nbuf = realloc(ssc->docs, ssc->docs_asz);
-          if (!nbuf) {
-            return iwrc_set_errno(IW_ERROR_ALLOC, errno);
-          }
-          ssc->docs = nbuf;
-        }
-      }
-      memcpy(ssc->docs + ssc->docs_npos, ctx->jblbuf, vsz);
-    } else {
-      size_t sz;
-      rc = sof->write(sof, ssc->docs_npos, ctx->jblbuf, vsz, &sz);
-      RCRET(rc);
+  if (ssc->recs_npos + rsz > ssc->recs_asz) {
+    uint32_t nasz = MAX(ssc->recs_npos + rsz, ssc->recs_asz ? ssc->recs_asz * 2 : 128 * 1024);
+    uint8_t *nrecs = realloc(ssc->recs, nasz);
+    if (!nrecs) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
     }
-    ssc->refs[ssc->refs_num++] = ssc->docs_npos;
-    ssc->docs_npos += vsz;
+    ssc->recs = nrecs;
+    ssc->recs_asz = nasz;
   }
 
+  uint8_t *wp = ssc->recs + ssc->recs_npos;
+  uint32_t klen32 = (uint32_t) klen;
+  memcpy(wp, &klen32, sizeof(klen32));
+  memcpy(wp + _JBS_REC_HDR_SZ, ssc->kbuf, klen);
+  memcpy(wp + _JBS_REC_HDR_SZ + klen, &id, sizeof(id));
+  ssc->refs[ssc->refs_num++] = ssc->recs_npos;
+  ssc->recs_npos += rsz;
   return rc;
 }
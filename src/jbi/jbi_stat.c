@@ -0,0 +1,655 @@
+#include "ejdb2_internal.h"
+
+/**
+ * @brief Index keys collecting context of `jbi_stat_collect()`.
+ */
+struct _JBSTATCTX {
+  JBIDX idx;
+  int64_t nexpected;          /**< Expected number of index records */
+  int64_t pos;                /**< Position of current index record */
+  int64_t ndv;                /**< Number of distinct keys seen so far */
+  uint32_t bnum;
+  uint32_t mnum;
+  IWKV_val bounds[JB_IDX_STAT_BUCKETS + 1];
+  IWKV_val mcvs[JB_IDX_STAT_MCV_NUM];
+  int64_t mfreqs[JB_IDX_STAT_MCV_NUM];
+};
+
+static int _jbi_stat_key_cmp(JBIDX idx, const IWKV_val *k1, const IWKV_val *k2) {
+  if (idx->mode & EJDB_IDX_I64) {
+    int64_t v1, v2;
+    memcpy(&v1, k1->data, sizeof(v1));
+    memcpy(&v2, k2->data, sizeof(v2));
+    return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+  } else if (idx->mode & EJDB_IDX_F64) {
+    // Real number keys are zero terminated strings
+    double v1 = iwatof(k1->data), v2 = iwatof(k2->data);
+    return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+  } else {
+    int rv = memcmp(k1->data, k2->data, MIN(k1->size, k2->size));
+    if (!rv) {
+      return k1->size < k2->size ? -1 : k1->size > k2->size ? 1 : 0;
+    }
+    return rv;
+  }
+}
+
+static double _jbi_stat_key_num(JBIDX idx, const IWKV_val *key) {
+  if (idx->mode & EJDB_IDX_I64) {
+    int64_t v;
+    memcpy(&v, key->data, sizeof(v));
+    return (double) v;
+  } else if (idx->mode & EJDB_IDX_F64B) {
+    return jbi_f64b_ikey_value(key->data);
+  } else {
+    return iwatof(key->data);
+  }
+}
+
+static iwrc _jbi_stat_key_dup(const void *data, size_t size, IWKV_val *key) {
+  key->data = malloc(size + 1);
+  if (!key->data) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  memcpy(key->data, data, size);
+  ((char *) key->data)[size] = '\0';
+  key->size = size;
+  return 0;
+}
+
+static iwrc _jbi_stat_add_bound(struct _JBSTATCTX *sctx, const void *data, size_t size) {
+  if (sctx->bnum > JB_IDX_STAT_BUCKETS) {
+    return 0;
+  }
+  iwrc rc = _jbi_stat_key_dup(data, size, &sctx->bounds[sctx->bnum]);
+  RCRET(rc);
+  ++sctx->bnum;
+  return 0;
+}
+
+/**
+ * @brief Account completed run of equal index keys.
+ */
+static iwrc _jbi_stat_add_run(struct _JBSTATCTX *sctx, const void *data, size_t size, int64_t cnt) {
+  ++sctx->ndv;
+  if (cnt < 2) { // Unique keys are not common
+    return 0;
+  }
+  uint32_t i = sctx->mnum;
+  if (sctx->mnum == JB_IDX_STAT_MCV_NUM) {
+    // Replace the least frequent key
+    i = 0;
+    for (uint32_t j = 1; j < sctx->mnum; ++j) {
+      if (sctx->mfreqs[j] < sctx->mfreqs[i]) {
+        i = j;
+      }
+    }
+    if (sctx->mfreqs[i] >= cnt) {
+      return 0;
+    }
+    free(sctx->mcvs[i].data);
+    sctx->mcvs[i].data = 0;
+  } else {
+    ++sctx->mnum;
+  }
+  sctx->mfreqs[i] = cnt;
+  iwrc rc = _jbi_stat_key_dup(data, size, &sctx->mcvs[i]);
+  if (rc) {
+    sctx->mcvs[i] = sctx->mcvs[--sctx->mnum];
+    sctx->mfreqs[i] = sctx->mfreqs[sctx->mnum];
+  }
+  return rc;
+}
+
+static iwrc _jbi_stat_build(struct _JBSTATCTX *sctx, struct _JBIDXSTAT **statp) {
+  *statp = 0;
+  IWPOOL *pool = iwpool_create(1024);
+  if (!pool) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  struct _JBIDXSTAT *stat = iwpool_calloc(sizeof(*stat), pool);
+  if (!stat) {
+    iwpool_destroy(pool);
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  stat->pool = pool;
+  stat->rnum = sctx->pos;
+  stat->ndv = sctx->ndv;
+  stat->bounds = iwpool_alloc((sctx->bnum + 1) * sizeof(stat->bounds[0]), pool);
+  stat->mcvs = iwpool_alloc((sctx->mnum + 1) * sizeof(stat->mcvs[0]), pool);
+  stat->mfreqs = iwpool_alloc((sctx->mnum + 1) * sizeof(stat->mfreqs[0]), pool);
+  if (!stat->bounds || !stat->mcvs || !stat->mfreqs) {
+    iwpool_destroy(pool);
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  // Index cursor walks keys in the storage order, keep bounds ascending
+  bool reverse = sctx->bnum > 1
+                 && _jbi_stat_key_cmp(sctx->idx, &sctx->bounds[0], &sctx->bounds[sctx->bnum - 1]) > 0;
+  for (uint32_t i = 0; i < sctx->bnum; ++i) {
+    IWKV_val *src = &sctx->bounds[reverse ? sctx->bnum - i - 1 : i];
+    IWKV_val *dst = &stat->bounds[stat->bnum++];
+    dst->size = src->size;
+    dst->data = iwpool_alloc(src->size + 1, pool);
+    if (!dst->data) {
+      iwpool_destroy(pool);
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    memcpy(dst->data, src->data, src->size + 1);
+  }
+  for (uint32_t i = 0; i < sctx->mnum; ++i) {
+    IWKV_val *dst = &stat->mcvs[stat->mnum];
+    dst->size = sctx->mcvs[i].size;
+    dst->data = iwpool_alloc(dst->size + 1, pool);
+    if (!dst->data) {
+      iwpool_destroy(pool);
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    memcpy(dst->data, sctx->mcvs[i].data, dst->size + 1);
+    stat->mfreqs[stat->mnum++] = sctx->mfreqs[i];
+    stat->mcv_rnum += sctx->mfreqs[i];
+  }
+  *statp = stat;
+  return 0;
+}
+
+iwrc jbi_stat_collect(JBIDX idx, struct _JBIDXSTAT **statp) {
+  IWKV_cursor cur;
+  size_t ksz = 0, psz = 0;
+  size_t kasz = 256, pasz = 256;
+  int64_t run = 0;
+  int64_t next_bpos = 0, last_bpos = -1;
+  struct _JBSTATCTX sctx = {
+    .idx = idx,
+    .nexpected = idx->rnum
+  };
+  *statp = 0;
+
+  char *kbuf = malloc(kasz);
+  char *pbuf = malloc(pasz);
+  if (!kbuf || !pbuf) {
+    free(kbuf);
+    free(pbuf);
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+
+  iwrc rc = iwkv_cursor_open(idx->idb, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  if (rc == IWKV_ERROR_NOTFOUND) { // Empty index
+    rc = _jbi_stat_build(&sctx, statp);
+    goto finish;
+  }
+  RCGO(rc, finish);
+
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    rc = iwkv_cursor_copy_key(cur, kbuf, kasz, &ksz, 0);
+    RCBREAK(rc);
+    if (ksz > kasz) {
+      char *nbuf = realloc(kbuf, ksz);
+      if (!nbuf) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        break;
+      }
+      kbuf = nbuf;
+      kasz = ksz;
+      rc = iwkv_cursor_copy_key(cur, kbuf, kasz, &ksz, 0);
+      RCBREAK(rc);
+    }
+    if (sctx.pos == next_bpos && sctx.bnum < JB_IDX_STAT_BUCKETS) {
+      rc = _jbi_stat_add_bound(&sctx, kbuf, ksz);
+      RCBREAK(rc);
+      last_bpos = sctx.pos;
+      next_bpos = sctx.nexpected * sctx.bnum / JB_IDX_STAT_BUCKETS;
+      if (next_bpos <= sctx.pos) {
+        next_bpos = sctx.pos + 1;
+      }
+    }
+    if (run && psz == ksz && !memcmp(pbuf, kbuf, ksz)) {
+      ++run;
+    } else {
+      if (run) {
+        rc = _jbi_stat_add_run(&sctx, pbuf, psz, run);
+        RCBREAK(rc);
+      }
+      char *tmp = pbuf;
+      size_t tsz = pasz;
+      pbuf = kbuf, pasz = kasz;
+      kbuf = tmp, kasz = tsz;
+      psz = ksz;
+      run = 1;
+    }
+    ++sctx.pos;
+  }
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    rc = 0;
+  }
+  IWRC(iwkv_cursor_close(&cur), rc);
+  RCGO(rc, finish);
+
+  if (run) {
+    rc = _jbi_stat_add_run(&sctx, pbuf, psz, run);
+    RCGO(rc, finish);
+    if (last_bpos != sctx.pos - 1) {
+      // Last key is the upper histogram bound
+      rc = _jbi_stat_add_bound(&sctx, pbuf, psz);
+      RCGO(rc, finish);
+    }
+  }
+  rc = _jbi_stat_build(&sctx, statp);
+
+finish:
+  for (uint32_t i = 0; i < sctx.bnum; ++i) {
+    free(sctx.bounds[i].data);
+  }
+  for (uint32_t i = 0; i < sctx.mnum; ++i) {
+    free(sctx.mcvs[i].data);
+  }
+  free(kbuf);
+  free(pbuf);
+  return rc;
+}
+
+void jbi_stat_release(struct _JBIDXSTAT **statp) {
+  if (*statp) {
+    iwpool_destroy((*statp)->pool);
+    *statp = 0;
+  }
+}
+
+static bool _jbi_stat_keys_to_list(JBIDX idx, const IWKV_val *keys, uint32_t num, binn *list) {
+  for (uint32_t i = 0; i < num; ++i) {
+    if (idx->mode & EJDB_IDX_I64) {
+      int64_t llv;
+      memcpy(&llv, keys[i].data, sizeof(llv));
+      llv = IW_HTOILL(llv);
+      if (!binn_list_add_blob(list, &llv, sizeof(llv))) {
+        return false;
+      }
+    } else if (!binn_list_add_blob(list, keys[i].data, (int) keys[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+iwrc jbi_stat_to_binn(JBIDX idx, struct _JBIDXSTAT *stat, binn **bnp) {
+  iwrc rc = 0;
+  binn *bn = binn_object();
+  binn *bounds = binn_list();
+  binn *mcvs = binn_list();
+  binn *mfreqs = binn_list();
+  *bnp = 0;
+  if (!bn || !bounds || !mcvs || !mfreqs) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  for (uint32_t i = 0; i < stat->mnum; ++i) {
+    if (!binn_list_add_int64(mfreqs, stat->mfreqs[i])) {
+      rc = JBL_ERROR_CREATION;
+      goto finish;
+    }
+  }
+  if (!_jbi_stat_keys_to_list(idx, stat->bounds, stat->bnum, bounds)
+      || !_jbi_stat_keys_to_list(idx, stat->mcvs, stat->mnum, mcvs)
+      || !binn_object_set_int64(bn, "rnum", stat->rnum)
+      || !binn_object_set_int64(bn, "ndv", stat->ndv)
+      || !binn_object_set_list(bn, "bounds", bounds)
+      || !binn_object_set_list(bn, "mcvs", mcvs)
+      || !binn_object_set_list(bn, "mfreqs", mfreqs)) {
+    rc = JBL_ERROR_CREATION;
+    goto finish;
+  }
+  *bnp = bn;
+
+finish:
+  if (rc && bn) {
+    binn_free(bn);
+  }
+  if (bounds) {
+    binn_free(bounds);
+  }
+  if (mcvs) {
+    binn_free(mcvs);
+  }
+  if (mfreqs) {
+    binn_free(mfreqs);
+  }
+  return rc;
+}
+
+static iwrc _jbi_stat_keys_from_list(JBIDX idx, void *list, IWKV_val **keysp, uint32_t *nump, IWPOOL *pool) {
+  int cnt = binn_count(list);
+  IWKV_val *keys = iwpool_alloc((cnt + 1) * sizeof(*keys), pool);
+  if (!keys) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (int i = 0; i < cnt; ++i) {
+    void *data;
+    int size;
+    if (!binn_list_get_blob(list, i + 1, &data, &size)
+        || ((idx->mode & (EJDB_IDX_I64 | EJDB_IDX_F64B)) && size != sizeof(int64_t))) {
+      return EJDB_ERROR_INVALID_COLLECTION_INDEX_META;
+    }
+    keys[i].size = size;
+    keys[i].data = iwpool_alloc(size + 1, pool);
+    if (!keys[i].data) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    if (idx->mode & EJDB_IDX_I64) {
+      int64_t llv;
+      memcpy(&llv, data, sizeof(llv));
+      llv = IW_ITOHLL(llv);
+      memcpy(keys[i].data, &llv, sizeof(llv));
+    } else {
+      memcpy(keys[i].data, data, size);
+    }
+    ((char *) keys[i].data)[size] = '\0';
+  }
+  *keysp = keys;
+  *nump = cnt;
+  return 0;
+}
+
+iwrc jbi_stat_from_buf(JBIDX idx, void *buf, size_t bufsz, struct _JBIDXSTAT **statp) {
+  struct _JBL sbn;
+  void *bounds, *mcvs, *mfreqs;
+  *statp = 0;
+
+  iwrc rc = jbl_from_buf_keep_onstack(&sbn, buf, bufsz);
+  RCRET(rc);
+
+  IWPOOL *pool = iwpool_create(1024);
+  if (!pool) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  struct _JBIDXSTAT *stat = iwpool_calloc(sizeof(*stat), pool);
+  if (!stat) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  stat->pool = pool;
+  if (!binn_object_get_int64(&sbn.bn, "rnum", &stat->rnum)
+      || !binn_object_get_int64(&sbn.bn, "ndv", &stat->ndv)
+      || !binn_object_get_list(&sbn.bn, "bounds", &bounds)
+      || !binn_object_get_list(&sbn.bn, "mcvs", &mcvs)
+      || !binn_object_get_list(&sbn.bn, "mfreqs", &mfreqs)) {
+    rc = EJDB_ERROR_INVALID_COLLECTION_INDEX_META;
+    goto finish;
+  }
+  rc = _jbi_stat_keys_from_list(idx, bounds, &stat->bounds, &stat->bnum, pool);
+  RCGO(rc, finish);
+  rc = _jbi_stat_keys_from_list(idx, mcvs, &stat->mcvs, &stat->mnum, pool);
+  RCGO(rc, finish);
+  if (binn_count(mfreqs) != stat->mnum) {
+    rc = EJDB_ERROR_INVALID_COLLECTION_INDEX_META;
+    goto finish;
+  }
+  stat->mfreqs = iwpool_alloc((stat->mnum + 1) * sizeof(stat->mfreqs[0]), pool);
+  if (!stat->mfreqs) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  for (uint32_t i = 0; i < stat->mnum; ++i) {
+    if (!binn_list_get_int64(mfreqs, i + 1, &stat->mfreqs[i])) {
+      rc = EJDB_ERROR_INVALID_COLLECTION_INDEX_META;
+      goto finish;
+    }
+    stat->mcv_rnum += stat->mfreqs[i];
+  }
+  *statp = stat;
+
+finish:
+  if (rc) {
+    iwpool_destroy(pool);
+  }
+  return rc;
+}
+
+/**
+ * @brief Estimated number of index records having specified key.
+ */
+static double _jbi_stat_eq_rows(JBIDX idx, const IWKV_val *key) {
+  struct _JBIDXSTAT *stat = idx->stat;
+  if (!key->size) {
+    return 0;
+  }
+  if (idx->mode & EJDB_IDX_UNIQUE) {
+    return 1;
+  }
+  for (uint32_t i = 0; i < stat->mnum; ++i) {
+    if (!_jbi_stat_key_cmp(idx, key, &stat->mcvs[i])) {
+      return stat->mfreqs[i];
+    }
+  }
+  if (stat->bnum
+      && (_jbi_stat_key_cmp(idx, key, &stat->bounds[0]) < 0
+          || _jbi_stat_key_cmp(idx, key, &stat->bounds[stat->bnum - 1]) > 0)) {
+    return 0; // Out of range of known keys
+  }
+  int64_t ndv = stat->ndv - stat->mnum;
+  if (ndv < 1) {
+    return 1;
+  }
+  return (double) (stat->rnum - stat->mcv_rnum) / ndv;
+}
+
+/**
+ * @brief Estimated fraction of index records having keys less than specified key.
+ */
+static double _jbi_stat_key_position(JBIDX idx, const IWKV_val *key) {
+  struct _JBIDXSTAT *stat = idx->stat;
+  if (stat->bnum < 2) {
+    return 0.5;
+  }
+  uint32_t nb = stat->bnum - 1;
+  if (_jbi_stat_key_cmp(idx, key, &stat->bounds[0]) <= 0) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < nb; ++i) {
+    IWKV_val *lb = &stat->bounds[i], *ub = &stat->bounds[i + 1];
+    if (_jbi_stat_key_cmp(idx, key, ub) <= 0) {
+      double frac = 0.5;
+      if (idx->mode & (EJDB_IDX_I64 | EJDB_IDX_F64 | EJDB_IDX_F64B)) {
+        double lv = _jbi_stat_key_num(idx, lb), uv = _jbi_stat_key_num(idx, ub);
+        if (uv > lv) {
+          frac = (_jbi_stat_key_num(idx, key) - lv) / (uv - lv);
+        }
+      }
+      return (i + frac) / nb;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Computes histogram positions of range of keys starting with `prefix` of `len` bytes.
+ * Range is bounded by prefix and the least key greater than all keys with this prefix.
+ */
+static iwrc _jbi_stat_prefix_range(JBIDX idx, const void *prefix, size_t len, double *lposp, double *uposp) {
+  IWKV_val key;
+  uint8_t *succ = malloc(len);
+  if (!succ) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  memcpy(succ, prefix, len);
+  key.data = (void *) prefix;
+  key.size = len;
+  *lposp = _jbi_stat_key_position(idx, &key);
+  for ( ; len && succ[len - 1] == 0xffU; --len);
+  if (len) {
+    succ[len - 1]++;
+    key.data = succ;
+    key.size = len;
+    *uposp = _jbi_stat_key_position(idx, &key);
+  } else {
+    *uposp = 1;
+  }
+  free(succ);
+  if (*uposp <= *lposp && idx->stat->bnum > 1) { // Range within single bucket
+    *uposp = *lposp + 0.5 / (idx->stat->bnum - 1);
+  }
+  return 0;
+}
+
+/**
+ * @brief Estimated number of composite index records matched by bound fields of `midx`.
+ */
+static iwrc _jbi_stat_composite_rows(JBEXEC *ctx, struct _JBMIDX *midx, double *rowsp) {
+  iwrc rc = 0;
+  double lpos = 0, upos = 1;
+  JBIDX idx = midx->idx;
+  JQP_AUX *aux = ctx->ux->q->aux;
+  JQP_EXPR *bexprs[] = { midx->clower, midx->cupper };
+  IWXSTR *prefix = iwxstr_new(), *bound = iwxstr_new();
+
+  *rowsp = 0;
+  if (!prefix || !bound) {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    goto finish;
+  }
+  for (int i = 0; i < midx->ceq_num; ++i) {
+    JQVAL *rv = jql_unit_to_jqval(aux, midx->ceq[i]->right, &rc);
+    RCGO(rc, finish);
+    rc = jbi_composite_jqval_add(rv, prefix);
+    RCGO(rc, finish);
+  }
+  if (midx->ceq_num == idx->cnum) { // All fields are bound by equality
+    IWKV_val key = {
+      .data = iwxstr_ptr(prefix),
+      .size = iwxstr_size(prefix)
+    };
+    *rowsp = _jbi_stat_eq_rows(idx, &key);
+    goto finish;
+  }
+  if (iwxstr_size(prefix)) {
+    rc = _jbi_stat_prefix_range(idx, iwxstr_ptr(prefix), iwxstr_size(prefix), &lpos, &upos);
+    RCGO(rc, finish);
+  }
+  for (int i = 0; i < sizeof(bexprs) / sizeof(bexprs[0]); ++i) {
+    JQP_EXPR *expr = bexprs[i];
+    if (!expr) {
+      continue;
+    }
+    JQVAL *rv = jql_unit_to_jqval(aux, expr->right, &rc);
+    RCGO(rc, finish);
+    iwxstr_clear(bound);
+    rc = iwxstr_cat(bound, iwxstr_ptr(prefix), iwxstr_size(prefix));
+    RCGO(rc, finish);
+    rc = jbi_composite_jqval_add(rv, bound);
+    RCGO(rc, finish);
+    IWKV_val key = {
+      .data = iwxstr_ptr(bound),
+      .size = iwxstr_size(bound)
+    };
+    double pos = _jbi_stat_key_position(idx, &key);
+    if (expr == midx->clower) {
+      lpos = MAX(lpos, pos);
+    } else {
+      upos = MIN(upos, pos);
+    }
+  }
+  *rowsp = upos > lpos ? (upos - lpos) * idx->stat->rnum : 0;
+
+finish:
+  iwxstr_destroy(prefix);
+  iwxstr_destroy(bound);
+  return rc;
+}
+
+int64_t jbi_stat_estimate(JBEXEC *ctx, struct _JBMIDX *midx) {
+  iwrc rc = 0;
+  double rows = 0;
+  IWKV_val key;
+  char numbuf[JBNUMBUF_SIZE];
+  JBIDX idx = midx->idx;
+  struct _JBIDXSTAT *stat = idx->stat;
+  JQP_AUX *aux = ctx->ux->q->aux;
+
+  if (!stat || !midx->expr1) {
+    return 0;
+  }
+  if (!stat->rnum || !idx->rnum) {
+    return 1;
+  }
+  if (idx->cnum) {
+    if (_jbi_stat_composite_rows(ctx, midx, &rows)) {
+      return 0;
+    }
+    rows = rows * idx->rnum / stat->rnum;
+    return rows < 1 ? 1 : (int64_t) rows;
+  }
+  JQVAL *rv = jql_unit_to_jqval(aux, midx->expr1->right, &rc);
+  if (rc) {
+    return 0;
+  }
+  jqp_op_t op = midx->expr1->op->value;
+  if (op == JQP_OP_EQ) {
+    jbi_jqval_fill_ikey(idx, rv, &key, numbuf);
+    rows = _jbi_stat_eq_rows(idx, &key);
+  } else if (op == JQP_OP_IN) {
+    if (rv->type != JQVAL_JBLNODE) {
+      return 0;
+    }
+    for (JBL_NODE n = rv->vnode->child; n; n = n->next) {
+      JQVAL jqv;
+      jql_node_to_jqval(n, &jqv);
+      jbi_jqval_fill_ikey(idx, &jqv, &key, numbuf);
+      rows += _jbi_stat_eq_rows(idx, &key);
+    }
+  } else if (op == JQP_OP_FT) {
+    // Documents containing all words of query are bounded by the rarest exact word
+    JQL_FTS_QUERY *fq;
+    if (jql_fts_query(aux, midx->expr1->op, rv, &fq)) {
+      return 0;
+    }
+    rows = -1;
+    for (size_t i = 0; i < fq->num; ++i) {
+      if (!fq->terms[i].prefix) {
+        key.data = (void *) fq->terms[i].term;
+        key.size = fq->terms[i].len;
+        double trows = _jbi_stat_eq_rows(idx, &key);
+        if (rows < 0 || trows < rows) {
+          rows = trows;
+        }
+      }
+    }
+    if (rows < 0) { // Only prefix terms
+      return 0;
+    }
+  } else {
+    double lpos = 0, upos = 1;
+    JQP_EXPR *exprs[] = { midx->prefix ? 0 : midx->expr1, midx->expr2 };
+    if (midx->prefix && _jbi_stat_prefix_range(idx, midx->prefix, strlen(midx->prefix), &lpos, &upos)) {
+      return 0;
+    }
+    for (int i = 0; i < sizeof(exprs) / sizeof(exprs[0]); ++i) {
+      JQP_EXPR *expr = exprs[i];
+      if (!expr) {
+        continue;
+      }
+      rv = jql_unit_to_jqval(aux, expr->right, &rc);
+      if (rc) {
+        return 0;
+      }
+      jbi_jqval_fill_ikey(idx, rv, &key, numbuf);
+      if (!key.size) {
+        return 0;
+      }
+      double pos = _jbi_stat_key_position(idx, &key);
+      switch (expr->op->value) {
+        case JQP_OP_GT:
+        case JQP_OP_GTE:
+          lpos = MAX(lpos, pos);
+          break;
+        case JQP_OP_LT:
+        case JQP_OP_LTE:
+          upos = MIN(upos, pos);
+          break;
+        default:
+          break;
+      }
+    }
+    rows = upos > lpos ? (upos - lpos) * stat->rnum : 0;
+  }
+  // Scale estimation to the current number of index records
+  rows = rows * idx->rnum / stat->rnum;
+  return rows < 1 ? 1 : (int64_t) rows;
+}
@@ -0,0 +1,61 @@
+#include "ejdb2_internal.h"
+
+static iwrc _jbi_union_consumer(struct _JBEXEC *ctx, IWKV_cursor cur, int64_t id,
+                                int64_t *step, bool *matched, iwrc err) {
+  if (!id) { // EOF of branch scan
+    return err;
+  }
+  int ret;
+  struct _JBUNION *un = &ctx->iunion;
+  kh_put(JBIDS, un->ids, id, &ret);
+  if (ret < 0) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  } else if (ret == 0) {
+    // Document was consumed by one of previous branches
+    return 0;
+  }
+  *step = 1;
+  iwrc rc = un->consumer(ctx, cur, id, step, matched, 0);
+  if (!rc && !*step) {
+    un->stop = true;
+  }
+  return rc;
+}
+
+iwrc jbi_union_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
+  iwrc rc = 0;
+  struct _JBUNION *un = &ctx->iunion;
+  un->consumer = consumer;
+  un->stop = false;
+  un->ids = kh_init(JBIDS);
+  if (!un->ids) {
+    return consumer(ctx, 0, 0, 0, 0, iwrc_set_errno(IW_ERROR_ALLOC, errno));
+  }
+  for (size_t i = 0; i < un->num && !un->stop; ++i) {
+    struct _JBMIDX *midx = &ctx->midx;
+    memcpy(midx, &un->midx[i], sizeof(*midx));
+    jqp_op_t op = midx->expr1->op->value;
+    if (op == JQP_OP_EQ || op == JQP_OP_IN) {
+      // Valid only while documents are fetched by this branch index
+      midx->expr1->prematched = true;
+    }
+    if (midx->idx->mode & EJDB_IDX_FTS) {
+      rc = jbi_fts_scanner(ctx, _jbi_union_consumer);
+    } else if (midx->idx->idbf & IWDB_COMPOUND_KEYS) {
+      rc = jbi_dup_scanner(ctx, _jbi_union_consumer);
+    } else {
+      rc = jbi_uniq_scanner(ctx, _jbi_union_consumer);
+    }
+    // Index expressions of this branch are not prematched for documents of other branches
+    if (midx->expr1) {
+      midx->expr1->prematched = false;
+    }
+    if (midx->expr2) {
+      midx->expr2->prematched = false;
+    }
+    RCBREAK(rc);
+  }
+  kh_destroy(JBIDS, un->ids);
+  un->ids = 0;
+  return consumer(ctx, 0, 0, 0, 0, rc);
+}
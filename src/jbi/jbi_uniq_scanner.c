@@ -28,51 +28,6 @@ static iwrc _jbi_consume_eq(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER
   return consumer(ctx, 0, 0, 0, 0, rc);
 }
 
-static iwrc _jbi_consume_in_node(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER consumer) {
-  JQVAL jqv;
-  size_t sz;
-  uint64_t id;
-  bool matched;
-  char numbuf[JBNUMBUF_SIZE];
-
-  iwrc rc = 0;
-  int64_t step = 1;
-  IWKV_val key;
-  struct _JBMIDX *midx = &ctx->midx;
-  JBL_NODE nv = jqval->vnode->child;
-
-  if (!nv) {
-    return consumer(ctx, 0, 0, 0, 0, 0);
-  }
-  do {
-    jql_node_to_jqval(nv, &jqv);
-    jbi_jqval_fill_ikey(midx->idx, &jqv, &key, numbuf);
-    if (!key.size) {
-      continue;
-    }
-    rc = iwkv_get_copy(midx->idx->idb, &key, numbuf, sizeof(numbuf), &sz);
-    if (rc) {
-      if (rc == IWKV_ERROR_NOTFOUND) {
-        rc = 0;
-        continue;
-      } else {
-        goto finish;
-      }
-    }
-    if (step > 0) --step;
-    else if (step < 0) ++step;
-    if (!step) {
-      IW_READVNUMBUF64_2(numbuf, id);
-      step = 1;
-      rc = consumer(ctx, 0, id, &step, &matched, 0);
-      RCGO(rc, finish);
-    }
-  } while (step && (step > 0 ? (nv = nv->next) : (nv = nv->prev)));
-
-finish:
-  return consumer(ctx, 0, 0, 0, 0, rc);
-}
-
 static iwrc _jbi_consume_scan(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUMER consumer) {
   size_t sz;
   IWKV_cursor cur;
@@ -120,6 +75,10 @@ static iwrc _jbi_consume_scan(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUME
         break;
       }
       IW_READVNUMBUF64_2(numbuf, id);
+      if (midx->prefix && !jbi_ikey_prefix_matched(cur, midx->prefix, &rc)) {
+        break;
+      }
+      RCGO(rc, finish);
       if (midx->expr2
           && !midx->expr2->prematched
           && !jbi_node_expr_matched(ctx->ux->q->aux, midx->idx, cur, midx->expr2, &rc)) {
@@ -129,7 +88,7 @@ static iwrc _jbi_consume_scan(struct _JBEXEC *ctx, JQVAL *jqval, JB_SCAN_CONSUME
       step = 1;
       rc = consumer(ctx, 0, id, &step, &matched, 0);
       RCGO(rc, finish);
-      if (!midx->expr1->prematched && matched) {
+      if (!midx->expr1->prematched && !midx->prefix && matched) {
         // Further scan will always match main index expression
         midx->expr1->prematched = true;
       }
@@ -202,7 +161,7 @@ iwrc jbi_uniq_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
       return _jbi_consume_eq(ctx, jqval, consumer);
     case JQP_OP_IN:
       if (jqval->type == JQVAL_JBLNODE) {
-        return _jbi_consume_in_node(ctx, jqval, consumer);
+        return jbi_in_scanner(ctx, jqval, consumer);
       } else {
         iwlog_ecode_error3(IW_ERROR_ASSERTION);
         return IW_ERROR_ASSERTION;
@@ -211,6 +170,13 @@ iwrc jbi_uniq_scanner(struct _JBEXEC *ctx, JB_SCAN_CONSUMER consumer) {
     default:
       break;
   }
+  if (midx->prefix) { // Scan of keys starting with prefix, expression is checked by consumer
+    JQVAL pjqv = {
+      .type = JQVAL_STR,
+      .vstr = midx->prefix
+    };
+    return _jbi_consume_scan(ctx, &pjqv, consumer);
+  }
   if (midx->expr1->op->value == JQP_OP_GT && jqval->type == JQVAL_I64) {
     JQVAL mjqv;
     memcpy(&mjqv, jqval, sizeof(*jqval));
@@ -2,8 +2,59 @@
 #include "convert.h"
 #include <ejdb2/iowow/iwutils.h>
 
+// Composite index key component tags
+#define _JBI_CK_BOOL 0x01
+#define _JBI_CK_NUM  0x02
+#define _JBI_CK_STR  0x03
+
 // ---------------------------------------------------------------------------
 
+uint64_t jbi_f64_ordered_bits(double v) {
+  uint64_t u;
+  if (v == 0.0) {
+    v = 0.0; // Positive and negative zero are equal
+  }
+  memcpy(&u, &v, sizeof(u));
+  return (u & (1ULL << 63)) ? ~u : (u | (1ULL << 63));
+}
+
+/**
+ * `EJDB_IDX_F64B` index key is order-preserving IEEE-754 bits of number stored in big-endian order,
+ * so keys are ordered by `memcmp()` as numbers.
+ */
+static void _jbi_f64b_fill_ikey(double v, IWKV_val *ikey, char numbuf[static JBNUMBUF_SIZE]) {
+  uint64_t u = jbi_f64_ordered_bits(v);
+  uint8_t *bp = (uint8_t *) numbuf;
+  for (int i = sizeof(u) - 1; i >= 0; --i) {
+    bp[i] = (uint8_t) u;
+    u >>= 8;
+  }
+  ikey->data = numbuf;
+  ikey->size = sizeof(u);
+}
+
+double jbi_f64b_ikey_value(const void *data) {
+  double v;
+  uint64_t u = 0;
+  const uint8_t *bp = data;
+  for (int i = 0; i < sizeof(u); ++i) {
+    u = (u << 8) | bp[i];
+  }
+  u = (u & (1ULL << 63)) ? (u & ~(1ULL << 63)) : ~u;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+/**
+ * Marks index as having keys converted from JSON values of other type,
+ * so index keys do not reproduce JQL comparison of such values.
+ */
+static void _jbi_coerced_set(JBIDX idx) {
+  if (!__atomic_load_n(&idx->coerced, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&idx->coerced, true, __ATOMIC_RELAXED);
+  }
+}
+
 // fixme: code duplication below
 void jbi_jbl_fill_ikey(JBIDX idx, JBL jbv, IWKV_val *ikey, char numbuf[static JBNUMBUF_SIZE]) {
   int64_t *llv = (void *) numbuf;
@@ -45,12 +96,16 @@ void jbi_jbl_fill_ikey(JBIDX idx, JBL jbv, IWKV_val *ikey, char numbuf[static JB
       ikey->data = llv;
       switch (jbvt) {
         case JBV_I64:
+          *llv = jbl_get_i64(jbv);
+          break;
         case JBV_F64:
         case JBV_BOOL:
           *llv = jbl_get_i64(jbv);
+          _jbi_coerced_set(idx);
           break;
         case JBV_STR:
           *llv = iwatoi(jbl_get_str(jbv));
+          _jbi_coerced_set(idx);
           break;
         default:
           ikey->size = 0;
@@ -75,6 +130,31 @@ void jbi_jbl_fill_ikey(JBIDX idx, JBL jbv, IWKV_val *ikey, char numbuf[static JB
           break;
       }
       break;
+    case EJDB_IDX_F64B:
+      switch (jbvt) {
+        case JBV_F64:
+          _jbi_f64b_fill_ikey(jbl_get_f64(jbv), ikey, numbuf);
+          break;
+        case JBV_I64: {
+          int64_t v = jbl_get_i64(jbv);
+          if (v > (1LL << 53) || v < -(1LL << 53)) { // Not exactly representable as double
+            _jbi_coerced_set(idx);
+          }
+          _jbi_f64b_fill_ikey((double) v, ikey, numbuf);
+          break;
+        }
+        case JBV_BOOL:
+          _jbi_f64b_fill_ikey(jbl_get_f64(jbv), ikey, numbuf);
+          _jbi_coerced_set(idx);
+          break;
+        case JBV_STR:
+          _jbi_f64b_fill_ikey(iwatof(jbl_get_str(jbv)), ikey, numbuf);
+          _jbi_coerced_set(idx);
+          break;
+        default:
+          break;
+      }
+      break;
     default:
       break;
   }
@@ -158,6 +238,24 @@ void jbi_jqval_fill_ikey(JBIDX idx, const JQVAL *jqval, IWKV_val *ikey, char num
           break;
       }
       break;
+    case EJDB_IDX_F64B:
+      switch (jqvt) {
+        case JQVAL_F64:
+          _jbi_f64b_fill_ikey(jqval->vf64, ikey, numbuf);
+          break;
+        case JQVAL_I64:
+          _jbi_f64b_fill_ikey((double) jqval->vi64, ikey, numbuf);
+          break;
+        case JQVAL_BOOL:
+          _jbi_f64b_fill_ikey(jqval->vbool, ikey, numbuf);
+          break;
+        case JQVAL_STR:
+          _jbi_f64b_fill_ikey(iwatof(jqval->vstr), ikey, numbuf);
+          break;
+        default:
+          break;
+      }
+      break;
     default:
       break;
   }
@@ -241,11 +339,43 @@ void jbi_node_fill_ikey(JBIDX idx, JBL_NODE node, IWKV_val *ikey, char numbuf[st
           break;
       }
       break;
+    case EJDB_IDX_F64B:
+      switch (jbvt) {
+        case JBV_F64:
+          _jbi_f64b_fill_ikey(node->vf64, ikey, numbuf);
+          break;
+        case JBV_I64:
+          _jbi_f64b_fill_ikey((double) node->vi64, ikey, numbuf);
+          break;
+        case JBV_BOOL:
+          _jbi_f64b_fill_ikey(node->vbool, ikey, numbuf);
+          break;
+        case JBV_STR:
+          _jbi_f64b_fill_ikey(iwatof(node->vptr), ikey, numbuf);
+          break;
+        default:
+          break;
+      }
+      break;
     default:
       break;
   }
 }
 
+iwrc jbi_fts_jbl_visit(JBL jbv, JBI_FTS_VISITOR visitor, void *op) {
+  JQL_FTS_TOKENIZER t;
+  if (jbl_type(jbv) != JBV_STR) {
+    return 0;
+  }
+  const char *str = jbl_get_str(jbv);
+  jql_fts_tokenizer_init(&t, str, strlen(str), false);
+  while (jql_fts_tokenizer_next(&t)) {
+    iwrc rc = visitor(t.term, t.len, op);
+    RCRET(rc);
+  }
+  return 0;
+}
+
 bool jbi_node_expr_matched(JQP_AUX *aux, JBIDX idx, IWKV_cursor cur, JQP_EXPR *expr, iwrc *rcp) {
   size_t sz;
   char skey[1024];
@@ -253,7 +383,7 @@ bool jbi_node_expr_matched(JQP_AUX *aux, JBIDX idx, IWKV_cursor cur, JQP_EXPR *e
   bool ret = false;
   iwrc rc = 0;
 
-  if (!(idx->mode & (EJDB_IDX_STR | EJDB_IDX_I64 | EJDB_IDX_F64))) {
+  if (!(idx->mode & JB_IDX_TYPE_MASK)) {
     return false;
   }
   JQVAL lv, *rv = jql_unit_to_jqval(aux, expr->right, &rc);
@@ -281,6 +411,9 @@ bool jbi_node_expr_matched(JQP_AUX *aux, JBIDX idx, IWKV_cursor cur, JQP_EXPR *e
     kbuf[sz] = '\0';
     lv.type = JQVAL_F64;
     lv.vf64 = (double) iwatof(kbuf);
+  } else if (idx->mode & EJDB_IDX_F64B) {
+    lv.type = JQVAL_F64;
+    lv.vf64 = jbi_f64b_ikey_value(kbuf);
   }
 
   ret = jql_match_jqval_pair(aux, &lv, expr->op, rv, &rc);
@@ -292,3 +425,215 @@ finish:
   *rcp = rc;
   return ret;
 }
+
+bool jbi_ikey_prefix_matched(IWKV_cursor cur, const char *prefix, iwrc *rcp) {
+  size_t sz;
+  char skey[256];
+  size_t len = strlen(prefix);
+  char *kbuf = len > sizeof(skey) ? malloc(len) : skey;
+  if (!kbuf) {
+    *rcp = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    return false;
+  }
+  *rcp = iwkv_cursor_copy_key(cur, kbuf, len, &sz, 0);
+  bool ret = !*rcp && sz >= len && !memcmp(kbuf, prefix, len);
+  if (kbuf != skey) {
+    free(kbuf);
+  }
+  return ret;
+}
+
+iwrc jbi_idx_ptr_serialize(JBIDX idx, IWXSTR *xstr) {
+  iwrc rc = 0;
+  if (!idx->cnum) {
+    return jbl_ptr_serialize(idx->ptr, xstr);
+  }
+  for (int i = 0; i < idx->cnum && !rc; ++i) {
+    if (i) {
+      rc = iwxstr_cat(xstr, ",", 1);
+      RCRET(rc);
+    }
+    rc = jbl_ptr_serialize(idx->cptrs[i], xstr);
+  }
+  return rc;
+}
+
+//--------------------------- Composite index keys
+
+/**
+ * Composite index key is a concatenation of fields components ordered by `memcmp()`:
+ * - boolean `[0x01][0|1]`
+ * - number  `[0x02][order-preserving IEEE-754 bits:u64 BE][sign-flipped integer part:i64 BE]`
+ *   Integer part keeps exact order of large I64 values having the same double representation.
+ * - string  `[0x03][bytes, 0x00 escaped as 0x00 0xFF][0x00]`
+ *
+ * Strings are coerced as JQL equality does, for both document and query values:
+ * `"true"`/`"false"` are encoded as booleans and canonical decimal numbers (`"5"`, `"1.5"`)
+ * as numbers, so `/[f = 5]` matches `{"f":"5"}` and `/[f = "5"]` matches `{"f":5}`.
+ * Only equality is consistent with JQL: range conditions over composite index fields
+ * are checked against documents, since JQL compares strings by length and bytes.
+ *
+ * Key format version is stored in index meta as `ckv`, see `JB_IDX_CK_VERSION`.
+ */
+
+static iwrc _jbi_ck_u64(IWXSTR *xstr, uint64_t v) {
+  uint8_t buf[sizeof(v)];
+  for (int i = sizeof(buf) - 1; i >= 0; --i) {
+    buf[i] = (uint8_t) v;
+    v >>= 8;
+  }
+  return iwxstr_cat(xstr, buf, sizeof(buf));
+}
+
+static int64_t _jbi_ck_f64_trunc(double v) {
+  if (v != v) { // NaN
+    return 0;
+  } else if (v >= 9.2233720368547758e18) {
+    return INT64_MAX;
+  } else if (v <= -9.2233720368547758e18) {
+    return INT64_MIN;
+  }
+  return (int64_t) v;
+}
+
+static iwrc _jbi_ck_num(IWXSTR *xstr, double dv, int64_t llv) {
+  uint8_t tag = _JBI_CK_NUM;
+  iwrc rc = iwxstr_cat(xstr, &tag, 1);
+  RCRET(rc);
+  rc = _jbi_ck_u64(xstr, jbi_f64_ordered_bits(dv));
+  RCRET(rc);
+  return _jbi_ck_u64(xstr, (uint64_t) llv ^ (1ULL << 63));
+}
+
+static iwrc _jbi_ck_str(IWXSTR *xstr, const char *str, size_t len) {
+  uint8_t tag = _JBI_CK_STR;
+  iwrc rc = iwxstr_cat(xstr, &tag, 1);
+  RCRET(rc);
+  for (const char *ep; (ep = memchr(str, '\0', len)); len -= (ep - str) + 1, str = ep + 1) {
+    rc = iwxstr_cat(xstr, str, ep - str);
+    RCRET(rc);
+    rc = iwxstr_cat(xstr, "\0\xff", 2);
+    RCRET(rc);
+  }
+  rc = iwxstr_cat(xstr, str, len);
+  RCRET(rc);
+  return iwxstr_cat(xstr, "\0", 1);
+}
+
+static iwrc _jbi_ck_bool(IWXSTR *xstr, bool v) {
+  uint8_t buf[] = { _JBI_CK_BOOL, v ? 1 : 0 };
+  return iwxstr_cat(xstr, buf, sizeof(buf));
+}
+
+/**
+ * @brief Returns tag of string component coerced the same way as JQL equality does:
+ *        `true`/`false` strings are booleans, canonical decimal numbers are numbers.
+ * @param str Zero terminated string of `len` bytes.
+ * @param [out] dvp Number value for `_JBI_CK_NUM` tag.
+ * @param [out] llvp Integer part of number for `_JBI_CK_NUM` tag.
+ */
+static uint8_t _jbi_ck_str_tag(const char *str, size_t len, double *dvp, int64_t *llvp) {
+  size_t osz;
+  char nbuf[JBNUMBUF_SIZE];
+  if (!strcmp(str, "true") || !strcmp(str, "false")) {
+    return _JBI_CK_BOOL;
+  }
+  if (len && len < sizeof(nbuf) && (str[0] == '-' || (str[0] >= '0' && str[0] <= '9'))) {
+    int64_t llv = iwatoi(str);
+    if (iwitoa(llv, nbuf, sizeof(nbuf)) == len && !memcmp(nbuf, str, len)) {
+      *dvp = (double) llv;
+      *llvp = llv;
+      return _JBI_CK_NUM;
+    }
+    double dv = (double) iwatof(str);
+    jbi_ftoa(dv, nbuf, &osz);
+    if (osz == len && !memcmp(nbuf, str, len)) {
+      *dvp = dv;
+      *llvp = _jbi_ck_f64_trunc(dv);
+      return _JBI_CK_NUM;
+    }
+  }
+  return _JBI_CK_STR;
+}
+
+static iwrc _jbi_ck_str_coerced(IWXSTR *xstr, const char *str, size_t len) {
+  double dv;
+  int64_t llv;
+  switch (_jbi_ck_str_tag(str, len, &dv, &llv)) {
+    case _JBI_CK_BOOL:
+      return _jbi_ck_bool(xstr, str[0] == 't');
+    case _JBI_CK_NUM:
+      return _jbi_ck_num(xstr, dv, llv);
+    default:
+      return _jbi_ck_str(xstr, str, len);
+  }
+}
+
+iwrc jbi_composite_fill_ikey(JBIDX idx, JBL jbl, IWXSTR *xstr, IWKV_val *ikey) {
+  iwrc rc = 0;
+  ikey->size = 0;
+  ikey->data = 0;
+  iwxstr_clear(xstr);
+
+  for (int i = 0; i < idx->cnum && !rc; ++i) {
+    struct _JBL jbv = { 0 };
+    if (!_jbl_at(jbl, idx->cptrs[i], &jbv)) {
+      return 0;
+    }
+    switch (jbl_type(&jbv)) {
+      case JBV_BOOL:
+        rc = _jbi_ck_bool(xstr, jbl_get_i32(&jbv) != 0);
+        break;
+      case JBV_I64: {
+        int64_t llv = jbl_get_i64(&jbv);
+        rc = _jbi_ck_num(xstr, (double) llv, llv);
+        break;
+      }
+      case JBV_F64: {
+        double dv = jbl_get_f64(&jbv);
+        rc = _jbi_ck_num(xstr, dv, _jbi_ck_f64_trunc(dv));
+        break;
+      }
+      case JBV_STR:
+        rc = _jbi_ck_str_coerced(xstr, jbl_get_str(&jbv), jbl_size(&jbv));
+        break;
+      default: // Documents with null, object or array fields are not indexed
+        return 0;
+    }
+  }
+  RCRET(rc);
+  ikey->data = iwxstr_ptr(xstr);
+  ikey->size = iwxstr_size(xstr);
+  return 0;
+}
+
+iwrc jbi_composite_jqval_add(const JQVAL *jqval, IWXSTR *xstr) {
+  switch (jqval->type) {
+    case JQVAL_BOOL:
+      return _jbi_ck_bool(xstr, jqval->vbool);
+    case JQVAL_I64:
+      return _jbi_ck_num(xstr, (double) jqval->vi64, jqval->vi64);
+    case JQVAL_F64:
+      return _jbi_ck_num(xstr, jqval->vf64, _jbi_ck_f64_trunc(jqval->vf64));
+    case JQVAL_STR:
+      return _jbi_ck_str_coerced(xstr, jqval->vstr, strlen(jqval->vstr));
+    default:
+      return IW_ERROR_INVALID_ARGS;
+  }
+}
+
+bool jbi_composite_jqval_exact(const JQVAL *jqval) {
+  double dv;
+  int64_t llv;
+  char *ep;
+  if (jqval->type != JQVAL_STR) {
+    return true;
+  }
+  const char *str = jqval->vstr;
+  if (_jbi_ck_str_tag(str, strlen(str), &dv, &llv) != _JBI_CK_STR) {
+    return true;
+  }
+  // Non canonical number like `5.0` or `05` is equal to stored numbers converted by `iwatof()`
+  strtod(str, &ep);
+  return ep == str;
+}
@@ -1212,6 +1212,49 @@ BOOL APIENTRY binn_object_get_value(void *ptr, const char *key, binn *value) {
   return GetValue(p, value);
 }
 
+BINN_PRIVATE unsigned char *SearchForKey2(unsigned char *p, int header_size, int size, int numitems, const char *key,
+                                          int keylen) {
+  unsigned char len, *plimit, *base;
+  int i;
+
+  base = p;
+  plimit = p + size - 1;
+  p += header_size;
+
+  for (i = 0; i < numitems; i++) {
+    len = *((unsigned char *) p);
+    p++;
+    if (p > plimit) break;
+    if (len == keylen && (len == 0 || memcmp(p, key, len) == 0)) {  // case sensitive
+      return p + len;
+    }
+    p += len;
+    if (p > plimit) break;
+    p = AdvanceDataPos(p, plimit);
+    if ((p == 0) || (p < base)) break;
+  }
+  return NULL;
+}
+
+BOOL binn_object_get_value2(void *ptr, const char *key, int keylen, binn *value) {
+  int type, count, size = 0, header_size;
+  unsigned char *p;
+
+  ptr = binn_ptr(ptr);
+  if ((ptr == 0) || (key == 0) || (value == 0) || (keylen > MAX_BIN_KEY_LEN)) return FALSE;
+
+  // check the header
+  if (IsValidBinnHeader(ptr, &type, &count, &size, &header_size) == FALSE) return FALSE;
+
+  if (type != BINN_OBJECT) return FALSE;
+  if (count == 0) return FALSE;
+
+  p = (unsigned char *) ptr;
+  p = SearchForKey2(p, header_size, size, count, key, keylen);
+  if (p == FALSE) return FALSE;
+  return GetValue(p, value);
+}
+
 BOOL APIENTRY binn_map_get_value(void *ptr, int id, binn *value) {
   int type, count, size = 0, header_size;
   unsigned char *p;
@@ -86,4 +86,6 @@ int _jbl_cmp_atomic_values(JBL v1, JBL v2);
 
 BOOL binn_read_next_pair2(int expected_type, binn_iter *iter, int *klidx, char **pkey, binn *value);
 
+BOOL binn_object_get_value2(void *obj, const char *key, int keylen, binn *value);
+
 #endif
@@ -709,6 +709,35 @@ void jbl_test1_8() {
   jbl_destroy(&nested);
 }
 
+void jbl_test1_9() {
+  JBL jbl, v1, v2;
+  iwrc rc = jbl_from_json(&jbl, "{\"i1\":1,\"i2\":2,\"i3\":1,\"f1\":1.5,\"f2\":2.5,\"f3\":1.5,"
+                                "\"b1\":true,\"b2\":false,\"s1\":\"a\",\"s2\":\"b\"}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  const char *eq[][2] = { { "/i1", "/i3" }, { "/f1", "/f3" }, { "/b1", "/b1" }, { "/s1", "/s1" } };
+  const char *ne[][2] = { { "/i1", "/i2" }, { "/f1", "/f2" }, { "/b1", "/b2" }, { "/s1", "/s2" }, { "/i1", "/f1" } };
+
+  for (int i = 0; i < sizeof(eq) / sizeof(eq[0]); ++i) {
+    rc = jbl_at(jbl, eq[i][0], &v1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = jbl_at(jbl, eq[i][1], &v2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_TRUE(_jbl_is_eq_atomic_values(v1, v2));
+    jbl_destroy(&v1);
+    jbl_destroy(&v2);
+  }
+  for (int i = 0; i < sizeof(ne) / sizeof(ne[0]); ++i) {
+    rc = jbl_at(jbl, ne[i][0], &v1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = jbl_at(jbl, ne[i][1], &v2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_FALSE(_jbl_is_eq_atomic_values(v1, v2));
+    jbl_destroy(&v1);
+    jbl_destroy(&v2);
+  }
+  jbl_destroy(&jbl);
+}
+
 int main() {
   CU_pSuite pSuite = NULL;
   if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
@@ -725,7 +754,8 @@ int main() {
     (NULL == CU_add_test(pSuite, "jbl_test1_5", jbl_test1_5)) ||
     (NULL == CU_add_test(pSuite, "jbl_test1_6", jbl_test1_6)) ||
     (NULL == CU_add_test(pSuite, "jbl_test1_7", jbl_test1_7)) ||
-    (NULL == CU_add_test(pSuite, "jbl_test1_8", jbl_test1_8))
+    (NULL == CU_add_test(pSuite, "jbl_test1_8", jbl_test1_8)) ||
+    (NULL == CU_add_test(pSuite, "jbl_test1_9", jbl_test1_9))
   ) {
     CU_cleanup_registry();
     return CU_get_error();
@@ -192,11 +192,12 @@ static void _jbr_on_query(JBRCTX *rctx) {
   };
 
   // Collection name must be encoded in query
-  iwrc rc = jql_create2(&ux.q, 0, data.data, JQL_SILENT_ON_PARSE_ERROR | JQL_KEEP_QUERY_ON_PARSE_ERROR);
+  iwrc rc = ejdb_query_acquire(ux.db, 0, data.data,
+                               JQL_SILENT_ON_PARSE_ERROR | JQL_KEEP_QUERY_ON_PARSE_ERROR, &ux.q);
   RCGO(rc, finish);
   if (rctx->read_anon && jql_has_apply(ux.q)) {
     // We have not permitted data modification request
-    jql_destroy(&ux.q);
+    ejdb_query_release(ux.db, &ux.q);
     _jbr_http_error_send(rctx->req, 403);
     return;
   }
@@ -204,7 +205,7 @@ static void _jbr_on_query(JBRCTX *rctx) {
   FIOBJ h = fiobj_hash_get2(req->headers, k_header_x_hints_hash);
   if (h) {
     if (!fiobj_type_is(h, FIOBJ_T_STRING)) {
-      jql_destroy(&ux.q);
+      ejdb_query_release(ux.db, &ux.q);
       _jbr_http_error_send(req, 400);
       return;
     }
@@ -268,7 +269,7 @@ finish:
     }
   }
   if (ux.q) {
-    jql_destroy(&ux.q);
+    ejdb_query_release(ux.db, &ux.q);
   }
   if (ux.log) {
     iwxstr_destroy(ux.log);
@@ -915,7 +916,8 @@ static void _jbr_ws_query(JBWCTX *wctx, const char *key, const char *coll, const
     .visitor = _jbr_ws_query_visitor,
   };
 
-  iwrc rc = jql_create2(&ux.q, coll, query, JQL_SILENT_ON_PARSE_ERROR | JQL_KEEP_QUERY_ON_PARSE_ERROR);
+  iwrc rc = ejdb_query_acquire(ux.db, coll, query,
+                               JQL_SILENT_ON_PARSE_ERROR | JQL_KEEP_QUERY_ON_PARSE_ERROR, &ux.q);
   RCGO(rc, finish);
 
   if (wctx->read_anon && jql_has_apply(ux.q)) {
@@ -968,7 +970,7 @@ finish:
     _jbr_ws_write_text(wctx->ws, key, strlen(key));
   }
   if (ux.q) {
-    jql_destroy(&ux.q);
+    ejdb_query_release(ux.db, &ux.q);
   }
   if (ux.log) {
     iwxstr_destroy(ux.log);
@@ -445,6 +445,10 @@ static JQPUNIT *_jqp_unit_op(yycontext *yy, const char *text) {
     unit->op.value = JQP_OP_NI;
   } else if (!strcmp(text, "re")) {
     unit->op.value = JQP_OP_RE;
+  } else if (!strcmp(text, "ft")) {
+    unit->op.value = JQP_OP_FT;
+  } else if (!strcmp(text, "sw")) {
+    unit->op.value = JQP_OP_PREFIX;
   } else {
     iwlog_error("Invalid operation: %s", text);
     JQRC(yy, JQL_ERROR_QUERY_PARSE);
@@ -1061,6 +1065,12 @@ static iwrc _jqp_print_join(jqp_op_t jqop, bool negate, jbl_json_printer pt, voi
     case JQP_OP_RE:
       PT("re", 2, 0, 0);
       break;
+    case JQP_OP_FT:
+      PT("ft", 2, 0, 0);
+      break;
+    case JQP_OP_PREFIX:
+      PT("sw", 2, 0, 0);
+      break;
     default:
       iwlog_ecode_error3(IW_ERROR_ASSERTION);
       rc = IW_ERROR_ASSERTION;
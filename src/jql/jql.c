@@ -23,6 +23,20 @@ typedef struct MENCTX {
   bool matched;
 } MENCTX;
 
+/** Field name probed by compiled filter node */
+typedef struct MPROBE {
+  const char *name;
+  int len;
+  int idx;                /**< Array index denoted by name or -1 */
+} MPROBE;
+
+/** Compiled filter node */
+typedef struct MNODE {
+  JQP_NODE *n;
+  MPROBE *probes;
+  int probes_num;         /**< Number of probes or -1 if every key of container must be checked */
+} MNODE;
+
 /** Filter matching context */
 typedef struct MFCTX {
   bool matched;
@@ -30,6 +44,8 @@ typedef struct MFCTX {
   JQP_NODE *nodes;
   JQP_NODE *last_node;
   JQP_FILTER *qpf;
+  MNODE *mnodes;          /**< Compiled filter nodes */
+  int mnodes_num;
 } MFCTX;
 
 static JQP_NODE *_jql_match_node(MCTX *mctx, JQP_NODE *n, bool *res, iwrc *rcp);
@@ -244,6 +260,105 @@ static void _jql_reset_expression_node(JQP_EXPR_NODE *en, JQP_AUX *aux, bool res
   }
 }
 
+static int _jql_name_to_idx(const char *name) {
+  int idx = 0;
+  const char *p = name;
+  if (!*p || (*p == '0' && p[1] != '\0') || strlen(name) > 9) {
+    return -1;
+  }
+  for ( ; *p; ++p) {
+    if (*p < '0' || *p > '9') {
+      return -1;
+    }
+    idx = idx * 10 + (*p - '0');
+  }
+  return idx;
+}
+
+static iwrc _jql_compile_node(JQP_NODE *n, MNODE *mn, JQP_AUX *aux) {
+  int num = 0;
+  mn->n = n;
+  mn->probes_num = -1;
+  if (n->ntype == JQP_NODE_FIELD) {
+    num = 1;
+  } else if (n->ntype == JQP_NODE_EXPR) {
+    for (JQP_EXPR *expr = &n->value->expr; expr; expr = expr->next) {
+      JQPUNIT *left = expr->left;
+      if (left->type != JQP_STRING_TYPE || (left->string.flavour & (JQP_STR_STAR | JQP_STR_DBL_STAR))) {
+        return 0; // Expression should be checked against every key
+      }
+      ++num;
+    }
+  } else {
+    return 0;
+  }
+  mn->probes = iwpool_calloc(num * sizeof(mn->probes[0]), aux->pool);
+  if (!mn->probes) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  mn->probes_num = 0;
+  if (n->ntype == JQP_NODE_FIELD) {
+    mn->probes[mn->probes_num++].name = n->value->string.value;
+  } else {
+    for (JQP_EXPR *expr = &n->value->expr; expr; expr = expr->next) {
+      const char *name = expr->left->string.value;
+      int i = 0;
+      for ( ; i < mn->probes_num && strcmp(mn->probes[i].name, name) != 0; ++i);
+      if (i == mn->probes_num) {
+        mn->probes[mn->probes_num++].name = name;
+      }
+    }
+  }
+  for (int i = 0; i < mn->probes_num; ++i) {
+    MPROBE *p = &mn->probes[i];
+    p->len = (int) strlen(p->name);
+    p->idx = _jql_name_to_idx(p->name);
+  }
+  return 0;
+}
+
+static iwrc _jql_compile_filter(MFCTX *fctx, JQP_AUX *aux) {
+  int num = 0;
+  for (JQP_NODE *n = fctx->nodes; n; n = n->next) ++num;
+  if (!num) {
+    return 0;
+  }
+  fctx->mnodes = iwpool_calloc(num * sizeof(fctx->mnodes[0]), aux->pool);
+  if (!fctx->mnodes) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (JQP_NODE *n = fctx->nodes; n; n = n->next) {
+    iwrc rc = _jql_compile_node(n, &fctx->mnodes[fctx->mnodes_num++], aux);
+    RCRET(rc);
+  }
+  return 0;
+}
+
+/**
+ * Returns true if expression can be matched by direct probing of document paths.
+ * Recursive descent filters (`**`) and negated filters depend on the order
+ * documents are visited in, so they are left to generic document visitor.
+ */
+static bool _jql_is_direct_expression_node(JQP_EXPR_NODE *en) {
+  for (en = en->chain; en; en = en->next) {
+    if (en->join && en->join->negate) {
+      return false;
+    }
+    if (en->type == JQP_EXPR_NODE_TYPE) {
+      if (!_jql_is_direct_expression_node(en)) {
+        return false;
+      }
+    } else if (en->type == JQP_FILTER_TYPE) {
+      for (JQP_NODE *n = ((JQP_FILTER *) en)->node; n; n = n->next) {
+        if (n->ntype == JQP_NODE_ANYS) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 static iwrc _jql_init_expression_node(JQP_EXPR_NODE *en, JQP_AUX *aux) {
   en->opaque = iwpool_calloc(sizeof(MENCTX), aux->pool);
   if (!en->opaque) return iwrc_set_errno(IW_ERROR_ALLOC, errno);
@@ -264,6 +379,8 @@ static iwrc _jql_init_expression_node(JQP_EXPR_NODE *en, JQP_AUX *aux) {
         n->start = -1;
         n->end = -1;
       }
+      iwrc rc = _jql_compile_filter(fctx, aux);
+      RCRET(rc);
     }
   }
   return 0;
@@ -310,6 +427,8 @@ iwrc jql_create2(JQL *qptr, const char *coll, const char *query, jql_create_mode
   }
 
   rc = _jql_init_expression_node(aux->expr, aux);
+  RCGO(rc, finish);
+  q->direct = _jql_is_direct_expression_node(aux->expr);
 
 finish:
   if (rc) {
@@ -329,6 +448,50 @@ iwrc jql_create(JQL *qptr, const char *coll, const char *query) {
   return jql_create2(qptr, coll, query, 0);
 }
 
+iwrc jql_clone(JQL q, JQL *qptr) {
+  if (!q || !qptr) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  *qptr = 0;
+  JQL cq;
+  iwrc rc = jql_create2(&cq, q->coll, q->aux->buf, q->aux->mode);
+  RCRET(rc);
+  // Placeholders of both queries are listed in the same order
+  JQP_STRING *pv = q->aux->start_placeholder, *cpv = cq->aux->start_placeholder;
+  for ( ; pv && cpv; pv = pv->placeholder_next, cpv = cpv->placeholder_next) {
+    JQVAL *qv = pv->opaque;
+    if (!qv) {
+      continue;
+    }
+    JQVAL *cqv = malloc(sizeof(*cqv));
+    if (!cqv) {
+      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      goto finish;
+    }
+    memcpy(cqv, qv, sizeof(*cqv));
+    // Values are owned by source query
+    cqv->freefn = 0;
+    cqv->freefn_op = 0;
+    if (qv->type == JQVAL_RE) {
+      cqv->vre = lwre_new(qv->vre->expression);
+      if (!cqv->vre) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        free(cqv);
+        goto finish;
+      }
+    }
+    cpv->opaque = cqv;
+  }
+
+finish:
+  if (rc) {
+    jql_destroy(&cq);
+  } else {
+    *qptr = cq;
+  }
+  return rc;
+}
+
 size_t jql_estimate_allocated_size(JQL q) {
   size_t ret = sizeof(struct _JQL);
   if (q->aux && q->aux->pool) {
@@ -555,7 +718,7 @@ static int _jql_cmp_jqval_pair(const JQVAL *left, const JQVAL *right, iwrc *rcp)
         case JQVAL_F64:
           return lv->vf64 > rv->vf64 ? 1 : lv->vf64 < rv->vf64 ? -1 : 0;
         case JQVAL_I64:
-          return lv->vf64 > (double) rv->vi64 ? 1 : lv->vf64 < rv->vf64 ? -1 : 0;
+          return lv->vf64 > (double) rv->vi64 ? 1 : lv->vf64 < (double) rv->vi64 ? -1 : 0;
         case JQVAL_STR: {
           double rval = (double) iwatof(rv->vstr);
           return lv->vf64 > rval ? 1 : lv->vf64 < rval ? -1 : 0;
@@ -771,6 +934,195 @@ static bool _jql_match_regexp(JQP_AUX *aux,
   return false;
 }
 
+const char *jql_regexp_prefix(const char *expr, IWPOOL *pool, iwrc *rcp) {
+  *rcp = 0;
+  if (!expr || expr[0] != '^') {
+    return 0;
+  }
+  // Anchor of expression with top level alternation is applied to the first branch only
+  int depth = 0;
+  bool cclass = false;
+  for (const char *p = expr + 1; *p; ++p) {
+    if (*p == '\\') {
+      if (p[1]) ++p;
+    } else if (cclass) {
+      cclass = (*p != ']');
+    } else if (*p == '[') {
+      cclass = true;
+    } else if (*p == '(' || *p == '{') {
+      ++depth;
+    } else if (*p == ')' || *p == '}') {
+      --depth;
+    } else if (*p == '|' && depth < 1) {
+      return 0;
+    }
+  }
+  size_t len = 0;
+  char *prefix = iwpool_alloc(strlen(expr), pool);
+  if (!prefix) {
+    *rcp = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    return 0;
+  }
+  for (const char *p = expr + 1; *p; ) {
+    size_t clen = len;
+    if (*p == '\\') { // Escaped character is matched as is
+      if (!p[1]) break;
+      prefix[len++] = p[1];
+      p += 2;
+    } else if (strchr(".[](){}|*+?$^", *p)) {
+      break;
+    } else {
+      prefix[len++] = *p++;
+    }
+    if (*p == '*' || *p == '?') { // Optional character
+      len = clen;
+      break;
+    }
+  }
+  if (!len) {
+    return 0;
+  }
+  prefix[len] = '\0';
+  return prefix;
+}
+
+static bool _jql_match_prefix(JQVAL *left, JQVAL *right, iwrc *rcp) {
+  JQVAL sleft, sright; // Stack allocated left/right converted values
+  JQVAL *lv = left, *rv = right;
+  char nbuf[JBNUMBUF_SIZE];
+  const char *input;
+  size_t osz;
+
+  if (lv->type == JQVAL_JBLNODE) {
+    _jql_node_to_jqval(lv->vnode, &sleft);
+    lv = &sleft;
+  } else if (lv->type == JQVAL_BINN) {
+    _jql_binn_to_jqval(lv->vbinn, &sleft);
+    lv = &sleft;
+  }
+  if (rv->type == JQVAL_JBLNODE) {
+    _jql_node_to_jqval(rv->vnode, &sright);
+    rv = &sright;
+  }
+  if (rv->type != JQVAL_STR) {
+    *rcp = _JQL_ERROR_UNMATCHED;
+    return false;
+  }
+  // Values are converted to strings the same way as keys of `EJDB_IDX_STR` index
+  switch (lv->type) {
+    case JQVAL_STR:
+      input = lv->vstr;
+      break;
+    case JQVAL_I64:
+      iwitoa(lv->vi64, nbuf, JBNUMBUF_SIZE);
+      input = nbuf;
+      break;
+    case JQVAL_F64:
+      jbi_ftoa(lv->vf64, nbuf, &osz);
+      input = nbuf;
+      break;
+    case JQVAL_BOOL:
+      input = lv->vbool ? "true" : "false";
+      break;
+    default:
+      *rcp = _JQL_ERROR_UNMATCHED;
+      return false;
+  }
+  return !strncmp(input, rv->vstr, strlen(rv->vstr));
+}
+
+iwrc jql_fts_query(JQP_AUX *aux, JQP_OP *jqop, JQVAL *rv, JQL_FTS_QUERY **qp) {
+  JQVAL sright;
+  JQL_FTS_QUERY *fq = jqop->opaque;
+  *qp = 0;
+  if (rv->type == JQVAL_JBLNODE) {
+    _jql_node_to_jqval(rv->vnode, &sright);
+    rv = &sright;
+  }
+  if (rv->type != JQVAL_STR) {
+    return _JQL_ERROR_UNMATCHED;
+  }
+  if (!fq || strcmp(fq->src, rv->vstr)) { // Query text may be changed by placeholder
+    iwrc rc = jql_fts_query_parse(rv->vstr, aux->pool, &fq);
+    RCRET(rc);
+    jqop->opaque = fq;
+  }
+  *qp = fq;
+  return 0;
+}
+
+/**
+ * @brief Marks terms of full-text query matched by words of `text` in `found` bitmask.
+ */
+static void _jql_fts_text_visit(JQL_FTS_QUERY *fq, const char *text, size_t len, uint64_t *found) {
+  JQL_FTS_TOKENIZER t;
+  uint64_t all = (fq->num < 64) ? (1ULL << fq->num) - 1 : ~0ULL;
+  jql_fts_tokenizer_init(&t, text, len, false);
+  while (*found != all && jql_fts_tokenizer_next(&t)) {
+    for (size_t i = 0; i < fq->num; ++i) {
+      if (!(*found & (1ULL << i)) && jql_fts_term_matched(&fq->terms[i], t.term, t.len)) {
+        *found |= (1ULL << i);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Matches text by full-text query.
+ * Every term of query must be matched by some word of text.
+ * Words of all string elements are matched if `left` is an array like it is done by `EJDB_IDX_FTS` index.
+ */
+static bool _jql_match_fts(JQP_AUX *aux,
+                           JQVAL *left, JQP_OP *jqop, JQVAL *right,
+                           iwrc *rcp) {
+  JQL_FTS_QUERY *fq;
+  JQVAL sleft;
+  JQVAL *lv = left;
+  uint64_t found = 0;
+
+  *rcp = jql_fts_query(aux, jqop, right, &fq);
+  if (*rcp || !fq->num) {
+    return false;
+  }
+  uint64_t all = (fq->num < 64) ? (1ULL << fq->num) - 1 : ~0ULL;
+
+  if (lv->type == JQVAL_JBLNODE && lv->vnode->type == JBV_ARRAY) {
+    for (JBL_NODE n = lv->vnode->child; n && found != all; n = n->next) {
+      if (n->type == JBV_STR) {
+        _jql_fts_text_visit(fq, n->vptr, n->vsize, &found);
+      }
+    }
+    return found == all;
+  } else if (lv->type == JQVAL_BINN && lv->vbinn->type == BINN_LIST) {
+    binn bv;
+    binn_iter iter;
+    if (!binn_iter_init(&iter, lv->vbinn, lv->vbinn->type)) {
+      *rcp = JBL_ERROR_INVALID;
+      return false;
+    }
+    while (found != all && binn_list_next(&iter, &bv)) {
+      if (bv.type == BINN_STRING) {
+        _jql_fts_text_visit(fq, bv.ptr, bv.size, &found);
+      }
+    }
+    return found == all;
+  }
+
+  if (lv->type == JQVAL_JBLNODE) {
+    _jql_node_to_jqval(lv->vnode, &sleft);
+    lv = &sleft;
+  } else if (lv->type == JQVAL_BINN) {
+    _jql_binn_to_jqval(lv->vbinn, &sleft);
+    lv = &sleft;
+  }
+  if (lv->type != JQVAL_STR) {
+    *rcp = _JQL_ERROR_UNMATCHED;
+    return false;
+  }
+  _jql_fts_text_visit(fq, lv->vstr, strlen(lv->vstr), &found);
+  return found == all;
+}
+
 static bool _jql_match_in(JQVAL *left, JQP_OP *jqop, JQVAL *right,
                           iwrc *rcp) {
 
@@ -876,6 +1228,12 @@ static bool _jql_match_jqval_pair(JQP_AUX *aux,
       case JQP_OP_RE:
         match = _jql_match_regexp(aux, left, jqop, right, rcp);
         break;
+      case JQP_OP_FT:
+        match = _jql_match_fts(aux, left, jqop, right, rcp);
+        break;
+      case JQP_OP_PREFIX:
+        match = _jql_match_prefix(left, right, rcp);
+        break;
       case JQP_OP_IN:
         match = _jql_match_in(left, jqop, right, rcp);
         break;
@@ -1047,10 +1405,7 @@ static bool _jql_match_node_expr_impl(MCTX *mctx, JQP_EXPR *expr, iwrc *rcp) {
   return negate != (0 == !ret);
 }
 
-static bool _jql_match_node_expr(MCTX *mctx, JQP_NODE *n, iwrc *rcp) {
-  n->start = mctx->lvl;
-  n->end = n->start;
-  JQPUNIT *unit = n->value;
+static bool _jql_match_node_expr_unit(MCTX *mctx, JQPUNIT *unit, iwrc *rcp) {
   if (unit->type != JQP_EXPR_TYPE) {
     iwlog_ecode_error3(IW_ERROR_ASSERTION);
     *rcp = IW_ERROR_ASSERTION;
@@ -1075,6 +1430,12 @@ static bool _jql_match_node_expr(MCTX *mctx, JQP_NODE *n, iwrc *rcp) {
   return prev;
 }
 
+static bool _jql_match_node_expr(MCTX *mctx, JQP_NODE *n, iwrc *rcp) {
+  n->start = mctx->lvl;
+  n->end = n->start;
+  return _jql_match_node_expr_unit(mctx, n->value, rcp);
+}
+
 IW_INLINE bool _jql_match_node_field(MCTX *mctx, JQP_NODE *n, iwrc *rcp) {
   n->start = mctx->lvl;
   n->end = n->start;
@@ -1221,6 +1582,146 @@ static jbl_visitor_cmd_t _jql_match_visitor(int lvl, binn *bv, const char *key,
   return 0;
 }
 
+/**
+ * Returns true if expression node matches keys not listed in node probes.
+ */
+static bool _jql_mnode_matches_other_keys(MNODE *mn) {
+  if (mn->n->ntype != JQP_NODE_EXPR) {
+    return false;
+  }
+  bool prev = false;
+  for (JQP_EXPR *expr = &mn->n->value->expr; expr; expr = expr->next) {
+    const JQP_JOIN *join = expr->join;
+    bool matched = expr->prematched || (join && join->negate);
+    if (!join) {
+      prev = matched;
+    } else if (join->value == JQP_JOIN_AND) {
+      prev = prev && matched;
+    } else if (prev || matched) {
+      prev = true;
+      break;
+    }
+  }
+  return prev;
+}
+
+static bool _jql_mnode_match(MCTX *mctx, MFCTX *fctx, int i, binn *bn, iwrc *rcp);
+
+static bool _jql_mnode_match_key(MCTX *mctx, MFCTX *fctx, int i, const char *key, binn *bv, iwrc *rcp) {
+  MNODE *mn = &fctx->mnodes[i];
+  JQP_NODE *n = mn->n;
+  mctx->key = key;
+  mctx->bv = bv;
+  if (n->ntype == JQP_NODE_FIELD) {
+    if (strcmp(n->value->string.value, key) != 0) {
+      return false;
+    }
+  } else if (n->ntype == JQP_NODE_EXPR) {
+    if (!_jql_match_node_expr_unit(mctx, n->value, rcp)) {
+      return false;
+    }
+  }
+  if (i + 1 == fctx->mnodes_num) {
+    return true;
+  }
+  if (!BINN_IS_CONTAINER_TYPE(bv->type)) {
+    return false;
+  }
+  return _jql_mnode_match(mctx, fctx, i + 1, bv, rcp);
+}
+
+static bool _jql_mnode_match(MCTX *mctx, MFCTX *fctx, int i, binn *bn, iwrc *rcp) {
+  MNODE *mn = &fctx->mnodes[i];
+  binn bv;
+  if (mn->probes_num >= 0 && bn->type != BINN_MAP && !_jql_mnode_matches_other_keys(mn)) {
+    for (int j = 0; j < mn->probes_num; ++j) {
+      MPROBE *p = &mn->probes[j];
+      bool found;
+      if (bn->type == BINN_OBJECT) {
+        found = binn_object_get_value2(bn, p->name, p->len, &bv);
+      } else {
+        found = p->idx >= 0 && binn_list_get_value(bn, p->idx + 1, &bv);
+      }
+      if (found && _jql_mnode_match_key(mctx, fctx, i, p->name, &bv, rcp)) {
+        return true;
+      }
+      if (*rcp) return false;
+    }
+    return false;
+  }
+  binn_iter it;
+  if (!binn_iter_init(&it, bn, bn->type)) {
+    *rcp = JBL_ERROR_INVALID;
+    return false;
+  }
+  switch (bn->type) {
+    case BINN_OBJECT: {
+      char key[MAX_BIN_KEY_LEN + 1];
+      while (binn_object_next(&it, key, &bv)) {
+        if (_jql_mnode_match_key(mctx, fctx, i, key, &bv, rcp)) {
+          return true;
+        }
+        if (*rcp) return false;
+      }
+      break;
+    }
+    case BINN_MAP: {
+      int idx;
+      char nbuf[JBNUMBUF_SIZE];
+      while (binn_map_next(&it, &idx, &bv)) {
+        iwitoa(idx, nbuf, sizeof(nbuf));
+        if (_jql_mnode_match_key(mctx, fctx, i, nbuf, &bv, rcp)) {
+          return true;
+        }
+        if (*rcp) return false;
+      }
+      break;
+    }
+    case BINN_LIST: {
+      char nbuf[JBNUMBUF_SIZE];
+      for (int idx = 0; binn_list_next(&it, &bv); ++idx) {
+        iwitoa(idx, nbuf, sizeof(nbuf));
+        if (_jql_mnode_match_key(mctx, fctx, i, nbuf, &bv, rcp)) {
+          return true;
+        }
+        if (*rcp) return false;
+      }
+      break;
+    }
+  }
+  return false;
+}
+
+static bool _jql_match_expression_node_direct(JQP_EXPR_NODE *en, MCTX *mctx, binn *bn, iwrc *rcp) {
+  bool prev = false;
+  for (en = en->chain; en; en = en->next) {
+    bool matched = false;
+    const JQP_JOIN *join = en->join;
+    if (join && join->value == JQP_JOIN_AND && !prev) {
+      continue;
+    }
+    if (en->type == JQP_EXPR_NODE_TYPE) {
+      matched = _jql_match_expression_node_direct(en, mctx, bn, rcp);
+    } else if (en->type == JQP_FILTER_TYPE) {
+      MFCTX *fctx = ((JQP_FILTER *) en)->opaque;
+      if (fctx->mnodes_num) {
+        matched = _jql_mnode_match(mctx, fctx, 0, bn, rcp);
+        fctx->matched = matched;
+      }
+    }
+    if (*rcp) return false;
+    if (!join) {
+      prev = matched;
+    } else if (join->value == JQP_JOIN_AND) {
+      prev = prev && matched;
+    } else if (prev || matched) {
+      prev = true;
+      break;
+    }
+  }
+  return prev;
+}
+
 iwrc jql_matched(JQL q, JBL jbl, bool *out) {
   JBL_VCTX vctx = {
     .bn = &jbl->bn,
@@ -1242,6 +1743,22 @@ iwrc jql_matched(JQL q, JBL jbl, bool *out) {
     }
   }
 
+  if (q->direct) {
+    iwrc rc = 0;
+    MCTX mctx = {
+      .q = q,
+      .aux = q->aux
+    };
+    if (!BINN_IS_CONTAINER_TYPE(jbl->bn.type)) {
+      return JBL_ERROR_INVALID;
+    }
+    q->matched = _jql_match_expression_node_direct(q->aux->expr, &mctx, &jbl->bn, &rc);
+    if (!rc) {
+      *out = q->matched;
+    }
+    return rc;
+  }
+
   iwrc rc = _jbl_visit(0, 0, &vctx, _jql_match_visitor);
   if (vctx.pool) {
     iwpool_destroy(vctx.pool);
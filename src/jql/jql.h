@@ -83,6 +83,22 @@ IW_EXPORT WUR iwrc jql_create(JQL *qptr, const char *coll, const char *query);
 
 IW_EXPORT WUR iwrc jql_create2(JQL *qptr, const char *coll, const char *query, jql_create_mode_t mode);
 
+/**
+ * @brief Create an independent copy of query object `q`.
+ *
+ * Copy has its own matching state, so it can be used to match
+ * documents in a thread other than thread owning `q`.
+ * Placeholder values bound to `q` are shared with the copy and not copied,
+ * regular expressions are compiled again.
+ *
+ * @note Copy must be destroyed before `q` is destroyed
+ *       or placeholders of `q` are changed.
+ *
+ * @param q Source query object
+ * @param [out] qptr Pointer to resulting query object
+ */
+IW_EXPORT WUR iwrc jql_clone(JQL q, JQL *qptr);
+
 IW_EXPORT const char *jql_collection(JQL q);
 
 /**
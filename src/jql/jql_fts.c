@@ -0,0 +1,154 @@
+#include "jql_internal.h"
+#include "utf8proc.h"
+
+/**
+ * @brief Returns true if code point is a part of word.
+ *
+ * ASCII letters and digits are word characters, as well as all other
+ * code points except control characters, Latin-1 punctuation and symbols,
+ * general, supplemental and CJK punctuation blocks.
+ */
+static bool _jql_fts_is_word(int32_t cp) {
+  if (cp < 0x80) {
+    return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') || (cp >= '0' && cp <= '9');
+  }
+  return !(
+    cp < 0xC0
+    || cp == 0xD7 || cp == 0xF7
+    || (cp >= 0x2000 && cp <= 0x206F)   // General Punctuation
+    || (cp >= 0x20A0 && cp <= 0x20CF)   // Currency Symbols
+    || (cp >= 0x2E00 && cp <= 0x2E7F)   // Supplemental Punctuation
+    || (cp >= 0x3000 && cp <= 0x303F)   // CJK Symbols and Punctuation
+    || (cp >= 0xFE30 && cp <= 0xFE4F)   // CJK Compatibility Forms
+    || (cp >= 0xFF00 && cp <= 0xFF0F)   // Fullwidth ASCII punctuation
+    || (cp >= 0xFF1A && cp <= 0xFF20)
+    || (cp >= 0xFF3B && cp <= 0xFF40)
+    || (cp >= 0xFF5B && cp <= 0xFF65));
+}
+
+/**
+ * @brief Simple case folding of Latin, Greek, Cyrillic and fullwidth Latin letters.
+ */
+static int32_t _jql_fts_fold(int32_t cp) {
+  if (cp < 0x80) {
+    return (cp >= 'A' && cp <= 'Z') ? cp + 0x20 : cp;
+  }
+  if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) { // Latin-1 Supplement
+    return cp + 0x20;
+  }
+  if (cp >= 0x100 && cp <= 0x17F) { // Latin Extended-A
+    if ((cp <= 0x137 || (cp >= 0x14A && cp <= 0x177)) && !(cp & 1)) {
+      return cp + 1;
+    }
+    if (((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) && (cp & 1)) {
+      return cp + 1;
+    }
+    if (cp == 0x178) {
+      return 0xFF;
+    }
+    return cp;
+  }
+  if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) { // Greek
+    return cp + 0x20;
+  }
+  if (cp == 0x3C2) { // Greek final sigma
+    return 0x3C3;
+  }
+  if (cp >= 0x400 && cp <= 0x40F) { // Cyrillic
+    return cp + 0x50;
+  }
+  if (cp >= 0x410 && cp <= 0x42F) {
+    return cp + 0x20;
+  }
+  if (cp >= 0xFF21 && cp <= 0xFF3A) { // Fullwidth Latin
+    return cp + 0x20;
+  }
+  return cp;
+}
+
+void jql_fts_tokenizer_init(JQL_FTS_TOKENIZER *t, const char *text, size_t len, bool query) {
+  memset(t, 0, sizeof(*t));
+  t->rp = (const uint8_t *) text;
+  t->ep = t->rp + len;
+  t->query = query;
+}
+
+bool jql_fts_tokenizer_next(JQL_FTS_TOKENIZER *t) {
+  int32_t cp;
+  bool full = false;
+  t->len = 0;
+  t->prefix = false;
+  while (t->rp < t->ep) {
+    utf8proc_ssize_t sz = utf8proc_iterate(t->rp, t->ep - t->rp, &cp);
+    if (sz < 1) { // Invalid UTF-8 sequence is a separator
+      t->rp++;
+      if (t->len) {
+        return true;
+      }
+      continue;
+    }
+    t->rp += sz;
+    if (!_jql_fts_is_word(cp)) {
+      if (t->len) {
+        if (t->query && cp == '*') {
+          t->prefix = true;
+        }
+        return true;
+      }
+      continue;
+    }
+    uint8_t ubuf[4];
+    sz = utf8proc_encode_char(_jql_fts_fold(cp), ubuf);
+    if (!full && t->len + sz <= JQL_FTS_TERM_MAX_SIZE) {
+      memcpy(t->term + t->len, ubuf, sz);
+      t->len += sz;
+    } else { // Long words are truncated
+      full = true;
+    }
+  }
+  return t->len > 0;
+}
+
+iwrc jql_fts_query_parse(const char *text, IWPOOL *pool, JQL_FTS_QUERY **qp) {
+  iwrc rc = 0;
+  JQL_FTS_TOKENIZER t;
+  *qp = 0;
+  JQL_FTS_QUERY *q = iwpool_calloc(sizeof(*q), pool);
+  if (!q) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  q->src = iwpool_strdup(pool, text, &rc);
+  RCRET(rc);
+  jql_fts_tokenizer_init(&t, text, strlen(text), true);
+  while (q->num < JQL_FTS_MAX_TERMS && jql_fts_tokenizer_next(&t)) {
+    size_t i = 0;
+    for ( ; i < q->num; ++i) {
+      struct JQL_FTS_TERM *qt = &q->terms[i];
+      if (qt->prefix == t.prefix && qt->len == t.len && !memcmp(qt->term, t.term, t.len)) {
+        break;
+      }
+    }
+    if (i < q->num) { // Duplicated term
+      continue;
+    }
+    char *term = iwpool_alloc(t.len, pool);
+    if (!term) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    memcpy(term, t.term, t.len);
+    q->terms[q->num++] = (struct JQL_FTS_TERM) {
+      .term = term,
+      .len = t.len,
+      .prefix = t.prefix
+    };
+  }
+  *qp = q;
+  return 0;
+}
+
+bool jql_fts_term_matched(const struct JQL_FTS_TERM *qt, const char *term, size_t len) {
+  if (qt->prefix ? len < qt->len : len != qt->len) {
+    return false;
+  }
+  return !memcmp(qt->term, term, qt->len);
+}
@@ -11,6 +11,7 @@
 struct _JQL {
   bool dirty;
   bool matched;
+  bool direct;     /**< Query is matched by direct probing of document paths */
   JQP_QUERY *qp;
   JQP_AUX *aux;
   const char *coll;
@@ -57,5 +58,59 @@ int jql_cmp_jqval_pair(const JQVAL *left, const JQVAL *right, iwrc *rcp);
 
 bool jql_match_jqval_pair(JQP_AUX *aux, JQVAL *left, JQP_OP *jqop, JQVAL *right, iwrc *rcp);
 
+/**
+ * @brief Returns literal prefix of every string matched by regular expression `expr`
+ *        anchored at the start of string, eg: `abc` for `^abc.*`.
+ *
+ * Returns zero if expression is not anchored or literal prefix is empty.
+ * Prefix is allocated in `pool`.
+ */
+const char *jql_regexp_prefix(const char *expr, IWPOOL *pool, iwrc *rcp);
+
+// Max size in bytes of full-text search term, longer words are truncated
+#define JQL_FTS_TERM_MAX_SIZE 64
+
+// Max number of distinct terms of full-text search query
+#define JQL_FTS_MAX_TERMS 64
+
+/**
+ * @brief Full-text tokenizer state.
+ *
+ * Text is split into words of letters and digits, words are case folded.
+ */
+typedef struct JQL_FTS_TOKENIZER {
+  const uint8_t *rp;          /**< Current read position */
+  const uint8_t *ep;          /**< End of text */
+  bool query;                 /**< Text is a search query where `*` after word denotes prefix term */
+  bool prefix;                /**< Current term is a prefix term */
+  size_t len;                 /**< Size of current term */
+  char term[JQL_FTS_TERM_MAX_SIZE]; /**< Current term, not zero terminated */
+} JQL_FTS_TOKENIZER;
+
+/** Full-text search query */
+typedef struct JQL_FTS_QUERY {
+  const char *src;            /**< Query text */
+  size_t num;                 /**< Number of distinct terms */
+  struct JQL_FTS_TERM {
+    const char *term;         /**< Term, not zero terminated */
+    size_t len;               /**< Size of term */
+    bool prefix;              /**< Term is matched by words starting with it */
+  } terms[JQL_FTS_MAX_TERMS];
+} JQL_FTS_QUERY;
+
+void jql_fts_tokenizer_init(JQL_FTS_TOKENIZER *t, const char *text, size_t len, bool query);
+
+bool jql_fts_tokenizer_next(JQL_FTS_TOKENIZER *t);
+
+iwrc jql_fts_query_parse(const char *text, IWPOOL *pool, JQL_FTS_QUERY **qp);
+
+bool jql_fts_term_matched(const struct JQL_FTS_TERM *qt, const char *term, size_t len);
+
+/**
+ * @brief Returns full-text query of `ft` operation with right value `rv`.
+ * Parsed query is cached in operation.
+ */
+iwrc jql_fts_query(JQP_AUX *aux, JQP_OP *jqop, JQVAL *rv, JQL_FTS_QUERY **qp);
+
 #endif
 
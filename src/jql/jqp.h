@@ -92,6 +92,8 @@ typedef enum { // Do not reorder members
   JQP_OP_IN,
   JQP_OP_NI,
   JQP_OP_RE,
+  JQP_OP_FT,
+  JQP_OP_PREFIX,
 } jqp_op_t;
 
 struct JQP_AUX;
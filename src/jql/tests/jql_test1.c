@@ -123,6 +123,11 @@ void jql_test1_2() {
   _jql_test1_2("{'foo':{'bar':22}}", "/*/[bar > 22 and bar <= 23]", false);
   _jql_test1_2("{'foo':{'bar':22}}", "/*/[bar > 23 or bar < 23]", true);
   _jql_test1_2("{'foo':{'bar':22}}", "/*/[bar < 23 or bar > 23]", true);
+  _jql_test1_2("{'f':1.5}", "/[f < 10]", true);
+  _jql_test1_2("{'f':1.5}", "/[f <= 1]", false);
+  _jql_test1_2("{'f':1.5}", "/[f > 1]", true);
+  _jql_test1_2("{'f':-1.5}", "/[f < -1]", true);
+  _jql_test1_2("{'f':-1.5}", "/[f >= -1]", false);
   _jql_test1_2("{'foo':{'bar':22}}", "/foo/[[* = bar] = 22]", true);
   _jql_test1_2("{'foo':{'bar':22}}", "/foo/[[* = bar] != 23]", true);
   _jql_test1_2("{'foo':{'bar':22}}", "/[* = foo]/[[* = bar] != 23]", true);
@@ -143,6 +148,26 @@ void jql_test1_2() {
   _jql_test1_2("{'foo':{'bar':22}}", "/[* in [\"foo\"]]/[bar in [21, 22]]", true);
   _jql_test1_2("{'foo':{'bar':22}}", "/[* not in [\"foo\"]]/[bar in [21, 22]]", false);
 
+  // ft
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t ft fox]", true);
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t ft \"BROWN quick\"]", true);
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t ft \"brown dog\"]", false);
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t ft \"qui* bro*\"]", true);
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t ft qui]", false);
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t not ft dog]", true);
+  _jql_test1_2("{'t':'The quick, brown Fox!'}", "/[t ft \"!!\"]", false);
+  _jql_test1_2("{'t':'Ünïcode ТЕКСТ'}", "/[t ft \"üNÏcode текст\"]", true);
+  _jql_test1_2("{'t':['red fox', 'blue whale']}", "/[t ft \"whale red\"]", true);
+  _jql_test1_2("{'t':22}", "/[t ft 22]", false);
+
+  // sw
+  _jql_test1_2("{'foo':'abcd'}", "/[foo sw abc]", true);
+  _jql_test1_2("{'foo':'abcd'}", "/[foo sw abcd]", true);
+  _jql_test1_2("{'foo':'abcd'}", "/[foo sw abcde]", false);
+  _jql_test1_2("{'foo':'abcd'}", "/[foo sw bcd]", false);
+  _jql_test1_2("{'foo':'abcd'}", "/[foo not sw bcd]", true);
+  _jql_test1_2("{'foo':1234}", "/[foo sw \"12\"]", true);
+
   // Array element
   _jql_test1_2("{'tags':['bar', 'foo']}", "/tags/[** in [\"bar\", \"baz\"]]", true);
   _jql_test1_2("{'tags':['bar', 'foo']}", "/tags/[** in [\"zaz\", \"gaz\"]]", false);
@@ -188,6 +213,36 @@ void jql_test1_2() {
   _jql_test1_2(doc, "/foo/[arr ni 3]", true);
   _jql_test1_2(doc, "/**/[zarr ni 42]", true);
   _jql_test1_2(doc, "/**/[[* in [\"zarr\"]] in [[42]]]", true);
+
+  // Direct path probes
+  _jql_test1_2(doc, "/foo/arr/2", true);
+  _jql_test1_2(doc, "/foo/arr/4", false);
+  _jql_test1_2(doc, "/foo/arr/[1 = 2]", true);
+  _jql_test1_2(doc, "/foo/arr/[01 = 2]", false);
+  _jql_test1_2(doc, "/foo/sas/gaz/zarr/0", true);
+  _jql_test1_2(doc, "/foo/sas/gaz/zaz/0", false);
+  _jql_test1_2(doc, "/FOO/sas", false);
+  _jql_test1_2(doc, "/foo/*/gaz/[zaz = 44]", true);
+  _jql_test1_2(doc, "/foo/*/[gaz = 44 or baz != 33]", true);
+  _jql_test1_2(doc, "/foo/*/[gaz = 44 or baz = 33]", false);
+  _jql_test1_2(doc, "/foo/[bar != 1]", true);
+  _jql_test1_2(doc, "/foo/[zzz != 1]", false);
+  _jql_test1_2(doc, "/foo/bar/baz/[zaz = 33] and /foo/[arr ni 4]", true);
+  _jql_test1_2(doc, "/foo/bar/baz/[zaz = 33] and (/foo/[arr ni 5] or /foo/sas/gaz)", true);
+  _jql_test1_2("[{'a':1},{'a':2}]", "/*/[a = 2]", true);
+  _jql_test1_2("[{'a':1},{'a':2}]", "/1/[a = 1]", false);
+
+  IWXSTR *xstr = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr);
+  iwxstr_cat2(xstr, "{");
+  for (int i = 0; i < 1000; ++i) {
+    iwxstr_printf(xstr, "'f%d':{'v':%d},", i, i);
+  }
+  iwxstr_cat2(xstr, "'tags':['a','b']}");
+  _jql_test1_2(iwxstr_ptr(xstr), "/f999/[v = 999]", true);
+  _jql_test1_2(iwxstr_ptr(xstr), "/f998/[v = 999]", false);
+  _jql_test1_2(iwxstr_ptr(xstr), "/tags/[** = b] and /f1/v", true);
+  iwxstr_destroy(xstr);
 }
 
 static void _jql_test1_3(const char *jsondata, const char *q, const char *eq) {
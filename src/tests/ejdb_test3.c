@@ -1028,6 +1028,2824 @@ void ejdb_test3_7() {
   CU_ASSERT_EQUAL_FATAL(rc, 0);
 }
 
+void ejdb_test3_8() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_8.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  char dbuf[1024];
+  EJDB_LIST list = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/status", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/tenant", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < 100; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"status\":\"%s\",\"tenant\":%d,\"n\":%d}",
+             (i % 2 ? "open" : "closed"), i % 5, i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  rc = ejdb_list3(db, "c1", "/[status = open] and /[tenant = 3]", 0, log, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED "));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] INTERSECT "));
+  int i = 0;
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++i) {
+    JBL jbl;
+    rc = jbl_at(doc->raw, "/n", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    int64_t n = jbl_get_i64(jbl);
+    CU_ASSERT_TRUE(n % 2 == 1 && n % 5 == 3);
+    jbl_destroy(&jbl);
+  }
+  CU_ASSERT_EQUAL(i, 10);
+  ejdb_list_destroy(&list);
+
+  // Intersection with sorting
+  iwxstr_clear(log);
+  rc = ejdb_list3(db, "c1", "/[status = closed] and /[tenant = 4] | desc /n", 0, log, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] INTERSECT "));
+  i = 0;
+  int64_t prev = INT64_MAX;
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++i) {
+    JBL jbl;
+    rc = jbl_at(doc->raw, "/n", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    int64_t n = jbl_get_i64(jbl);
+    CU_ASSERT_TRUE(n % 2 == 0 && n % 5 == 4);
+    CU_ASSERT_TRUE(n < prev);
+    prev = n;
+    jbl_destroy(&jbl);
+  }
+  CU_ASSERT_EQUAL(i, 10);
+  ejdb_list_destroy(&list);
+
+  // Empty intersection
+  rc = ejdb_list3(db, "c1", "/[status = open] and /[tenant = 7]", 0, 0, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NULL(list->first);
+  ejdb_list_destroy(&list);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+static iwrc list_count(EJDB db, const char *coll, const char *query, int64_t *count, IWXSTR *log) {
+  EJDB_LIST list;
+  *count = 0;
+  iwrc rc = ejdb_list3(db, coll, query, 0, log, &list);
+  RCRET(rc);
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next) {
+    *count = *count + 1;
+  }
+  ejdb_list_destroy(&list);
+  return 0;
+}
+
+void ejdb_test3_9() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_9.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  char dbuf[1024];
+  int64_t count = 0;
+  EJDB_LIST list = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/a", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/b", EJDB_IDX_UNIQUE | EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < 100; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"a\":%d,\"b\":%d,\"c\":%d}", i % 10, i, i % 3);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // a = 1 gives 10 documents, b < 20 gives 20 documents, two of them are shared
+  rc = list_count(db, "c1", "/[a = 1] or /[b < 20]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 28);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] UNION I64|100 /a EXPR1: 'a = 1'"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] UNION UNIQUE|I64|100 /b EXPR1: 'b < 20'"));
+
+  // Branch without index
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[a = 1] or /[c = 2]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 40);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] UNION"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO"));
+
+  // Nested and branch
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "(/[a = 2] and /[c = 0]) or /[b in [1, 2, 3]]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 6);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] UNION"));
+
+  // Sorting and limit
+  rc = ejdb_list3(db, "c1", "/[a = 3] or /[b >= 95] | desc /b", 3, 0, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  int i = 0;
+  const int64_t expected[] = { 99, 98, 97 };
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++i) {
+    JBL jbl;
+    rc = jbl_at(doc->raw, "/b", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(jbl_get_i64(jbl), expected[i]);
+    jbl_destroy(&jbl);
+  }
+  CU_ASSERT_EQUAL(i, 3);
+  ejdb_list_destroy(&list);
+
+  rc = ejdb_list3(db, "c1", "/[a = 3] or /[b >= 95]", 5, 0, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  i = 0;
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++i);
+  CU_ASSERT_EQUAL(i, 5);
+  ejdb_list_destroy(&list);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+static iwrc exec_count(EJDB db, const char *coll, const char *query, int64_t *count, IWXSTR *log) {
+  JQL q;
+  *count = 0;
+  iwrc rc = jql_create(&q, coll, query);
+  RCRET(rc);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .log = log
+  };
+  rc = ejdb_exec(&ux);
+  *count = ux.cnt;
+  jql_destroy(&q);
+  return rc;
+}
+
+void ejdb_test3_10() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_10.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  char dbuf[1024];
+  int64_t count = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/a", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/b", EJDB_IDX_UNIQUE | EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/d", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/s", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < 100; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"a\":%d,\"b\":%d,\"c\":%d,\"d\":%d,\"s\":\"s%03d\"}",
+             i % 10, i, i % 3, i % 4, i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  rc = exec_count(db, "c1", "/[a = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[b >= 90]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[b > 89 and b < 95]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[b >= 90] | skip 2 limit 3", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 3);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[s >= s095] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5);
+  // String keys do not reproduce JQL comparison of numeric strings
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  // Intersected equality indexes
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[a = 2] and /[d = 0] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  // Filter without index
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[a = 3] and /[c = 0] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  // Range expression of not selected index
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[a = 3] and /[b >= 50] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  // Key of string value converted by I64 index does not match as JQL compares it
+  rc = put_json(db, "c1", "{'a':'3x','b':1000}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[a = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[b >= 90] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 11);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  // Converted keys are remembered in index meta
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  opts.kv.oflags = 0;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[a = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+void ejdb_test3_11() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_11.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  char dbuf[1024];
+  int64_t count = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/status", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/ts", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"status\":\"%s\",\"ts\":%d}", (i % 10) ? "active" : "closed", i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Equality index is preferred without statistics
+  rc = list_count(db, "c1", "/[status = active] and /[ts >= 990]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 9);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|1000 /status"));
+
+  rc = ejdb_analyze(db, "c1");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_analyze(db, "c2");
+  CU_ASSERT_EQUAL(rc, IW_ERROR_NOT_EXISTS);
+
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[status = active] and /[ts >= 990]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 9);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|1000 /ts"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] MATCHED  STR|1000 /status EXPR1: 'status = active' "
+                                "INIT: IWKV_CURSOR_EQ ROWS: 900\n"));
+  // Low cardinality index is not intersected with selective one
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] INTERSECT"));
+
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[status = closed] and /[ts >= 500]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 50);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|1000 /status"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "ROWS: 100\n"));
+
+  // Most of documents are matched so collection scan is cheaper
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[ts > 100]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 899);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SKIPPED I64|1000 /ts"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO"));
+
+  // But not for count queries served by index only
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[ts > 100] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 899);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+
+  // Statistics are persistent and scaled to the current number of index records
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  opts.kv.oflags &= ~IWKV_TRUNC;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 1000; i < 2000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"status\":\"%s\",\"ts\":%d}", (i % 10) ? "active" : "closed", i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[status = closed] and /[ts >= 1990]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] MATCHED  STR|2000 /status EXPR1: 'status = closed' "
+                                "INIT: IWKV_CURSOR_EQ ROWS: 200\n"));
+
+  // Statistics are removed together with index
+  rc = ejdb_remove_index(db, "c1", "/status", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/status", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[status = closed]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 200);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "ROWS:"));
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+static iwrc projection_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  if (!doc->node) {
+    return IW_ERROR_FAIL;
+  }
+  return jbl_node_as_json(doc->node, jbl_xstr_json_printer, ctx->opaque, 0);
+}
+
+void ejdb_test3_12() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_12.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true,
+    .query_cache_sz = 2
+  };
+  EJDB db;
+  JQL q, q2;
+  char dbuf[1024];
+  int64_t count = 0;
+  IWXSTR *xstr = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < 10; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"a\":%d,\"b\":%d}", i % 2, i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  rc = ejdb_query_acquire(db, "c1", "/[a = :a] | /b", 0, &q);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jql_set_i64(q, "a", 0, 1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  // Projection is not needed for count
+  rc = ejdb_count(db, q, &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5);
+
+  // Same query text used concurrently
+  rc = ejdb_query_acquire(db, "c1", "/[a = :a] | /b", 0, &q2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NOT_EQUAL(q, q2);
+  ejdb_query_release(db, &q2);
+  CU_ASSERT_PTR_NULL(q2);
+
+  JQL qprev = q;
+  ejdb_query_release(db, &q);
+  CU_ASSERT_PTR_NULL(q);
+
+  rc = ejdb_query_acquire(db, "c1", "/[a = :a] | /b", 0, &q);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_EQUAL(q, qprev);
+  rc = jql_set_i64(q, "a", 0, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .visitor = projection_visitor,
+    .opaque = xstr
+  };
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(ux.cnt, 5);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr), "{\"b\":8}{\"b\":6}{\"b\":4}{\"b\":2}{\"b\":0}");
+  ejdb_query_release(db, &q);
+
+  // Collection is a part of cache key
+  rc = ejdb_query_acquire(db, "c2", "/[a = :a] | /b", 0, &q);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NOT_EQUAL(q, qprev);
+  CU_ASSERT_STRING_EQUAL(jql_collection(q), "c2");
+  ejdb_query_release(db, &q);
+
+  for (int i = 0; i < 3; ++i) {
+    rc = list_count(db, "c1", "/[b > 6]", &count, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, 3);
+  }
+
+  // Parse errors are not cached
+  rc = ejdb_query_acquire(db, "c1", "/[a = ", JQL_SILENT_ON_PARSE_ERROR | JQL_KEEP_QUERY_ON_PARSE_ERROR, &q);
+  CU_ASSERT_EQUAL(rc, JQL_ERROR_QUERY_PARSE);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+  CU_ASSERT_PTR_NOT_NULL(jql_error(q));
+  ejdb_query_release(db, &q);
+  rc = ejdb_query_acquire(db, "c1", "/[a = ", JQL_SILENT_ON_PARSE_ERROR, &q);
+  CU_ASSERT_EQUAL(rc, JQL_ERROR_QUERY_PARSE);
+  CU_ASSERT_PTR_NULL(q);
+
+  // Lists and acquired queries are released after database is closed
+  EJDB_LIST list = 0;
+  rc = ejdb_list3(db, "c1", "/[b > 6]", 0, 0, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_query_acquire(db, "c1", "/[a = :a] | /b", 0, &q);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  count = 0;
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++count);
+  CU_ASSERT_EQUAL(count, 3);
+  ejdb_list_destroy(&list);
+  CU_ASSERT_PTR_NULL(list);
+  ejdb_query_release(db, &q);
+  CU_ASSERT_PTR_NULL(q);
+
+  opts.no_query_cache = true;
+  opts.kv.oflags &= ~IWKV_TRUNC;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_query_acquire(db, "c1", "/[a = 1]", 0, &q);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_count(db, q, &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5);
+  ejdb_query_release(db, &q);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(xstr);
+}
+
+static iwrc ids_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  return iwxstr_printf(ctx->opaque, "%lld,", (long long) doc->id);
+}
+
+static iwrc exec_ids(EJDB db, JQL q, uint32_t parallel, bool unordered, IWXSTR *xstr, int64_t *cnt, IWXSTR *log) {
+  iwxstr_clear(xstr);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .visitor = ids_visitor,
+    .opaque = xstr,
+    .log = log,
+    .parallel = parallel,
+    .parallel_unordered = unordered
+  };
+  iwrc rc = ejdb_exec(&ux);
+  *cnt = ux.cnt;
+  return rc;
+}
+
+static iwrc ids_step2_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  *step = 2;
+  return iwxstr_printf(ctx->opaque, "%lld,", (long long) doc->id);
+}
+
+static iwrc list_ids(EJDB db, JQL q, IWXSTR *xstr, int64_t *cnt, IWXSTR *log) {
+  EJDB_LIST list;
+  iwxstr_clear(xstr);
+  *cnt = 0;
+  iwrc rc = ejdb_list4(db, q, 0, log, &list);
+  RCRET(rc);
+  for (EJDB_DOC doc = list->first; doc && !rc; doc = doc->next) {
+    rc = iwxstr_printf(xstr, "%lld,", (long long) doc->id);
+    *cnt = *cnt + 1;
+  }
+  ejdb_list_destroy(&list);
+  return rc;
+}
+
+void ejdb_test3_13() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_13.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  JQL q;
+  char dbuf[1024];
+  int64_t cnt, cnt2, count;
+  IWXSTR *xstr = iwxstr_new();
+  IWXSTR *xstr2 = iwxstr_new();
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr2);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 3000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"a\":%d,\"b\":%d,\"s\":\"v%d\"}", i % 7, i, i % 100);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  // Make holes in ids sequence
+  for (int64_t id = 100; id < 400; ++id) {
+    rc = ejdb_del(db, "c1", id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  // Document with negative id
+  JBL jbl;
+  rc = jbl_from_json(&jbl, "{\"a\":3,\"b\":-3,\"s\":\"v2\"}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_put(db, "c1", jbl, -3);
+  jbl_destroy(&jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = jql_create(&q, "c1", "/[a = :a] and /[s re :re]");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jql_set_i64(q, "a", 0, 3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jql_set_regexp(q, "re", 0, "v[1-3]");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = exec_ids(db, q, 0, false, xstr, &cnt, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_TRUE(cnt > 0);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[PARALLEL]"));
+  iwxstr_clear(log);
+
+  // Ordered parallel scan produces the same result as sequential one
+  rc = exec_ids(db, q, 4, false, xstr2, &cnt2, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cnt2, cnt);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr2), iwxstr_ptr(xstr));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(xstr2), "-3,"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO [PARALLEL] 4 [COLLECTOR] PLAIN"));
+  iwxstr_clear(log);
+
+  // Unordered scan visits the same number of documents
+  rc = exec_ids(db, q, 4, true, xstr2, &cnt2, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cnt2, cnt);
+  CU_ASSERT_EQUAL(iwxstr_size(xstr2), iwxstr_size(xstr));
+
+  rc = ejdb_count(db, q, &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, cnt);
+  jql_destroy(&q);
+
+  // Skip and limit
+  rc = jql_create(&q, "c1", "/[a = 5] | skip 10 limit 20");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_ids(db, q, 0, false, xstr, &cnt, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cnt, 20);
+  rc = exec_ids(db, q, 3, false, xstr2, &cnt2, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cnt2, 20);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr2), iwxstr_ptr(xstr));
+  jql_destroy(&q);
+
+  // Inverse order
+  rc = jql_create(&q, "c1", "/[a = 1] | inverse");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_ids(db, q, 0, false, xstr, &cnt, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_ids(db, q, 8, false, xstr2, &cnt2, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cnt2, cnt);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr2), iwxstr_ptr(xstr));
+  jql_destroy(&q);
+
+  // Count query
+  rc = jql_create(&q, "c1", "/[b > 1000] | count");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .parallel = 4
+  };
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(ux.cnt, 1999);
+  jql_destroy(&q);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(xstr);
+  iwxstr_destroy(xstr2);
+  iwxstr_destroy(log);
+}
+
+struct sorted_ctx {
+  int64_t cnt;
+  int64_t prev_g;
+  char prev_s[64];
+  bool failed;
+};
+
+static iwrc sorted_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  struct sorted_ctx *sctx = ctx->opaque;
+  JBL jg, js;
+  int64_t g = 0;
+  const char *s = "";
+  if (jbl_at(doc->raw, "/g", &jg) == 0) {
+    g = jbl_get_i64(jg);
+    jbl_destroy(&jg);
+  }
+  iwrc rc = jbl_at(doc->raw, "/s", &js);
+  RCRET(rc);
+  s = jbl_get_str(js);
+  if (sctx->cnt > 0) {
+    // Sorted by `g` ascending then by `s` descending
+    if (g < sctx->prev_g || (g == sctx->prev_g && strcmp(s, sctx->prev_s) > 0)) {
+      sctx->failed = true;
+    }
+  }
+  sctx->prev_g = g;
+  strncpy(sctx->prev_s, s, sizeof(sctx->prev_s) - 1);
+  ++sctx->cnt;
+  jbl_destroy(&js);
+  return 0;
+}
+
+void ejdb_test3_14() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_14.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true,
+    .sort_buffer_sz = 1024 * 1024
+  };
+  EJDB db;
+  JQL q;
+  char dbuf[1024];
+  IWXSTR *xstr = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  // Sort keys of 50K documents do not fit into 1Mb sort buffer
+  for (int i = 0; i < 50000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"g\":%d,\"s\":\"string value number %08d\"}",
+             (i * 7919) % 13, (int) (((int64_t) i * 104729) % 50000));
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  struct sorted_ctx sctx = { 0 };
+  rc = jql_create(&q, "c1", "/* | asc /g desc /s");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .visitor = sorted_visitor,
+    .opaque = &sctx
+  };
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(sctx.cnt, 50000);
+  CU_ASSERT_FALSE(sctx.failed);
+  CU_ASSERT_EQUAL(sctx.prev_g, 12);
+  CU_ASSERT_STRING_EQUAL(sctx.prev_s, "string value number 00000003");
+
+  // Skip and limit over merged runs
+  memset(&sctx, 0, sizeof(sctx));
+  ux.cnt = 0;
+  ux.skip = 49990;
+  ux.limit = 5;
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(sctx.cnt, 5);
+  CU_ASSERT_FALSE(sctx.failed);
+  CU_ASSERT_EQUAL(sctx.prev_g, 12);
+  jql_destroy(&q);
+
+  // Documents with equal keys are kept in scan order
+  int64_t cnt, cnt2;
+  IWXSTR *xstr2 = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr2);
+  rc = jql_create(&q, "c1", "/[g = 3]");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_ids(db, q, 0, false, xstr, &cnt, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jql_destroy(&q);
+  rc = jql_create(&q, "c1", "/[g = 3] | asc /g");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_ids(db, q, 0, false, xstr2, &cnt2, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cnt2, cnt);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr2), iwxstr_ptr(xstr));
+  iwxstr_destroy(xstr2);
+  iwxstr_clear(xstr);
+  jql_destroy(&q);
+
+  // Top-K collector returns the same documents as full sort
+  struct {
+    const char *query;
+    int64_t skip;
+    int64_t limit;
+  } topk_queries[] = {
+    { "/* | asc /g desc /s", 7, 20 },
+    { "/* | desc /g", 0, 30 },
+    { "/[g > 10] | asc /s", 2, 1 }
+  };
+  xstr2 = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr2);
+  for (int i = 0; i < sizeof(topk_queries) / sizeof(topk_queries[0]); ++i) {
+    IWXSTR *log = iwxstr_new();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+    rc = jql_create(&q, "c1", topk_queries[i].query);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = exec_ids(db, q, 0, false, xstr, &cnt, log);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[TOPK]"));
+    jql_destroy(&q);
+    iwxstr_clear(log);
+
+    int64_t skip = topk_queries[i].skip, limit = topk_queries[i].limit;
+    snprintf(dbuf, sizeof(dbuf), "%s skip %" PRId64 " limit %" PRId64, topk_queries[i].query, skip, limit);
+    rc = jql_create(&q, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = list_ids(db, q, xstr2, &cnt2, log);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[COLLECTOR] SORTER [TOPK]"));
+    jql_destroy(&q);
+
+    CU_ASSERT_EQUAL(cnt2, limit);
+    // Find `skip` and `skip + limit` records of full sort result
+    const char *sp = iwxstr_ptr(xstr), *ep;
+    for (int64_t j = 0; j < skip; ++j) {
+      sp = strchr(sp, ',') + 1;
+    }
+    ep = sp;
+    for (int64_t j = 0; j < limit; ++j) {
+      ep = strchr(ep, ',') + 1;
+    }
+    CU_ASSERT_EQUAL(iwxstr_size(xstr2), ep - sp);
+    CU_ASSERT_EQUAL(strncmp(iwxstr_ptr(xstr2), sp, ep - sp), 0);
+    iwxstr_destroy(log);
+  }
+
+  // Visitor moving by two records gets every other document of full sort
+  rc = jql_create(&q, "c1", "/* | asc /g desc /s");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_ids(db, q, 0, false, xstr, &cnt, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jql_destroy(&q);
+  rc = jql_create(&q, "c1", "/* | asc /g desc /s skip 7 limit 20");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+  iwxstr_clear(xstr2);
+  EJDB_EXEC ux2 = {
+    .db = db,
+    .q = q,
+    .visitor = ids_step2_visitor,
+    .opaque = xstr2,
+    .log = log
+  };
+  rc = ejdb_exec(&ux2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[TOPK]"));
+  CU_ASSERT_EQUAL(ux2.cnt, 20);
+  jql_destroy(&q);
+  iwxstr_destroy(log);
+  {
+    IWXSTR *xstr3 = iwxstr_new();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(xstr3);
+    const char *sp = iwxstr_ptr(xstr);
+    for (int64_t j = 0; j < 7; ++j) {
+      sp = strchr(sp, ',') + 1;
+    }
+    for (int64_t j = 0; j < 20; ++j) {
+      const char *ep = strchr(sp, ',') + 1;
+      iwxstr_cat(xstr3, sp, ep - sp);
+      sp = strchr(ep, ',') + 1;
+    }
+    CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr2), iwxstr_ptr(xstr3));
+    iwxstr_destroy(xstr3);
+  }
+  iwxstr_destroy(xstr2);
+  iwxstr_clear(xstr);
+
+  // Values of different types are ordered by type, negative numbers first
+  rc = put_json(db, "c2", "{\"v\":\"b\"}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":-2.5}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":true}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":-10}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":\"ab\"}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":3}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":0.5}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{\"v\":null}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = jql_create(&q, "c2", "/* | /v | asc /v");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  EJDB_EXEC ux2 = {
+    .db = db,
+    .q = q,
+    .visitor = projection_visitor,
+    .opaque = xstr
+  };
+  rc = ejdb_exec(&ux2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr),
+                         "{\"v\":null}{\"v\":true}{\"v\":-10}{\"v\":3}{\"v\":-2.5}{\"v\":0.5}{\"v\":\"ab\"}{\"v\":\"b\"}");
+  jql_destroy(&q);
+
+  iwxstr_clear(xstr);
+  rc = jql_create(&q, "c2", "/* | /v | desc /v");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  ux2.q = q;
+  rc = ejdb_exec(&ux2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_STRING_EQUAL(iwxstr_ptr(xstr),
+                         "{\"v\":\"b\"}{\"v\":\"ab\"}{\"v\":0.5}{\"v\":-2.5}{\"v\":3}{\"v\":-10}{\"v\":true}{\"v\":null}");
+  jql_destroy(&q);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(xstr);
+}
+
+void ejdb_test3_15() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_15.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  JBL docs[100], jbl;
+  int64_t ids[100], count = 0;
+  char dbuf[64];
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_UNIQUE | EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < 100; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d,\"v\":\"a%d\"}", i, i);
+    rc = jbl_from_json(&docs[i], dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = ejdb_put_new_batch(db, "c1", docs, 100, ids);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 100; ++i) {
+    CU_ASSERT_EQUAL(ids[i], i + 1);
+  }
+  rc = exec_count(db, "c1", "/[n >= 50] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 50);
+
+  // Update documents in reverse order of ids
+  for (int i = 0; i < 100; ++i) {
+    jbl_destroy(&docs[i]);
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d,\"v\":\"b%d\"}", 100 + i, i);
+    rc = jbl_from_json(&docs[i], dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    ids[i] = 100 - i;
+  }
+  rc = ejdb_put_batch(db, "c1", docs, ids, 100);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[n < 100] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+  rc = exec_count(db, "c1", "/[n >= 150] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 50);
+  rc = exec_count(db, "c1", "/* | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 100);
+  rc = ejdb_get(db, "c1", 100, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  JBL jv;
+  rc = jbl_at(jbl, "/v", &jv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_STRING_EQUAL(jbl_get_str(jv), "b0");
+  jbl_destroy(&jv);
+  jbl_destroy(&jbl);
+
+  // The last document of duplicated id is stored
+  for (int i = 0; i < 4; ++i) {
+    jbl_destroy(&docs[i]);
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d,\"v\":\"c%d\"}", 2000 + i, i);
+    rc = jbl_from_json(&docs[i], dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  ids[0] = 5, ids[1] = 6, ids[2] = 5, ids[3] = 5;
+  rc = ejdb_put_batch(db, "c1", docs, ids, 4);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_get(db, "c1", 5, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_at(jbl, "/v", &jv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_STRING_EQUAL(jbl_get_str(jv), "c3");
+  jbl_destroy(&jv);
+  jbl_destroy(&jbl);
+  rc = exec_count(db, "c1", "/[n >= 2000] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  rc = exec_count(db, "c1", "/* | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 100);
+
+  // Unique index violation stops the batch, previous documents are kept
+  for (int i = 0; i < 3; ++i) {
+    jbl_destroy(&docs[i]);
+  }
+  rc = jbl_from_json(&docs[0], "{\"n\":1000}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_from_json(&docs[1], "{\"n\":150}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_from_json(&docs[2], "{\"n\":1001}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_put_new_batch(db, "c1", docs, 3, ids);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED);
+  CU_ASSERT_EQUAL(ids[0], 101);
+  CU_ASSERT_EQUAL(ids[1], 0);
+  CU_ASSERT_EQUAL(ids[2], 0);
+  rc = exec_count(db, "c1", "/* | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 101);
+  rc = exec_count(db, "c1", "/[n = 1001] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+
+  for (int i = 0; i < 100; ++i) {
+    jbl_destroy(&docs[i]);
+  }
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+struct _IDXBUILDCTX {
+  EJDB db;
+  iwrc rc;
+  volatile bool done;
+};
+
+static void *_ejdb_test3_16_build(void *op) {
+  struct _IDXBUILDCTX *ctx = op;
+  ctx->rc = ejdb_ensure_index_online(ctx->db, "c1", "/n", EJDB_IDX_I64);
+  __atomic_store_n(&ctx->done, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+void ejdb_test3_16() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_16.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  JBL jbl;
+  pthread_t th;
+  int64_t id, count = 0;
+  char dbuf[64];
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 1; i <= 20000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d}", i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Modify collection while index is being built
+  struct _IDXBUILDCTX ctx = {.db = db};
+  int rci = pthread_create(&th, 0, _ejdb_test3_16_build, &ctx);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  int ops = 0;
+  for ( ; ops < 5000 && (ops < 200 || !__atomic_load_n(&ctx.done, __ATOMIC_ACQUIRE)); ++ops) {
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d}", 100000 + ops);
+    rc = jbl_from_json(&jbl, dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = ejdb_put(db, "c1", jbl, 1001 + ops);
+    jbl_destroy(&jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d}", 200000 + ops);
+    id = 0;
+    rc = put_json2(db, "c1", dbuf, &id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (ops < 500) {
+      rc = ejdb_del(db, "c1", ops + 1);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  rci = pthread_join(th, 0);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  CU_ASSERT_EQUAL_FATAL(ctx.rc, 0);
+
+  rc = exec_count(db, "c1", "/[n >= 100000] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2 * ops);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[n <= 1000] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, ops < 500 ? 1000 - ops : 500);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[n > 1000 and n <= 6000] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5000 - ops);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+
+  rc = ejdb_ensure_index_online(db, "c1", "/n", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL(rc, 0);
+
+  // Unique index constraint violation aborts build
+  rc = put_json(db, "c2", "{'n':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{'n':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  // Document with negative id
+  rc = jbl_from_json(&jbl, "{\"n\":-7}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_put(db, "c2", jbl, -7);
+  jbl_destroy(&jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index_online(db, "c2", "/n", EJDB_IDX_UNIQUE | EJDB_IDX_I64);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED);
+  rc = exec_count(db, "c2", "/[n = 1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO"));
+  iwxstr_clear(log);
+  rc = ejdb_ensure_index_online(db, "c2", "/n", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL(rc, 0);
+  rc = exec_count(db, "c2", "/[n = 1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c2", "/[n = -7] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+struct ordered_ctx {
+  int64_t cnt;
+  char prev_s[64];
+  bool failed;
+};
+
+static iwrc ordered_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  struct ordered_ctx *octx = ctx->opaque;
+  JBL js;
+  iwrc rc = jbl_at(doc->raw, "/s", &js);
+  RCRET(rc);
+  const char *s = jbl_get_str(js);
+  if (octx->cnt > 0 && strcmp(s, octx->prev_s) <= 0) {
+    octx->failed = true;
+  }
+  strncpy(octx->prev_s, s, sizeof(octx->prev_s) - 1);
+  ++octx->cnt;
+  jbl_destroy(&js);
+  return 0;
+}
+
+void ejdb_test3_17() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_17.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true,
+    .sort_buffer_sz = 1024 * 1024
+  };
+  EJDB db;
+  JQL q;
+  JBL meta, jbl;
+  int64_t count = 0;
+  char dbuf[1024];
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  // Index records of 40K documents do not fit into 1Mb index load buffer
+  for (int i = 0; i < 40000; ++i) {
+    int k = (int) (((int64_t) i * 104729) % 40000);
+    snprintf(dbuf, sizeof(dbuf),
+             "{\"s\":\"string value number %08d\",\"n\":%d,\"a\":[%d,%d,%d],\"f\":%d.5}",
+             k, k % 100, k % 10, k % 10, -k, k - 20000);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Document with negative id
+  rc = jbl_from_json(&jbl, "{\"s\":\"negative id\",\"n\":-1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_put(db, "c1", jbl, -1);
+  jbl_destroy(&jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Duplicated array elements are indexed once
+  rc = ejdb_ensure_index(db, "c1", "/a", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_get_meta(db, &meta);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_at(meta, "/collections/0/indexes/0/rnum", &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(jbl_get_i64(jbl), 2 * 40000 - 1);
+  jbl_destroy(&jbl);
+  jbl_destroy(&meta);
+
+  rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_UNIQUE | EJDB_IDX_I64);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED);
+  rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/s", EJDB_IDX_UNIQUE | EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/f", EJDB_IDX_F64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = exec_count(db, "c1", "/[n = 42] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 400);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[n = -1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[f >= 100.0 and f < 300.0] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 200);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/a/[** = -39999] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+
+  struct ordered_ctx octx = { 0 };
+  rc = jql_create(&q, "c1", "/[s >= \"string value number 00010000\"] | asc /s");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .visitor = ordered_visitor,
+    .opaque = &octx,
+    .log = log
+  };
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(octx.cnt, 30000);
+  CU_ASSERT_FALSE(octx.failed);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  jql_destroy(&q);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+struct created_ctx {
+  int64_t vals[1024];
+  int64_t cnt;
+};
+
+static iwrc created_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  struct created_ctx *cctx = ctx->opaque;
+  JBL jbl;
+  iwrc rc = jbl_at(doc->raw, "/created", &jbl);
+  RCRET(rc);
+  if (cctx->cnt < sizeof(cctx->vals) / sizeof(cctx->vals[0])) {
+    cctx->vals[cctx->cnt++] = jbl_get_i64(jbl);
+  }
+  jbl_destroy(&jbl);
+  return 0;
+}
+
+static iwrc exec_created(EJDB db, const char *query, struct created_ctx *cctx, IWXSTR *log) {
+  JQL q;
+  cctx->cnt = 0;
+  iwrc rc = jql_create(&q, "c1", query);
+  RCRET(rc);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .visitor = created_visitor,
+    .opaque = cctx,
+    .log = log
+  };
+  rc = ejdb_exec(&ux);
+  jql_destroy(&q);
+  return rc;
+}
+
+void ejdb_test3_18() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_18.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  int64_t id, count = 0;
+  char dbuf[1024];
+  struct created_ctx cctx;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"tenant\":\"t%d\",\"created\":%d}", i % 4, i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  // Not indexed documents
+  rc = put_json(db, "c1", "{'tenant':'t1'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'tenant':'t1','created':[1001]}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/tenant,/created", EJDB_IDX_COMPOSITE | EJDB_IDX_STR);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_MODE);
+  rc = ejdb_ensure_index(db, "c1", "/tenant", EJDB_IDX_COMPOSITE);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+  rc = ejdb_ensure_index(db, "c1", "/tenant,/created", EJDB_IDX_COMPOSITE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/tenant, /created", EJDB_IDX_COMPOSITE | EJDB_IDX_UNIQUE);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_MISMATCHED_INDEX_UNIQUENESS_MODE);
+
+  // Latest documents of tenant served by index scan without sorting
+  rc = exec_created(db, "/[tenant = \"t1\"] and /[created > 500] | desc /created limit 50", &cctx, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cctx.cnt, 50);
+  for (int i = 0; i < cctx.cnt; ++i) {
+    CU_ASSERT_EQUAL(cctx.vals[i], 997 - 4 * i);
+  }
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED COMPOSITE|1000 /tenant,/created"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "ORDERBY"));
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[COLLECTOR] SORTER"));
+  iwxstr_clear(log);
+
+  rc = exec_created(db, "/[tenant = \"t2\"] and /[created <= 102] | asc /created", &cctx, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cctx.cnt, 26);
+  for (int i = 0; i < cctx.cnt; ++i) {
+    CU_ASSERT_EQUAL(cctx.vals[i], 2 + 4 * i);
+  }
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED COMPOSITE"));
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[COLLECTOR] SORTER"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[tenant = \"t0\"] and /[created > 500] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 124);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] ONLY"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[tenant = \"t0\"] and /[created >= 500 and created < 600.5] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 26);
+  rc = exec_count(db, "c1", "/[tenant = \"t3\"] and /[created = 503] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[tenant = \"t1\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 250);
+
+  // Index is maintained on document updates and removals
+  id = 2; // {"tenant":"t1","created":1}
+  rc = put_json2(db, "c1", "{'tenant':'t0','created':1}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_del(db, "c1", 998); // {"tenant":"t1","created":997}
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_created(db, "/[tenant = \"t1\"] | desc /created limit 1", &cctx, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(cctx.cnt, 1);
+  CU_ASSERT_EQUAL(cctx.vals[0], 993);
+  rc = exec_count(db, "c1", "/[tenant = \"t0\"] and /[created < 10] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+
+  // Composite index skipped in favor of full scan by statistics
+  // does not leave its bound expressions prematched
+  rc = ejdb_analyze(db, "c1");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_clear(log);
+  rc = list_count(db, "c1", "/[tenant >= \"t1\"] and /[tenant < \"t3\"]", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 500);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SKIPPED COMPOSITE"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[tenant = \"t2\"] and /[created >= 10] and /[created < 20] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 3);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED COMPOSITE"));
+
+  // Unique composite index
+  rc = put_json(db, "c2", "{'a':1,'b':'x'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{'a':1,'b':'y'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c2", "/a,/b", EJDB_IDX_COMPOSITE | EJDB_IDX_UNIQUE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c2", "{'a':1.0,'b':'x'}");
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_UNIQUE_INDEX_CONSTRAINT_VIOLATED);
+  rc = put_json(db, "c2", "{'a':2,'b':'x'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Composite index keys coerced as JQL equality does
+  rc = put_json(db, "c3", "{'tenant':'5','created':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c3", "{'tenant':6,'created':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c3", "{'tenant':'1.5','created':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c3", "{'tenant':'true','created':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c3", "{'tenant':'05','created':1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c3", "/tenant,/created", EJDB_IDX_COMPOSITE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  const char *cqueries[] = {
+    "/[tenant = 5] and /[created = 1] | count",
+    "/[tenant = \"5\"] and /[created = 1] | count",
+    "/[tenant = 6] and /[created = 1] | count",
+    "/[tenant = \"6\"] and /[created = 1] | count",
+    "/[tenant = 1.5] and /[created = 1] | count",
+    "/[tenant = \"1.5\"] and /[created = 1] | count",
+    "/[tenant = \"true\"] and /[created = 1] | count",
+    "/[tenant = \"05\"] and /[created = 1] | count",
+  };
+  for (int i = 0; i < sizeof(cqueries) / sizeof(cqueries[0]); ++i) {
+    iwxstr_clear(log);
+    rc = exec_count(db, "c3", cqueries[i], &count, log);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED COMPOSITE"));
+  }
+
+  // Range bounds and non canonical numbers are checked against documents
+  const char *cdocs[] = {
+    "{'t':1,'code':'10'}", "{'t':1,'code':'6'}", "{'t':1,'code':'abc'}",
+    "{'t':1,'code':4}", "{'t':1,'code':5}", "{'t':1,'code':7}"
+  };
+  for (int i = 0; i < sizeof(cdocs) / sizeof(cdocs[0]); ++i) {
+    rc = put_json(db, "c4", cdocs[i]);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = ejdb_ensure_index(db, "c4", "/t,/code", EJDB_IDX_COMPOSITE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  struct {
+    const char *query;
+    int64_t count;
+  } crange[] = {
+    { "/[t = 1] and /[code > \"5\"]", 4 },
+    { "/[t = 1] and /[code > 5]", 3 },
+    { "/[t = 1] and /[code = \"5.0\"]", 1 },
+  };
+  for (int i = 0; i < sizeof(crange) / sizeof(crange[0]); ++i) {
+    int64_t scount = -1;
+    char qbuf[128];
+    snprintf(qbuf, sizeof(qbuf), "%s | count noidx", crange[i].query);
+    rc = exec_count(db, "c4", qbuf, &scount, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(scount, crange[i].count);
+    iwxstr_clear(log);
+    rc = list_count(db, "c4", crange[i].query, &count, log);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, crange[i].count);
+    CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED COMPOSITE"));
+  }
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Composite index is loaded on reopen
+  opts.kv.oflags = 0;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[tenant = \"t0\"] and /[created < 10] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED COMPOSITE"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c2", "/[a = 1] and /[b = \"y\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED UNIQUE|COMPOSITE"));
+  rc = ejdb_remove_index(db, "c1", "/tenant,/created", EJDB_IDX_COMPOSITE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[tenant = \"t0\"] and /[created < 10] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+void ejdb_test3_19() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_19.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  int64_t id, count = 0;
+  char dbuf[1024];
+  const char *statuses[] = { "open", "pending", "closed" };
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d,\"x\":%d,\"deleted\":%s,\"status\":\"%s\"}",
+             i, i % 7, (i % 10) ? "true" : "false", statuses[i % 3]);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  rc = ejdb_ensure_index2(db, "c1", "/x", EJDB_IDX_I64, "/[deleted = false] | limit 1");
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_FILTER);
+  rc = ejdb_ensure_index2(db, "c1", "/x", EJDB_IDX_I64, "/[deleted = :?]");
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_FILTER);
+  rc = ejdb_ensure_index2(db, "c1", "/x", EJDB_IDX_I64, "/[deleted = false]");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/x", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_MISMATCHED_INDEX_FILTER);
+  rc = ejdb_ensure_index2(db, "c1", "/n", EJDB_IDX_I64 | EJDB_IDX_UNIQUE, "/[status in [\"open\",\"pending\"]]");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Query filter implies index filter
+  rc = exec_count(db, "c1", "/[deleted = false] and /[x = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 15);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|100 /x FILTER: '/[deleted = false]'"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[x = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 143);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[deleted = true] and /[x = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 128);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[status = \"open\"] and /[n < 30] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED UNIQUE|I64|667 /n"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[status in [\"pending\",\"open\"]] and /[n < 30] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 20);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED UNIQUE|I64|667 /n"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[status in [\"open\",\"closed\"]] and /[n < 30] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 20);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+
+  // Index used to avoid sorting
+  rc = exec_count(db, "c1", "/[deleted = false] | asc /x", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 100);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|100 /x"));
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[COLLECTOR] SORTER"));
+  iwxstr_clear(log);
+
+  // Index is maintained when documents start or stop matching index filter
+  id = 4; // {"n":3,"x":3,"deleted":true}
+  rc = put_json2(db, "c1", "{'n':3,'x':3,'deleted':false}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  id = 11; // {"n":10,"x":3,"deleted":false}
+  rc = put_json2(db, "c1", "{'n':10,'x':3,'deleted':true}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  id = 81; // {"n":80,"x":3,"deleted":false}
+  rc = ejdb_del(db, "c1", id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[deleted = false] and /[x = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 14);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|99 /x"));
+  iwxstr_clear(log);
+
+  // Range of query is within range of index filter
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"a\":%d,\"b\":%d}", i, i % 5);
+    rc = put_json(db, "c2", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = ejdb_ensure_index2(db, "c2", "/b", EJDB_IDX_I64, "/[a >= 100]");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Partial indexes are loaded on reopen
+  opts.kv.oflags = 0;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c2", "/[a > 200] and /[b = 1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 160);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|900 /b FILTER: '/[a >= 100]'"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c2", "/[a > 50] and /[b = 1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 190);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  // String "2" is greater than number 100 in JQL, but matches number 2 outside of filter
+  rc = exec_count(db, "c2", "/[a = \"2\"] and /[b = 2] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[deleted = false] and /[x = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 14);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|99 /x FILTER: '/[deleted = false]'"));
+
+  rc = ejdb_remove_index(db, "c1", "/x", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/x", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL(rc, 0);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+void ejdb_test3_20() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_20.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  int64_t id, count = 0;
+  IWXSTR *log = iwxstr_new();
+  IWXSTR *xstr = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  iwxstr_cat2(xstr, "{\"tags\":[");
+  for (int i = 0; i < 500; ++i) {
+    iwxstr_printf(xstr, "%s\"t%d\"", i ? "," : "", i);
+  }
+  iwxstr_cat2(xstr, "]}");
+  rc = put_json2(db, "c1", iwxstr_ptr(xstr), &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/tags", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Append element
+  iwxstr_pop(xstr, 2);
+  iwxstr_cat2(xstr, ",\"t500\"]}");
+  rc = put_json2(db, "c1", iwxstr_ptr(xstr), &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/tags/[** = \"t500\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|501 /tags"));
+  iwxstr_clear(log);
+
+  // Remove element and add duplicate of existing one
+  iwxstr_clear(xstr);
+  iwxstr_cat2(xstr, "{\"tags\":[");
+  for (int i = 1; i <= 500; ++i) {
+    iwxstr_printf(xstr, "\"t%d\",", i);
+  }
+  iwxstr_cat2(xstr, "\"t1\"]}");
+  rc = put_json2(db, "c1", iwxstr_ptr(xstr), &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/tags/[** = \"t0\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|500 /tags"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/tags/[** = \"t1\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+
+  // Array replaced by scalar value and back
+  rc = put_json2(db, "c1", "{'tags':'t7'}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[tags = \"t7\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|1 /tags"));
+  iwxstr_clear(log);
+  rc = put_json2(db, "c1", "{'tags':['t7','t8']}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/tags/[** = \"t8\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|2 /tags"));
+  iwxstr_clear(log);
+
+  // Elements of different types with the same key
+  rc = ejdb_ensure_index(db, "c1", "/nums", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json2(db, "c1", "{'nums':[1, 2.0, '3', 3, {'a':1}]}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/nums/[** = 3] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|3 /nums"));
+  iwxstr_clear(log);
+  rc = put_json2(db, "c1", "{'nums':[3, 1]}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/nums/[** = 1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|2 /nums"));
+  iwxstr_clear(log);
+
+  rc = ejdb_del(db, "c1", id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/nums/[** = 1] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|0 /nums"));
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+  iwxstr_destroy(xstr);
+}
+
+void ejdb_test3_21() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_21.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  char dbuf[256];
+  int64_t count = 0;
+  EJDB_LIST list = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/f", EJDB_IDX_F64B | EJDB_IDX_F64);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_MODE);
+  rc = ejdb_ensure_index(db, "c1", "/f", EJDB_IDX_F64B | EJDB_IDX_COMPOSITE);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_MODE);
+
+  for (int i = -50; i < 50; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"f\":%.17g,\"g\":%.17g}", i + 0.5, i + 0.5);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = put_json(db, "c1", "{'f':1.0000001,'g':1.0000001}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'f':1.0000002,'g':1.0000002}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'f':-0.0,'g':-0.0}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/f", EJDB_IDX_F64B);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/g", EJDB_IDX_F64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Numbers are indexed without loss of precision
+  rc = exec_count(db, "c1", "/[f = 1.0000001] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED F64B|103 /f"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[f > 1.0000001] and /[f < 1.5] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED F64B|103 /f"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[f = 0] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[f >= -10] and /[f < 10] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 23);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED F64B|103 /f"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[f in [-49.5, 0, 49.5, 7]] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 3);
+
+  // Negative and positive numbers are ordered by index
+  rc = ejdb_list3(db, "c1", "/[f < 0] | desc /f", 0, log, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED F64B|103 /f"));
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[COLLECTOR] SORTER"));
+  count = 0;
+  double prev = 0;
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++count) {
+    JBL jbl;
+    double v = 0;
+    rc = jbl_at(doc->raw, "/f", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    v = jbl_get_f64(jbl);
+    jbl_destroy(&jbl);
+    CU_ASSERT_TRUE(v < 0);
+    if (count) {
+      CU_ASSERT_TRUE(v < prev);
+    }
+    prev = v;
+  }
+  CU_ASSERT_EQUAL(count, 50);
+  ejdb_list_destroy(&list);
+  iwxstr_clear(log);
+
+  // Migrate string keys index
+  rc = ejdb_migrate_index(db, "c1", "/g", EJDB_IDX_F64, EJDB_IDX_F64);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_MODE);
+  rc = ejdb_migrate_index(db, "c1", "/g", EJDB_IDX_F64, EJDB_IDX_F64B);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_migrate_index(db, "c1", "/g", EJDB_IDX_F64, EJDB_IDX_F64B);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[g = 1.0000002] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED F64B|103 /g"));
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] MATCHED  F64|"));
+  iwxstr_clear(log);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.kv.oflags = 0;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'g':-1e300}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[g < -100] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED F64B|104 /g"));
+  iwxstr_clear(log);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+void ejdb_test3_22() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_22.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  int64_t id = 0, count = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_ensure_index(db, "c1", "/t", EJDB_IDX_FTS | EJDB_IDX_STR);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_MODE);
+  rc = ejdb_ensure_index(db, "c1", "/t", EJDB_IDX_FTS | EJDB_IDX_UNIQUE);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_INVALID_INDEX_MODE);
+
+  rc = put_json2(db, "c1", "{'t':'The quick brown fox jumps over the lazy dog'}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'t':'Quick brown dogs, quick cats!'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'t':'Ünïcode ТЕКСТ and Straße'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'t':['red fox', 'blue whale']}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Existing documents are indexed on index creation
+  rc = ejdb_ensure_index(db, "c1", "/t", EJDB_IDX_FTS);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = put_json(db, "c1", "{'t':'Foxes are quick'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'t':42}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = put_json(db, "c1", "{'n':'quick'}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = exec_count(db, "c1", "/[t ft quick] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 3);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED FTS|"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[t ft \"quick brown\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED FTS|"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[t ft fox*] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 3);
+  rc = exec_count(db, "c1", "/[t ft \"QUICK Fox*\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  rc = exec_count(db, "c1", "/[t ft \"ÜNÏCODE текст\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[t ft \"red whale\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[t ft \"quick zebra\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+
+  // Full-text index is not used by other operators
+  rc = exec_count(db, "c1", "/[t = 42] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+
+  // Only changed words are reindexed
+  rc = patch_json(db, "c1", "[{'op':'replace', 'path':'/t', 'value':'The slow brown fox'}]", id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[t ft \"quick brown\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[t ft \"slow fox\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[t ft lazy] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+
+  rc = ejdb_del(db, "c1", id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[t ft fox*] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.kv.oflags = 0;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = exec_count(db, "c1", "/[t ft brown] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED FTS|"));
+  iwxstr_clear(log);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+void ejdb_test3_23() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_23.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  int64_t count = 0;
+  EJDB_LIST list = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/name", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/code", EJDB_IDX_STR | EJDB_IDX_UNIQUE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  const char *names[] = { "aa", "ab", "abc", "abd", "abz", "a.b", "a.bc", "ac", "b", "bab", "aaab" };
+  for (int i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    char dbuf[64];
+    snprintf(dbuf, sizeof(dbuf), "{'name':'%s','code':'%s'}", names[i], names[i]);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = put_json(db, "c1", "{'name':1234}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = exec_count(db, "c1", "/[name re \"^ab\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|12 /name EXPR1: 'name re \"^ab\"' PREFIX: 'ab'"));
+  iwxstr_clear(log);
+
+  // Regular expression is still applied to documents of scanned range
+  rc = exec_count(db, "c1", "/[name re \"^ab[cz]$\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "PREFIX: 'ab'"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[name re \"^abc?\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "PREFIX: 'ab'"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[name re \"^a\\\\.b\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "PREFIX: 'a.b'"));
+  iwxstr_clear(log);
+
+  // Not anchored expressions and expressions without literal prefix are not served by index
+  rc = exec_count(db, "c1", "/[name re \"abc\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[name re \"^.b\"] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED"));
+  iwxstr_clear(log);
+
+  rc = exec_count(db, "c1", "/[name sw ab] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED STR|12 /name EXPR1: 'name sw ab' PREFIX: 'ab'"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[name sw \"12\"] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+  rc = exec_count(db, "c1", "/[code sw a.] | count", &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 2);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED UNIQUE|STR|11 /code"));
+  iwxstr_clear(log);
+  rc = exec_count(db, "c1", "/[name sw ab and name < abz] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 3);
+
+  // Prefix scan returns documents ordered by index
+  rc = ejdb_list3(db, "c1", "/[name sw a] | asc /name", 0, log, &list);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "PREFIX: 'a'"));
+  CU_ASSERT_PTR_NULL(strstr(iwxstr_ptr(log), "[COLLECTOR] SORTER"));
+  count = 0;
+  const char *expected[] = { "a.b", "a.bc", "aa", "aaab", "ab", "abc", "abd", "abz", "ac" };
+  for (EJDB_DOC doc = list->first; doc; doc = doc->next, ++count) {
+    JBL jbl;
+    rc = jbl_at(doc->raw, "/name", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (count < sizeof(expected) / sizeof(expected[0])) {
+      CU_ASSERT_STRING_EQUAL(jbl_get_str(jbl), expected[count]);
+    }
+    jbl_destroy(&jbl);
+  }
+  CU_ASSERT_EQUAL(count, 9);
+  ejdb_list_destroy(&list);
+  iwxstr_clear(log);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+// Builds `in` query over `field` with values `from, from + step, ...` followed by `tail` values
+static IWXSTR *in_query(const char *field, int64_t num, int64_t from, int64_t step, const char *tail) {
+  IWXSTR *xstr = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(xstr);
+  iwxstr_printf(xstr, "/[%s in [", field);
+  for (int64_t i = 0; i < num; ++i) {
+    iwxstr_printf(xstr, i ? ",%" PRId64 : "%" PRId64, from + i * step);
+  }
+  iwxstr_printf(xstr, "%s]]", tail);
+  return xstr;
+}
+
+void ejdb_test3_24() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_24.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  int64_t count = 0;
+  IWXSTR *log = iwxstr_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(log);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_I64 | EJDB_IDX_UNIQUE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/g", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 5000; ++i) {
+    char dbuf[64];
+    snprintf(dbuf, sizeof(dbuf), "{'n':%d,'g':%d}", i, i % 1000);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Without index statistics large arrays fall back to full scan
+  IWXSTR *q = in_query("n", 1000, 0, 1, "");
+  rc = list_count(db, "c1", iwxstr_ptr(q), &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1000);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO"));
+  iwxstr_destroy(q);
+  iwxstr_clear(log);
+
+  q = in_query("g", 100, 0, 1, "");
+  rc = list_count(db, "c1", iwxstr_ptr(q), &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 500);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] NO"));
+  iwxstr_destroy(q);
+  iwxstr_clear(log);
+
+  rc = ejdb_analyze(db, "c1");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Large array is matched by single pass over index
+  q = in_query("n", 10000, 0, 3, ",3,6,-1");
+  iwxstr_cat2(q, " | count");
+  rc = exec_count(db, "c1", iwxstr_ptr(q), &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1667);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED UNIQUE|I64|5000 /n EXPR1: 'n in"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] IN PROBE 10001"));
+  iwxstr_destroy(q);
+  iwxstr_clear(log);
+
+  q = in_query("n", 20, 4990, 1, "");
+  rc = list_count(db, "c1", iwxstr_ptr(q), &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] IN SEEK 20"));
+  iwxstr_destroy(q);
+  iwxstr_clear(log);
+
+  // Non unique index
+  q = in_query("g", 100, 0, 1, ",5,99");
+  rc = list_count(db, "c1", iwxstr_ptr(q), &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 500);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] SELECTED I64|5000 /g EXPR1: 'g in"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] IN SEEK 100"));
+  iwxstr_destroy(q);
+  iwxstr_clear(log);
+
+  q = in_query("g", 100, 0, 7, "");
+  iwxstr_cat2(q, " | limit 7");
+  rc = list_count(db, "c1", iwxstr_ptr(q), &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 7);
+  iwxstr_destroy(q);
+
+  q = in_query("g", 2000, -500, 1, "");
+  iwxstr_cat2(q, " | count");
+  rc = exec_count(db, "c1", iwxstr_ptr(q), &count, log);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 5000);
+  CU_ASSERT_PTR_NOT_NULL(strstr(iwxstr_ptr(log), "[INDEX] IN PROBE 2000"));
+  iwxstr_destroy(q);
+  iwxstr_clear(log);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwxstr_destroy(log);
+}
+
+struct snapshot_check {
+  const char *query;
+  int64_t count;
+};
+
+struct snapshot_ctx {
+  EJDB db;
+  int64_t visits;
+  const struct snapshot_check *checks;
+};
+
+// Reads collection while document modification made by writer is not finished
+static iwrc snapshot_visitor(struct _EJDB_EXEC *ctx, EJDB_DOC doc, int64_t *step) {
+  JBL jbl, jbv;
+  int64_t count;
+  struct snapshot_ctx *sctx = ctx->opaque;
+  if (sctx->visits++) {
+    return 0;
+  }
+  for (const struct snapshot_check *c = sctx->checks; c->query; ++c) {
+    iwrc rc = exec_count(sctx->db, "c1", c->query, &count, 0);
+    CU_ASSERT_EQUAL(rc, 0);
+    CU_ASSERT_EQUAL(count, c->count);
+  }
+  iwrc rc = list_count(sctx->db, "c1", "/[n >= 0] | asc /n", &count, 0);
+  CU_ASSERT_EQUAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+
+  rc = ejdb_get(sctx->db, "c1", doc->id, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_at(jbl, "/v", &jbv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(jbl_get_i64(jbv), 1);
+  jbl_destroy(&jbv);
+  jbl_destroy(&jbl);
+  return 0;
+}
+
+void ejdb_test3_25() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_25.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true,
+    .snapshot_reads = true
+  };
+  EJDB db;
+  JQL q;
+  int64_t count = 0;
+  char dbuf[64];
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_I64 | EJDB_IDX_UNIQUE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 10; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{'n':%d,'v':1}", i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Readers called from visitor of writer holding the collection write lock
+  // see collection state before the writer started
+  const struct snapshot_check update_checks[] = {
+    { "/[v = 1] | count", 10 },
+    { "/[v = 2] | count", 0  },
+    { "/[n = 3] | count", 1  },
+    { "/[n = 3] and /[v = 1] | count", 1 },
+    { 0 }
+  };
+  struct snapshot_ctx sctx = {
+    .db = db,
+    .checks = update_checks
+  };
+  rc = jql_create(&q, "c1", "/[n = 3] | apply {\"v\":2}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  EJDB_EXEC ux = {
+    .db = db,
+    .q = q,
+    .visitor = snapshot_visitor,
+    .opaque = &sctx
+  };
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(sctx.visits, 1);
+  jql_destroy(&q);
+
+  rc = exec_count(db, "c1", "/[v = 2] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 1);
+
+  const struct snapshot_check del_checks[] = {
+    { "/* | count", 10 },
+    { "/[n = 5] | count", 1 },
+    { "/[n >= 4] | count", 6 },
+    { "/[v = 1] | limit 4", 4 },
+    { 0 }
+  };
+  sctx.visits = 0;
+  sctx.checks = del_checks;
+  rc = jql_create(&q, "c1", "/[n = 5] | del");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  ux = (EJDB_EXEC) {
+    .db = db,
+    .q = q,
+    .visitor = snapshot_visitor,
+    .opaque = &sctx
+  };
+  rc = ejdb_exec(&ux);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(sctx.visits, 1);
+  jql_destroy(&q);
+
+  rc = exec_count(db, "c1", "/* | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 9);
+  rc = exec_count(db, "c1", "/[n = 5] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 0);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+struct _COLLREADCTX {
+  EJDB db;
+  iwrc rc;
+  int64_t found;
+};
+
+static void *_ejdb_test3_26_read(void *op) {
+  struct _COLLREADCTX *ctx = op;
+  for (int i = 0; i < 2000 && !ctx->rc; ++i) {
+    JBL jbl;
+    iwrc rc = ejdb_get(ctx->db, "c1", i % 10 + 1, &jbl);
+    if (!rc) {
+      ++ctx->found;
+      jbl_destroy(&jbl);
+    } else {
+      ctx->rc = rc;
+    }
+  }
+  return 0;
+}
+
+void ejdb_test3_26() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_26.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  EJDB_COLL coll, coll2;
+  JBL jbl;
+  pthread_t th[4];
+  char dbuf[64];
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 10; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "{\"n\":%d}", i);
+    rc = put_json(db, "c1", dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Collections are created and removed while readers look up collection by name
+  struct _COLLREADCTX ctx[4] = { 0 };
+  for (int i = 0; i < 4; ++i) {
+    ctx[i].db = db;
+    int rci = pthread_create(&th[i], 0, _ejdb_test3_26_read, &ctx[i]);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < 50; ++i) {
+    snprintf(dbuf, sizeof(dbuf), "t%d", i);
+    rc = ejdb_ensure_collection(db, dbuf);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (i % 2) {
+      rc = ejdb_remove_collection(db, dbuf);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  for (int i = 0; i < 4; ++i) {
+    pthread_join(th[i], 0);
+    CU_ASSERT_EQUAL(ctx[i].rc, 0);
+    CU_ASSERT_EQUAL(ctx[i].found, 2000);
+  }
+
+  rc = ejdb_coll_handle(db, "c1", &coll);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_handle(db, "c1", &coll2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_EQUAL(coll, coll2);
+
+  rc = jbl_from_json(&jbl, "{\"n\":100}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_put(coll, jbl, 100);
+  jbl_destroy(&jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_get(db, "c1", 100, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jbl_destroy(&jbl);
+  rc = ejdb_coll_get(coll, 100, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jbl_destroy(&jbl);
+  rc = ejdb_coll_del(coll, 100);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_get(coll, 100, &jbl);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+
+  // Handle follows renamed collection
+  rc = ejdb_rename_collection(db, "c1", "c2");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_get(coll, 1, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jbl_destroy(&jbl);
+  rc = ejdb_get(db, "c2", 1, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jbl_destroy(&jbl);
+  rc = ejdb_get(db, "c1", 1, &jbl);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+
+  rc = ejdb_remove_collection(db, "c2");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_get(coll, 1, &jbl);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_COLLECTION_NOT_FOUND);
+  rc = ejdb_coll_del(coll, 1);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_COLLECTION_NOT_FOUND);
+  rc = ejdb_get(db, "c2", 1, &jbl);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+
+  // Removed collection is released with its last handle
+  ejdb_coll_handle_release(&coll);
+  CU_ASSERT_PTR_NULL(coll);
+  rc = ejdb_coll_get(coll2, 1, &jbl);
+  CU_ASSERT_EQUAL(rc, EJDB_ERROR_COLLECTION_NOT_FOUND);
+  ejdb_coll_handle_release(&coll2);
+
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+struct _PUTNEWCTX {
+  EJDB db;
+  EJDB_COLL coll;
+  int n;
+  iwrc rc;
+  int64_t ids[500];
+};
+
+static void *_ejdb_test3_27_put(void *op) {
+  char dbuf[64];
+  struct _PUTNEWCTX *ctx = op;
+  for (int i = 0; i < 500 && !ctx->rc; ++i) {
+    JBL jbl;
+    snprintf(dbuf, sizeof(dbuf), "{\"t\":%d,\"i\":%d}", ctx->n, i);
+    ctx->rc = jbl_from_json(&jbl, dbuf);
+    if (ctx->rc) break;
+    if (i % 2) {
+      ctx->rc = ejdb_coll_put_new(ctx->coll, jbl, &ctx->ids[i]);
+    } else {
+      ctx->rc = ejdb_put_new(ctx->db, "c1", jbl, &ctx->ids[i]);
+    }
+    jbl_destroy(&jbl);
+  }
+  return 0;
+}
+
+static int _ejdb_test3_27_id_cmp(const void *o1, const void *o2) {
+  int64_t v1 = *(const int64_t *) o1, v2 = *(const int64_t *) o2;
+  return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+void ejdb_test3_27() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_27.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  EJDB_COLL coll;
+  JBL jbl;
+  pthread_t th[4];
+  int64_t id, count = 0;
+  int64_t *ids = malloc(4 * 500 * sizeof(ids[0]));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(ids);
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/i", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_handle(db, "c1", &coll);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  struct _PUTNEWCTX *ctx = calloc(4, sizeof(*ctx));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+  for (int i = 0; i < 4; ++i) {
+    ctx[i].db = db;
+    ctx[i].coll = coll;
+    ctx[i].n = i;
+    int rci = pthread_create(&th[i], 0, _ejdb_test3_27_put, &ctx[i]);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < 4; ++i) {
+    pthread_join(th[i], 0);
+    CU_ASSERT_EQUAL(ctx[i].rc, 0);
+    memcpy(ids + i * 500, ctx[i].ids, sizeof(ctx[i].ids));
+  }
+  // Every document got unique id from the same sequence
+  qsort(ids, 4 * 500, sizeof(ids[0]), _ejdb_test3_27_id_cmp);
+  for (int i = 0; i < 4 * 500; ++i) {
+    CU_ASSERT_EQUAL(ids[i], i + 1);
+  }
+  rc = exec_count(db, "c1", "/[i = 7] | count", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 4);
+
+  // Sequence continues after document stored with explicit id
+  rc = jbl_from_json(&jbl, "{\"i\":-1}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_put(coll, jbl, 3000);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_put_new(coll, jbl, &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(id, 3001);
+  jbl_destroy(&jbl);
+
+  // Id allocated before document of the same explicit id is stored is skipped
+  rc = jbl_from_json(&jbl, "{\"i\":-2}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_put(coll, jbl, 3002);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  jbl_destroy(&jbl);
+  __atomic_store_n(&coll->id_seq, 3001, __ATOMIC_RELAXED);
+  rc = jbl_from_json(&jbl, "{\"i\":-3}");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_coll_put_new(coll, jbl, &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(id, 3003);
+  jbl_destroy(&jbl);
+  rc = ejdb_coll_get(coll, 3002, &jbl);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_object_get_i64(jbl, "i", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(id, -2);
+  jbl_destroy(&jbl);
+
+  free(ctx);
+  free(ids);
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static int64_t _ejdb_test3_28_stat(EJDB db, const char *name) {
+  JBL meta, jbl;
+  char path[64];
+  int64_t ret = -1;
+  snprintf(path, sizeof(path), "/collections/0/cache/%s", name);
+  iwrc rc = ejdb_get_meta(db, &meta);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_at(meta, path, &jbl);
+  if (!rc) {
+    ret = jbl_get_i64(jbl);
+    jbl_destroy(&jbl);
+  }
+  jbl_destroy(&meta);
+  return ret;
+}
+
+void ejdb_test3_28() {
+  for (int m = 0; m < 2; ++m) {
+    EJDB_OPTS opts = {
+      .kv = {
+        .path = "ejdb_test3_28.db",
+        .oflags = IWKV_TRUNC
+      },
+      .no_wal = true,
+      .snapshot_reads = m,
+      .document_cache_sz = 8 * 1024
+    };
+    EJDB db;
+    JBL jbl, jbl1, jbl2;
+    int64_t id = 0, count = 0;
+    char dbuf[64];
+
+    iwrc rc = ejdb_open(&opts, &db);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_I64);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = put_json2(db, "c1", "{'n':1,'v':'first'}", &id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+    rc = ejdb_get(db, "c1", id, &jbl1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = ejdb_get(db, "c1", id, &jbl2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(_ejdb_test3_28_stat(db, "misses"), 1);
+    CU_ASSERT_EQUAL(_ejdb_test3_28_stat(db, "hits"), 1);
+    CU_ASSERT_EQUAL(_ejdb_test3_28_stat(db, "num"), 1);
+    jbl_destroy(&jbl2);
+
+    // Document update invalidates cached document but not documents returned before
+    rc = jbl_from_json(&jbl, "{\"n\":2,\"v\":\"second\"}");
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = ejdb_put(db, "c1", jbl, id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    jbl_destroy(&jbl);
+    CU_ASSERT_EQUAL(_ejdb_test3_28_stat(db, "num"), 0);
+    rc = ejdb_get(db, "c1", id, &jbl2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = jbl_at(jbl2, "/n", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(jbl_get_i64(jbl), 2);
+    jbl_destroy(&jbl);
+    rc = jbl_at(jbl1, "/v", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_STRING_EQUAL(jbl_get_str(jbl), "first");
+    jbl_destroy(&jbl);
+    jbl_destroy(&jbl1);
+    jbl_destroy(&jbl2);
+
+    // Index lookups of queries use the same cache
+    rc = list_count(db, "c1", "/[n = 2]", &count, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT_EQUAL(_ejdb_test3_28_stat(db, "hits"), 2);
+    rc = exec_count(db, "c1", "/[v = second]", &count, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, 1);
+
+    rc = ejdb_del(db, "c1", id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(_ejdb_test3_28_stat(db, "num"), 0);
+    rc = ejdb_get(db, "c1", id, &jbl);
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    rc = list_count(db, "c1", "/[n = 2]", &count, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, 0);
+
+    // Cache size is bounded, documents referenced by application survive eviction
+    id = 0;
+    rc = put_json2(db, "c1", "{'n':-1}", &id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = ejdb_get(db, "c1", id, &jbl1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    for (int i = 0; i < 500; ++i) {
+      snprintf(dbuf, sizeof(dbuf), "{\"n\":%d,\"s\":\"document number %d\"}", i, i);
+      id = 0;
+      rc = put_json2(db, "c1", dbuf, &id);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = ejdb_get(db, "c1", id, &jbl);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      jbl_destroy(&jbl);
+    }
+    CU_ASSERT_TRUE(_ejdb_test3_28_stat(db, "size") <= 8 * 1024);
+    CU_ASSERT_TRUE(_ejdb_test3_28_stat(db, "num") < 500);
+    rc = jbl_at(jbl1, "/n", &jbl);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(jbl_get_i64(jbl), -1);
+    jbl_destroy(&jbl);
+    jbl_destroy(&jbl1);
+
+    rc = exec_count(db, "c1", "/[n >= 0] | count", &count, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(count, 500);
+
+    rc = ejdb_close(&db);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+}
+
+static iwrc _ejdb_test3_29_check(EJDB db, int64_t id, int n) {
+  JBL jbl, jbl2;
+  char buf[32];
+  iwrc rc = ejdb_get(db, "c1", id, &jbl);
+  RCRET(rc);
+  rc = jbl_at(jbl, "/n", &jbl2);
+  if (!rc) {
+    CU_ASSERT_EQUAL(jbl_get_i64(jbl2), n);
+    jbl_destroy(&jbl2);
+    rc = jbl_at(jbl, "/host", &jbl2);
+  }
+  if (!rc) {
+    snprintf(buf, sizeof(buf), "node-%d.cluster.local", n % 10);
+    CU_ASSERT_STRING_EQUAL(jbl_get_str(jbl2), buf);
+    jbl_destroy(&jbl2);
+  }
+  jbl_destroy(&jbl);
+  return rc;
+}
+
+static int64_t _ejdb_test3_29_mode(EJDB db) {
+  JBL meta, jbl;
+  int64_t ret = -1;
+  iwrc rc = ejdb_get_meta(db, &meta);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = jbl_at(meta, "/collections/0/compression", &jbl);
+  if (!rc) {
+    ret = jbl_get_i64(jbl);
+    jbl_destroy(&jbl);
+  }
+  jbl_destroy(&meta);
+  return ret;
+}
+
+void ejdb_test3_29() {
+  EJDB_OPTS opts = {
+    .kv = {
+      .path = "ejdb_test3_29.db",
+      .oflags = IWKV_TRUNC
+    },
+    .no_wal = true
+  };
+  EJDB db;
+  JBL jbl;
+  int64_t id, count = 0, ids[300];
+  char dbuf[512];
+
+  iwrc rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_ensure_index(db, "c1", "/level", EJDB_IDX_STR);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 300; ++i) {
+    snprintf(dbuf, sizeof(dbuf),
+             "{\"n\":%d,\"level\":\"%s\",\"host\":\"node-%d.cluster.local\","
+             "\"service\":\"storage-gateway\",\"message\":\"Request processed successfully\","
+             "\"tags\":[\"production\",\"eu-west\",\"storage\"]}",
+             i, (i % 3) ? "info" : "warn", i % 10);
+    id = 0;
+    rc = put_json2(db, "c1", dbuf, &id);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    ids[i] = id;
+  }
+  CU_ASSERT_EQUAL(_ejdb_test3_29_mode(db), EJDB_COMPRESS_NONE);
+
+  rc = ejdb_compress_collection(db, "c1", EJDB_COMPRESS_LZ_DICT);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_ejdb_test3_29_mode(db), EJDB_COMPRESS_LZ_DICT);
+  rc = ejdb_compress_collection(db, "c2", EJDB_COMPRESS_LZ);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_NOT_EXISTS);
+
+  for (int i = 0; i < 300; i += 7) {
+    rc = _ejdb_test3_29_check(db, ids[i], i);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = list_count(db, "c1", "/[level = warn]", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 100);
+  rc = list_count(db, "c1", "/[n >= 150]", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 150);
+  rc = list_count(db, "c1", "/[level = info] | desc /n", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 200);
+
+  // New documents, updates and removals keep indexes consistent
+  id = 0;
+  rc = put_json2(db, "c1", "{'n':300,'level':'warn','host':'node-0.cluster.local'}", &id);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _ejdb_test3_29_check(db, id, 300);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_patch(db, "c1", "[{\"op\":\"replace\", \"path\":\"/level\", \"value\":\"info\"}]", ids[0]);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_del(db, "c1", ids[3]);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = list_count(db, "c1", "/[level = warn]", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 99);
+  rc = _ejdb_test3_29_check(db, ids[0], 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Index built over compressed documents
+  rc = ejdb_ensure_index(db, "c1", "/n", EJDB_IDX_I64);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = list_count(db, "c1", "/[n > 290]", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 10);
+
+  // Compression settings and dictionary are persistent
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  opts.kv.oflags = 0;
+  rc = ejdb_open(&opts, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_ejdb_test3_29_mode(db), EJDB_COMPRESS_LZ_DICT);
+  rc = _ejdb_test3_29_check(db, ids[100], 100);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = ejdb_compress_collection(db, "c1", EJDB_COMPRESS_LZ);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _ejdb_test3_29_check(db, ids[200], 200);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_compress_collection(db, "c1", EJDB_COMPRESS_NONE);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_ejdb_test3_29_mode(db), EJDB_COMPRESS_NONE);
+  rc = list_count(db, "c1", "/[n >= 0]", &count, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(count, 300);
+  rc = ejdb_get(db, "c1", ids[3], &jbl);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+
+  rc = ejdb_remove_collection(db, "c1");
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = ejdb_close(&db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
 int main() {
   CU_pSuite pSuite = NULL;
   if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
@@ -1043,7 +3861,29 @@ int main() {
     (NULL == CU_add_test(pSuite, "ejdb_test3_4", ejdb_test3_4)) ||
     (NULL == CU_add_test(pSuite, "ejdb_test3_5", ejdb_test3_5)) ||
     (NULL == CU_add_test(pSuite, "ejdb_test3_6", ejdb_test3_6)) ||
-    (NULL == CU_add_test(pSuite, "ejdb_test3_7", ejdb_test3_7))
+    (NULL == CU_add_test(pSuite, "ejdb_test3_7", ejdb_test3_7)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_8", ejdb_test3_8)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_9", ejdb_test3_9)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_10", ejdb_test3_10)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_11", ejdb_test3_11)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_12", ejdb_test3_12)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_13", ejdb_test3_13)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_14", ejdb_test3_14)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_15", ejdb_test3_15)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_16", ejdb_test3_16)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_17", ejdb_test3_17)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_18", ejdb_test3_18)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_19", ejdb_test3_19)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_20", ejdb_test3_20)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_21", ejdb_test3_21)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_22", ejdb_test3_22)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_23", ejdb_test3_23)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_24", ejdb_test3_24)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_25", ejdb_test3_25)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_26", ejdb_test3_26)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_27", ejdb_test3_27)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_28", ejdb_test3_28)) ||
+    (NULL == CU_add_test(pSuite, "ejdb_test3_29", ejdb_test3_29))
   ) {
     CU_cleanup_registry();
     return CU_get_error();
@@ -0,0 +1,214 @@
+#include "lzb.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LZB_MINMATCH     4
+#define LZB_LASTLITERALS 5       // The last bytes of block are always literals
+#define LZB_MFLIMIT      12      // The last match starts at least this number of bytes before end of block
+#define LZB_MAX_DISTANCE 65535
+#define LZB_HASH_LOG     12
+#define LZB_HASH_SIZE    (1U << LZB_HASH_LOG)
+
+struct LZB_DICT {
+  size_t size;
+  uint32_t htab[LZB_HASH_SIZE]; /**< The last dictionary position + 1 of every hash of 4 bytes sequence */
+  uint8_t data[];
+};
+
+static inline uint32_t _lzb_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t _lzb_hash(uint32_t seq) {
+  return (seq * 2654435761U) >> (32 - LZB_HASH_LOG);
+}
+
+LZB_DICT *lzb_dict_create(const void *data, size_t size) {
+  if (size > LZB_DICT_MAX_SIZE) {
+    data = (const uint8_t *) data + size - LZB_DICT_MAX_SIZE;
+    size = LZB_DICT_MAX_SIZE;
+  }
+  LZB_DICT *dict = calloc(1, sizeof(*dict) + size);
+  if (!dict) {
+    return 0;
+  }
+  dict->size = size;
+  if (size) {
+    memcpy(dict->data, data, size);
+  }
+  for (size_t i = 0; i + LZB_MINMATCH <= size; ++i) {
+    dict->htab[_lzb_hash(_lzb_read32(dict->data + i))] = (uint32_t) i + 1;
+  }
+  return dict;
+}
+
+void lzb_dict_destroy(LZB_DICT *dict) {
+  free(dict);
+}
+
+const void *lzb_dict_data(const LZB_DICT *dict, size_t *sizep) {
+  *sizep = dict->size;
+  return dict->data;
+}
+
+// Writes extra bytes of token length `len` >= 15
+static uint8_t *_lzb_len_put(uint8_t *op, size_t len) {
+  for (len -= 15; len >= 255; len -= 255) {
+    *op++ = 255;
+  }
+  *op++ = (uint8_t) len;
+  return op;
+}
+
+static bool _lzb_len_get(const uint8_t **ipp, const uint8_t *iend, size_t *len) {
+  uint8_t b;
+  const uint8_t *ip = *ipp;
+  do {
+    if (ip >= iend) {
+      return false;
+    }
+    b = *ip++;
+    *len += b;
+  } while (b == 255);
+  *ipp = ip;
+  return true;
+}
+
+size_t lzb_compress(const void *src_, size_t srcsz, const LZB_DICT *dict, void *dst_, size_t dstsz) {
+  const uint8_t *src = src_;
+  const uint8_t *ip = src, *anchor = src, *iend = src + srcsz;
+  uint8_t *op = dst_, *oend = op + dstsz;
+  size_t dsz = dict ? dict->size : 0;
+  uint32_t htab[LZB_HASH_SIZE] = { 0 };
+
+  if (srcsz > LZB_MFLIMIT) {
+    const uint8_t *mlimit = iend - LZB_MFLIMIT;
+    const uint8_t *matchlimit = iend - LZB_LASTLITERALS;
+    while (ip < mlimit) {
+      size_t off = 0, mlen = 0;
+      uint32_t seq = _lzb_read32(ip);
+      uint32_t h = _lzb_hash(seq);
+      uint32_t ref = htab[h];
+      htab[h] = (uint32_t) (ip - src) + 1;
+      if (ref && ip - (src + ref - 1) <= LZB_MAX_DISTANCE && _lzb_read32(src + ref - 1) == seq) {
+        const uint8_t *m = src + ref - 1;
+        off = ip - m;
+        for (mlen = LZB_MINMATCH; ip + mlen < matchlimit && m[mlen] == ip[mlen]; ++mlen);
+      } else if (dsz && (ref = dict->htab[h])) {
+        size_t dpos = ref - 1;
+        size_t doff = (ip - src) + dsz - dpos;
+        if (doff <= LZB_MAX_DISTANCE && _lzb_read32(dict->data + dpos) == seq) {
+          off = doff;
+          // Match may continue through the end of dictionary into the block
+          for (mlen = LZB_MINMATCH; ip + mlen < matchlimit; ++mlen) {
+            size_t p = dpos + mlen;
+            if ((p < dsz ? dict->data[p] : src[p - dsz]) != ip[mlen]) {
+              break;
+            }
+          }
+        }
+      }
+      if (!mlen) {
+        ++ip;
+        continue;
+      }
+      size_t llen = ip - anchor;
+      if (oend - op < 1 + llen / 255 + 1 + llen + 2 + (mlen - LZB_MINMATCH) / 255 + 1) {
+        return 0;
+      }
+      uint8_t *token = op++;
+      if (llen >= 15) {
+        *token = 15 << 4;
+        op = _lzb_len_put(op, llen);
+      } else {
+        *token = (uint8_t) (llen << 4);
+      }
+      memcpy(op, anchor, llen);
+      op += llen;
+      *op++ = (uint8_t) off;
+      *op++ = (uint8_t) (off >> 8);
+      mlen -= LZB_MINMATCH;
+      if (mlen >= 15) {
+        *token |= 15;
+        op = _lzb_len_put(op, mlen);
+      } else {
+        *token |= (uint8_t) mlen;
+      }
+      ip += mlen + LZB_MINMATCH;
+      anchor = ip;
+    }
+  }
+
+  size_t llen = iend - anchor;
+  if (oend - op < 1 + llen / 255 + 1 + llen) {
+    return 0;
+  }
+  uint8_t *token = op++;
+  if (llen >= 15) {
+    *token = 15 << 4;
+    op = _lzb_len_put(op, llen);
+  } else {
+    *token = (uint8_t) (llen << 4);
+  }
+  memcpy(op, anchor, llen);
+  op += llen;
+  return op - (uint8_t *) dst_;
+}
+
+bool lzb_decompress(const void *src, size_t srcsz, const LZB_DICT *dict, void *dst_, size_t dstsz) {
+  const uint8_t *ip = src, *iend = ip + srcsz;
+  uint8_t *dst = dst_, *op = dst, *oend = dst + dstsz;
+  size_t dsz = dict ? dict->size : 0;
+
+  while (ip < iend) {
+    unsigned token = *ip++;
+    size_t len = token >> 4;
+    if (len == 15 && !_lzb_len_get(&ip, iend, &len)) {
+      return false;
+    }
+    if (len > iend - ip || len > oend - op) {
+      return false;
+    }
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+    if (ip == iend) { // The last sequence contains only literals
+      break;
+    }
+    if (iend - ip < 2) {
+      return false;
+    }
+    size_t off = ip[0] | ((size_t) ip[1] << 8);
+    ip += 2;
+    len = token & 15;
+    if (len == 15 && !_lzb_len_get(&ip, iend, &len)) {
+      return false;
+    }
+    len += LZB_MINMATCH;
+    size_t opos = op - dst;
+    if (!off || off > opos + dsz || len > oend - op) {
+      return false;
+    }
+    const uint8_t *m;
+    if (off > opos) { // Match starts in dictionary
+      size_t dpos = dsz - (off - opos);
+      size_t n = dsz - dpos < len ? dsz - dpos : len;
+      memcpy(op, dict->data + dpos, n);
+      op += n;
+      len -= n;
+      m = dst;
+    } else {
+      m = op - off;
+    }
+    if (m + len <= op) {
+      memcpy(op, m, len);
+      op += len;
+    } else { // Overlapped copy repeats pattern
+      while (len--) *op++ = *m++;
+    }
+  }
+  return op == oend;
+}
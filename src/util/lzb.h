@@ -0,0 +1,50 @@
+#pragma once
+#ifndef LZB_H
+#define LZB_H
+
+/**
+ * @file
+ * @brief Fast LZ77 block compression (LZ4 block format)
+ * with optional prefix dictionary shared by many small blocks.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Max useful size of dictionary, matches can refer at most 64Kb back */
+#define LZB_DICT_MAX_SIZE 65535
+
+/** Max size of compressed data of `size_` bytes block */
+#define LZB_COMPRESS_BOUND(size_) ((size_) + (size_) / 255 + 16)
+
+/** Prefix dictionary: data preceding every compressed block */
+typedef struct LZB_DICT LZB_DICT;
+
+/**
+ * @brief Creates dictionary from copy of `data`.
+ * Only the last `LZB_DICT_MAX_SIZE` bytes of `data` are used.
+ * @return Dictionary or zero if memory allocation failed
+ */
+LZB_DICT *lzb_dict_create(const void *data, size_t size);
+
+void lzb_dict_destroy(LZB_DICT *dict);
+
+/** Data of dictionary, its size is returned in `sizep` */
+const void *lzb_dict_data(const LZB_DICT *dict, size_t *sizep);
+
+/**
+ * @brief Compresses `src` block into `dst` buffer.
+ * @param dict Optional dictionary
+ * @return Size of compressed data or zero if it doesn't fit into `dstsz` bytes
+ */
+size_t lzb_compress(const void *src, size_t srcsz, const LZB_DICT *dict, void *dst, size_t dstsz);
+
+/**
+ * @brief Decompresses `src` block compressed with the same dictionary `dict`.
+ * @param dstsz Exact size of decompressed data
+ * @return False if `src` is not a valid compressed block of `dstsz` bytes
+ */
+bool lzb_decompress(const void *src, size_t srcsz, const LZB_DICT *dict, void *dst, size_t dstsz);
+
+#endif